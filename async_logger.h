@@ -0,0 +1,177 @@
+#ifndef ASYNC_LOGGER_H
+#define ASYNC_LOGGER_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "mpsc_ring.h"
+
+// Where an AsyncLogger's lines go. Every call comes from the logger's writer
+// thread.
+class LogSink {
+public:
+    virtual ~LogSink() = default;
+
+    // Function to append whole lines, each ending in a newline
+    virtual void write(const std::string& lines) = 0;
+
+    // Function to make everything written so far durable
+    virtual void sync() = 0;
+
+    // Function to release the files held
+    virtual void close() = 0;
+};
+
+// Background line logger.
+//
+// log() hands the line to a lock-free ring and returns; it never touches the
+// sink. One writer thread drains the ring into a buffer and hands the buffer
+// to the sink once it reaches flushBytes or has been waiting flushInterval.
+// flush() returns once every line logged before the call has been written;
+// sync() is the explicit durability point: it returns once they have been
+// written and fsynced.
+//
+// The writer polls at flushInterval when idle, so producers do not have to
+// take a lock to wake it; they only signal it when the ring is half full.
+// If the ring is completely full, log() yields until the writer catches up,
+// so lines are never dropped.
+class AsyncLogger {
+public:
+    explicit AsyncLogger(LogSink& logSink,
+                         size_t ringCapacity = 8192,
+                         size_t flushThresholdBytes = 64 * 1024,
+                         std::chrono::milliseconds interval = std::chrono::milliseconds(50))
+        : sink(logSink), ring(ringCapacity), flushBytes(flushThresholdBytes), flushInterval(interval) {
+        writer = std::thread([this]() { run(); });
+    }
+
+    ~AsyncLogger() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        writer.join();
+    }
+
+    AsyncLogger(const AsyncLogger&) = delete;
+    AsyncLogger& operator=(const AsyncLogger&) = delete;
+
+    // Function to queue one line (without its newline)
+    void log(std::string line) {
+        while (!ring.tryPush(std::move(line))) {
+            wake.notify_one();
+            std::this_thread::yield();
+        }
+        if (ring.claimed() - consumed.load(std::memory_order_relaxed) > ring.capacity() / 2) {
+            wake.notify_one();
+        }
+    }
+
+    // Function to wait until everything logged so far has reached the sink
+    void flush() {
+        std::unique_lock<std::mutex> lock(mutex);
+        uint64_t target = ring.claimed();
+        if (target > flushTarget) flushTarget = target;
+        wake.notify_all();
+        synced.wait(lock, [this, target]() { return flushedSeq >= target; });
+    }
+
+    // Function to wait until everything logged so far is on disk
+    void sync() {
+        std::unique_lock<std::mutex> lock(mutex);
+        uint64_t target = ring.claimed();
+        if (target > syncTarget) syncTarget = target;
+        wake.notify_all();
+        synced.wait(lock, [this, target]() { return syncedSeq >= target; });
+    }
+
+private:
+    void run() {
+        std::string buffer;
+        std::string line;
+        auto lastFlush = std::chrono::steady_clock::now();
+
+        for (;;) {
+            while (ring.tryPop(line)) {
+                buffer += line;
+                buffer += '\n';
+                consumed.fetch_add(1, std::memory_order_relaxed);
+                if (buffer.size() >= flushBytes) {
+                    write(buffer);
+                    lastFlush = std::chrono::steady_clock::now();
+                }
+            }
+
+            std::unique_lock<std::mutex> lock(mutex);
+            const uint64_t done = consumed.load(std::memory_order_relaxed);
+            const bool syncWanted = syncTarget > syncedSeq;
+            const bool flushWanted = flushTarget > flushedSeq;
+            const bool stop = stopping && done == ring.claimed();
+
+            if (!buffer.empty() && (syncWanted || flushWanted || stop ||
+                                    std::chrono::steady_clock::now() - lastFlush >= flushInterval)) {
+                lock.unlock();
+                write(buffer);
+                lastFlush = std::chrono::steady_clock::now();
+                lock.lock();
+            }
+
+            if (flushWanted && done >= flushTarget) {
+                flushedSeq = done;
+                synced.notify_all();
+            }
+
+            if (syncWanted && done >= syncTarget) {
+                lock.unlock();
+                sink.sync();
+                lock.lock();
+                syncedSeq = done;
+                synced.notify_all();
+            }
+
+            if (stop) {
+                sink.close();
+                return;
+            }
+
+            if (syncWanted || flushWanted || stopping) {
+                // A producer has claimed a slot but not filled it yet
+                lock.unlock();
+                std::this_thread::yield();
+            } else {
+                wake.wait_for(lock, flushInterval);
+            }
+        }
+    }
+
+    // Writer thread only
+    void write(std::string& buffer) {
+        sink.write(buffer);
+        buffer.clear();
+    }
+
+    LogSink& sink;
+    MpscRing<std::string> ring;
+    size_t flushBytes;
+    std::chrono::milliseconds flushInterval;
+    std::atomic<uint64_t> consumed{0};
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable synced;
+    uint64_t syncTarget = 0;
+    uint64_t syncedSeq = 0;
+    uint64_t flushTarget = 0;
+    uint64_t flushedSeq = 0;
+    bool stopping = false;
+
+    std::thread writer;
+};
+
+#endif
@@ -0,0 +1,114 @@
+#ifndef ATOMIC_FILE_H
+#define ATOMIC_FILE_H
+
+#include <cstdio>
+#include <string>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "stats.h"
+
+// Writes a file so that readers only ever see the old or the new contents.
+// Data goes to "<path>.tmp"; commit() flushes and fsyncs it, then renames it
+// over path (and fsyncs the directory on POSIX so the rename itself survives
+// a crash). Destroying the writer without a successful commit() removes the
+// temporary file and leaves path untouched. Bytes and fsyncs are counted
+// under path's name in the I/O statistics, or under the counters given.
+class AtomicFileWriter {
+public:
+    explicit AtomicFileWriter(const std::string& targetPath)
+        : AtomicFileWriter(targetPath, ioCounters(targetPath)) {}
+
+    AtomicFileWriter(const std::string& targetPath, IoCounters& counters)
+        : path(targetPath), tmpPath(targetPath + ".tmp"), io(counters) {
+        file = std::fopen(tmpPath.c_str(), "wb");
+        failed = (file == nullptr);
+    }
+
+    ~AtomicFileWriter() {
+        if (file != nullptr) {
+            std::fclose(file);
+        }
+        if (!committed) {
+            std::remove(tmpPath.c_str());
+        }
+    }
+
+    AtomicFileWriter(const AtomicFileWriter&) = delete;
+    AtomicFileWriter& operator=(const AtomicFileWriter&) = delete;
+
+    // Function to check whether every write so far has succeeded
+    bool ok() const {
+        return !failed;
+    }
+
+    // Function to append bytes
+    void write(const void* data, size_t size) {
+        if (failed || size == 0) return;
+        if (std::fwrite(data, 1, size, file) != size) {
+            failed = true;
+        }
+        io.wrote(size);
+    }
+
+    void write(const std::string& text) {
+        write(text.data(), text.size());
+    }
+
+    // Function to make the new contents durable and swap them in
+    bool commit() {
+        if (failed) return false;
+
+        if (std::fflush(file) != 0) {
+            failed = true;
+            return false;
+        }
+#ifdef _WIN32
+        ::_commit(::_fileno(file));
+#else
+        ::fsync(::fileno(file));
+#endif
+        io.synced();
+        std::fclose(file);
+        file = nullptr;
+
+#ifdef _WIN32
+        std::remove(path.c_str()); // rename() will not replace on Windows
+#endif
+        if (std::rename(tmpPath.c_str(), path.c_str()) != 0) {
+            failed = true;
+            return false;
+        }
+        committed = true;
+        syncDirectory();
+        return true;
+    }
+
+private:
+    void syncDirectory() {
+#ifndef _WIN32
+        size_t slash = path.find_last_of('/');
+        std::string dir = (slash == std::string::npos) ? "." : path.substr(0, slash + 1);
+        int fd = ::open(dir.c_str(), O_RDONLY);
+        if (fd >= 0) {
+            ::fsync(fd);
+            io.synced();
+            ::close(fd);
+        }
+#endif
+    }
+
+    std::string path;
+    std::string tmpPath;
+    IoCounters& io;
+    std::FILE* file = nullptr;
+    bool failed = false;
+    bool committed = false;
+};
+
+#endif
@@ -0,0 +1,380 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "dataset_generator.h"
+#include "library.h"
+
+// Benchmarks for the Library engine at several catalog sizes.
+//
+// For each scale a synthetic data set is generated into its own directory
+// (see dataset_generator.h) and the engine is timed end to end: loading from
+// text and from the binary snapshots, searching each field (exactly and with
+// typos), borrowing and
+// returning, reporting circulation, paging through the catalog in each
+// order, checkpointing, and paging through the transaction history.
+// Results go to stdout, one line per benchmark, as JSON lines or CSV, so
+// they can be collected and compared between commits; progress goes to
+// stderr.
+
+namespace fs = std::filesystem;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct BenchOptions {
+    std::vector<size_t> scales{10000, 100000, 1000000};
+    std::string dir = "bench_data";
+    bool csv = false;
+    size_t ops = 1000;           // Operations per search and circulation benchmark
+    size_t transactionsPerBook = 2;
+    bool keep = false;           // Keep each scale's data directory afterwards
+};
+
+// Timings for one benchmark: the total, and per-operation latencies when
+// the operations were timed one by one
+struct BenchResult {
+    std::string name;
+    size_t scale = 0;
+    size_t ops = 0;
+    double seconds = 0;
+    std::vector<double> latencies; // Seconds per operation (may be empty)
+};
+
+double secondsSince(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// Function to get a latency percentile in microseconds (0 if not sampled)
+double percentileMicros(std::vector<double>& latencies, double fraction) {
+    if (latencies.empty()) return 0;
+    size_t at = std::min(latencies.size() - 1, static_cast<size_t>(fraction * latencies.size()));
+    std::nth_element(latencies.begin(), latencies.begin() + at, latencies.end());
+    return latencies[at] * 1e6;
+}
+
+void printHeader(const BenchOptions& options) {
+    if (options.csv) {
+        std::cout << "scale,benchmark,ops,seconds,ops_per_second,p50_us,p99_us,max_us" << std::endl;
+    }
+}
+
+// Function to print one result line
+void report(const BenchOptions& options, BenchResult result) {
+    double perSecond = result.seconds > 0 ? result.ops / result.seconds : 0;
+    double p50 = percentileMicros(result.latencies, 0.50);
+    double p99 = percentileMicros(result.latencies, 0.99);
+    double max = percentileMicros(result.latencies, 1.0);
+
+    std::ostringstream line;
+    line << std::fixed << std::setprecision(6);
+    if (options.csv) {
+        line << result.scale << ',' << result.name << ',' << result.ops << ',' << result.seconds << ','
+             << std::setprecision(1) << perSecond << ',' << p50 << ',' << p99 << ',' << max;
+    } else {
+        line << "{\"scale\":" << result.scale << ",\"benchmark\":\"" << result.name << "\",\"ops\":" << result.ops
+             << ",\"seconds\":" << result.seconds << std::setprecision(1) << ",\"ops_per_second\":" << perSecond
+             << ",\"p50_us\":" << p50 << ",\"p99_us\":" << p99 << ",\"max_us\":" << max << "}";
+    }
+    std::cout << line.str() << std::endl;
+}
+
+// Function to time one call
+template <typename Work>
+BenchResult timeOnce(const std::string& name, size_t scale, Work work) {
+    BenchResult result;
+    result.name = name;
+    result.scale = scale;
+    result.ops = 1;
+    auto start = Clock::now();
+    work();
+    result.seconds = secondsSince(start);
+    return result;
+}
+
+// Function to time count calls of work(i) one by one
+template <typename Work>
+BenchResult timeEach(const std::string& name, size_t scale, size_t count, Work work) {
+    BenchResult result;
+    result.name = name;
+    result.scale = scale;
+    result.ops = count;
+    result.latencies.reserve(count);
+    auto start = Clock::now();
+    for (size_t i = 0; i < count; ++i) {
+        auto opStart = Clock::now();
+        work(i);
+        result.latencies.push_back(secondsSince(opStart));
+    }
+    result.seconds = secondsSince(start);
+    return result;
+}
+
+// Function to run every benchmark against the data set in the current
+// directory
+void runScale(const BenchOptions& options, size_t scale, const DatasetOptions& data) {
+    auto library = std::make_unique<Library>();
+    report(options, timeOnce("load_text", scale, [&]() { library->load(); }));
+    library.reset();
+
+    library = std::make_unique<Library>();
+    report(options, timeOnce("load_snapshot", scale, [&]() { library->load(); }));
+
+    // Search terms taken from the catalog itself, so every query has hits
+    std::vector<std::string> titles, authors, isbns;
+    {
+        std::shared_ptr<const LibrarySnapshot> view = library->snapshot();
+        DatasetRandom random(data.seed + 1);
+        for (size_t i = 0; i < options.ops; ++i) {
+            std::optional<Book> book = view->findBook(static_cast<int>(random.below(data.books) + 1));
+            if (!book) continue;
+            // The longest word of the title: common short words like "The"
+            // would match most of the catalog
+            std::string title(book->title), word;
+            std::stringstream words(title);
+            for (std::string next; words >> next;) {
+                if (next.size() > word.size()) word = next;
+            }
+            titles.push_back(word);
+            authors.emplace_back(book->author);
+            isbns.emplace_back(book->isbn);
+        }
+    }
+    const struct {
+        const char* name;
+        BookField field;
+        const std::vector<std::string>& terms;
+    } searches[] = {
+        {"search_title", BookField::Title, titles},
+        {"search_author", BookField::Author, authors},
+        {"search_isbn", BookField::Isbn, isbns},
+    };
+    for (const auto& search : searches) {
+        report(options, timeEach(search.name, scale, search.terms.size(), [&](size_t i) {
+            library->searchBooks(search.field, search.terms[i], [](const Book&) {});
+        }));
+    }
+
+    // The same terms with one letter changed, for the typo-tolerant search
+    const struct {
+        const char* name;
+        BookField field;
+        const std::vector<std::string>& terms;
+    } fuzzySearches[] = {
+        {"fuzzy_title", BookField::Title, titles},
+        {"fuzzy_author", BookField::Author, authors},
+    };
+    DatasetRandom typos(data.seed + 4);
+    for (const auto& search : fuzzySearches) {
+        std::vector<std::string> misspelled = search.terms;
+        for (std::string& term : misspelled) {
+            if (term.size() > 4) term[1 + typos.below(term.size() - 2)] = 'q';
+        }
+        report(options, timeEach(search.name, scale, misspelled.size(), [&](size_t i) {
+            library->fuzzySearchBooks(search.field, misspelled[i], 2, 20, [](const Book&, unsigned) {});
+        }));
+    }
+
+    // The first three letters of the same terms, as typed ahead
+    const struct {
+        const char* name;
+        BookField field;
+        const std::vector<std::string>& terms;
+    } completions[] = {
+        {"complete_title", BookField::Title, titles},
+        {"complete_author", BookField::Author, authors},
+    };
+    for (const auto& complete : completions) {
+        std::vector<PrefixIndex::Completion> found;
+        report(options, timeEach(complete.name, scale, complete.terms.size(), [&](size_t i) {
+            library->completeBooks(complete.field, complete.terms[i].substr(0, 3), 10, found);
+        }));
+    }
+
+    // Borrow then return books that are on the shelf
+    std::vector<int> shelf;
+    {
+        std::shared_ptr<const LibrarySnapshot> view = library->snapshot();
+        DatasetRandom random(data.seed + 2);
+        for (size_t tries = 0; shelf.size() < options.ops && tries < options.ops * 20; ++tries) {
+            std::optional<Book> book = view->findBook(static_cast<int>(random.below(data.books) + 1));
+            if (book && book->available && std::find(shelf.begin(), shelf.end(), book->id) == shelf.end()) {
+                shelf.push_back(book->id);
+            }
+        }
+    }
+    report(options, timeEach("borrow", scale, shelf.size(), [&](size_t i) {
+        library->borrowBook(static_cast<int>(i % data.students + 1), shelf[i]);
+    }));
+    report(options, timeEach("return", scale, shelf.size(), [&](size_t i) {
+        library->returnBook(shelf[i]);
+    }));
+
+    // The circulation dashboard: totals, top ten lists and a month of days
+    CirculationReport circulation;
+    report(options, timeEach("report", scale, options.ops, [&](size_t) {
+        library->circulationReport(10, coarseClock().today() - 29, coarseClock().today(), circulation);
+    }));
+
+    // Catalog browsing: one page of 50 after a random book, in each order
+    const struct {
+        const char* name;
+        BookOrder order;
+    } orders[] = {
+        {"page_id", BookOrder::Id},
+        {"page_title", BookOrder::Title},
+        {"page_author", BookOrder::Author},
+    };
+    std::vector<Book> books;
+    for (const auto& order : orders) {
+        std::shared_ptr<const LibrarySnapshot> view = library->snapshot();
+        DatasetRandom random(data.seed + 3);
+        std::vector<BookCursor> cursors(options.ops);
+        for (BookCursor& cursor : cursors) {
+            std::optional<Book> book = view->findBook(static_cast<int>(random.below(data.books) + 1));
+            if (!book) continue;
+            cursor.started = true;
+            cursor.id = book->id;
+            cursor.key = order.order == BookOrder::Title ? std::string(book->title)
+                         : order.order == BookOrder::Author ? std::string(book->author) : std::string();
+        }
+        report(options, timeEach(order.name, scale, cursors.size(), [&](size_t i) {
+            library->bookPage(order.order, cursors[i], 50, books);
+        }));
+    }
+
+    report(options, timeOnce("save", scale, [&]() { library->save(); }));
+
+    // History display: the whole log in pages, and one student's history
+    const size_t PAGE_SIZE = 1000;
+    std::vector<TransactionRow> page;
+    BenchResult history;
+    history.name = "history_all";
+    history.scale = scale;
+    auto start = Clock::now();
+    {
+        TransactionCursor cursor;
+        bool more = true;
+        while (more) {
+            more = library->transactionPage(TransactionFilter(), cursor, PAGE_SIZE, page);
+            history.ops += page.size();
+        }
+    }
+    history.seconds = secondsSince(start);
+    report(options, history);
+
+    TransactionFilter filter;
+    filter.studentId = 1; // The generator's most active student
+    history.name = "history_student";
+    history.ops = 0;
+    start = Clock::now();
+    {
+        TransactionCursor cursor;
+        bool more = true;
+        while (more) {
+            more = library->transactionPage(filter, cursor, PAGE_SIZE, page);
+            history.ops += page.size();
+        }
+    }
+    history.seconds = secondsSince(start);
+    report(options, history);
+}
+
+// Function to parse a comma-separated list of counts
+bool parseScales(const std::string& text, std::vector<size_t>& scales) {
+    scales.clear();
+    std::stringstream list(text);
+    std::string item;
+    while (std::getline(list, item, ',')) {
+        size_t count;
+        if (!parseDatasetCount(item, count) || count == 0) return false;
+        scales.push_back(count);
+    }
+    return !scales.empty();
+}
+
+// Function to print the command-line usage
+void printUsage(const char* program) {
+    std::cerr << "Usage: " << program << " [--scales <n,...>] [--dir <dir>] [--ops <n>] [--transactions-per-book <n>]"
+              << " [--format json|csv] [--keep]\n"
+              << "  --scales <n,...>            Catalog sizes to run, in books (default 10k,100k,1m; up to 10m and beyond)\n"
+              << "  --dir <dir>                 Where the data sets are generated (default bench_data)\n"
+              << "  --ops <n>                   Operations per search and circulation benchmark (default 1000)\n"
+              << "  --transactions-per-book <n> History length as a multiple of the catalog (default 2)\n"
+              << "  --format json|csv           Output format (default json, one object per line)\n"
+              << "  --keep                      Keep the generated data sets\n";
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    BenchOptions options;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        size_t count;
+        if (arg == "--scales" && i + 1 < argc && parseScales(argv[i + 1], options.scales)) {
+            ++i;
+        } else if (arg == "--dir" && i + 1 < argc) {
+            options.dir = argv[++i];
+        } else if ((arg == "--ops" || arg == "--transactions-per-book") && i + 1 < argc &&
+                   parseDatasetCount(argv[i + 1], count)) {
+            (arg == "--ops" ? options.ops : options.transactionsPerBook) = count;
+            ++i;
+        } else if (arg == "--format" && i + 1 < argc && (std::string(argv[i + 1]) == "json" ||
+                                                          std::string(argv[i + 1]) == "csv")) {
+            options.csv = std::string(argv[++i]) == "csv";
+        } else if (arg == "--keep") {
+            options.keep = true;
+        } else {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    std::error_code error;
+    fs::path root = fs::absolute(options.dir, error);
+    fs::path home = fs::current_path(error);
+    printHeader(options);
+    for (size_t scale : options.scales) {
+        DatasetOptions data;
+        data.books = scale;
+        data.students = scale / 10 + 1;
+        data.transactions = scale * options.transactionsPerBook;
+
+        // The engine reads and writes its files in the working directory
+        fs::path dir = root / ("scale-" + std::to_string(scale));
+        fs::remove_all(dir, error);
+        fs::create_directories(dir, error);
+        if (error) {
+            std::cerr << "Unable to create " << dir << ": " << error.message() << std::endl;
+            return 1;
+        }
+
+        std::cerr << "Generating " << scale << " books..." << std::endl;
+        std::string reason;
+        BenchResult generated = timeOnce("generate", scale, [&]() {
+            if (!generateDataset(dir.string(), data, reason)) {
+                std::cerr << "Unable to generate data: " << reason << std::endl;
+                std::exit(1);
+            }
+        });
+        report(options, generated);
+
+        std::cerr << "Running benchmarks at " << scale << " books..." << std::endl;
+        fs::current_path(dir);
+        runScale(options, scale, data);
+        fs::current_path(home);
+        if (!options.keep) {
+            fs::remove_all(dir, error);
+        }
+    }
+    return 0;
+}
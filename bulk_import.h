@@ -0,0 +1,448 @@
+#ifndef BULK_IMPORT_H
+#define BULK_IMPORT_H
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <future>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "isbn.h"
+#include "stats.h"
+#include "thread_pool.h"
+
+// Non-interactive catalog import from CSV or MARC-like (.mrk) files.
+//
+//   reader (calling thread) -> parse/validate (shared pool) -> sink (calling thread)
+//
+// The reader streams the file in blocks of about IMPORT_BLOCK_BYTES, cutting
+// each block at a record boundary, and hands every block to the shared pool.
+// Workers split a block into records, pull out title/author/ISBN, validate
+// them and compute the normalized ISBN key. Finished blocks are handed to the
+// sink in file order on the calling thread, so the sink can dedupe and append
+// without locking. At most IMPORT_WINDOW_PER_THREAD blocks per thread are in
+// flight, which bounds memory no matter how large the file is. Must not be
+// called from a pool task.
+//
+// CSV follows RFC 4180 (quoted fields, "" escapes, quoted line breaks). A
+// first row naming a "title" column is a header that maps the columns;
+// otherwise columns are title,author,isbn. MARC input is MARCMaker text: one
+// "=TAG  II$aValue$bValue" line per field, records separated by a blank line
+// or a new "=LDR" line. The title is 245 $a and $b, the author 100 $a (or 110
+// $a), the ISBN the first word of the first 020 $a.
+
+const size_t IMPORT_BLOCK_BYTES = 4 << 20;
+const size_t IMPORT_WINDOW_PER_THREAD = 2;
+
+enum class ImportFormat {
+    Csv,
+    Marc
+};
+
+struct ImportRow {
+    size_t line; // Line the record starts on
+    std::string title;
+    std::string author;
+    std::string isbn;
+    std::string key; // normalizeIsbn(isbn)
+};
+
+struct ImportReject {
+    size_t line;
+    std::string reason;
+};
+
+// One block's parsed rows and rejects. Line numbers are block-local while the
+// block is parsed and absolute by the time the sink sees it.
+struct ImportBatch {
+    std::vector<ImportRow> rows;
+    std::vector<ImportReject> rejects;
+    size_t lines = 0;
+};
+
+struct ImportStats {
+    size_t bytes = 0;
+    size_t records = 0;
+    size_t blocks = 0;
+};
+
+// Column positions of the fields we keep (-1: not present)
+struct CsvColumns {
+    int title = 0;
+    int author = 1;
+    int isbn = 2;
+};
+
+// Function to pick a format from a file name (.mrk/.marc are MARC, anything
+// else is CSV)
+inline ImportFormat importFormatFor(const std::string& path) {
+    size_t dot = path.find_last_of('.');
+    std::string extension = (dot == std::string::npos) ? "" : path.substr(dot + 1);
+    for (auto& c : extension) c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    return (extension == "mrk" || extension == "marc") ? ImportFormat::Marc : ImportFormat::Csv;
+}
+
+// Function to strip ASCII whitespace from both ends of a field
+inline void trimField(std::string& text) {
+    size_t end = text.size();
+    while (end > 0 && std::isspace(static_cast<unsigned char>(text[end - 1]))) --end;
+    size_t begin = 0;
+    while (begin < end && std::isspace(static_cast<unsigned char>(text[begin]))) ++begin;
+    text.erase(end);
+    text.erase(0, begin);
+}
+
+// Function to trim fields and check a row can enter the catalog; on success
+// the row's ISBN key is filled in
+inline bool validateImportRow(ImportRow& row, std::string& reason) {
+    trimField(row.title);
+    trimField(row.author);
+    trimField(row.isbn);
+
+    if (row.title.empty()) {
+        reason = "missing title";
+    } else if (row.isbn.empty()) {
+        reason = "missing ISBN";
+    } else if (!isValidIsbn(row.isbn)) {
+        reason = "invalid ISBN '" + row.isbn + "'";
+    } else if ((row.title + row.author + row.isbn).find_first_of("|\r\n") != std::string::npos) {
+        reason = "field contains '|' or a line break"; // The text tables cannot hold them
+    } else {
+        row.key = normalizeIsbn(row.isbn);
+        return true;
+    }
+    return false;
+}
+
+// Function to parse one CSV record starting at pos. pos is left just past the
+// record's line break and newlines counts the line breaks consumed (including
+// quoted ones). Returns false if a quoted field runs off the end of the text.
+inline bool parseCsvRecord(std::string_view text, size_t& pos, std::vector<std::string>& fields,
+                           size_t& newlines) {
+    fields.clear();
+    fields.emplace_back();
+    bool quoted = false;
+    while (pos < text.size()) {
+        char c = text[pos++];
+        if (quoted) {
+            if (c == '"') {
+                if (pos < text.size() && text[pos] == '"') {
+                    fields.back() += '"';
+                    ++pos;
+                } else {
+                    quoted = false;
+                }
+            } else {
+                if (c == '\n') ++newlines;
+                fields.back() += c;
+            }
+        } else if (c == ',') {
+            fields.emplace_back();
+        } else if (c == '\n') {
+            ++newlines;
+            break;
+        } else if (c == '"' && fields.back().empty()) {
+            quoted = true;
+        } else if (c != '\r') {
+            fields.back() += c;
+        }
+    }
+    return !quoted;
+}
+
+// Function to read a CSV header row into a column map. Returns false if the
+// row is data rather than a header.
+inline bool parseCsvHeader(const std::vector<std::string>& fields, CsvColumns& columns, std::string& error) {
+    CsvColumns mapped;
+    mapped.title = mapped.author = mapped.isbn = -1;
+    for (size_t i = 0; i < fields.size(); ++i) {
+        std::string name = fields[i];
+        trimField(name);
+        for (auto& c : name) c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+        int column = static_cast<int>(i);
+        if (name == "title" && mapped.title < 0) {
+            mapped.title = column;
+        } else if ((name == "author" || name == "authors") && mapped.author < 0) {
+            mapped.author = column;
+        } else if ((name == "isbn" || name == "isbn13" || name == "isbn10") && mapped.isbn < 0) {
+            mapped.isbn = column;
+        }
+    }
+    if (mapped.title < 0) return false;
+
+    if (mapped.isbn < 0) {
+        error = "CSV header has no isbn column";
+    }
+    columns = mapped;
+    return true;
+}
+
+// Function to parse a block of CSV records
+inline void parseCsvBlock(std::string_view text, const CsvColumns& columns, ImportBatch& batch) {
+    std::vector<std::string> fields;
+    std::string reason;
+    const size_t needed = static_cast<size_t>(std::max(columns.title, std::max(columns.author, columns.isbn))) + 1;
+
+    size_t pos = 0;
+    while (pos < text.size()) {
+        size_t line = batch.lines + 1;
+        bool complete = parseCsvRecord(text, pos, fields, batch.lines);
+        if (fields.size() == 1 && fields[0].empty()) continue; // Blank line
+
+        if (!complete) {
+            batch.rejects.push_back({line, "unterminated quoted field"});
+        } else if (fields.size() < needed) {
+            batch.rejects.push_back({line, "expected " + std::to_string(needed) + " columns, found " +
+                                           std::to_string(fields.size())});
+        } else {
+            ImportRow row;
+            row.line = line;
+            row.title = std::move(fields[columns.title]);
+            if (columns.author >= 0) row.author = std::move(fields[columns.author]);
+            row.isbn = std::move(fields[columns.isbn]);
+            if (validateImportRow(row, reason)) {
+                batch.rows.push_back(std::move(row));
+            } else {
+                batch.rejects.push_back({line, reason});
+            }
+        }
+    }
+}
+
+// Function to strip ISBD punctuation (" /", " :", trailing commas...) from the
+// end of a MARC subfield. A final period is kept after an initial ("J. R. R.").
+inline void trimMarcValue(std::string& value) {
+    trimField(value);
+    while (!value.empty()) {
+        char last = value.back();
+        size_t n = value.size();
+        bool initial = last == '.' && n >= 2 && std::isalpha(static_cast<unsigned char>(value[n - 2])) &&
+                       (n == 2 || value[n - 3] == ' ' || value[n - 3] == '.');
+        if ((last == '/' || last == ':' || last == ';' || last == ',' || last == '=' || last == '.') && !initial) {
+            value.pop_back();
+            trimField(value);
+        } else {
+            break;
+        }
+    }
+}
+
+// Function to get subfield code's first value from a MARC field body
+// ("II$aValue$bValue"), or an empty string
+inline std::string marcSubfield(std::string_view body, char code) {
+    size_t pos = 0;
+    while ((pos = body.find('$', pos)) != std::string_view::npos) {
+        if (pos + 1 < body.size() && body[pos + 1] == code) {
+            size_t end = body.find('$', pos + 2);
+            return std::string(body.substr(pos + 2, end == std::string_view::npos ? std::string_view::npos
+                                                                                   : end - pos - 2));
+        }
+        ++pos;
+    }
+    return std::string();
+}
+
+// Function to finish one MARC record: validate it, or reject it
+inline void finishMarcRecord(ImportRow& row, bool& open, ImportBatch& batch) {
+    if (!open) return;
+    open = false;
+
+    std::string reason;
+    if (validateImportRow(row, reason)) {
+        batch.rows.push_back(std::move(row));
+    } else {
+        batch.rejects.push_back({row.line, reason});
+    }
+    row = ImportRow();
+}
+
+// Function to parse a block of MARC records
+inline void parseMarcBlock(std::string_view text, ImportBatch& batch) {
+    ImportRow row;
+    bool open = false;
+    bool haveIsbn = false;
+    bool haveAuthor = false;
+
+    size_t pos = 0;
+    while (pos < text.size()) {
+        size_t newline = text.find('\n', pos);
+        size_t lineEnd = (newline == std::string_view::npos) ? text.size() : newline;
+        std::string_view line = text.substr(pos, lineEnd - pos);
+        pos = lineEnd + 1;
+        ++batch.lines;
+
+        if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+        if (line.empty() || line.compare(0, 4, "=LDR") == 0) {
+            finishMarcRecord(row, open, batch);
+            if (line.empty()) continue;
+        }
+        if (!open) {
+            open = true;
+            haveIsbn = haveAuthor = false;
+            row.line = batch.lines;
+        }
+        if (line.size() < 6 || line[0] != '=') continue; // Continuation or stray text
+
+        std::string_view tag = line.substr(1, 3);
+        std::string_view body = line.substr(6);
+        if (tag == "245") {
+            row.title = marcSubfield(body, 'a');
+            trimMarcValue(row.title);
+            std::string subtitle = marcSubfield(body, 'b');
+            trimMarcValue(subtitle);
+            if (!subtitle.empty()) row.title += ": " + subtitle;
+        } else if ((tag == "100" || (tag == "110" && row.author.empty())) && !haveAuthor) {
+            row.author = marcSubfield(body, 'a');
+            trimMarcValue(row.author);
+            haveAuthor = (tag == "100");
+        } else if (tag == "020" && !haveIsbn) {
+            std::string value = marcSubfield(body, 'a');
+            trimField(value);
+            row.isbn = value.substr(0, value.find(' ')); // "0061120081 (pbk.)"
+            haveIsbn = !row.isbn.empty();
+        }
+    }
+    finishMarcRecord(row, open, batch);
+}
+
+// Function to find where the last complete record in buffer ends (0 if none
+// does yet)
+inline size_t recordBoundary(const std::string& buffer, ImportFormat format) {
+    if (format == ImportFormat::Csv) {
+        if (std::memchr(buffer.data(), '"', buffer.size()) == nullptr) {
+            size_t newline = buffer.rfind('\n');
+            return newline == std::string::npos ? 0 : newline + 1;
+        }
+        size_t boundary = 0;
+        bool quoted = false;
+        for (size_t i = 0; i < buffer.size(); ++i) {
+            if (buffer[i] == '"') {
+                quoted = !quoted; // An escaped "" toggles twice
+            } else if (buffer[i] == '\n' && !quoted) {
+                boundary = i + 1;
+            }
+        }
+        return boundary;
+    }
+
+    // MARC: cut after the last blank line or before the last =LDR line
+    size_t boundary = 0;
+    size_t leader = buffer.rfind("\n=LDR");
+    if (leader != std::string::npos) boundary = leader + 1;
+    size_t newline = buffer.rfind('\n');
+    while (newline != std::string::npos && newline + 1 > boundary) {
+        size_t before = newline;
+        if (before > 0 && buffer[before - 1] == '\r') --before;
+        if (before > 0 && buffer[before - 1] == '\n') return newline + 1;
+        if (before == 0) break;
+        newline = buffer.rfind('\n', before - 1);
+    }
+    return boundary;
+}
+
+// Function to run an import. sink(batch) is called on the calling thread
+// once per block, in file order. Returns false (with error set) if the file
+// cannot be read or its header is unusable; rows already passed to the sink
+// stay with it.
+template <typename Sink>
+bool importRecords(const std::string& path, ImportFormat format, Sink sink, ImportStats& stats,
+                   std::string& error) {
+    stats = ImportStats();
+    error.clear();
+    std::FILE* file = std::fopen(path.c_str(), "rb");
+    if (file == nullptr) {
+        error = "unable to open " + path;
+        return false;
+    }
+
+    IoCounters& io = ioCounters(path);
+    ThreadPool& pool = sharedPool();
+    const size_t window = IMPORT_WINDOW_PER_THREAD * (pool.size() + 1);
+    std::deque<std::future<ImportBatch>> inFlight;
+    size_t lineBase = 0;
+
+    // Function to hand the oldest finished block to the sink
+    auto deliver = [&]() {
+        ImportBatch batch = inFlight.front().get();
+        inFlight.pop_front();
+        for (auto& row : batch.rows) row.line += lineBase;
+        for (auto& reject : batch.rejects) reject.line += lineBase;
+        lineBase += batch.lines;
+        stats.records += batch.rows.size() + batch.rejects.size();
+        io.parsed(batch.rows.size() + batch.rejects.size());
+        sink(batch);
+    };
+
+    CsvColumns columns;
+    bool headerChecked = (format != ImportFormat::Csv);
+    std::string pending;
+    bool done = false;
+    while (!done && error.empty()) {
+        size_t used = pending.size();
+        pending.resize(used + IMPORT_BLOCK_BYTES);
+        size_t got = std::fread(&pending[used], 1, IMPORT_BLOCK_BYTES, file);
+        pending.resize(used + got);
+        stats.bytes += got;
+        io.read(got);
+        if (got < IMPORT_BLOCK_BYTES) {
+            if (std::ferror(file)) {
+                error = "read error in " + path;
+                break;
+            }
+            done = true;
+        }
+
+        if (!headerChecked) {
+            size_t pos = 0;
+            size_t newlines = 0;
+            std::vector<std::string> fields;
+            if (!done && pending.find('\n') == std::string::npos) continue;
+            parseCsvRecord(pending, pos, fields, newlines);
+            if (parseCsvHeader(fields, columns, error)) {
+                pending.erase(0, pos);
+                lineBase += newlines;
+            }
+            headerChecked = true;
+            if (!error.empty()) break;
+        }
+
+        size_t cut = done ? pending.size() : recordBoundary(pending, format);
+        if (cut == 0) continue; // A record longer than a block: keep reading
+
+        std::string tail = pending.substr(cut);
+        pending.resize(cut);
+        auto block = std::make_shared<std::string>(std::move(pending));
+        pending = std::move(tail);
+
+        auto task = std::make_shared<std::packaged_task<ImportBatch()>>([block, format, columns]() {
+            ImportBatch batch;
+            batch.rows.reserve(block->size() / 64);
+            if (format == ImportFormat::Csv) {
+                parseCsvBlock(*block, columns, batch);
+            } else {
+                parseMarcBlock(*block, batch);
+            }
+            return batch;
+        });
+        inFlight.push_back(task->get_future());
+        pool.post([task]() { (*task)(); });
+        ++stats.blocks;
+
+        while (inFlight.size() >= window) {
+            deliver();
+        }
+    }
+    std::fclose(file);
+
+    while (!inFlight.empty()) {
+        deliver();
+    }
+    return error.empty();
+}
+
+#endif
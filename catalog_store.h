@@ -0,0 +1,391 @@
+#ifndef CATALOG_STORE_H
+#define CATALOG_STORE_H
+
+#include <bitset>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "cow_vector.h"
+
+// Column-wise storage for the book catalog.
+//
+// Each book is a slot number. The hot columns are what scans touch: a dense
+// array of ids and a bitset of availability, 4 bytes and 1 bit per book. The
+// cold columns hold 8-byte references to title and ISBN text, which is packed
+// end to end in an arena, and a 4-byte author number. Author names are
+// interned, so an author with a thousand books is stored once. The open loan
+// on each book (its borrow transaction and student) sits alongside.
+//
+// Every column is a CowVector and the arena is made of blocks that never
+// move, so snapshot() hands out a read-only CatalogView of the catalog as it
+// is now, at the cost of a pointer per 4096 books. The view keeps seeing
+// that state however the store changes afterwards.
+//
+// Erasing a slot leaves a tombstone (id 0) and changing a title or ISBN
+// leaves the old text behind in the arena (counted by deadTextBytes());
+// compact() reclaims both and renumbers the slots. string_views handed out by a view stay valid as long
+// as the view; those handed out by the store, until it is next changed.
+// Substring scans read the arena blocks in place (textExtents()) and map
+// each match back to a book through textSpan() and authorSpan().
+// Text offsets are 32-bit, which caps title, ISBN and author text at 4 GB,
+// the same limit as the snapshot string heap. Callers check hasRoom() before
+// adding text; past the cap store() would wrap offsets and corrupt titles.
+
+enum class BookField {
+    Title,
+    Author,
+    Isbn
+};
+
+// An open loan: the borrow transaction that has not been returned yet
+// (transactionId 0 if the book is not on loan)
+struct Loan {
+    int32_t transactionId;
+    int32_t studentId;
+};
+
+const size_t CATALOG_CHUNK = 4096; // Books per copy-on-write chunk
+
+class CatalogView {
+public:
+    static const int EMPTY_ID = 0;
+
+    // Function to get the number of slots, tombstones included
+    size_t size() const {
+        return ids.size();
+    }
+
+    int id(size_t slot) const {
+        return ids[slot];
+    }
+
+    bool available(size_t slot) const {
+        return (availableBits[slot / 64] >> (slot % 64)) & 1;
+    }
+
+    const Loan& loan(size_t slot) const {
+        return loans[slot];
+    }
+
+    std::string_view title(size_t slot) const {
+        return arena.view(titles[slot]);
+    }
+
+    std::string_view author(size_t slot) const {
+        return arena.view(authorNames[authors[slot]]);
+    }
+
+    // Function to get the interned author's number (below authorCount())
+    uint32_t authorNumber(size_t slot) const {
+        return authors[slot];
+    }
+
+    size_t authorCount() const {
+        return authorNames.size();
+    }
+
+    std::string_view isbn(size_t slot) const {
+        return arena.view(isbns[slot]);
+    }
+
+    std::string_view text(size_t slot, BookField field) const {
+        return field == BookField::Title ? title(slot) : field == BookField::Author ? author(slot) : isbn(slot);
+    }
+
+    // A run of packed text in the arena: length bytes starting at offset
+    struct TextExtent {
+        const char* data;
+        uint32_t offset;
+        uint32_t length;
+    };
+
+    // Function to list the runs of text in the arena, in offset order, for
+    // scans that read it in place. Runs hold stale text too (see compact()).
+    std::vector<TextExtent> textExtents() const {
+        return arena.extents();
+    }
+
+    // Function to get one past the highest arena offset in use
+    uint32_t textEnd() const {
+        return arena.end();
+    }
+
+    // Function to get the arena offsets [first, second) of a slot's title
+    // or ISBN, or of an interned author's name given the author number
+    std::pair<uint32_t, uint32_t> textSpan(size_t slot, BookField field) const {
+        return span(field == BookField::Title ? titles[slot] : isbns[slot]);
+    }
+
+    std::pair<uint32_t, uint32_t> authorSpan(uint32_t number) const {
+        return span(authorNames[number]);
+    }
+
+    // Function to count available books with a popcount per 64 slots
+    // (tombstones are never marked available)
+    size_t countAvailable() const {
+        size_t count = 0;
+        for (size_t i = 0; i < availableBits.size(); ++i) {
+            count += std::bitset<64>(availableBits[i]).count();
+        }
+        return count;
+    }
+
+    // Function to estimate the bytes held by the columns and the arena,
+    // containers' spare capacity included
+    size_t memoryBytes() const {
+        return ids.memoryBytes() + availableBits.memoryBytes() + loans.memoryBytes() + titles.memoryBytes() +
+               isbns.memoryBytes() + authors.memoryBytes() + authorNames.memoryBytes() + arena.memoryBytes();
+    }
+
+protected:
+    struct TextRef {
+        uint32_t offset;
+        uint32_t length;
+    };
+
+    static std::pair<uint32_t, uint32_t> span(TextRef ref) {
+        return {ref.offset, ref.offset + ref.length};
+    }
+
+    // Append-only text in fixed-size blocks. A block never moves once
+    // allocated, so views into it stay valid while text is added, and a copy
+    // of the arena shares the blocks. Text longer than a block gets a run of
+    // pages to itself.
+    class TextArena {
+    public:
+        static const uint32_t BLOCK_BYTES = 1 << 20;
+        static const uint64_t MAX_END = UINT32_MAX; // Highest offset after a text
+
+        // Function to check that count texts totalling bytes can be stored
+        // without an offset passing MAX_END. Each may start a new block, so
+        // the bound allows for the unused tail of one block per text.
+        bool hasRoom(size_t count, size_t bytes) const {
+            return (uint64_t(pages.size()) + count) * BLOCK_BYTES + bytes <= MAX_END;
+        }
+
+        // Function to copy text into the arena
+        TextRef store(std::string_view text) {
+            uint32_t length = static_cast<uint32_t>(text.size());
+            if (size_t(used) + length > pages.size() * size_t(BLOCK_BYTES)) {
+                for (size_t i = pages.size(); i > 0 && pages[i - 1].block == pages.back().block; --i) {
+                    pages[i - 1].end = used;
+                }
+                used = static_cast<uint32_t>(pages.size() * size_t(BLOCK_BYTES));
+                size_t count = length > BLOCK_BYTES ? (length + BLOCK_BYTES - 1) / BLOCK_BYTES : 1;
+                std::shared_ptr<char> block(new char[count * BLOCK_BYTES], std::default_delete<char[]>());
+                for (size_t i = 0; i < count; ++i) {
+                    pages.push_back(Page{block, used, 0});
+                }
+            }
+            TextRef ref{used, length};
+            if (length > 0) {
+                std::memcpy(at(used), text.data(), length);
+            }
+            used += length;
+            return ref;
+        }
+
+        std::string_view view(TextRef ref) const {
+            return ref.length == 0 ? std::string_view() : std::string_view(at(ref.offset), ref.length);
+        }
+
+        // Function to list each block's filled bytes (a run of pages shares one block)
+        std::vector<TextExtent> extents() const {
+            std::vector<TextExtent> runs;
+            for (size_t i = 0; i < pages.size();) {
+                const Page& page = pages[i];
+                size_t next = i + 1;
+                while (next < pages.size() && pages[next].block == page.block) ++next;
+                uint32_t end = next == pages.size() ? used : page.end;
+                if (end > page.base) {
+                    runs.push_back(TextExtent{page.block.get(), page.base, end - page.base});
+                }
+                i = next;
+            }
+            return runs;
+        }
+
+        uint32_t end() const {
+            return used;
+        }
+
+        size_t memoryBytes() const {
+            return pages.capacity() * sizeof(Page) + pages.size() * size_t(BLOCK_BYTES);
+        }
+
+    private:
+        struct Page {
+            std::shared_ptr<char> block;
+            uint32_t base; // Offset of the block's first byte
+            uint32_t end;  // Offset after the block's text, once a later block is started
+        };
+
+        char* at(uint32_t offset) const {
+            const Page& page = pages[offset / BLOCK_BYTES];
+            return page.block.get() + (offset - page.base);
+        }
+
+        std::vector<Page> pages; // One per BLOCK_BYTES of offsets
+        uint32_t used = 0;
+    };
+
+    // Hot columns
+    CowVector<int32_t, CATALOG_CHUNK> ids;
+    CowVector<uint64_t, CATALOG_CHUNK / 64> availableBits;
+
+    // Circulation column
+    CowVector<Loan, CATALOG_CHUNK> loans;
+
+    // Cold columns
+    CowVector<TextRef, CATALOG_CHUNK> titles;
+    CowVector<TextRef, CATALOG_CHUNK> isbns;
+    CowVector<uint32_t, CATALOG_CHUNK> authors;
+
+    CowVector<TextRef, 1024> authorNames;
+    TextArena arena;
+};
+
+class CatalogStore : public CatalogView {
+public:
+    CatalogStore() = default;
+    CatalogStore(CatalogStore&&) = default;
+    CatalogStore& operator=(CatalogStore&&) = default;
+    CatalogStore(const CatalogStore&) = delete; // Use snapshot(); the intern table is the writer's alone
+    CatalogStore& operator=(const CatalogStore&) = delete;
+
+    // Function to get a read-only view of the catalog as it is now
+    CatalogView snapshot() const {
+        return CatalogView(*this);
+    }
+
+    // Function to make room for count books
+    void reserve(size_t count) {
+        ids.reserve(count);
+        loans.reserve(count);
+        titles.reserve(count);
+        isbns.reserve(count);
+        authors.reserve(count);
+        availableBits.reserve((count + 63) / 64);
+    }
+
+    void clear() {
+        *this = CatalogStore();
+    }
+
+    // Function to check that a book's title, author and ISBN (bytes in all)
+    // still fit in the arena
+    bool hasRoom(size_t bytes) const {
+        return arena.hasRoom(3, bytes);
+    }
+
+    // Function to get the bytes of arena text no book refers to any more
+    // (old titles and ISBNs, and the text of erased books)
+    size_t deadTextBytes() const {
+        return deadBytes;
+    }
+
+    // Function to append a book and get its slot
+    size_t append(int id, std::string_view title, std::string_view author, std::string_view isbn,
+                  bool available) {
+        size_t slot = ids.size();
+        ids.push_back(id);
+        loans.push_back(Loan{0, 0});
+        titles.push_back(arena.store(title));
+        isbns.push_back(arena.store(isbn));
+        authors.push_back(intern(author));
+        if (slot % 64 == 0) {
+            availableBits.push_back(0);
+        }
+        setAvailable(slot, available);
+        return slot;
+    }
+
+    void setAvailable(size_t slot, bool available) {
+        uint64_t bit = uint64_t(1) << (slot % 64);
+        if (available) {
+            availableBits.mutate(slot / 64) |= bit;
+        } else {
+            availableBits.mutate(slot / 64) &= ~bit;
+        }
+    }
+
+    void setLoan(size_t slot, Loan loan) {
+        loans.set(slot, loan);
+    }
+
+    void setTitle(size_t slot, std::string_view title) {
+        deadBytes += titles[slot].length;
+        titles.set(slot, arena.store(title));
+    }
+
+    void setAuthor(size_t slot, std::string_view author) {
+        authors.set(slot, intern(author));
+    }
+
+    void setIsbn(size_t slot, std::string_view isbn) {
+        deadBytes += isbns[slot].length;
+        isbns.set(slot, arena.store(isbn));
+    }
+
+    // Function to turn a slot into a tombstone
+    void erase(size_t slot) {
+        ids.set(slot, EMPTY_ID);
+        setAvailable(slot, false);
+        loans.set(slot, Loan{0, 0});
+        deadBytes += titles[slot].length + isbns[slot].length;
+        titles.set(slot, TextRef{0, 0});
+        isbns.set(slot, TextRef{0, 0});
+        authors.set(slot, intern(std::string_view()));
+    }
+
+    // Function to drop tombstones, unused text and unused authors. Slots are
+    // renumbered (live books keep their order and their loans), so slot
+    // indexes must be rebuilt afterwards.
+    void compact() {
+        CatalogStore packed;
+        size_t live = 0;
+        for (size_t slot = 0; slot < ids.size(); ++slot) {
+            if (ids[slot] != EMPTY_ID) ++live;
+        }
+        packed.reserve(live);
+        for (size_t slot = 0; slot < ids.size(); ++slot) {
+            if (ids[slot] != EMPTY_ID) {
+                size_t packedSlot = packed.append(ids[slot], title(slot), author(slot), isbn(slot), available(slot));
+                packed.setLoan(packedSlot, loan(slot));
+            }
+        }
+        *this = std::move(packed);
+    }
+
+    size_t memoryBytes() const {
+        return CatalogView::memoryBytes() +
+               authorIds.bucket_count() * sizeof(void*) +
+               authorIds.size() * (sizeof(std::pair<std::string_view, uint32_t>) + 2 * sizeof(void*));
+    }
+
+private:
+    // Function to get an author's number, adding the name if it is new. The
+    // map's keys are views into the arena, whose text never moves.
+    uint32_t intern(std::string_view name) {
+        auto it = authorIds.find(name);
+        if (it != authorIds.end()) {
+            return it->second;
+        }
+        uint32_t number = static_cast<uint32_t>(authorNames.size());
+        TextRef ref = arena.store(name);
+        authorNames.push_back(ref);
+        authorIds.emplace(arena.view(ref), number);
+        return number;
+    }
+
+    std::unordered_map<std::string_view, uint32_t> authorIds;
+    size_t deadBytes = 0;
+};
+
+#endif
@@ -0,0 +1,88 @@
+#ifndef CHECKSUM_H
+#define CHECKSUM_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define CHECKSUM_SSE42 1
+#include <nmmintrin.h>
+#endif
+
+// Function to build a 256-entry table for a reflected CRC-32 polynomial
+template <uint32_t Polynomial>
+struct CrcTable {
+    uint32_t entries[256];
+    CrcTable() {
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k) {
+                c = (c & 1) ? Polynomial ^ (c >> 1) : c >> 1;
+            }
+            entries[i] = c;
+        }
+    }
+};
+
+// Function to compute (or continue) a CRC-32 (IEEE 802.3, reflected) over a
+// byte range. Pass the previous result as crc to checksum data in pieces.
+inline uint32_t crc32(const void* data, size_t size, uint32_t crc = 0) {
+    static const CrcTable<0xEDB88320u> table;
+
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    crc = ~crc;
+    for (size_t i = 0; i < size; ++i) {
+        crc = table.entries[(crc ^ bytes[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+// Function to compute CRC-32C (Castagnoli) a byte at a time
+inline uint32_t crc32cScalar(const void* data, size_t size, uint32_t crc = 0) {
+    static const CrcTable<0x82F63B78u> table;
+
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    crc = ~crc;
+    for (size_t i = 0; i < size; ++i) {
+        crc = table.entries[(crc ^ bytes[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+#ifdef CHECKSUM_SSE42
+// Function to compute CRC-32C eight bytes per instruction with SSE4.2
+__attribute__((target("sse4.2")))
+inline uint32_t crc32cSse42(const void* data, size_t size, uint32_t crc = 0) {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    uint64_t c = ~crc;
+    while (size >= 8) {
+        uint64_t word;
+        std::memcpy(&word, bytes, sizeof(word));
+        c = _mm_crc32_u64(c, word);
+        bytes += 8;
+        size -= 8;
+    }
+    uint32_t c32 = static_cast<uint32_t>(c);
+    while (size > 0) {
+        c32 = _mm_crc32_u8(c32, *bytes++);
+        --size;
+    }
+    return ~c32;
+}
+#endif
+
+// Function to compute (or continue) a CRC-32C. This is the checksum for bulk
+// data such as snapshots: on x86-64 CPUs with SSE4.2 it runs at several GB/s,
+// elsewhere it falls back to the table.
+inline uint32_t crc32c(const void* data, size_t size, uint32_t crc = 0) {
+#ifdef CHECKSUM_SSE42
+    static const bool hasSse42 = __builtin_cpu_supports("sse4.2") != 0;
+    if (hasSse42) {
+        return crc32cSse42(data, size, crc);
+    }
+#endif
+    return crc32cScalar(data, size, crc);
+}
+
+#endif
@@ -0,0 +1,472 @@
+#ifndef CIRCULATION_STATS_H
+#define CIRCULATION_STATS_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "atomic_file.h"
+#include "checksum.h"
+#include "civil_date.h"
+#include "cow_vector.h"
+#include "mapped_file.h"
+
+// Circulation aggregates kept up to date by every borrow and return, so the
+// reports (most borrowed books overall and this month, borrows per student,
+// daily totals, books never borrowed) are read off rather than computed
+// from the history.
+//
+// Per-book and per-student borrow counts are dense arrays by id, copy-on-
+// write like the catalog so a snapshot can carry them. Daily totals are one
+// entry per day with any circulation, in day order. The most borrowed books
+// (all time and in the latest month seen), and the students who borrowed
+// most, are each a short ranked list of TOP_TRACKED entries. A count only
+// ever rises by one, so the lists stay exact with a check against their
+// last entry on each borrow: a count below it cannot place, and one that
+// does moves up a few places at most. Only deleting a ranked book makes a
+// list rescan its counts to refill.
+//
+// Deleting a book drops its counts, so the reports cover the books in the
+// catalog. The month is the calendar month of the latest borrow; the first
+// borrow dated in a later month starts the monthly counts afresh.
+//
+// write() stores the aggregates marked with the transaction id they run up
+// to; read() loads them and the caller adds the transactions from there on
+// (see Library::load()). The ranked lists are not stored, as rank()
+// rebuilds them from the counts in one pass.
+class CirculationStats {
+public:
+    static constexpr size_t TOP_TRACKED = 50;
+    static constexpr size_t COUNT_CHUNK = 4096; // Ids per copy-on-write chunk
+    static constexpr int32_t NO_MONTH = INT32_MIN;
+
+    using Counts = CowVector<uint32_t, COUNT_CHUNK>;
+
+    struct Day {
+        int32_t day;
+        uint32_t borrows;
+        uint32_t returns;
+    };
+
+    struct Ranked {
+        int id;
+        uint32_t count;
+    };
+
+    // Function to number the calendar month a day falls in
+    static int32_t monthOf(int32_t day) {
+        int year;
+        unsigned month, dayOfMonth;
+        civilFromDays(day, year, month, dayOfMonth);
+        return year * 12 + static_cast<int32_t>(month) - 1;
+    }
+
+    // Function to name a month numbered by monthOf() as "YYYY-MM"
+    static std::string monthName(int32_t month) {
+        int32_t year = month >= 0 ? month / 12 : (month - 11) / 12;
+        char name[32];
+        std::snprintf(name, sizeof(name), "%04d-%02d", static_cast<int>(year), static_cast<int>(month - year * 12) + 1);
+        return name;
+    }
+
+    // Function to count a borrow
+    void borrowed(int bookId, int studentId, int32_t day) {
+        if (bookId <= 0 || studentId <= 0) return;
+        bookBorrows.growTo(static_cast<size_t>(bookId) + 1, 0);
+        uint32_t& count = bookBorrows.mutate(bookId);
+        if (count++ == 0) ++borrowedBooks;
+        bookTop.counted(bookId, count);
+
+        studentBorrows.growTo(static_cast<size_t>(studentId) + 1, 0);
+        studentTop.counted(studentId, ++studentBorrows.mutate(studentId));
+
+        int32_t month = monthOf(day);
+        if (month > currentMonth) {
+            currentMonth = month;
+            monthBorrows.clear();
+            monthTop.clear();
+        }
+        if (month == currentMonth) {
+            monthTop.counted(bookId, ++monthBorrows[bookId]);
+        }
+        dayEntry(day).borrows++;
+        ++totalBorrows;
+    }
+
+    // Function to count a return
+    void returned(int32_t day) {
+        dayEntry(day).returns++;
+        ++totalReturns;
+    }
+
+    // Function to drop a deleted book's counts
+    void bookRemoved(int bookId) {
+        if (!forget(bookId)) return;
+        if (bookTop.drop(bookId)) {
+            bookTop.refill([this](const std::function<void(int, uint32_t)>& offer) { offerBooks(offer); });
+        }
+        if (monthTop.drop(bookId)) {
+            monthTop.refill([this](const std::function<void(int, uint32_t)>& offer) { offerMonth(offer); });
+        }
+    }
+
+    // Function to drop the counts of every book live() rejects, then rank
+    // the lists afresh (after a load)
+    void prune(const std::function<bool(int)>& live) {
+        for (size_t id = 1; id < bookBorrows.size(); ++id) {
+            if (bookBorrows[id] != 0 && !live(static_cast<int>(id))) {
+                forget(static_cast<int>(id));
+            }
+        }
+        rank();
+    }
+
+    // Function to rebuild the ranked lists from the counts
+    void rank() {
+        bookTop.refill([this](const std::function<void(int, uint32_t)>& offer) { offerBooks(offer); });
+        monthTop.refill([this](const std::function<void(int, uint32_t)>& offer) { offerMonth(offer); });
+        studentTop.refill([this](const std::function<void(int, uint32_t)>& offer) {
+            for (size_t id = 1; id < studentBorrows.size(); ++id) {
+                if (studentBorrows[id] != 0) offer(static_cast<int>(id), studentBorrows[id]);
+            }
+        });
+    }
+
+    void clear() {
+        bookBorrows.clear();
+        studentBorrows.clear();
+        monthBorrows.clear();
+        days.clear();
+        bookTop.clear();
+        monthTop.clear();
+        studentTop.clear();
+        currentMonth = NO_MONTH;
+        borrowedBooks = 0;
+        totalBorrows = 0;
+        totalReturns = 0;
+    }
+
+    // Per-id borrow counts (ids past the end have none)
+    const Counts& bookCounts() const {
+        return bookBorrows;
+    }
+
+    const Counts& studentCounts() const {
+        return studentBorrows;
+    }
+
+    // Function to count the books borrowed at least once
+    size_t booksBorrowed() const {
+        return borrowedBooks;
+    }
+
+    uint64_t borrows() const {
+        return totalBorrows;
+    }
+
+    uint64_t returns() const {
+        return totalReturns;
+    }
+
+    // Function to get the month topMonthBooks() covers (NO_MONTH before the
+    // first borrow)
+    int32_t month() const {
+        return currentMonth;
+    }
+
+    // Ranked lists, most borrowed first (ties by id)
+    const std::vector<Ranked>& topBooks() const {
+        return bookTop.entries();
+    }
+
+    const std::vector<Ranked>& topMonthBooks() const {
+        return monthTop.entries();
+    }
+
+    const std::vector<Ranked>& topStudents() const {
+        return studentTop.entries();
+    }
+
+    // Function to get the daily totals for days in [fromDay, toDay]
+    void daysBetween(int32_t fromDay, int32_t toDay, std::vector<Day>& out) const {
+        out.clear();
+        auto it = std::lower_bound(days.begin(), days.end(), fromDay,
+                                   [](const Day& entry, int32_t day) { return entry.day < day; });
+        for (; it != days.end() && it->day <= toDay; ++it) {
+            out.push_back(*it);
+        }
+    }
+
+    // Function to write the aggregates to path via a temp file, marked with
+    // the first transaction id they do not include
+    bool write(const std::string& path, int64_t nextTransactionId) const {
+        std::vector<uint32_t> bookColumn = flatten(bookBorrows);
+        std::vector<uint32_t> studentColumn = flatten(studentBorrows);
+        std::vector<Ranked> monthColumn;
+        monthColumn.reserve(monthBorrows.size());
+        for (const auto& entry : monthBorrows) {
+            monthColumn.push_back({entry.first, entry.second});
+        }
+        std::sort(monthColumn.begin(), monthColumn.end(),
+                  [](const Ranked& a, const Ranked& b) { return a.id < b.id; });
+
+        Header header;
+        std::memset(&header, 0, sizeof(header));
+        std::memcpy(header.magic, MAGIC, sizeof(header.magic));
+        header.version = VERSION;
+        header.endianTag = ENDIAN_TAG;
+        header.nextTransactionId = nextTransactionId;
+        header.month = currentMonth;
+        header.bookCount = bookColumn.size();
+        header.studentCount = studentColumn.size();
+        header.dayCount = days.size();
+        header.monthCount = monthColumn.size();
+
+        uint32_t crc = crc32c(bookColumn.data(), bookColumn.size() * sizeof(uint32_t));
+        crc = crc32c(studentColumn.data(), studentColumn.size() * sizeof(uint32_t), crc);
+        crc = crc32c(days.data(), days.size() * sizeof(Day), crc);
+        header.payloadCrc = crc32c(monthColumn.data(), monthColumn.size() * sizeof(Ranked), crc);
+        header.headerCrc = crc32c(&header, sizeof(header));
+
+        AtomicFileWriter file(path);
+        file.write(&header, sizeof(header));
+        file.write(bookColumn.data(), bookColumn.size() * sizeof(uint32_t));
+        file.write(studentColumn.data(), studentColumn.size() * sizeof(uint32_t));
+        file.write(days.data(), days.size() * sizeof(Day));
+        file.write(monthColumn.data(), monthColumn.size() * sizeof(Ranked));
+        return file.commit();
+    }
+
+    // Function to load aggregates written by write(), setting
+    // nextTransactionId to the id they run up to. On failure they are
+    // empty and error says why, or is left empty if the file simply does
+    // not exist.
+    bool read(const std::string& path, int64_t& nextTransactionId, std::string& error) {
+        clear();
+        error.clear();
+        MappedFile file;
+        if (!file.open(path)) return false;
+        if (file.size() < sizeof(Header)) {
+            error = "truncated header";
+            return false;
+        }
+
+        Header header;
+        std::memcpy(&header, file.data(), sizeof(header));
+        Header check = header;
+        check.headerCrc = 0;
+        const uint64_t room = file.size() - sizeof(Header);
+        if (std::memcmp(header.magic, MAGIC, sizeof(header.magic)) != 0) {
+            error = "not a circulation file";
+        } else if (header.endianTag != ENDIAN_TAG) {
+            error = "written on a machine with different byte order";
+        } else if (crc32c(&check, sizeof(check)) != header.headerCrc) {
+            error = "header checksum mismatch";
+        } else if (header.version != VERSION) {
+            error = "unsupported version " + std::to_string(header.version);
+        } else if (header.bookCount > room / sizeof(uint32_t) || header.studentCount > room / sizeof(uint32_t) ||
+                   header.dayCount > room / sizeof(Day) || header.monthCount > room / sizeof(Ranked) ||
+                   (header.bookCount + header.studentCount) * sizeof(uint32_t) + header.dayCount * sizeof(Day) +
+                           header.monthCount * sizeof(Ranked) != room) {
+            error = "section sizes do not match the file";
+        } else if (crc32c(file.data() + sizeof(Header), room) != header.payloadCrc) {
+            error = "data checksum mismatch";
+        }
+        if (!error.empty()) return false;
+
+        const char* at = file.data() + sizeof(Header);
+        at = unflatten(at, header.bookCount, bookBorrows);
+        at = unflatten(at, header.studentCount, studentBorrows);
+        days.resize(header.dayCount);
+        std::memcpy(days.data(), at, days.size() * sizeof(Day));
+        at += days.size() * sizeof(Day);
+        std::vector<Ranked> monthColumn(header.monthCount);
+        std::memcpy(monthColumn.data(), at, monthColumn.size() * sizeof(Ranked));
+
+        // The checksum vouches for the bytes; check that they also agree
+        for (size_t i = 0; i < days.size() && error.empty(); ++i) {
+            if (i > 0 && days[i].day <= days[i - 1].day) error = "days out of order";
+            totalBorrows += days[i].borrows;
+            totalReturns += days[i].returns;
+        }
+        for (size_t i = 0; i < monthColumn.size() && error.empty(); ++i) {
+            const Ranked& entry = monthColumn[i];
+            if (entry.id <= 0 || static_cast<size_t>(entry.id) >= bookBorrows.size() ||
+                entry.count > bookBorrows[entry.id]) {
+                error = "monthly count out of range";
+            } else {
+                monthBorrows.emplace(entry.id, entry.count);
+            }
+        }
+        if (!error.empty()) {
+            clear();
+            return false;
+        }
+        for (size_t id = 1; id < bookBorrows.size(); ++id) {
+            if (bookBorrows[id] != 0) ++borrowedBooks;
+        }
+        currentMonth = header.month;
+        nextTransactionId = header.nextTransactionId;
+        rank();
+        return true;
+    }
+
+private:
+    static constexpr uint32_t VERSION = 1;
+    static constexpr uint32_t ENDIAN_TAG = 0x01020304;
+    static constexpr char MAGIC[8] = {'L', 'M', 'S', 'C', 'I', 'R', 'C', '\0'};
+
+    // File layout: the header, then the book counts, student counts, days
+    // and this month's book counts (by id)
+    struct Header {
+        char magic[8];
+        uint32_t version;
+        uint32_t endianTag;
+        int64_t nextTransactionId; // First transaction not counted
+        int32_t month;
+        uint32_t payloadCrc;
+        uint64_t bookCount;
+        uint64_t studentCount;
+        uint64_t dayCount;
+        uint64_t monthCount;
+        uint32_t reserved;
+        uint32_t headerCrc; // With this field zeroed
+    };
+    static_assert(sizeof(Header) == 72, "circulation header layout changed");
+
+    // The TOP_TRACKED highest counts, kept sorted
+    class Ranking {
+    public:
+        const std::vector<Ranked>& entries() const {
+            return ranked;
+        }
+
+        void clear() {
+            ranked.clear();
+        }
+
+        // Function to note that id's count has risen to count
+        void counted(int id, uint32_t count) {
+            Ranked entry{id, count};
+            if (ranked.size() == TOP_TRACKED && !before(entry, ranked.back())) return;
+            auto at = std::find_if(ranked.begin(), ranked.end(), [id](const Ranked& r) { return r.id == id; });
+            if (at == ranked.end()) {
+                if (ranked.size() == TOP_TRACKED) ranked.pop_back();
+                ranked.push_back(entry);
+                at = ranked.end() - 1;
+            }
+            at->count = count;
+            for (; at != ranked.begin() && before(*at, *(at - 1)); --at) {
+                std::iter_swap(at, at - 1);
+            }
+        }
+
+        // Function to take id out of the list; true if it was in it
+        bool drop(int id) {
+            auto at = std::find_if(ranked.begin(), ranked.end(), [id](const Ranked& r) { return r.id == id; });
+            if (at == ranked.end()) return false;
+            ranked.erase(at);
+            return true;
+        }
+
+        // Function to rank afresh from every (id, count) scan() offers
+        void refill(const std::function<void(const std::function<void(int, uint32_t)>&)>& scan) {
+            ranked.clear();
+            scan([this](int id, uint32_t count) {
+                Ranked entry{id, count};
+                if (ranked.size() == TOP_TRACKED) {
+                    if (!before(entry, ranked.front())) return;
+                    std::pop_heap(ranked.begin(), ranked.end(), before);
+                    ranked.back() = entry;
+                } else {
+                    ranked.push_back(entry);
+                }
+                std::push_heap(ranked.begin(), ranked.end(), before);
+            });
+            std::sort_heap(ranked.begin(), ranked.end(), before);
+        }
+
+    private:
+        static bool before(const Ranked& a, const Ranked& b) {
+            return a.count != b.count ? a.count > b.count : a.id < b.id;
+        }
+
+        std::vector<Ranked> ranked;
+    };
+
+    static std::vector<uint32_t> flatten(const Counts& counts) {
+        std::vector<uint32_t> out(counts.size());
+        for (size_t i = 0; i < out.size(); ++i) {
+            out[i] = counts[i];
+        }
+        return out;
+    }
+
+    static const char* unflatten(const char* at, uint64_t count, Counts& out) {
+        out.clear();
+        out.reserve(count);
+        for (uint64_t i = 0; i < count; ++i, at += sizeof(uint32_t)) {
+            uint32_t value;
+            std::memcpy(&value, at, sizeof(value));
+            out.push_back(value);
+        }
+        return at;
+    }
+
+    // Function to zero a book's counts; true if it had any
+    bool forget(int bookId) {
+        if (bookId <= 0 || static_cast<size_t>(bookId) >= bookBorrows.size() || bookBorrows[bookId] == 0) {
+            return false;
+        }
+        bookBorrows.set(bookId, 0);
+        --borrowedBooks;
+        monthBorrows.erase(bookId);
+        return true;
+    }
+
+    void offerBooks(const std::function<void(int, uint32_t)>& offer) const {
+        for (size_t id = 1; id < bookBorrows.size(); ++id) {
+            if (bookBorrows[id] != 0) offer(static_cast<int>(id), bookBorrows[id]);
+        }
+    }
+
+    void offerMonth(const std::function<void(int, uint32_t)>& offer) const {
+        for (const auto& entry : monthBorrows) {
+            offer(entry.first, entry.second);
+        }
+    }
+
+    // Function to find a day's totals, adding the day if it has none yet.
+    // Days nearly always arrive in order, so this is an append or a bump.
+    Day& dayEntry(int32_t day) {
+        if (days.empty() || days.back().day < day) {
+            days.push_back({day, 0, 0});
+            return days.back();
+        }
+        auto it = std::lower_bound(days.begin(), days.end(), day,
+                                   [](const Day& entry, int32_t value) { return entry.day < value; });
+        if (it == days.end() || it->day != day) {
+            it = days.insert(it, {day, 0, 0});
+        }
+        return *it;
+    }
+
+    Counts bookBorrows;                             // By book id
+    Counts studentBorrows;                          // By student id
+    std::unordered_map<int, uint32_t> monthBorrows; // Book id -> borrows in currentMonth
+    std::vector<Day> days;                          // Ascending
+    Ranking bookTop;
+    Ranking monthTop;
+    Ranking studentTop;
+    int32_t currentMonth = NO_MONTH;
+    size_t borrowedBooks = 0;
+    uint64_t totalBorrows = 0;
+    uint64_t totalReturns = 0;
+};
+
+#endif
@@ -0,0 +1,80 @@
+#ifndef CIVIL_DATE_H
+#define CIVIL_DATE_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Calendar dates as day numbers: days since 1970-01-01 in the proleptic
+// Gregorian calendar. A day number is a plain int32_t, so dates are stored in
+// four bytes and compared and subtracted as integers; text is produced only
+// for display and export. The conversions are Howard Hinnant's
+// days_from_civil / civil_from_days and are exact for any date an int32_t
+// day number can hold.
+
+// Function to convert a year/month/day to a day number
+inline int32_t daysFromCivil(int year, unsigned month, unsigned day) {
+    year -= month <= 2;
+    const int era = (year >= 0 ? year : year - 399) / 400;
+    const unsigned yearOfEra = static_cast<unsigned>(year - era * 400);
+    const unsigned dayOfYear = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+    const unsigned dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+    return era * 146097 + static_cast<int32_t>(dayOfEra) - 719468;
+}
+
+// Function to convert a day number back to year/month/day
+inline void civilFromDays(int32_t days, int& year, unsigned& month, unsigned& day) {
+    days += 719468;
+    const int era = (days >= 0 ? days : days - 146096) / 146097;
+    const unsigned dayOfEra = static_cast<unsigned>(days - era * 146097);
+    const unsigned yearOfEra = (dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 - dayOfEra / 146096) / 365;
+    const unsigned dayOfYear = dayOfEra - (365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100);
+    const unsigned monthIndex = (5 * dayOfYear + 2) / 153;
+    day = dayOfYear - (153 * monthIndex + 2) / 5 + 1;
+    month = monthIndex < 10 ? monthIndex + 3 : monthIndex - 9;
+    year = static_cast<int>(yearOfEra) + era * 400 + (month <= 2);
+}
+
+// Function to format a day number as "Y-M-D". Fields are not zero-padded,
+// matching the dates this program has always written ("2025-4-9").
+inline std::string formatDay(int32_t days) {
+    int year;
+    unsigned month, day;
+    civilFromDays(days, year, month, day);
+    return std::to_string(year) + "-" + std::to_string(month) + "-" + std::to_string(day);
+}
+
+// Function to parse a "Y-M-D" date, zero-padded or not, into a day number.
+// Returns false for anything that is not a real calendar date.
+inline bool parseDay(std::string_view text, int32_t& days) {
+    int parts[3] = {0, 0, 0};
+    int part = 0;
+    bool sawDigit = false;
+
+    for (char c : text) {
+        if (c == '-') {
+            if (!sawDigit || ++part > 2) return false;
+            sawDigit = false;
+        } else if (c >= '0' && c <= '9') {
+            parts[part] = parts[part] * 10 + (c - '0');
+            if (parts[part] > 9999) return false;
+            sawDigit = true;
+        } else {
+            return false;
+        }
+    }
+    if (part != 2 || !sawDigit) return false;
+
+    const int year = parts[0];
+    const unsigned month = static_cast<unsigned>(parts[1]);
+    const unsigned day = static_cast<unsigned>(parts[2]);
+    static const unsigned DAYS_IN_MONTH[12] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+    if (month < 1 || month > 12 || day < 1) return false;
+    bool leap = (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+    if (day > DAYS_IN_MONTH[month - 1] + (month == 2 && leap ? 1 : 0)) return false;
+
+    days = daysFromCivil(year, month, day);
+    return true;
+}
+
+#endif
@@ -0,0 +1,86 @@
+#ifndef COARSE_CLOCK_H
+#define COARSE_CLOCK_H
+
+#include <cstdint>
+#include <ctime>
+#include <mutex>
+#include <string>
+
+#include "civil_date.h"
+
+// Wall clock with one-second resolution whose formatted forms are cached.
+//
+// time() is cheap, but localtime() plus string building on every call is
+// not, and localtime() returns a shared static buffer that is unsafe across
+// threads. Here the local-time breakdown and the "Y-M-D" / "Y-M-D h:m:s"
+// strings are rebuilt (with the reentrant localtime variant) only when the
+// second changes; every other call copies the cached value under a mutex.
+// today() returns the local date as a day number and builds no strings.
+// The formats match what this program has always written: fields are not
+// zero-padded.
+class CoarseClock {
+public:
+    // Function to get the current "Y-M-D h:m:s" timestamp
+    std::string timestamp() {
+        std::lock_guard<std::mutex> lock(mutex);
+        refresh();
+        return cachedTimestamp;
+    }
+
+    // Function to get the current "Y-M-D" date
+    std::string date() {
+        std::lock_guard<std::mutex> lock(mutex);
+        refresh();
+        return cachedDate;
+    }
+
+    // Function to get today's local date as a day number (see civil_date.h)
+    int32_t today() {
+        std::lock_guard<std::mutex> lock(mutex);
+        refresh();
+        return cachedDay;
+    }
+
+    // Function to get the current local calendar fields
+    std::tm localTime() {
+        std::lock_guard<std::mutex> lock(mutex);
+        refresh();
+        return cachedTm;
+    }
+
+private:
+    void refresh() {
+        std::time_t now = std::time(nullptr);
+        if (now == cachedSecond) return;
+        cachedSecond = now;
+
+#ifdef _WIN32
+        localtime_s(&cachedTm, &now);
+#else
+        localtime_r(&now, &cachedTm);
+#endif
+        cachedDay = daysFromCivil(1900 + cachedTm.tm_year, 1 + cachedTm.tm_mon, cachedTm.tm_mday);
+        cachedDate = std::to_string(1900 + cachedTm.tm_year) + "-" +
+                     std::to_string(1 + cachedTm.tm_mon) + "-" +
+                     std::to_string(cachedTm.tm_mday);
+        cachedTimestamp = cachedDate + " " +
+                          std::to_string(cachedTm.tm_hour) + ":" +
+                          std::to_string(cachedTm.tm_min) + ":" +
+                          std::to_string(cachedTm.tm_sec);
+    }
+
+    std::mutex mutex;
+    std::time_t cachedSecond = -1;
+    std::tm cachedTm = std::tm();
+    int32_t cachedDay = 0;
+    std::string cachedDate;
+    std::string cachedTimestamp;
+};
+
+// Function to get the process-wide clock
+inline CoarseClock& coarseClock() {
+    static CoarseClock clock;
+    return clock;
+}
+
+#endif
@@ -0,0 +1,112 @@
+#ifndef COW_VECTOR_H
+#define COW_VECTOR_H
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+// Chunked copy-on-write vector: the building block of the snapshots readers
+// take of the catalog (see CatalogStore and LibrarySnapshot).
+//
+// Elements live in fixed-size chunks held by shared_ptr. Copying the vector
+// copies only the table of chunk pointers, so a copy is a point-in-time
+// snapshot that costs one pointer per CHUNK elements. The copies share every
+// chunk; a chunk is duplicated the first time the vector that is still being
+// written changes an element in it while another copy holds it, so a
+// snapshot never sees later writes and writes never wait for readers.
+// Chunks are freed when the last copy referring to them goes away.
+//
+// Thread safety: one thread at a time may use a given CowVector (copies
+// included), as with any container. Distinct copies may be used from
+// different threads at once, even though they share chunks: shared chunks
+// are never written. That relies on copies of the vector being written to
+// being made only under the lock its writer holds: a chunk the writer holds
+// alone can then only become shared through the writer itself. Copies of
+// copies may be made freely.
+template <typename T, size_t CHUNK>
+class CowVector {
+public:
+    static_assert(CHUNK > 0, "chunks must hold at least one element");
+
+    size_t size() const {
+        return count;
+    }
+
+    bool empty() const {
+        return count == 0;
+    }
+
+    const T& operator[](size_t i) const {
+        return (*chunks[i / CHUNK])[i % CHUNK];
+    }
+
+    // Function to get an element for writing, copying its chunk first if a
+    // snapshot still shares it
+    T& mutate(size_t i) {
+        return own(i / CHUNK)[i % CHUNK];
+    }
+
+    void set(size_t i, T value) {
+        mutate(i) = std::move(value);
+    }
+
+    void push_back(T value) {
+        if (count % CHUNK == 0) {
+            chunks.push_back(std::make_shared<Chunk>());
+            chunks.back()->reserve(CHUNK);
+        }
+        own(count / CHUNK).push_back(std::move(value));
+        ++count;
+    }
+
+    // Function to grow to n elements, filling with value (never shrinks)
+    void growTo(size_t n, const T& value) {
+        while (count < n) {
+            push_back(value);
+        }
+    }
+
+    void reserve(size_t n) {
+        chunks.reserve((n + CHUNK - 1) / CHUNK);
+    }
+
+    void clear() {
+        chunks.clear();
+        count = 0;
+    }
+
+    // Function to estimate the bytes held by this copy (shared chunks are
+    // counted in full by every copy)
+    size_t memoryBytes() const {
+        size_t bytes = chunks.capacity() * sizeof(std::shared_ptr<Chunk>);
+        for (const auto& chunk : chunks) {
+            bytes += sizeof(Chunk) + chunk->capacity() * sizeof(T);
+        }
+        return bytes;
+    }
+
+private:
+    using Chunk = std::vector<T>;
+
+    // Function to get a chunk this copy alone holds. use_count() is only a
+    // hint in general, but here the count can only rise under the writer's
+    // lock, so a count of one stays one; the fence orders our writes after
+    // the reads a snapshot made before it let go of the chunk. (ThreadSanitizer
+    // does not model fences and reports those reads as racing the write.)
+    Chunk& own(size_t c) {
+        if (chunks[c].use_count() > 1) {
+            auto copy = std::make_shared<Chunk>();
+            copy->reserve(CHUNK);
+            copy->assign(chunks[c]->begin(), chunks[c]->end());
+            chunks[c] = std::move(copy);
+        } else {
+            std::atomic_thread_fence(std::memory_order_acquire);
+        }
+        return *chunks[c];
+    }
+
+    std::vector<std::shared_ptr<Chunk>> chunks;
+    size_t count = 0;
+};
+
+#endif
@@ -0,0 +1,63 @@
+#include <iostream>
+#include <string>
+
+#include "dataset_generator.h"
+
+// Command-line front end to the synthetic data generator: writes books.txt,
+// students.txt and transactions.txt into a directory, ready to be loaded by
+// library_system or library_bench.
+
+// Function to print the command-line usage
+void printUsage(const char* program) {
+    std::cerr << "Usage: " << program << " <dir> [--books <n>] [--students <n>] [--transactions <n>] [--seed <n>]\n"
+              << "  <dir>              Existing directory to write books.txt, students.txt, transactions.txt into\n"
+              << "  --books <n>        Number of books (default 10k); k and m suffixes are accepted\n"
+              << "  --students <n>     Number of students (default: books / 10)\n"
+              << "  --transactions <n> Number of borrow/return transactions (default: books * 2)\n"
+              << "  --seed <n>         Random seed; the same options always give the same data (default 1)\n";
+}
+
+int main(int argc, char* argv[]) {
+    std::string dir;
+    DatasetOptions options;
+    bool studentsSet = false, transactionsSet = false;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        size_t count;
+        if (arg[0] != '-' && dir.empty()) {
+            dir = arg;
+        } else if ((arg == "--books" || arg == "--students" || arg == "--transactions" || arg == "--seed") &&
+                   i + 1 < argc && parseDatasetCount(argv[i + 1], count)) {
+            if (arg == "--books") {
+                options.books = count;
+            } else if (arg == "--students") {
+                options.students = count;
+                studentsSet = true;
+            } else if (arg == "--transactions") {
+                options.transactions = count;
+                transactionsSet = true;
+            } else {
+                options.seed = count;
+            }
+            ++i;
+        } else {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+    if (dir.empty()) {
+        printUsage(argv[0]);
+        return 1;
+    }
+    if (!studentsSet) options.students = options.books / 10 + 1;
+    if (!transactionsSet) options.transactions = options.books * 2;
+
+    std::string error;
+    if (!generateDataset(dir, options, error)) {
+        std::cerr << "Unable to generate data: " << error << std::endl;
+        return 1;
+    }
+    std::cout << "Wrote " << options.books << " books, " << options.students << " students and "
+              << options.transactions << " transactions to " << dir << std::endl;
+    return 0;
+}
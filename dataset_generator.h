@@ -0,0 +1,373 @@
+#ifndef DATASET_GENERATOR_H
+#define DATASET_GENERATOR_H
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "civil_date.h"
+#include "text_loader.h"
+#include "transaction.h"
+
+// Synthetic library data for benchmarks and load testing.
+//
+// Writes books.txt, students.txt and transactions.txt in the same text
+// format the library exports, so Library::load() reads them like any other
+// data directory (and moves the transactions into history/ on first load).
+//
+// The distributions are skewed the way real catalogs are. Title words and
+// authors are drawn with a roughly Zipfian (1/rank) popularity, so a few
+// authors have hundreds of books and most have one or two. Borrowing
+// favours a small set of popular books. The transaction log is a valid
+// history: a book is only returned by the student who has it, dates never
+// go backwards, and each book's availability in books.txt matches whether
+// its last transaction was a borrow. Output depends only on the options,
+// including the seed.
+
+struct DatasetOptions {
+    size_t books = 10000;
+    size_t students = 1000;
+    size_t transactions = 20000;
+    uint64_t seed = 1;
+    int32_t firstDay = daysFromCivil(2015, 1, 1); // Date of the first transaction
+    int32_t spanDays = 3650;                       // Days the history is spread over
+};
+
+// Small, fast generator (splitmix64) whose output is the same on every
+// platform, unlike the standard distributions
+class DatasetRandom {
+public:
+    explicit DatasetRandom(uint64_t seed) : state(seed) {}
+
+    uint64_t next() {
+        uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+
+    // Function to draw uniformly from [0, n)
+    size_t below(size_t n) {
+        return static_cast<size_t>(unit() * n);
+    }
+
+    // Function to draw from [0, 1)
+    double unit() {
+        return (next() >> 11) * (1.0 / 9007199254740992.0);
+    }
+
+    // Function to draw a rank from [0, n) with probability about 1/(rank + 1)
+    size_t zipf(size_t n) {
+        size_t rank = static_cast<size_t>(std::exp(unit() * std::log(double(n) + 1))) - 1;
+        return rank < n ? rank : n - 1;
+    }
+
+private:
+    uint64_t state;
+};
+
+namespace dataset_detail {
+
+const char* const TITLE_WORDS[] = {
+    "the", "of", "and", "night", "house", "war", "love", "river", "city", "shadow", "garden", "time", "last",
+    "secret", "history", "world", "light", "stone", "king", "queen", "winter", "summer", "road", "sea", "fire",
+    "island", "dark", "lost", "silent", "empire", "heart", "memory", "storm", "glass", "iron", "golden",
+    "children", "mountain", "forest", "letters", "journey", "daughter", "son", "midnight", "blood", "songs",
+    "dreams", "stars", "machine", "theory", "introduction", "principles", "art", "science", "guide", "modern",
+    "practical", "complete", "short", "brief", "new", "old", "american", "european", "ancient", "hidden",
+    "broken", "wild", "little", "great", "second", "book", "tales", "voices", "water", "north", "south",
+    "east", "west", "empty", "burning", "quiet", "distant", "stolen", "final", "first", "other", "small",
+    "bright", "cold", "long", "deep", "red", "blue", "white", "black", "green", "programming", "systems",
+    "design", "economics", "philosophy", "mathematics", "biology", "chemistry", "physics", "language",
+    "music", "painting", "poems", "essays", "stories", "notes", "lessons", "rules", "keeper", "thief",
+    "hunter", "doctor", "soldier", "witness", "stranger", "prince", "orchard", "harbor", "bridge", "tower",
+    "wall", "door", "window", "clock", "map", "compass", "lantern", "mirror", "bell", "crown", "sword",
+};
+
+const char* const FIRST_NAMES[] = {
+    "James", "Mary", "John", "Patricia", "Robert", "Jennifer", "Michael", "Linda", "William", "Elizabeth",
+    "David", "Barbara", "Richard", "Susan", "Joseph", "Jessica", "Thomas", "Sarah", "Charles", "Karen",
+    "Wei", "Mei", "Hiroshi", "Yuki", "Ahmed", "Fatima", "Carlos", "Sofia", "Ivan", "Olga", "Pierre",
+    "Claire", "Hans", "Greta", "Raj", "Priya", "Kwame", "Amara", "Liam", "Emma", "Noah", "Olivia", "Lucas",
+    "Mia", "Mateo", "Chloe", "Arjun", "Ananya", "Kofi", "Zara", "Daniel", "Nancy", "Matthew", "Lisa",
+    "Anthony", "Margaret", "Mark", "Betty", "Donald", "Sandra", "Steven", "Ashley", "Paul", "Dorothy",
+    "Andrew", "Kimberly", "Joshua", "Emily", "Kenneth", "Donna", "George", "Michelle", "Edward", "Carol",
+    "Brian", "Amanda", "Ronald", "Melissa", "Timothy", "Deborah", "Jorge", "Lucia", "Diego", "Valentina",
+    "Miguel", "Camila", "Pablo", "Isabel", "Javier", "Elena", "Luca", "Giulia", "Marco", "Francesca", "Jan",
+    "Anna", "Piotr", "Katarzyna", "Lars", "Ingrid", "Sven", "Astrid", "Dmitri", "Natalia", "Sergei",
+    "Tatiana", "Yusuf", "Leila", "Omar", "Noor", "Hassan", "Amina", "Kenji", "Aiko", "Takeshi", "Haruka",
+    "Min", "Jia", "Hao", "Lan", "Sanjay", "Deepa", "Vikram", "Kavya", "Ravi", "Lakshmi", "Chidi", "Ngozi",
+    "Tunde", "Ayesha", "Emeka", "Adaeze", "Thabo", "Lerato", "Tariq", "Salma", "Mehmet", "Elif", "Emre",
+    "Zeynep", "Oscar", "Julia", "Felix", "Nora", "Hugo", "Alice", "Ethan", "Grace", "Samuel", "Ruth",
+};
+
+const char* const LAST_NAMES[] = {
+    "Smith", "Johnson", "Williams", "Brown", "Jones", "Garcia", "Miller", "Davis", "Rodriguez", "Martinez",
+    "Hernandez", "Lopez", "Wilson", "Anderson", "Thomas", "Taylor", "Moore", "Jackson", "Martin", "Lee",
+    "Perez", "Thompson", "White", "Harris", "Clark", "Lewis", "Robinson", "Walker", "Young", "Allen",
+    "Chen", "Wang", "Li", "Zhang", "Tanaka", "Suzuki", "Kim", "Park", "Nguyen", "Singh", "Patel", "Khan",
+    "Ivanov", "Petrov", "Muller", "Schmidt", "Dubois", "Moreau", "Rossi", "Bianchi", "Silva", "Santos",
+    "Okafor", "Mensah", "Haddad", "Cohen", "Novak", "Kowalski", "Larsen", "Berg", "King", "Wright", "Scott",
+    "Torres", "Hill", "Flores", "Green", "Adams", "Nelson", "Baker", "Hall", "Rivera", "Campbell",
+    "Mitchell", "Carter", "Roberts", "Gomez", "Phillips", "Evans", "Turner", "Diaz", "Parker", "Cruz",
+    "Edwards", "Collins", "Reyes", "Stewart", "Morris", "Murphy", "Cook", "Rogers", "Morgan", "Peterson",
+    "Cooper", "Reed", "Bailey", "Bell", "Kelly", "Howard", "Ward", "Liu", "Huang", "Zhao", "Wu", "Yamamoto",
+    "Watanabe", "Ito", "Nakamura", "Choi", "Jung", "Tran", "Pham", "Sharma", "Gupta", "Reddy", "Iyer",
+    "Ali", "Hussain", "Rahman", "Aziz", "Sokolov", "Popov", "Volkov", "Fischer", "Weber", "Wagner",
+    "Becker", "Hoffmann", "Lefebvre", "Girard", "Ricci", "Romano", "Costa", "Ferreira", "Oliveira",
+    "Pereira", "Nowak", "Wojcik", "Nielsen", "Hansen", "Johansson", "Lindqvist", "Adeyemi", "Balogun",
+    "Nwosu", "Owusu", "Boateng", "Yilmaz", "Demir", "Kaya",
+};
+
+template <size_t N>
+const char* pick(const char* const (&words)[N], size_t index) {
+    return words[index % N];
+}
+
+// Function to find a step that visits every slot of [0, n) exactly once
+inline size_t coprimeStride(size_t n, size_t start) {
+    auto gcd = [](size_t a, size_t b) {
+        while (b != 0) {
+            size_t t = a % b;
+            a = b;
+            b = t;
+        }
+        return a;
+    };
+    size_t stride = start % n;
+    while (stride == 0 || gcd(stride, n) != 1) {
+        stride = (stride + 1) % n;
+    }
+    return stride;
+}
+
+// Function to build a title of one to six words, popular words first
+inline std::string makeTitle(DatasetRandom& random) {
+    const size_t words = sizeof(TITLE_WORDS) / sizeof(TITLE_WORDS[0]);
+    size_t length = 1 + random.zipf(6);
+    std::string title;
+    size_t last = words;
+    for (size_t i = 0; i < length; ++i) {
+        size_t pick = random.zipf(words);
+        if (pick == last) pick = (pick + 1) % words; // No "The the"
+        last = pick;
+        std::string word = TITLE_WORDS[pick];
+        if (i == 0 || word.size() > 3) {
+            word[0] = static_cast<char>(word[0] - 'a' + 'A');
+        }
+        if (i > 0) title += ' ';
+        title += word;
+    }
+    return title;
+}
+
+// Function to build a person's name from a number. Distinct numbers give
+// distinct names: the number is read as digits picking a first name, a
+// surname, then none, one or two middle initials, and only past all of
+// those (15.8 million names) second, hyphenated surnames, so no name needs
+// a counter.
+inline std::string makeName(size_t number) {
+    const size_t firsts = sizeof(FIRST_NAMES) / sizeof(FIRST_NAMES[0]);
+    const size_t lasts = sizeof(LAST_NAMES) / sizeof(LAST_NAMES[0]);
+    const size_t initials = 1 + 26 + 26 * 26; // None, one or two letters
+
+    // The surname is offset by the first name, so neighbouring numbers
+    // differ in both
+    size_t first = number % firsts;
+    number /= firsts;
+    size_t last = (number + first) % lasts;
+    number /= lasts;
+    size_t middle = number % initials;
+    number /= initials;
+    std::string name = FIRST_NAMES[first];
+    if (middle > 26) {
+        middle -= 27;
+        name += std::string(" ") + char('A' + middle / 26) + ". " + char('A' + middle % 26) + ".";
+    } else if (middle > 0) {
+        name += std::string(" ") + char('A' + middle - 1) + ".";
+    }
+    name += ' ';
+    name += LAST_NAMES[last];
+    while (number > 0) {
+        --number;
+        last = (last + 1 + number % (lasts - 1)) % lasts; // Never the surname before it
+        number /= lasts - 1;
+        name += '-';
+        name += LAST_NAMES[last];
+    }
+    return name;
+}
+
+// Function to make the ISBN-13 with the given 9-digit body
+inline std::string makeIsbn(uint64_t body) {
+    char digits[14];
+    std::snprintf(digits, sizeof(digits), "978%09llu", static_cast<unsigned long long>(body % 1000000000ull));
+    int sum = 0;
+    for (int i = 0; i < 12; ++i) {
+        sum += (digits[i] - '0') * (i % 2 == 0 ? 1 : 3);
+    }
+    digits[12] = static_cast<char>('0' + (10 - sum % 10) % 10);
+    digits[13] = '\0';
+    return digits;
+}
+
+// Buffered writer for one output file
+class TableWriter {
+public:
+    bool open(const std::string& path) {
+        file = std::fopen(path.c_str(), "wb");
+        return file != nullptr;
+    }
+
+    ~TableWriter() {
+        close();
+    }
+
+    std::string& buffer() {
+        if (pending.size() >= (1 << 20)) flush();
+        return pending;
+    }
+
+    bool close() {
+        if (file == nullptr) return true;
+        flush();
+        bool ok = !failed && std::fclose(file) == 0;
+        file = nullptr;
+        return ok;
+    }
+
+private:
+    void flush() {
+        if (!pending.empty() && std::fwrite(pending.data(), 1, pending.size(), file) != pending.size()) {
+            failed = true;
+        }
+        pending.clear();
+    }
+
+    std::FILE* file = nullptr;
+    std::string pending;
+    bool failed = false;
+};
+
+} // namespace dataset_detail
+
+// Function to parse a count, accepting k/m suffixes ("250k", "10m")
+inline bool parseDatasetCount(std::string text, size_t& count) {
+    size_t scale = 1;
+    if (!text.empty() && (text.back() == 'k' || text.back() == 'K')) {
+        scale = 1000;
+        text.pop_back();
+    } else if (!text.empty() && (text.back() == 'm' || text.back() == 'M')) {
+        scale = 1000000;
+        text.pop_back();
+    }
+    int value;
+    if (!parseInt(text, value) || value < 0) return false;
+    count = static_cast<size_t>(value) * scale;
+    return true;
+}
+
+// Function to write a synthetic data set into dir (which must exist).
+// Returns false with a reason if a file could not be written.
+inline bool generateDataset(const std::string& dir, const DatasetOptions& options, std::string& error) {
+    using namespace dataset_detail;
+
+    if (options.books == 0 || options.students == 0 || options.books > 1000000000 ||
+        options.students > 1000000000 || options.transactions > 2000000000) {
+        error = "counts must be between 1 and 10^9 (transactions up to 2*10^9)";
+        return false;
+    }
+
+    DatasetRandom random(options.seed);
+    const size_t authors = options.books / 8 + 1;
+    // Popularity rank -> id, spread over the id range so popular books and
+    // authors are not simply the lowest ids
+    const size_t bookStride = coprimeStride(options.books, options.books / 2 + 7919);
+    const size_t studentStride = coprimeStride(options.students, options.students / 3 + 104729);
+    const size_t isbnStride = coprimeStride(1000000000, 387420489);
+
+    // Simulate the history first: it decides which books end up on loan
+    std::vector<int32_t> holder(options.books + 1, 0); // Student who has each book, 0 if none
+    TableWriter transactions;
+    if (!transactions.open(dir + "/transactions.txt")) {
+        error = "cannot write " + dir + "/transactions.txt";
+        return false;
+    }
+    transactions.buffer() += std::to_string(options.transactions + 1) + "\n";
+    for (size_t i = 0; i < options.transactions; ++i) {
+        size_t bookId = random.zipf(options.books) * bookStride % options.books + 1;
+        int32_t day = options.firstDay +
+                      static_cast<int32_t>(double(i) * options.spanDays / double(options.transactions));
+        TransactionType type;
+        int32_t studentId;
+        if (holder[bookId] != 0) {
+            type = TransactionType::Return;
+            studentId = holder[bookId];
+            holder[bookId] = 0;
+        } else {
+            type = TransactionType::Borrow;
+            studentId = static_cast<int32_t>(random.zipf(options.students) * studentStride % options.students + 1);
+            holder[bookId] = studentId;
+        }
+        std::string& line = transactions.buffer();
+        line += std::to_string(i + 1);
+        line += '|';
+        line += std::to_string(bookId);
+        line += '|';
+        line += std::to_string(studentId);
+        line += '|';
+        line += transactionTypeName(type);
+        line += '|';
+        line += formatDay(day);
+        line += '\n';
+    }
+    if (!transactions.close()) {
+        error = "cannot write " + dir + "/transactions.txt";
+        return false;
+    }
+
+    TableWriter books;
+    if (!books.open(dir + "/books.txt")) {
+        error = "cannot write " + dir + "/books.txt";
+        return false;
+    }
+    books.buffer() += std::to_string(options.books + 1) + "\n";
+    for (size_t id = 1; id <= options.books; ++id) {
+        std::string& line = books.buffer();
+        line += std::to_string(id);
+        line += '|';
+        line += makeTitle(random);
+        line += '|';
+        line += makeName(random.zipf(authors) * 7 + 3);
+        line += '|';
+        line += makeIsbn(uint64_t(id) * isbnStride);
+        line += holder[id] != 0 ? "|0\n" : "|1\n";
+    }
+    if (!books.close()) {
+        error = "cannot write " + dir + "/books.txt";
+        return false;
+    }
+
+    TableWriter students;
+    if (!students.open(dir + "/students.txt")) {
+        error = "cannot write " + dir + "/students.txt";
+        return false;
+    }
+    students.buffer() += std::to_string(options.students + 1) + "\n";
+    for (size_t id = 1; id <= options.students; ++id) {
+        std::string& line = students.buffer();
+        line += std::to_string(id);
+        line += '|';
+        line += makeName(id * 13 + 5);
+        line += '\n';
+    }
+    if (!students.close()) {
+        error = "cannot write " + dir + "/students.txt";
+        return false;
+    }
+    return true;
+}
+
+#endif
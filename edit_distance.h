@@ -0,0 +1,93 @@
+#ifndef EDIT_DISTANCE_H
+#define EDIT_DISTANCE_H
+
+#include <algorithm>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+// Levenshtein distance kernel used by the fuzzy search.
+//
+// A pattern of up to 64 bytes is compiled once into one bit mask per byte
+// value (the positions where it occurs); the distance to any text is then
+// computed a column at a time with Myers' bit-parallel algorithm, in
+// Hyyrö's form for whole-string distance: each text byte is a handful of
+// word operations instead of a row of the dynamic-programming table.
+// distance() can give up early once the answer is certain to exceed a
+// bound. Longer patterns fall back to the classic two-row table. Bytes are
+// compared as they are; callers fold case first.
+class EditPattern {
+public:
+    static const size_t MAX_BITS = 64;
+
+    explicit EditPattern(std::string_view patternText) : text(patternText) {
+        if (text.size() <= MAX_BITS) {
+            for (size_t i = 0; i < text.size(); ++i) {
+                peq[static_cast<unsigned char>(text[i])] |= uint64_t(1) << i;
+            }
+        }
+    }
+
+    size_t size() const {
+        return text.size();
+    }
+
+    // Function to get the edit distance to other, or any value above bound
+    // as soon as the distance is known to exceed it
+    unsigned distance(std::string_view other, unsigned bound = ~0u) const {
+        const size_t m = text.size();
+        const size_t n = other.size();
+        if ((m > n ? m - n : n - m) > bound) return bound + 1;
+        if (m == 0) return static_cast<unsigned>(n);
+        if (m > MAX_BITS) return tableDistance(other, bound);
+
+        const uint64_t last = uint64_t(1) << (m - 1);
+        uint64_t pv = m == MAX_BITS ? ~uint64_t(0) : (last << 1) - 1;
+        uint64_t mv = 0;
+        unsigned score = static_cast<unsigned>(m);
+        for (size_t j = 0; j < n; ++j) {
+            const uint64_t eq = peq[static_cast<unsigned char>(other[j])];
+            const uint64_t xv = eq | mv;
+            const uint64_t xh = (((eq & pv) + pv) ^ pv) | eq;
+            uint64_t ph = mv | ~(xh | pv);
+            uint64_t mh = pv & xh;
+            if (ph & last) {
+                ++score;
+            } else if (mh & last) {
+                --score;
+            }
+            // Row 0 grows by one per column
+            ph = (ph << 1) | 1;
+            mh <<= 1;
+            pv = mh | ~(xv | ph);
+            mv = ph & xv;
+
+            // Each remaining column lowers the score by at most one
+            if (score > bound + (n - 1 - j)) return bound + 1;
+        }
+        return score;
+    }
+
+private:
+    unsigned tableDistance(std::string_view other, unsigned bound) const {
+        std::vector<unsigned> row(other.size() + 1), next(other.size() + 1);
+        for (size_t j = 0; j <= other.size(); ++j) row[j] = static_cast<unsigned>(j);
+        for (size_t i = 1; i <= text.size(); ++i) {
+            next[0] = static_cast<unsigned>(i);
+            unsigned best = next[0];
+            for (size_t j = 1; j <= other.size(); ++j) {
+                unsigned substitute = row[j - 1] + (text[i - 1] == other[j - 1] ? 0 : 1);
+                next[j] = std::min({row[j] + 1, next[j - 1] + 1, substitute});
+                best = std::min(best, next[j]);
+            }
+            if (best > bound) return bound + 1;
+            row.swap(next);
+        }
+        return row.back();
+    }
+
+    std::string_view text;
+    uint64_t peq[256] = {};
+};
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef ESCAPED_FIELDS_H
+#define ESCAPED_FIELDS_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Field escaping shared by the journal (journal.h) and the server's line
+// protocol (protocol.h).
+//
+// A line is a list of fields separated by '|'. Inside a field '\', '|' and
+// newlines are written as "\\", "\|" and "\n", so a field may hold any
+// character and a line never spans two lines of a file or a socket. Any
+// other escaped character stands for itself, and a lone '\' at the end of
+// a line is kept as is.
+
+// Function to append one escaped field to a line
+inline void appendEscapedField(std::string& line, std::string_view field) {
+    for (char c : field) {
+        if (c == '\\' || c == '|') {
+            line += '\\';
+            line += c;
+        } else if (c == '\n') {
+            line += "\\n";
+        } else {
+            line += c;
+        }
+    }
+}
+
+// Function to append fields to a line, escaped and '|'-separated
+inline void appendEscapedFields(std::string& line, const std::vector<std::string>& fields) {
+    for (size_t i = 0; i < fields.size(); ++i) {
+        if (i > 0) line += '|';
+        appendEscapedField(line, fields[i]);
+    }
+}
+
+// Function to split a line (without its newline) into unescaped fields
+inline void splitEscapedFields(std::string_view line, std::vector<std::string>& fields) {
+    fields.assign(1, std::string());
+    for (size_t i = 0; i < line.size(); ++i) {
+        char c = line[i];
+        if (c == '\\' && i + 1 < line.size()) {
+            char next = line[++i];
+            fields.back() += (next == 'n') ? '\n' : next;
+        } else if (c == '|') {
+            fields.emplace_back();
+        } else {
+            fields.back() += c;
+        }
+    }
+}
+
+#endif
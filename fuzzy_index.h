@@ -0,0 +1,307 @@
+#ifndef FUZZY_INDEX_H
+#define FUZZY_INDEX_H
+
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "edit_distance.h"
+
+// Typo-tolerant word index: the best-matching records for a query whose
+// words may each be misspelled by a few edits.
+//
+// Text is split into words (runs of letters, digits and non-ASCII bytes),
+// folded to lowercase and interned: each distinct word is stored once with a
+// posting list of the ids holding it, sorted by id like TrigramIndex's. The
+// words also form a BK-tree under edit distance: a node's children hang off
+// it by their distance to it, so by the triangle inequality a search within
+// d of a query word only descends into children whose edge is within d of
+// the node's own distance. A probe measures only part of the dictionary,
+// each distance with the bit-parallel kernel of edit_distance.h.
+//
+// A record matches when every query word is within its allowance of some
+// word of the record; its score is the sum of those distances. best() ranks
+// by score, then id. It takes candidates from the query word with the
+// shortest posting lists one distance level at a time, merging that level's
+// lists lazily in id order, and probes the other words' lists by binary
+// search. Since ids only rise within a level, it stops as soon as the k-th
+// best cannot be beaten, so a common word costs about k probes rather than
+// a pass over its postings.
+//
+// Words whose records have all gone stay in the tree with empty lists (a BK-
+// tree cannot drop a node) and are skipped; the next rebuild drops them.
+class FuzzyIndex {
+public:
+    static const unsigned MAX_DISTANCE = 3;
+    static const size_t MIN_WORD = 2; // Shorter words are not indexed
+
+    struct Match {
+        int id;
+        unsigned distance;
+    };
+
+    // Function to get the edits allowed for a query word: none for two
+    // letters, one up to four, then up to maxDistance
+    static unsigned allowance(size_t length, unsigned maxDistance) {
+        unsigned cap = length <= 2 ? 0 : (length <= 4 ? 1 : MAX_DISTANCE);
+        return std::min(cap, maxDistance);
+    }
+
+    // Function to index the text of a record
+    void add(int id, std::string_view text) {
+        for (const std::string& word : wordsOf(text)) {
+            std::vector<int>& list = postings[intern(word)];
+            if (list.empty() || list.back() < id) {
+                list.push_back(id);
+            } else {
+                auto pos = std::lower_bound(list.begin(), list.end(), id);
+                if (pos == list.end() || *pos != id) {
+                    list.insert(pos, id);
+                }
+            }
+        }
+    }
+
+    // Function to unindex a record; text must be what was passed to add()
+    void remove(int id, std::string_view text) {
+        for (const std::string& word : wordsOf(text)) {
+            auto it = termIds.find(word);
+            if (it == termIds.end()) continue;
+            std::vector<int>& list = postings[it->second];
+            auto pos = std::lower_bound(list.begin(), list.end(), id);
+            if (pos != list.end() && *pos == id) {
+                list.erase(pos);
+            }
+        }
+    }
+
+    // Function to drop every word
+    void clear() {
+        termIds.clear();
+        terms.clear();
+        postings.clear();
+        nodes.clear();
+    }
+
+    size_t termCount() const {
+        return terms.size();
+    }
+
+    // Function to collect up to limit records matching query, best first
+    void best(std::string_view query, unsigned maxDistance, size_t limit, std::vector<Match>& out) const {
+        out.clear();
+        std::vector<std::string> words = wordsOf(query);
+        if (words.empty() || limit == 0) return;
+
+        // Each query word's dictionary matches, nearest first
+        std::vector<QueryWord> probes;
+        for (const std::string& word : words) {
+            QueryWord probe;
+            near(word, allowance(word.size(), maxDistance), probe.terms);
+            if (probe.terms.empty()) return;
+            std::stable_sort(probe.terms.begin(), probe.terms.end(),
+                             [](const TermHit& a, const TermHit& b) { return a.distance < b.distance; });
+            for (const TermHit& hit : probe.terms) {
+                probe.cost += postings[hit.term].size();
+            }
+            probes.push_back(std::move(probe));
+        }
+        std::sort(probes.begin(), probes.end(),
+                  [](const QueryWord& a, const QueryWord& b) { return a.cost < b.cost; });
+        const QueryWord& lead = probes[0];
+
+        // The other words add at least their nearest terms' distances
+        unsigned rest = 0;
+        for (size_t w = 1; w < probes.size(); ++w) {
+            rest += probes[w].terms[0].distance;
+        }
+
+        // Kept sorted by (score, id); the last entry is the one to beat
+        auto better = [](const Match& a, const Match& b) {
+            return a.distance != b.distance ? a.distance < b.distance : a.id < b.id;
+        };
+        std::vector<Cursor> heap;
+        for (size_t t = 0, first = 0; t < lead.terms.size(); first = t) {
+            const unsigned distance = lead.terms[t].distance;
+            const unsigned floor = distance + rest; // No record reached here scores less
+            if (out.size() == limit && out.back().distance < floor) break;
+
+            // Merge this level's posting lists lazily, in id order
+            heap.clear();
+            for (; t < lead.terms.size() && lead.terms[t].distance == distance; ++t) {
+                const std::vector<int>& list = postings[lead.terms[t].term];
+                if (!list.empty()) heap.push_back({list.data(), list.data() + list.size()});
+            }
+            std::make_heap(heap.begin(), heap.end());
+            int previous = 0;
+            while (!heap.empty()) {
+                std::pop_heap(heap.begin(), heap.end());
+                Cursor& cursor = heap.back();
+                const int id = *cursor.next;
+                if (++cursor.next == cursor.end) {
+                    heap.pop_back();
+                } else {
+                    std::push_heap(heap.begin(), heap.end());
+                }
+                if (id == previous) continue;
+                previous = id;
+
+                // Ids only rise from here, so once the one to beat scores
+                // no more than any could, nothing else in the level places
+                if (out.size() == limit && out.back().distance <= floor && out.back().id < id) break;
+                if (heldByAny(lead.terms, 0, first, id)) continue; // Reached at a nearer level
+
+                unsigned score = distance;
+                for (size_t w = 1; w < probes.size() && score != NO_MATCH; ++w) {
+                    unsigned nearest = nearestIn(probes[w], id);
+                    score = nearest == NO_MATCH ? NO_MATCH : score + nearest;
+                }
+                if (score == NO_MATCH) continue;
+                Match match{id, score};
+                if (out.size() == limit) {
+                    if (!better(match, out.back())) continue;
+                    out.pop_back();
+                }
+                out.insert(std::upper_bound(out.begin(), out.end(), match, better), match);
+            }
+        }
+    }
+
+private:
+    static const uint32_t NO_CHILD = ~uint32_t(0);
+    static const unsigned NO_MATCH = ~0u;
+
+    // A BK-tree node per term: its first child, and its next sibling with
+    // the distance from their shared parent
+    struct Node {
+        uint32_t firstChild = NO_CHILD;
+        uint32_t nextSibling = NO_CHILD;
+        uint32_t edge = 0;
+    };
+
+    struct TermHit {
+        uint32_t term;
+        unsigned distance;
+    };
+
+    // The unread part of a posting list, ordered for a min-heap on its
+    // next id
+    struct Cursor {
+        const int* next;
+        const int* end;
+
+        bool operator<(const Cursor& other) const {
+            return *next > *other.next;
+        }
+    };
+
+    struct QueryWord {
+        std::vector<TermHit> terms; // Nearest first
+        size_t cost = 0;            // Ids in their posting lists
+    };
+
+    // Function to split text into lowercase words
+    static std::vector<std::string> wordsOf(std::string_view text) {
+        std::vector<std::string> words;
+        std::string word;
+        for (size_t i = 0; i <= text.size(); ++i) {
+            unsigned char c = i < text.size() ? static_cast<unsigned char>(text[i]) : ' ';
+            if ((c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c >= 0x80) {
+                word += static_cast<char>(c);
+            } else if (c >= 'A' && c <= 'Z') {
+                word += static_cast<char>(c + ('a' - 'A'));
+            } else {
+                if (word.size() >= MIN_WORD) words.push_back(word);
+                word.clear();
+            }
+        }
+        std::sort(words.begin(), words.end());
+        words.erase(std::unique(words.begin(), words.end()), words.end());
+        return words;
+    }
+
+    // Function to find a word's term id, adding it to the dictionary and
+    // the tree if it is new
+    uint32_t intern(const std::string& word) {
+        auto it = termIds.find(word);
+        if (it != termIds.end()) return it->second;
+
+        uint32_t id = static_cast<uint32_t>(terms.size());
+        terms.push_back(word);
+        termIds.emplace(terms.back(), id);
+        postings.emplace_back();
+        nodes.emplace_back();
+        if (id == 0) return id;
+
+        EditPattern pattern(word);
+        uint32_t node = 0;
+        for (;;) {
+            uint32_t distance = pattern.distance(terms[node]);
+            uint32_t child = nodes[node].firstChild;
+            while (child != NO_CHILD && nodes[child].edge != distance) {
+                child = nodes[child].nextSibling;
+            }
+            if (child == NO_CHILD) {
+                nodes[id].edge = distance;
+                nodes[id].nextSibling = nodes[node].firstChild;
+                nodes[node].firstChild = id;
+                return id;
+            }
+            node = child;
+        }
+    }
+
+    // Function to collect the terms within limit edits of word that still
+    // have records
+    void near(const std::string& word, unsigned limit, std::vector<TermHit>& out) const {
+        out.clear();
+        if (nodes.empty()) return;
+        EditPattern pattern(word);
+        std::vector<uint32_t> stack{0};
+        while (!stack.empty()) {
+            uint32_t node = stack.back();
+            stack.pop_back();
+            unsigned distance = pattern.distance(terms[node]);
+            if (distance <= limit && !postings[node].empty()) {
+                out.push_back({node, distance});
+            }
+            for (uint32_t child = nodes[node].firstChild; child != NO_CHILD; child = nodes[child].nextSibling) {
+                unsigned edge = nodes[child].edge;
+                if (edge + limit >= distance && edge <= distance + limit) {
+                    stack.push_back(child);
+                }
+            }
+        }
+    }
+
+    // Function to check whether any of terms[begin, end) holds a record
+    bool heldByAny(const std::vector<TermHit>& terms, size_t begin, size_t end, int id) const {
+        for (size_t t = begin; t < end; ++t) {
+            const std::vector<int>& list = postings[terms[t].term];
+            if (std::binary_search(list.begin(), list.end(), id)) return true;
+        }
+        return false;
+    }
+
+    // Function to get the smallest distance of a query word's terms held by
+    // a record, or NO_MATCH
+    unsigned nearestIn(const QueryWord& word, int id) const {
+        for (const TermHit& hit : word.terms) {
+            const std::vector<int>& list = postings[hit.term];
+            if (std::binary_search(list.begin(), list.end(), id)) return hit.distance;
+        }
+        return NO_MATCH;
+    }
+
+    std::unordered_map<std::string_view, uint32_t> termIds; // Views into terms
+    std::deque<std::string> terms;                          // Never moves an element
+    std::vector<std::vector<int>> postings;                 // By term id
+    std::vector<Node> nodes;                                // By term id; term 0 is the root
+};
+
+#endif
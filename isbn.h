@@ -0,0 +1,82 @@
+#ifndef ISBN_H
+#define ISBN_H
+
+#include <algorithm>
+#include <cctype>
+#include <string>
+
+// Function to normalize an ISBN into its index key.
+// Hyphens and spaces are dropped and letters upper-cased; a valid ISBN-10 is
+// converted to its ISBN-13 form (978 prefix, recomputed check digit) so both
+// spellings of the same book collide. Anything else is kept as stripped text.
+inline std::string normalizeIsbn(const std::string& isbn) {
+    std::string key;
+    key.reserve(isbn.size());
+    for (char c : isbn) {
+        if (c == '-' || c == ' ') continue;
+        key += static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+    }
+
+    if (key.size() == 10) {
+        for (int i = 0; i < 9; ++i) {
+            if (!std::isdigit(static_cast<unsigned char>(key[i]))) return key;
+        }
+        if (!std::isdigit(static_cast<unsigned char>(key[9])) && key[9] != 'X') return key;
+        
+        std::string isbn13 = "978" + key.substr(0, 9);
+        int sum = 0;
+        for (int i = 0; i < 12; ++i) {
+            sum += (isbn13[i] - '0') * (i % 2 == 0 ? 1 : 3);
+        }
+        isbn13 += static_cast<char>('0' + (10 - sum % 10) % 10);
+        return isbn13;
+    }
+    return key;
+}
+
+// Function to check whether a normalized key is a complete ISBN-13
+inline bool isFullIsbn(const std::string& key) {
+    return key.size() == 13 &&
+           std::all_of(key.begin(), key.end(), [](char c) {
+               return std::isdigit(static_cast<unsigned char>(c)) != 0;
+           });
+}
+
+// Function to check whether an ISBN-10 or ISBN-13 (hyphens and spaces
+// allowed) has a correct check digit. Text that is not shaped like an ISBN
+// at all (wrong length, letters other than a final X) returns false.
+inline bool isValidIsbn(const std::string& isbn) {
+    std::string digits;
+    for (char c : isbn) {
+        if (c == '-' || c == ' ') continue;
+        digits += static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+    }
+
+    if (digits.size() == 10) {
+        int sum = 0;
+        for (int i = 0; i < 10; ++i) {
+            int value;
+            if (std::isdigit(static_cast<unsigned char>(digits[i]))) {
+                value = digits[i] - '0';
+            } else if (i == 9 && digits[i] == 'X') {
+                value = 10;
+            } else {
+                return false;
+            }
+            sum += value * (10 - i);
+        }
+        return sum % 11 == 0;
+    }
+
+    if (digits.size() == 13) {
+        int sum = 0;
+        for (int i = 0; i < 13; ++i) {
+            if (!std::isdigit(static_cast<unsigned char>(digits[i]))) return false;
+            sum += (digits[i] - '0') * (i % 2 == 0 ? 1 : 3);
+        }
+        return sum % 10 == 0;
+    }
+    return false;
+}
+
+#endif
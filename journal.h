@@ -0,0 +1,435 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "checksum.h"
+#include "escaped_fields.h"
+#include "stats.h"
+
+// Append-only write-ahead journal.
+//
+// Each record is one line: pipe-separated fields (escaped as in
+// escaped_fields.h) followed by "|" and the CRC-32 of everything before it in hex.
+// append() only queues the line and returns its sequence number; a writer
+// thread collects whatever has queued up, writes it with a single write() and
+// fsyncs once for the whole group. sync(seq) waits until that record is on
+// disk, so a caller that syncs before reporting success never acknowledges a
+// change a crash could lose. Appenders that arrive while a group is being
+// written form the next group.
+//
+// If a write or fsync fails, the records in that group and every one queued
+// after it are reported as lost by sync(): the file may now end in a torn
+// record, so nothing more is written until rotate() cuts it off.
+//
+// On startup readAll() returns the records in order and stops at the first
+// line that is incomplete or fails its checksum (a write torn by a crash),
+// cutting the file back to the last good record.
+//
+// A checkpoint calls rotate() at the point its snapshot is taken: the
+// records so far move to "<path>.old" and new ones start an empty file, so
+// the checkpoint can write its tables while appends carry on. Once the
+// tables are on disk, dropRotated() deletes the old records. Until then,
+// readAll() returns both files' records, the old ones first.
+//
+// Bytes, fsyncs and records replayed are counted under the journal's path in
+// the I/O statistics.
+class Journal {
+public:
+    explicit Journal(const std::string& journalPath,
+                     std::chrono::milliseconds window = std::chrono::milliseconds(5),
+                     size_t maxGroupRecords = 512)
+        : path(journalPath), oldPath(journalPath + ".old"), groupWindow(window), groupRecords(maxGroupRecords),
+          io(ioCounters(journalPath)) {}
+
+    ~Journal() {
+        close();
+    }
+
+    Journal(const Journal&) = delete;
+    Journal& operator=(const Journal&) = delete;
+
+    // Function to open the journal for appending and start the writer thread
+    bool open() {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (writer.joinable()) return fd >= 0;
+        if (!openFd()) return false;
+
+        stopping = false;
+        writer = std::thread([this]() { writerLoop(); });
+        return true;
+    }
+
+    // Function to flush everything and stop the writer thread
+    void close() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!writer.joinable()) return;
+            stopping = true;
+        }
+        wake.notify_all();
+        writer.join();
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (fd >= 0) closeFd();
+    }
+
+    // Function to queue one record; returns its sequence number
+    uint64_t append(const std::vector<std::string>& fields) {
+        std::string line = encode(fields);
+        uint64_t seq;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            pending += line;
+            seq = ++appendedSeq;
+            ++recordCount;
+        }
+        wake.notify_all();
+        return seq;
+    }
+
+    // Function to block until record seq is on disk; returns false if it
+    // could not be written (or the journal is not open)
+    bool sync(uint64_t seq) {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (!writer.joinable() || fd < 0) return false;
+        if (durableSeq < seq) {
+            syncRequested = true; // Write now rather than after the group window
+            wake.notify_all();
+            durable.wait(lock, [this, seq]() { return durableSeq >= seq || fd < 0; });
+        }
+        return durableSeq >= seq && seq > lostSeq;
+    }
+
+    // Function to set aside every record appended so far, once a checkpoint
+    // has captured the state they lead to. They are made durable and moved
+    // to the old file (added to its end if an unfinished checkpoint left
+    // one), and the journal carries on empty. Returns false if they could
+    // not be moved; they then stay in the journal.
+    //
+    // Records that could not be written are reported lost to their waiters
+    // (the checkpoint's snapshot still holds their changes), and a torn
+    // write is cut off so the journal can be written again.
+    bool rotate() {
+        std::unique_lock<std::mutex> lock(mutex);
+        durable.wait(lock, [this]() { return !writing; });
+        if (!pending.empty()) {
+            // The writer thread waits for the lock meanwhile
+            if (fd >= 0 && !failed && writeAll(pending)) {
+                fileSize += static_cast<std::streamoff>(pending.size());
+            } else {
+                lostSeq = appendedSeq;
+                failed = fd >= 0;
+            }
+        }
+        pending.clear();
+        durableSeq = appendedSeq;
+        durable.notify_all();
+        if (failed && truncateFd(fileSize)) {
+            failed = false;
+        }
+
+        bool reopen = fd >= 0;
+        bool moved;
+        if (std::ifstream(oldPath).is_open()) {
+            moved = appendTo(oldPath);
+            if (moved) {
+                if (fd >= 0) {
+                    failed = !truncateFd(0);
+                } else {
+                    truncatePath(0);
+                }
+            }
+        } else {
+            if (reopen) closeFd();
+            moved = std::rename(path.c_str(), oldPath.c_str()) == 0 || !std::ifstream(path).is_open();
+            syncDirectory();
+            if (reopen) openFd();
+            if (moved) failed = false;
+        }
+        if (moved) recordCount = 0;
+        return moved;
+    }
+
+    // Function to delete the records set aside by rotate() once the
+    // checkpoint that captured them is on disk
+    void dropRotated() {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::remove(oldPath.c_str());
+    }
+
+    // Function to get the number of records since the last rotate()
+    size_t records() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return recordCount;
+    }
+
+    // Function to read every intact record, dropping a torn tail: the
+    // records set aside by a rotate() not yet dropped, then the journal's
+    std::vector<std::vector<std::string>> readAll() {
+        std::vector<std::vector<std::string>> records;
+        std::streamoff goodBytes = 0;
+        if (readFile(oldPath, records, goodBytes)) {
+            truncatePath(oldPath, goodBytes);
+        }
+        if (readFile(path, records, goodBytes)) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (fd >= 0) {
+                truncateFd(goodBytes);
+                fileSize = goodBytes;
+            } else {
+                truncatePath(goodBytes);
+            }
+        }
+        io.parsed(records.size());
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            recordCount = records.size();
+        }
+        return records;
+    }
+
+    // Function to encode fields as one checksummed journal line
+    static std::string encode(const std::vector<std::string>& fields) {
+        std::string payload;
+        appendEscapedFields(payload, fields);
+
+        char crc[16];
+        std::snprintf(crc, sizeof(crc), "|%08x\n", crc32(payload.data(), payload.size()));
+        return payload + crc;
+    }
+
+    // Function to verify and split one journal line (without its newline)
+    static bool decode(const std::string& line, std::vector<std::string>& fields) {
+        size_t bar = line.rfind('|');
+        if (bar == std::string::npos || line.size() - bar != 9) return false;
+
+        unsigned long stored = std::strtoul(line.c_str() + bar + 1, nullptr, 16);
+        if (crc32(line.data(), bar) != static_cast<uint32_t>(stored)) return false;
+
+        splitEscapedFields(std::string_view(line.data(), bar), fields);
+        return true;
+    }
+
+private:
+    // Function to add a file's intact records to records. Returns true if it
+    // ends in a torn record, setting goodBytes to the length before it.
+    bool readFile(const std::string& file, std::vector<std::vector<std::string>>& records,
+                  std::streamoff& goodBytes) {
+        std::ifstream in(file, std::ios::binary);
+        goodBytes = 0;
+        if (!in.is_open()) return false;
+        std::string line;
+        while (std::getline(in, line)) {
+            io.read(line.size() + (in.eof() ? 0 : 1));
+            std::vector<std::string> fields;
+            if (in.eof() || !decode(line, fields)) {
+                return true; // No newline (partial write) or bad checksum
+            }
+            records.push_back(fields);
+            goodBytes += static_cast<std::streamoff>(line.size()) + 1;
+        }
+        return false;
+    }
+
+    // Function to copy the journal file onto the end of another and make
+    // the copy durable (called with the lock held and nothing queued)
+    bool appendTo(const std::string& target) {
+        std::ifstream in(path, std::ios::binary);
+        std::string contents;
+        if (in.is_open()) {
+            contents.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        }
+        if (fd >= 0 && static_cast<std::streamoff>(contents.size()) > fileSize) {
+            contents.resize(static_cast<size_t>(fileSize)); // Leave a torn write behind
+        }
+        std::FILE* out = std::fopen(target.c_str(), "ab");
+        if (out == nullptr) return false;
+        bool ok = std::fwrite(contents.data(), 1, contents.size(), out) == contents.size() && std::fflush(out) == 0;
+#ifdef _WIN32
+        ::_commit(::_fileno(out));
+#else
+        ::fsync(::fileno(out));
+#endif
+        io.wrote(contents.size());
+        io.synced();
+        return std::fclose(out) == 0 && ok;
+    }
+
+    void writerLoop() {
+        std::unique_lock<std::mutex> lock(mutex);
+        for (;;) {
+            wake.wait(lock, [this]() { return stopping || !pending.empty(); });
+            if (pending.empty() && stopping) return;
+
+            // Give concurrent writers one window to join this group
+            if (!stopping && !syncRequested) {
+                wake.wait_for(lock, groupWindow, [this]() {
+                    return stopping || syncRequested || appendedSeq - durableSeq >= groupRecords;
+                });
+            }
+
+            std::string batch;
+            batch.swap(pending);
+            uint64_t batchSeq = appendedSeq;
+            syncRequested = false;
+            if (failed) {
+                // The file may end in a torn record; wait for rotate()
+                lostSeq = batchSeq;
+                durableSeq = batchSeq;
+                durable.notify_all();
+                continue;
+            }
+            writing = true;
+
+            lock.unlock();
+            bool written = writeAll(batch);
+            lock.lock();
+
+            writing = false;
+            if (written) {
+                fileSize += static_cast<std::streamoff>(batch.size());
+            } else {
+                failed = true;
+                lostSeq = batchSeq;
+            }
+            if (batchSeq > durableSeq) durableSeq = batchSeq;
+            durable.notify_all();
+        }
+    }
+
+    // Called by the writer thread without the lock held, or by rotate()
+    // with it held while the writer is idle; returns false if the batch is
+    // not all on disk
+    bool writeAll(const std::string& batch) {
+        const char* data = batch.data();
+        size_t left = batch.size();
+        while (left > 0) {
+#ifdef _WIN32
+            int written = ::_write(fd, data, static_cast<unsigned>(left));
+#else
+            ssize_t written = ::write(fd, data, left);
+            if (written < 0 && errno == EINTR) continue;
+#endif
+            if (written <= 0) return false;
+            io.wrote(static_cast<uint64_t>(written));
+            data += written;
+            left -= static_cast<size_t>(written);
+        }
+#ifdef _WIN32
+        bool synced = ::_commit(fd) == 0;
+#else
+        bool synced = ::fsync(fd) == 0;
+#endif
+        io.synced();
+        return synced;
+    }
+
+    bool truncateFd(std::streamoff size) {
+#ifdef _WIN32
+        bool cut = ::_chsize_s(fd, size) == 0 && ::_commit(fd) == 0;
+        io.synced();
+#else
+        bool cut = ::ftruncate(fd, static_cast<off_t>(size)) == 0 && ::fsync(fd) == 0;
+        io.synced();
+#endif
+        if (cut) fileSize = size;
+        return cut;
+    }
+
+    void truncatePath(std::streamoff size) {
+        truncatePath(path, size);
+    }
+
+    static void truncatePath(const std::string& file, std::streamoff size) {
+#ifdef _WIN32
+        int tmp = ::_open(file.c_str(), _O_WRONLY | _O_BINARY);
+        if (tmp >= 0) {
+            ::_chsize_s(tmp, size);
+            ::_close(tmp);
+        }
+#else
+        if (::truncate(file.c_str(), static_cast<off_t>(size)) != 0) {
+            std::perror(file.c_str());
+        }
+#endif
+    }
+
+    bool openFd() {
+#ifdef _WIN32
+        fd = ::_open(path.c_str(), _O_WRONLY | _O_CREAT | _O_APPEND | _O_BINARY, 0644);
+        if (fd >= 0) fileSize = ::_lseeki64(fd, 0, SEEK_END);
+#else
+        fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+        if (fd >= 0) fileSize = ::lseek(fd, 0, SEEK_END);
+#endif
+        return fd >= 0;
+    }
+
+    // Function to make a rename in the journal's directory durable
+    void syncDirectory() {
+#ifndef _WIN32
+        size_t slash = path.find_last_of('/');
+        std::string dir = (slash == std::string::npos) ? "." : path.substr(0, slash + 1);
+        int dirFd = ::open(dir.c_str(), O_RDONLY);
+        if (dirFd >= 0) {
+            ::fsync(dirFd);
+            io.synced();
+            ::close(dirFd);
+        }
+#endif
+    }
+
+    void closeFd() {
+#ifdef _WIN32
+        ::_close(fd);
+#else
+        ::close(fd);
+#endif
+        fd = -1;
+    }
+
+    std::string path;
+    std::string oldPath; // Records set aside by rotate()
+    std::chrono::milliseconds groupWindow;
+    size_t groupRecords;
+    IoCounters& io;
+
+    mutable std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable durable;
+    std::thread writer;
+    std::string pending;
+    uint64_t appendedSeq = 0;
+    uint64_t durableSeq = 0;
+    uint64_t lostSeq = 0;        // Records up to this one could not be written
+    std::streamoff fileSize = 0; // Bytes of whole records in the file
+    bool failed = false;         // A write failed; nothing more until rotate()
+    size_t recordCount = 0;
+    bool syncRequested = false;
+    bool writing = false;
+    bool stopping = false;
+    int fd = -1;
+};
+
+#endif
@@ -0,0 +1,2088 @@
+#include "library.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#include "atomic_file.h"
+#include "civil_date.h"
+#include "coarse_clock.h"
+#include "isbn.h"
+#include "scan_kernel.h"
+#include "snapshot.h"
+#include "stats.h"
+#include "text_loader.h"
+#include "thread_pool.h"
+
+namespace {
+
+const int DELETED_BOOK_ID = CatalogStore::EMPTY_ID;
+
+std::mutex noticeMutex;
+
+// Function to point an id at a slot, growing the index as needed
+void setSlot(SlotIndex& index, int id, size_t slot) {
+    index.growTo(static_cast<size_t>(id) + 1, 0);
+    index.set(id, static_cast<uint32_t>(slot + 1));
+}
+
+// Function to get the key a listing order sorts a book by (the id order
+// needs none)
+std::string_view orderKey(const CatalogView& view, const SlotIndex& slots, BookOrder order, int id) {
+    if (order == BookOrder::Id) return std::string_view();
+    size_t slot = slotOf(slots, id);
+    return order == BookOrder::Title ? view.title(slot) : view.author(slot);
+}
+
+// Function to count the bytes a text file writer has written, before it is
+// closed
+void countWritten(const std::string& path, std::ofstream& file) {
+    std::streamoff written = file.tellp();
+    if (written > 0) {
+        ioCounters(path).wrote(static_cast<uint64_t>(written));
+    }
+}
+
+// Formats a text export into a buffer that is handed to an AtomicFileWriter
+// a megabyte at a time, so the old file stays whole until commit()
+class TextExport {
+public:
+    explicit TextExport(const std::string& path) : file(path) {}
+
+    std::ostringstream& out() {
+        return buffer;
+    }
+
+    // Function to pass the buffer on once it is full
+    void flushIfFull() {
+        if (buffer.tellp() >= static_cast<std::streamoff>(FLUSH_BYTES)) {
+            flush();
+        }
+    }
+
+    // Function to write the rest and swap the new file in
+    bool commit() {
+        flush();
+        return file.commit();
+    }
+
+private:
+    static constexpr size_t FLUSH_BYTES = 1 << 20;
+
+    void flush() {
+        file.write(buffer.str());
+        buffer.str(std::string());
+    }
+
+    AtomicFileWriter file;
+    std::ostringstream buffer;
+};
+
+// Function to check whether any bit in [begin, end) is set
+bool anyBitSet(const std::vector<uint64_t>& bits, size_t begin, size_t end) {
+    for (size_t i = begin; i < end;) {
+        uint64_t word = bits[i / 64] >> (i % 64);
+        size_t span = std::min<size_t>(64 - i % 64, end - i);
+        if (span < 64) word &= (uint64_t(1) << span) - 1;
+        if (word != 0) return true;
+        i += span;
+    }
+    return false;
+}
+
+} // namespace
+
+// Function to print a one-line notice (safe from any thread)
+void printNotice(const std::string& notice) {
+    std::lock_guard<std::mutex> lock(noticeMutex);
+    std::cout << notice << std::endl;
+}
+
+// Function to view the book in a snapshot slot
+Book LibrarySnapshot::bookAt(size_t slot) const {
+    return Book(books.id(slot), books.title(slot), books.author(slot), books.isbn(slot), books.available(slot));
+}
+
+// Function to find a book by ID
+std::optional<Book> LibrarySnapshot::findBook(int id) const {
+    size_t slot = slotOf(bookSlots, id);
+    return slot == NO_SLOT ? std::nullopt : std::optional<Book>(bookAt(slot));
+}
+
+// Function to find a student by ID (nullptr if not found)
+const Student* LibrarySnapshot::findStudent(int id) const {
+    size_t slot = slotOf(studentSlots, id);
+    return slot == NO_SLOT ? nullptr : &students[slot];
+}
+
+// Function to visit every book in catalog order
+void LibrarySnapshot::forEachBook(const std::function<void(const Book&)>& visit) const {
+    for (size_t slot = 0; slot < books.size(); ++slot) {
+        if (books.id(slot) != DELETED_BOOK_ID) {
+            visit(bookAt(slot));
+        }
+    }
+}
+
+// Function to visit every student in registration order
+void LibrarySnapshot::forEachStudent(const std::function<void(const Student&)>& visit) const {
+    for (size_t i = 0; i < students.size(); ++i) {
+        visit(students[i]);
+    }
+}
+
+// Function to list the books a student has out, by book ID
+LibraryStatus LibrarySnapshot::studentLoans(int studentId, std::string& name, std::vector<LoanRow>& rows) const {
+    rows.clear();
+    const Student* student = findStudent(studentId);
+    if (student == nullptr) {
+        return LibraryStatus::StudentNotFound;
+    }
+    name = student->name;
+
+    for (int bookId : student->books) {
+        LoanRow row{bookId, 0, std::nullopt};
+        size_t slot = slotOf(bookSlots, bookId);
+        if (slot != NO_SLOT) {
+            row.transactionId = books.loan(slot).transactionId;
+            row.bookTitle = std::string(books.title(slot));
+        }
+        rows.push_back(std::move(row));
+    }
+    return LibraryStatus::Ok;
+}
+
+// Function to get how many times a book has been borrowed
+uint32_t LibrarySnapshot::bookBorrows(int bookId) const {
+    return bookId > 0 && static_cast<size_t>(bookId) < bookBorrowCounts.size() ? bookBorrowCounts[bookId] : 0;
+}
+
+// Function to get how many books a student has borrowed
+uint32_t LibrarySnapshot::studentBorrows(int studentId) const {
+    return studentId > 0 && static_cast<size_t>(studentId) < studentBorrowCounts.size()
+               ? studentBorrowCounts[studentId]
+               : 0;
+}
+
+// Function to get the next page of books never borrowed, by ID after
+// afterId. Returns whether there may be more.
+bool LibrarySnapshot::neverBorrowedPage(int afterId, size_t pageSize, std::vector<Book>& page) const {
+    page.clear();
+    for (int id = std::max(afterId, 0) + 1; id < nextBookId; ++id) {
+        size_t slot = slotOf(bookSlots, id);
+        if (slot == NO_SLOT || bookBorrows(id) != 0) continue;
+        if (page.size() == pageSize) return true;
+        page.push_back(bookAt(slot));
+    }
+    return false;
+}
+
+// Function to get the next page of students, by ID after afterId. Returns
+// whether there may be more.
+bool LibrarySnapshot::studentPage(int afterId, size_t pageSize, std::vector<Student>& page) const {
+    page.clear();
+    for (int id = std::max(afterId, 0) + 1; id < nextStudentId; ++id) {
+        const Student* student = findStudent(id);
+        if (student == nullptr) continue;
+        if (page.size() == pageSize) return true;
+        page.push_back(*student);
+    }
+    return false;
+}
+
+Library::Library()
+    : transactionHistory("history"), journal("journal.log"), operationLog("operations", "operation_history.txt") {}
+
+Library::~Library() {
+    stopCheckpointer();
+}
+
+// Function to choose the history segment length for an archive that does not
+// exist yet
+void Library::setSegmentMonths(int months) {
+    std::lock_guard<std::mutex> lock(commitMutex);
+    transactionHistory.setSpanMonths(months);
+}
+
+// Function to set how often changes are checkpointed: every seconds, and as
+// soon as changes journal records have built up
+void Library::setCheckpointPolicy(int seconds, size_t changes) {
+    std::lock_guard<std::mutex> lock(checkpointerMutex);
+    checkpointInterval = std::chrono::seconds(seconds);
+    checkpointChanges = changes;
+}
+
+// Function to log an operation
+void Library::logOperation(const std::string& operation) {
+    operationLog.log(coarseClock().timestamp() + ": " + operation);
+}
+
+// Function to get the last count operations logged, oldest first
+void Library::recentOperations(size_t count, std::vector<std::string>& entries) {
+    StatTimer timer(StatOp::Operations);
+    operationLog.last(count, entries);
+}
+
+// Function to get up to limit operations logged between two times
+// (inclusive), oldest first, skipping the first skip; returns whether more
+// fall in the range
+bool Library::operationsBetween(int64_t from, int64_t to, size_t skip, size_t limit,
+                                std::vector<std::string>& entries) {
+    StatTimer timer(StatOp::Operations);
+    return operationLog.between(from, to, skip, limit, entries);
+}
+
+// Function to get a view of the library as of the latest commit. The last
+// snapshot handed out is reused while it is current and still held by
+// someone. It is not kept alive otherwise, because every chunk a live
+// snapshot shares must be copied on the next write to it.
+std::shared_ptr<const LibrarySnapshot> Library::snapshot() const {
+    std::lock_guard<std::mutex> lock(commitMutex);
+    return snapshotLocked();
+}
+
+// Function to get the latest snapshot with commitMutex already held
+std::shared_ptr<const LibrarySnapshot> Library::snapshotLocked() const {
+    std::shared_ptr<const LibrarySnapshot> current = published.lock();
+    if (current && current->commit == commitCount) {
+        return current;
+    }
+
+    auto view = std::make_shared<LibrarySnapshot>();
+    view->books = books.snapshot();
+    view->bookSlots = bookSlots;
+    view->students = students;
+    view->studentSlots = studentSlots;
+    view->bookBorrowCounts = circulation.bookCounts();
+    view->studentBorrowCounts = circulation.studentCounts();
+    view->liveBooks = liveBooks;
+    view->nextBookId = nextBookId;
+    view->nextStudentId = nextStudentId;
+    view->nextTransactionId = nextTransactionId;
+    view->commit = commitCount;
+    published = view;
+    return view;
+}
+
+// Function to rebuild the ISBN index from scratch (first book wins on
+// duplicates that predate the index)
+void Library::rebuildIsbnIndex() {
+    isbnIndex.clear();
+    isbnIndex.reserve(books.size());
+    for (size_t slot = 0; slot < books.size(); ++slot) {
+        if (books.id(slot) != DELETED_BOOK_ID) {
+            isbnIndex.emplace(normalizeIsbn(std::string(books.isbn(slot))), books.id(slot));
+        }
+    }
+}
+
+// Function to check if an ISBN is taken by a book other than excludeId
+bool Library::isbnExists(const std::string& isbn, int excludeId) const {
+    auto it = isbnIndex.find(normalizeIsbn(isbn));
+    return it != isbnIndex.end() && it->second != excludeId;
+}
+
+// Function to drop a book's ISBN key, if that key points at the book
+void Library::unindexIsbn(const std::string& isbn, int id) {
+    auto it = isbnIndex.find(normalizeIsbn(isbn));
+    if (it != isbnIndex.end() && it->second == id) {
+        isbnIndex.erase(it);
+    }
+}
+
+// Function to rebuild one trigram index over a book field from scratch
+template <typename Index>
+void Library::rebuildTextIndex(Index& index, BookField field) {
+    index.clear();
+    for (size_t slot = 0; slot < books.size(); ++slot) {
+        if (books.id(slot) != DELETED_BOOK_ID) {
+            index.add(books.id(slot), books.text(slot, field));
+        }
+    }
+}
+
+// Function to rebuild the book id index from scratch (liveBooks is left
+// alone: it may be read by index rebuilds running alongside)
+void Library::rebuildBookIndex() {
+    bookSlots.clear();
+    for (size_t slot = 0; slot < books.size(); ++slot) {
+        if (books.id(slot) != DELETED_BOOK_ID) {
+            setSlot(bookSlots, books.id(slot), slot);
+        }
+    }
+}
+
+// Function to rebuild the student id index from scratch
+void Library::rebuildStudentIndex() {
+    studentSlots.clear();
+    for (size_t i = 0; i < students.size(); ++i) {
+        setSlot(studentSlots, students[i].id, i);
+    }
+}
+
+// Function to view the book in a catalog slot
+Book Library::bookAt(size_t slot) const {
+    return Book(books.id(slot), books.title(slot), books.author(slot), books.isbn(slot), books.available(slot));
+}
+
+// Function to find a book's catalog slot by ID (NO_SLOT if not found)
+size_t Library::findBookSlot(int id) const {
+    return slotOf(bookSlots, id);
+}
+
+// Function to find a student's slot by ID (NO_SLOT if not found)
+size_t Library::findStudentSlot(int id) const {
+    return slotOf(studentSlots, id);
+}
+
+// Function to get the ordered index behind a listing order
+OrderedIndex& Library::orderIndex(BookOrder order) {
+    return order == BookOrder::Title ? titleOrder : order == BookOrder::Author ? authorOrder : idOrder;
+}
+
+const OrderedIndex& Library::orderIndex(BookOrder order) const {
+    return order == BookOrder::Title ? titleOrder : order == BookOrder::Author ? authorOrder : idOrder;
+}
+
+// Function to rebuild one ordered index from scratch over live books
+void Library::rebuildOrderIndex(BookOrder order, size_t live) {
+    std::vector<std::pair<int, std::string_view>> records;
+    records.reserve(live);
+    for (size_t slot = 0; slot < books.size(); ++slot) {
+        int id = books.id(slot);
+        if (id != DELETED_BOOK_ID) {
+            records.emplace_back(id, order == BookOrder::Id ? std::string_view()
+                                     : order == BookOrder::Title ? books.title(slot) : books.author(slot));
+        }
+    }
+    orderIndex(order).build(records);
+}
+
+// Function to add the book in a slot of a catalog view to one ordered index.
+// bookSlots must map the view's ids to its slots.
+void Library::orderBook(const CatalogView& view, BookOrder order, size_t slot) {
+    int id = view.id(slot);
+    orderIndex(order).insert(id, orderKey(view, bookSlots, order, id), [this, &view, order](int other) {
+        return orderKey(view, bookSlots, order, other);
+    });
+}
+
+// Function to drop the book in a catalog slot from one ordered index, before
+// its key changes or it is erased
+void Library::unorderBook(BookOrder order, size_t slot) {
+    int id = books.id(slot);
+    orderIndex(order).erase(id, orderKey(books, bookSlots, order, id), [this, order](int other) {
+        return orderKey(books, bookSlots, order, other);
+    });
+}
+
+// Function to rebuild every book index after a bulk load. The live count
+// is taken first, on this thread; after that the indexes do not share any
+// state that is written, so they are built concurrently.
+void Library::rebuildBookIndexes() {
+    size_t live = 0;
+    for (size_t slot = 0; slot < books.size(); ++slot) {
+        if (books.id(slot) != DELETED_BOOK_ID) ++live;
+    }
+    liveBooks = live;
+
+    sharedPool().parallelFor(9, 1, [this, live](size_t, size_t begin, size_t end) {
+        for (size_t task = begin; task < end; ++task) {
+            if (task == 0) {
+                rebuildBookIndex();
+            } else if (task == 1) {
+                rebuildIsbnIndex();
+            } else if (task == 2) {
+                rebuildTextIndex(titleGrams, BookField::Title);
+            } else if (task == 3) {
+                rebuildTextIndex(authorGrams, BookField::Author);
+            } else if (task == 4) {
+                rebuildTextIndex(titleWords, BookField::Title);
+            } else if (task == 5) {
+                rebuildTextIndex(authorWords, BookField::Author);
+            } else {
+                rebuildOrderIndex(static_cast<BookOrder>(task - 6), live);
+            }
+        }
+    });
+}
+
+// Function to add the books from slot first onwards of a catalog view to the
+// trigram, word, prefix and ordered indexes, all at once. Working from a view
+// lets this run without the commit lock, so circulation carries on meanwhile.
+void Library::indexNewBooks(const CatalogView& view, size_t first) {
+    sharedPool().parallelFor(9, 1, [this, &view, first](size_t, size_t begin, size_t end) {
+        for (size_t task = begin; task < end; ++task) {
+            for (size_t i = first; i < view.size(); ++i) {
+                if (task == 0) {
+                    titleGrams.add(view.id(i), view.title(i));
+                } else if (task == 1) {
+                    authorGrams.add(view.id(i), view.author(i));
+                } else if (task == 2) {
+                    titleWords.add(view.id(i), view.title(i));
+                } else if (task == 3) {
+                    authorWords.add(view.id(i), view.author(i));
+                } else if (task == 4) {
+                    titleCompletions.add(view.id(i), view.title(i));
+                } else if (task == 5) {
+                    authorCompletions.add(view.id(i), view.author(i));
+                } else {
+                    orderBook(view, static_cast<BookOrder>(task - 6), i);
+                }
+            }
+        }
+    });
+}
+
+// Function to append a book and index it
+void Library::insertBook(const Book& book) {
+    setSlot(bookSlots, book.id, books.append(book.id, book.title, book.author, book.isbn, book.available));
+    ++liveBooks;
+    isbnIndex.emplace(normalizeIsbn(std::string(book.isbn)), book.id);
+    titleGrams.add(book.id, book.title);
+    authorGrams.add(book.id, book.author);
+    titleWords.add(book.id, book.title);
+    authorWords.add(book.id, book.author);
+    titleCompletions.add(book.id, book.title);
+    authorCompletions.add(book.id, book.author);
+    dirtyTables |= DIRTY_BOOKS | DIRTY_COMPLETIONS;
+    for (BookOrder order : {BookOrder::Id, BookOrder::Title, BookOrder::Author}) {
+        orderBook(books, order, books.size() - 1);
+    }
+}
+
+// Function to change the title in a catalog slot and re-index it
+void Library::setBookTitle(size_t slot, const std::string& title) {
+    titleGrams.remove(books.id(slot), books.title(slot));
+    titleWords.remove(books.id(slot), books.title(slot));
+    unorderBook(BookOrder::Title, slot);
+    books.setTitle(slot, title);
+    titleGrams.add(books.id(slot), title);
+    titleWords.add(books.id(slot), title);
+    titleCompletions.add(books.id(slot), title);
+    orderBook(books, BookOrder::Title, slot);
+    dirtyTables |= DIRTY_BOOKS | DIRTY_COMPLETIONS;
+}
+
+// Function to change the author in a catalog slot and re-index it
+void Library::setBookAuthor(size_t slot, const std::string& author) {
+    authorGrams.remove(books.id(slot), books.author(slot));
+    authorWords.remove(books.id(slot), books.author(slot));
+    unorderBook(BookOrder::Author, slot);
+    books.setAuthor(slot, author);
+    authorGrams.add(books.id(slot), author);
+    authorWords.add(books.id(slot), author);
+    authorCompletions.add(books.id(slot), author);
+    orderBook(books, BookOrder::Author, slot);
+    dirtyTables |= DIRTY_BOOKS | DIRTY_COMPLETIONS;
+}
+
+// Function to change the ISBN in a catalog slot and re-key the ISBN index
+void Library::setBookIsbn(size_t slot, const std::string& isbn) {
+    unindexIsbn(std::string(books.isbn(slot)), books.id(slot));
+    books.setIsbn(slot, isbn);
+    isbnIndex.emplace(normalizeIsbn(isbn), books.id(slot));
+    dirtyTables |= DIRTY_BOOKS;
+}
+
+// Function to append a student and index it
+void Library::insertStudent(const Student& student) {
+    setSlot(studentSlots, student.id, students.size());
+    students.push_back(student);
+    dirtyTables |= DIRTY_STUDENTS;
+}
+
+// Function to drop tombstoned slots and re-point the index
+void Library::compactBooks() {
+    books.compact();
+    bookTombstones = 0;
+    rebuildBookIndex();
+}
+
+// Function to compact the catalog once tombstones are half of its slots or
+// dead text is half of its arena. Amortized O(1): compaction is O(n) but
+// only runs after that many deletes or bytes of edits.
+void Library::compactBooksIfWasteful() {
+    if (bookTombstones * 2 > books.size() || books.deadTextBytes() * 2 > books.textEnd()) {
+        compactBooks();
+    }
+}
+
+// Function to make sure a book's text (textBytes of title, author and ISBN)
+// fits in the catalog arena, compacting first if dead text is in the way
+bool Library::makeRoomForBook(size_t textBytes) {
+    if (!books.hasRoom(textBytes) && books.deadTextBytes() > 0) {
+        compactBooks();
+    }
+    return books.hasRoom(textBytes);
+}
+
+// Function to remove a book by ID without shifting the other slots
+bool Library::removeBook(int id) {
+    size_t slot = findBookSlot(id);
+    if (slot == NO_SLOT) {
+        return false;
+    }
+
+    unindexIsbn(std::string(books.isbn(slot)), id);
+    titleGrams.remove(id, books.title(slot));
+    authorGrams.remove(id, books.author(slot));
+    titleWords.remove(id, books.title(slot));
+    authorWords.remove(id, books.author(slot));
+    titleCompletions.remove(id);
+    authorCompletions.remove(id);
+    circulation.bookRemoved(id);
+    for (BookOrder order : {BookOrder::Id, BookOrder::Title, BookOrder::Author}) {
+        unorderBook(order, slot);
+    }
+    books.erase(slot);
+    bookSlots.set(id, 0);
+    --liveBooks;
+    dirtyTables |= DIRTY_BOOKS | DIRTY_COMPLETIONS | DIRTY_CIRCULATION;
+
+    ++bookTombstones;
+    compactBooksIfWasteful();
+    return true;
+}
+
+// Function to record a new open loan (ignored for a book that has since been
+// deleted, as history replayed on load may hold such loans)
+void Library::openLoan(int bookId, int transactionId, int studentId) {
+    size_t slot = findBookSlot(bookId);
+    if (slot == NO_SLOT) return;
+    books.setLoan(slot, Loan{transactionId, studentId});
+
+    size_t owner = findStudentSlot(studentId);
+    if (owner != NO_SLOT) {
+        std::vector<int>& out = students.mutate(owner).books;
+        auto at = std::lower_bound(out.begin(), out.end(), bookId);
+        if (at == out.end() || *at != bookId) {
+            out.insert(at, bookId);
+        }
+    }
+}
+
+// Function to close the open loan on a book (false if there is none)
+bool Library::closeLoan(int bookId) {
+    size_t slot = findBookSlot(bookId);
+    if (slot == NO_SLOT || books.loan(slot).transactionId == 0) {
+        return false;
+    }
+    int studentId = books.loan(slot).studentId;
+    books.setLoan(slot, Loan{0, 0});
+
+    size_t owner = findStudentSlot(studentId);
+    if (owner != NO_SLOT) {
+        std::vector<int>& out = students.mutate(owner).books;
+        auto at = std::lower_bound(out.begin(), out.end(), bookId);
+        if (at != out.end() && *at == bookId) {
+            out.erase(at);
+        }
+    }
+    return true;
+}
+
+// Function to rebuild the open loans of freshly loaded books and students:
+// the loans the archive had open when its current segment began, then the
+// current segment replayed on top. A book on loan is then marked out even if
+// books.bin says otherwise: a checkpoint saves history/ before books.bin, so
+// after a crash or a failed write in between, books.bin is the older one.
+void Library::rebuildLoanIndex() {
+    for (const auto& borrow : transactionHistory.openBorrows()) {
+        openLoan(borrow.bookId, borrow.id, borrow.studentId);
+    }
+    for (const auto& transaction : transactionHistory.current()) {
+        if (transaction.type == TransactionType::Borrow) {
+            closeLoan(transaction.bookId); // A borrow supersedes any unmatched one
+            openLoan(transaction.bookId, transaction.id, transaction.studentId);
+        } else {
+            closeLoan(transaction.bookId);
+        }
+    }
+    for (size_t slot = 0; slot < books.size(); ++slot) {
+        if (books.id(slot) != DELETED_BOOK_ID && books.available(slot) && books.loan(slot).transactionId != 0) {
+            books.setAvailable(slot, false);
+            dirtyTables |= DIRTY_BOOKS;
+        }
+    }
+}
+
+// Function to save books to file (replacing it atomically)
+void Library::saveBooksToFile(const LibrarySnapshot& view) {
+    TextExport file("books.txt");
+    file.out() << view.nextBookId << "\n"; // Save next ID
+    view.forEachBook([&file](const Book& book) {
+        file.out() << book.id << "|" << book.title << "|" << book.author << "|"
+                   << book.isbn << "|" << book.available << "\n";
+        file.flushIfFull();
+    });
+    if (file.commit()) {
+        logOperation("Books saved to file");
+    } else {
+        printNotice("Unable to write books.txt; the previous file is unchanged.");
+    }
+}
+
+// Function to report and log the outcome of a text table load
+void Library::reportTextLoad(const std::string& path, const std::string& table, const LoadReport& report) {
+    ioCounters(path).parsed(report.rows);
+    std::string summary = table + " loaded from file";
+    if (report.malformed > 0) {
+        summary += " (" + std::to_string(report.malformed) + " malformed line(s) skipped)";
+        for (const auto& sample : report.samples) {
+            printNotice(path + ": " + sample);
+        }
+        printNotice(path + ": " + std::to_string(report.malformed) + " malformed line(s) skipped.");
+    }
+    logOperation(summary);
+}
+
+// Function to load books from file. Rows are parsed in parallel as views
+// into the mapped file and then copied into the catalog in one pass.
+void Library::loadBooksFromFile() {
+    MappedFile file;
+    if (!file.open("books.txt")) return;
+
+    LoadReport report;
+    std::vector<Book> rows;
+    loadTextTable(file, nextBookId, rows,
+        [](std::string_view line, std::vector<Book>& rows, std::string& error) {
+            std::string_view fields[5];
+            int id;
+            if (splitFields(line, '|', fields, 5) < 5) {
+                error = "expected id|title|author|isbn|available";
+                return false;
+            }
+            if (!parseInt(fields[0], id) || id <= 0) {
+                error = "bad book id '" + std::string(fields[0]) + "'";
+                return false;
+            }
+            if (fields[4] != "0" && fields[4] != "1") {
+                error = "availability must be 0 or 1";
+                return false;
+            }
+            rows.emplace_back(id, fields[1], fields[2], fields[3], fields[4] == "1");
+            return true;
+        }, report);
+
+    books.clear();
+    books.reserve(rows.size());
+    for (const auto& row : rows) {
+        if (!books.hasRoom(row.title.size() + row.author.size() + row.isbn.size())) {
+            printNotice("books.txt: catalog text passes 4 GB; books from ID " + std::to_string(row.id) +
+                        " on were not loaded.");
+            break;
+        }
+        books.append(row.id, row.title, row.author, row.isbn, row.available);
+    }
+    bookTombstones = 0;
+    catalogCrcKnown = false;
+    rebuildBookIndexes();
+    reportTextLoad("books.txt", "Books", report);
+}
+
+// Function to save students to file (replacing it atomically)
+void Library::saveStudentsToFile(const LibrarySnapshot& view) {
+    TextExport file("students.txt");
+    file.out() << view.nextStudentId << "\n"; // Save next ID
+    view.forEachStudent([&file](const Student& student) {
+        file.out() << student.id << "|" << student.name << "\n";
+        file.flushIfFull();
+    });
+    if (file.commit()) {
+        logOperation("Students saved to file");
+    } else {
+        printNotice("Unable to write students.txt; the previous file is unchanged.");
+    }
+}
+
+// Function to load students from file
+void Library::loadStudentsFromFile() {
+    LoadReport report;
+    std::vector<Student> rows;
+    bool found = loadTextTable("students.txt", nextStudentId, rows,
+        [](std::string_view line, std::vector<Student>& rows, std::string& error) {
+            size_t bar = line.find('|');
+            int id;
+            if (bar == std::string_view::npos) {
+                error = "expected id|name";
+                return false;
+            }
+            if (!parseInt(line.substr(0, bar), id) || id <= 0) {
+                error = "bad student id '" + std::string(line.substr(0, bar)) + "'";
+                return false;
+            }
+            rows.emplace_back(id, std::string(line.substr(bar + 1)));
+            return true;
+        }, report);
+    if (!found) return;
+
+    students.clear();
+    students.reserve(rows.size());
+    for (auto& row : rows) {
+        students.push_back(std::move(row));
+    }
+    rebuildStudentIndex();
+    reportTextLoad("students.txt", "Students", report);
+}
+
+// Function to save transactions to file: every segment of the archive, in id
+// order, up to where the snapshot stops, replacing the file atomically. The
+// archive is only locked while each segment is fetched, so circulation
+// carries on meanwhile.
+void Library::saveTransactionsToFile(const LibrarySnapshot& view) {
+    TextExport file("transactions.txt");
+    file.out() << view.nextTransactionId << "\n"; // Save next ID
+    std::string error;
+    std::vector<Transaction> rows;
+    for (size_t segment = 0;; ++segment) {
+        bool read;
+        {
+            std::lock_guard<std::mutex> lock(commitMutex);
+            if (segment >= transactionHistory.segmentCount()) break;
+            read = transactionHistory.rows(segment, rows, error);
+        }
+        if (!read) {
+            printNotice("Skipping unreadable history segment: " + error);
+            continue;
+        }
+        for (const auto& transaction : rows) {
+            if (transaction.id >= view.nextTransactionId) break;
+            file.out() << transaction.id << "|" << transaction.bookId << "|"
+                       << transaction.studentId << "|" << transactionTypeName(transaction.type) << "|"
+                       << formatDay(transaction.day) << "\n";
+            file.flushIfFull();
+        }
+        if (!rows.empty() && rows.back().id >= view.nextTransactionId) break;
+    }
+    if (file.commit()) {
+        logOperation("Transactions saved to file");
+    } else {
+        printNotice("Unable to write transactions.txt; the previous file is unchanged.");
+    }
+}
+
+// Function to load transactions from the text file into rows (only used to
+// migrate to the archive). Returns false if the file is missing.
+bool Library::loadTransactionsFromFile(std::vector<Transaction>& rows) {
+    LoadReport report;
+    bool found = loadTextTable("transactions.txt", nextTransactionId, rows,
+        [](std::string_view line, std::vector<Transaction>& rows, std::string& error) {
+            std::string_view fields[5];
+            int id, bookId, studentId;
+            int32_t day;
+            TransactionType type;
+            if (splitFields(line, '|', fields, 5) < 5) {
+                error = "expected id|book_id|student_id|type|date";
+                return false;
+            }
+            if (!parseInt(fields[0], id) || !parseInt(fields[1], bookId) || !parseInt(fields[2], studentId)) {
+                error = "bad id in '" + std::string(line) + "'";
+                return false;
+            }
+            if (!parseTransactionType(fields[3], type)) {
+                error = "unknown type '" + std::string(fields[3]) + "'";
+                return false;
+            }
+            if (!parseDay(fields[4], day)) {
+                error = "bad date '" + std::string(fields[4]) + "'";
+                return false;
+            }
+            rows.emplace_back(id, bookId, studentId, type, day);
+            return true;
+        }, report);
+    if (!found) return false;
+
+    reportTextLoad("transactions.txt", "Transactions", report);
+    return true;
+}
+
+// Function to save the books of a snapshot to the binary snapshot file
+bool Library::saveBooksSnapshot(const LibrarySnapshot& view) {
+    const CatalogView& catalog = view.books;
+    SnapshotWriter writer(SNAPSHOT_BOOKS, sizeof(BookRecord), view.liveBooks);
+    // Each interned author is written to the heap once and shared by its books
+    std::vector<StringRef> authorRefs(catalog.authorCount(), StringRef{0, UINT32_MAX});
+    for (size_t slot = 0; slot < catalog.size(); ++slot) {
+        if (catalog.id(slot) == DELETED_BOOK_ID) continue;
+
+        StringRef& author = authorRefs[catalog.authorNumber(slot)];
+        if (author.length == UINT32_MAX) {
+            author = writer.addString(catalog.author(slot));
+        }
+        BookRecord record;
+        record.id = catalog.id(slot);
+        record.available = catalog.available(slot) ? 1 : 0;
+        record.title = writer.addString(catalog.title(slot));
+        record.author = author;
+        record.isbn = writer.addString(catalog.isbn(slot));
+        writer.addRecord(&record);
+    }
+
+    if (!writer.write("books.bin", view.nextBookId, &catalogCrc)) {
+        printNotice("Unable to write books.bin.");
+        catalogCrcKnown = false;
+        return false;
+    }
+    catalogCrcKnown = true;
+    logOperation("Books saved to snapshot");
+    return true;
+}
+
+// Function to load books from the binary snapshot (false if it is missing
+// or damaged, in which case books.txt is imported instead)
+bool Library::loadBooksFromSnapshot() {
+    SnapshotReader reader;
+    std::string error;
+    if (!reader.open("books.bin", SNAPSHOT_BOOKS, sizeof(BookRecord), error)) {
+        if (!error.empty()) {
+            printNotice("books.bin is unusable (" + error + "); loading books.txt instead.");
+        }
+        return false;
+    }
+
+    books.clear();
+    books.reserve(reader.count());
+    bookTombstones = 0;
+    nextBookId = static_cast<int>(reader.nextId());
+    catalogCrc = reader.payloadCrc();
+    catalogCrcKnown = true;
+    for (size_t i = 0; i < reader.count(); ++i) {
+        const BookRecord& record = reader.record<BookRecord>(i);
+        if (!reader.valid(record.title) || !reader.valid(record.author) || !reader.valid(record.isbn)) continue;
+        if (!books.hasRoom(record.title.length + record.author.length + record.isbn.length)) {
+            printNotice("books.bin: catalog text passes 4 GB; books from ID " + std::to_string(record.id) +
+                        " on were not loaded.");
+            break;
+        }
+
+        books.append(record.id, reader.view(record.title), reader.view(record.author),
+                     reader.view(record.isbn), record.available != 0);
+    }
+    rebuildBookIndexes();
+    logOperation("Books loaded from snapshot");
+    return true;
+}
+
+// Function to save the students of a snapshot to the binary snapshot file
+bool Library::saveStudentsSnapshot(const LibrarySnapshot& view) {
+    SnapshotWriter writer(SNAPSHOT_STUDENTS, sizeof(StudentRecord), view.students.size());
+    for (size_t i = 0; i < view.students.size(); ++i) {
+        StudentRecord record;
+        record.id = view.students[i].id;
+        record.reserved = 0;
+        record.name = writer.addString(view.students[i].name);
+        writer.addRecord(&record);
+    }
+
+    if (!writer.write("students.bin", view.nextStudentId)) {
+        printNotice("Unable to write students.bin.");
+        return false;
+    }
+    logOperation("Students saved to snapshot");
+    return true;
+}
+
+// Function to load students from the binary snapshot
+bool Library::loadStudentsFromSnapshot() {
+    SnapshotReader reader;
+    std::string error;
+    if (!reader.open("students.bin", SNAPSHOT_STUDENTS, sizeof(StudentRecord), error)) {
+        if (!error.empty()) {
+            printNotice("students.bin is unusable (" + error + "); loading students.txt instead.");
+        }
+        return false;
+    }
+
+    students.clear();
+    students.reserve(reader.count());
+    nextStudentId = static_cast<int>(reader.nextId());
+    for (size_t i = 0; i < reader.count(); ++i) {
+        const StudentRecord& record = reader.record<StudentRecord>(i);
+        if (!reader.valid(record.name)) continue;
+
+        students.push_back(Student(record.id, reader.toString(record.name)));
+    }
+    rebuildStudentIndex();
+    logOperation("Students loaded from snapshot");
+    return true;
+}
+
+// Function to write the transaction archive as copied by a checkpoint, with
+// no lock held until the written segments are handed back to the archive
+bool Library::saveTransactionsSnapshot(TransactionArchive::Checkpoint& history) {
+    std::string error;
+    if (!transactionHistory.writeCheckpoint(history, error)) {
+        printNotice("Unable to save transaction history (" + error + ").");
+        return false;
+    }
+    {
+        std::lock_guard<std::mutex> lock(commitMutex);
+        transactionHistory.checkpointWritten(history);
+    }
+    logOperation("Transactions saved to history");
+    return true;
+}
+
+// Function to load transactions from the history archive. Without one, the
+// whole log is read from transactions.bin or transactions.txt, as written
+// before the archive existed, and split into segments in memory; load()
+// then checkpoints it so the next start reads the archive.
+void Library::loadTransactions() {
+    std::string error;
+    if (transactionHistory.open(nextTransactionId, error)) {
+        logOperation("Transactions loaded from history (" + std::to_string(transactionHistory.segmentCount()) +
+                     " segments)");
+        return;
+    }
+    if (!error.empty()) {
+        printNotice("history/manifest.txt is unusable (" + error + "); rebuilding it from transactions.txt.");
+    }
+
+    std::vector<Transaction> rows;
+    int64_t snapshotNextId = 0;
+    std::string snapshotError;
+    bool found = error.empty() && readTransactionSnapshot("transactions.bin", rows, snapshotNextId, snapshotError);
+    if (found) {
+        nextTransactionId = static_cast<int>(snapshotNextId);
+    } else {
+        if (!snapshotError.empty()) {
+            printNotice("transactions.bin is unusable (" + snapshotError + "); loading transactions.txt instead.");
+        }
+        found = loadTransactionsFromFile(rows);
+    }
+
+    transactionHistory.create();
+    for (const auto& transaction : rows) {
+        transactionHistory.append(transaction);
+    }
+    transactionsMigrated = found;
+}
+
+// Function to load the completion indexes saved with books.bin (false if
+// they are missing, damaged or were saved with another books.bin)
+bool Library::loadCompletions() {
+    if (!catalogCrcKnown) return false;
+    std::string error;
+    if (titleCompletions.read("title_completions.bin", catalogCrc, error) &&
+        authorCompletions.read("author_completions.bin", catalogCrc, error)) {
+        logOperation("Completions loaded (" + std::to_string(titleCompletions.termCount()) + " titles, " +
+                     std::to_string(authorCompletions.termCount()) + " authors)");
+        return true;
+    }
+    if (!error.empty()) {
+        printNotice("The completion index is unusable (" + error + "); rebuilding it.");
+    }
+    return false;
+}
+
+// Function to build the completion indexes from the catalog, weighting each
+// book by its borrows in the whole transaction history
+void Library::rebuildCompletions() {
+    std::vector<uint32_t> borrows(static_cast<size_t>(std::max(nextBookId, 1)), 0);
+    std::vector<Transaction> rows;
+    std::string error;
+    for (size_t i = 0; i < transactionHistory.segmentCount(); ++i) {
+        if (!transactionHistory.rows(i, rows, error)) {
+            printNotice("Unable to read a history segment (" + error + "); its borrows are not counted.");
+            continue;
+        }
+        for (const auto& transaction : rows) {
+            if (transaction.type == TransactionType::Borrow && transaction.bookId > 0 &&
+                static_cast<size_t>(transaction.bookId) < borrows.size()) {
+                ++borrows[transaction.bookId];
+            }
+        }
+    }
+
+    std::vector<std::pair<int, std::string_view>> titles, authors;
+    titles.reserve(liveBooks);
+    authors.reserve(liveBooks);
+    for (size_t slot = 0; slot < books.size(); ++slot) {
+        if (books.id(slot) == DELETED_BOOK_ID) continue;
+        titles.emplace_back(books.id(slot), books.title(slot));
+        authors.emplace_back(books.id(slot), books.author(slot));
+    }
+    sharedPool().parallelFor(2, 1, [&](size_t, size_t begin, size_t end) {
+        for (size_t task = begin; task < end; ++task) {
+            (task == 0 ? titleCompletions : authorCompletions).build(task == 0 ? titles : authors, borrows);
+        }
+    });
+    logOperation("Completions rebuilt");
+}
+
+// Function to save the completion indexes, marked with the books.bin they
+// go with (failing only costs a rebuild on the next start)
+bool Library::saveCompletions() {
+    if (!catalogCrcKnown) return false;
+    if (!titleCompletions.write("title_completions.bin", catalogCrc) ||
+        !authorCompletions.write("author_completions.bin", catalogCrc)) {
+        printNotice("Unable to write the completion index; it will be rebuilt on the next start.");
+        return false;
+    }
+    logOperation("Completions saved");
+    return true;
+}
+
+// Function to load the circulation aggregates saved at the last checkpoint,
+// setting counted to the first transaction they leave out (false if they
+// are missing, damaged or ahead of the history)
+bool Library::loadCirculation(int64_t& counted) {
+    std::string error;
+    if (circulation.read("circulation.bin", counted, error)) {
+        if (counted <= nextTransactionId) return true;
+        error = "ahead of the transaction history";
+        circulation.clear();
+    }
+    if (!error.empty()) {
+        printNotice("circulation.bin is unusable (" + error + "); rebuilding it from the history.");
+    }
+    return false;
+}
+
+// Function to bring the circulation aggregates up to the loaded history by
+// counting its transactions from id counted on (from the start when there
+// was nothing saved), then drop the counts of books deleted since; returns
+// whether any transactions were counted
+bool Library::catchUpCirculation(int64_t counted) {
+    std::vector<Transaction> rows;
+    std::string error;
+    size_t added = 0;
+    for (size_t i = 0; i < transactionHistory.segmentCount(); ++i) {
+        const bool sealed = i + 1 < transactionHistory.segmentCount();
+        if (sealed && transactionHistory.segment(i).lastId < counted) continue;
+        if (!transactionHistory.rows(i, rows, error)) {
+            printNotice("Unable to read a history segment (" + error + "); its circulation is not counted.");
+            continue;
+        }
+        for (const auto& transaction : rows) {
+            if (transaction.id < counted) continue;
+            if (transaction.type == TransactionType::Borrow) {
+                circulation.borrowed(transaction.bookId, transaction.studentId, transaction.day);
+            } else {
+                circulation.returned(transaction.day);
+            }
+            ++added;
+        }
+    }
+    circulation.prune([this](int id) { return findBookSlot(id) != NO_SLOT; });
+    logOperation(counted <= 1 ? "Circulation rebuilt from history (" + std::to_string(added) + " transactions)"
+                              : "Circulation loaded (" + std::to_string(added) + " transactions since)");
+    return added > 0;
+}
+
+// Function to save circulation aggregates that count the transactions
+// below nextId (failing only costs counting the history since the last good
+// save on the next start)
+bool Library::saveCirculation(const CirculationStats& counts, int nextId) {
+    if (!counts.write("circulation.bin", nextId)) {
+        printNotice("Unable to write circulation.bin; it will be brought up to date on the next start.");
+        return false;
+    }
+    logOperation("Circulation saved");
+    return true;
+}
+
+// Function to checkpoint: write the files of the tables changed since the
+// last checkpoint, then drop the journal records they now hold.
+//
+// The state to write is fixed in one short pass under both locks: queued
+// borrows are folded into the completion weights, the dirty tables are
+// taken, a snapshot is taken, the history archive's new segments and
+// current rows are copied, and the journal is rotated. The files are then
+// encoded and written from those copies with only catalogMutex held shared,
+// so searches, borrows and returns carry on; book edits wait, which keeps the
+// completion indexes as they were when the snapshot was taken. Each file is
+// replaced atomically. A table whose file fails is marked dirty again, and
+// the rotated journal records are kept until a checkpoint succeeds.
+bool Library::checkpoint() {
+    std::lock_guard<std::mutex> serial(checkpointMutex);
+    StatTimer timer(StatOp::Save);
+    unsigned tables;
+    unsigned failed = 0;
+    std::shared_ptr<const LibrarySnapshot> view;
+    TransactionArchive::Checkpoint history;
+    std::unique_ptr<CirculationStats> counts;
+    bool rotated;
+    {
+        std::unique_lock<std::shared_mutex> catalog(catalogMutex);
+        std::lock_guard<std::mutex> lock(commitMutex);
+        foldBorrows();
+        tables = dirtyTables;
+        if (tables == 0) return true;
+        dirtyTables = 0;
+        view = snapshotLocked();
+        if (tables & DIRTY_HISTORY) {
+            history = transactionHistory.prepareCheckpoint(nextTransactionId);
+        }
+        if (tables & DIRTY_CIRCULATION) {
+            counts = std::make_unique<CirculationStats>(circulation);
+        }
+        rotated = journal.rotate();
+    }
+
+    std::shared_lock<std::shared_mutex> catalog(catalogMutex);
+    if ((tables & DIRTY_HISTORY) && !saveTransactionsSnapshot(history)) {
+        failed |= DIRTY_HISTORY | DIRTY_CIRCULATION;
+        counts.reset(); // circulation.bin must not run ahead of history/
+    }
+    if ((tables & DIRTY_BOOKS) && !saveBooksSnapshot(*view)) {
+        failed |= DIRTY_BOOKS;
+    }
+    if ((tables & DIRTY_STUDENTS) && !saveStudentsSnapshot(*view)) {
+        failed |= DIRTY_STUDENTS;
+    }
+    if (tables & (DIRTY_BOOKS | DIRTY_COMPLETIONS)) {
+        // books.bin's checksum just changed, so they need rewriting unless
+        // a book edit got in before the shared lock did
+        bool edited;
+        {
+            std::lock_guard<std::mutex> lock(commitMutex);
+            edited = (dirtyTables & DIRTY_COMPLETIONS) != 0;
+        }
+        if (edited || !saveCompletions()) {
+            failed |= DIRTY_COMPLETIONS;
+        }
+    }
+    if (counts && !saveCirculation(*counts, view->nextTransactionId)) {
+        failed |= DIRTY_CIRCULATION;
+    }
+    catalog.unlock();
+
+    if (failed == 0 && rotated) {
+        journal.dropRotated();
+    } else {
+        std::lock_guard<std::mutex> lock(commitMutex);
+        dirtyTables |= failed | (rotated ? 0 : tables);
+    }
+    operationLog.sync();
+    return failed == 0 && rotated;
+}
+
+// Function to save all changed data (checkpoint) now
+bool Library::save() {
+    return checkpoint();
+}
+
+// Function to bring the next checkpoint forward once the journal has grown
+// past its limit. The checkpoint runs on the background thread, so the
+// operation that trips it returns at once; before load() starts the thread
+// it runs in the caller.
+void Library::checkpointIfDue() {
+    {
+        std::lock_guard<std::mutex> lock(checkpointerMutex);
+        if (journal.records() < checkpointChanges) return;
+        if (checkpointer.joinable()) {
+            checkpointDue = true;
+            checkpointerWake.notify_one();
+            return;
+        }
+    }
+    checkpoint();
+}
+
+// Function to start the background checkpoint thread
+void Library::startCheckpointer() {
+    std::lock_guard<std::mutex> lock(checkpointerMutex);
+    if (checkpointer.joinable()) return;
+    checkpointerStopping = false;
+    checkpointer = std::thread([this]() { checkpointLoop(); });
+}
+
+// Function to stop the background checkpoint thread (the caller saves
+// whatever it still has to)
+void Library::stopCheckpointer() {
+    {
+        std::lock_guard<std::mutex> lock(checkpointerMutex);
+        if (!checkpointer.joinable()) return;
+        checkpointerStopping = true;
+    }
+    checkpointerWake.notify_one();
+    checkpointer.join();
+}
+
+// Function run by the checkpoint thread: checkpoint every interval, or
+// sooner when checkpointIfDue() asks
+void Library::checkpointLoop() {
+    std::unique_lock<std::mutex> lock(checkpointerMutex);
+    while (!checkpointerStopping) {
+        checkpointerWake.wait_for(lock, checkpointInterval,
+                                  [this]() { return checkpointerStopping || checkpointDue; });
+        if (checkpointerStopping) break;
+        checkpointDue = false;
+        lock.unlock();
+        bool dirty;
+        {
+            std::lock_guard<std::mutex> commit(commitMutex);
+            dirty = dirtyTables != 0;
+        }
+        if (dirty) {
+            checkpoint();
+        }
+        lock.lock();
+    }
+}
+
+// Function to count the borrows queued since the last fold towards the
+// completion weights
+void Library::foldBorrows() {
+    if (pendingBorrows.empty()) return;
+    dirtyTables |= DIRTY_COMPLETIONS;
+    for (int bookId : pendingBorrows) {
+        titleCompletions.borrowed(bookId);
+        authorCompletions.borrowed(bookId);
+    }
+    pendingBorrows.clear();
+}
+
+// Function to fold queued borrows once COMPLETION_FOLD_BORROWS have built up.
+// A checkpoint writing the completion indexes holds catalogMutex shared, so
+// the fold is left to a later borrow rather than waiting for it.
+void Library::foldBorrowsIfDue() {
+    std::unique_lock<std::shared_mutex> catalog(catalogMutex, std::try_to_lock);
+    if (!catalog.owns_lock()) return;
+    std::lock_guard<std::mutex> lock(commitMutex);
+    if (pendingBorrows.size() >= COMPLETION_FOLD_BORROWS) {
+        foldBorrows();
+    }
+}
+
+// Function to export all data to the text files, as of one snapshot
+void Library::exportText() {
+    std::shared_ptr<const LibrarySnapshot> view = snapshot();
+    saveBooksToFile(*view);
+    saveStudentsToFile(*view);
+    saveTransactionsToFile(*view);
+}
+
+// Function to journal a book's current title/author/ISBN ("AB" on add,
+// "UB" on update), returning the record's sequence number
+uint64_t Library::journalBook(const std::string& op, const Book& book) {
+    return journal.append({op, std::to_string(book.id), std::string(book.title), std::string(book.author),
+                    std::string(book.isbn)});
+}
+
+// Function to journal a borrow ("BR") or return ("RT") transaction,
+// returning the record's sequence number
+uint64_t Library::journalTransaction(const Transaction& transaction) {
+    return journal.append({transaction.type == TransactionType::Borrow ? "BR" : "RT",
+                           std::to_string(transaction.id), std::to_string(transaction.bookId),
+                           std::to_string(transaction.studentId), std::to_string(transaction.day)});
+}
+
+// Function to wait for a change's journal record to reach the disk before
+// the change is reported done. If it cannot be written, the change stays in
+// memory but is reported as not saved, and a checkpoint is brought forward
+// to write it to the data files and start a fresh journal.
+LibraryStatus Library::awaitJournal(uint64_t record) {
+    if (journal.sync(record)) return LibraryStatus::Ok;
+    logOperation("Journal write failed; checkpointing");
+    {
+        std::lock_guard<std::mutex> lock(checkpointerMutex);
+        checkpointDue = true;
+    }
+    checkpointerWake.notify_one();
+    return LibraryStatus::NotSaved;
+}
+
+// Function to apply one journal record on top of the loaded snapshot.
+// A crash between writing the snapshot and emptying the journal leaves
+// records the snapshot already contains, so replay must be idempotent:
+// adds and transactions whose id is below the snapshot's next id are
+// skipped, updates rewrite the whole row, deletes of missing books are no-ops.
+bool Library::applyJournalRecord(const std::vector<std::string>& fields) {
+    const std::string& op = fields[0];
+
+    if (op == "AB" && fields.size() == 5) {
+        int id = std::atoi(fields[1].c_str());
+        if (id >= nextBookId) {
+            if (!makeRoomForBook(fields[2].size() + fields[3].size() + fields[4].size())) {
+                printNotice("Journal: no room in the catalog for book " + fields[1] + "; skipped.");
+                return false;
+            }
+            insertBook(Book(id, fields[2], fields[3], fields[4]));
+            nextBookId = id + 1;
+        }
+    } else if (op == "UB" && fields.size() == 5) {
+        int id = std::atoi(fields[1].c_str());
+        if (findBookSlot(id) != NO_SLOT) {
+            if (!makeRoomForBook(fields[2].size() + fields[3].size() + fields[4].size())) {
+                printNotice("Journal: no room in the catalog for the update of book " + fields[1] + "; skipped.");
+                return false;
+            }
+            size_t slot = findBookSlot(id);
+            setBookTitle(slot, fields[2]);
+            setBookAuthor(slot, fields[3]);
+            setBookIsbn(slot, fields[4]);
+            compactBooksIfWasteful();
+        }
+    } else if (op == "DB" && fields.size() == 2) {
+        removeBook(std::atoi(fields[1].c_str()));
+    } else if (op == "AS" && fields.size() == 3) {
+        int id = std::atoi(fields[1].c_str());
+        if (id >= nextStudentId) {
+            insertStudent(Student(id, fields[2]));
+            nextStudentId = id + 1;
+        }
+    } else if ((op == "BR" || op == "RT") && fields.size() == 5) {
+        int id = std::atoi(fields[1].c_str());
+        int bookId = std::atoi(fields[2].c_str());
+        int studentId = std::atoi(fields[3].c_str());
+        int32_t day;
+        // The date is a day number; journals written before that hold "Y-M-D"
+        if (!parseInt(fields[4], day) && !parseDay(fields[4], day)) {
+            return false;
+        }
+        bool borrow = (op == "BR");
+        size_t slot = findBookSlot(bookId);
+        if (id < nextTransactionId) {
+            // Already in history/ (and so in the loans), but books.bin may
+            // predate it; replaying in order leaves the latest state
+            if (slot != NO_SLOT && books.available(slot) == borrow) {
+                books.setAvailable(slot, !borrow);
+                dirtyTables |= DIRTY_BOOKS;
+            }
+        } else {
+            if (slot != NO_SLOT) {
+                books.setAvailable(slot, !borrow);
+            }
+            transactionHistory.append(Transaction(id, bookId, studentId,
+                                                  borrow ? TransactionType::Borrow : TransactionType::Return, day));
+            if (borrow) {
+                closeLoan(bookId);
+                openLoan(bookId, id, studentId);
+                circulation.borrowed(bookId, studentId, day);
+                pendingBorrows.push_back(bookId);
+            } else {
+                closeLoan(bookId);
+                circulation.returned(day);
+            }
+            dirtyTables |= DIRTY_BOOKS | DIRTY_HISTORY | DIRTY_CIRCULATION;
+            nextTransactionId = id + 1;
+        }
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// Function to replay the journal written since the last checkpoint
+void Library::replayJournal() {
+    std::vector<std::vector<std::string>> records = journal.readAll();
+    if (records.empty()) return;
+
+    size_t skipped = 0;
+    for (const auto& fields : records) {
+        if (!applyJournalRecord(fields)) {
+            ++skipped;
+        }
+    }
+    logOperation("Replayed " + std::to_string(records.size() - skipped) + " journal records" +
+                 (skipped > 0 ? " (" + std::to_string(skipped) + " unrecognized or skipped)" : ""));
+}
+
+// Function to load all data: each table from its binary snapshot (or its
+// text file when there is no usable snapshot yet), with the completion
+// indexes saved alongside books.bin, then the open loans, then the journal.
+// The three tables share no state until the loans are rebuilt, so they load
+// concurrently. Whatever did not come from an up-to-date binary file is
+// marked dirty for the first checkpoint, and the checkpoint thread starts.
+void Library::load() {
+    StatTimer timer(StatOp::Load);
+    std::unique_lock<std::shared_mutex> catalog(catalogMutex);
+    std::unique_lock<std::mutex> lock(commitMutex);
+
+    bool completionsLoaded = false;
+    int64_t circulationCounted = 0;
+    unsigned stale[3] = {}; // Per table, the files that need writing at the first checkpoint
+    sharedPool().parallelFor(3, 1, [this, &completionsLoaded, &circulationCounted, &stale](size_t, size_t begin,
+                                                                                         size_t end) {
+        for (size_t table = begin; table < end; ++table) {
+            if (table == 0) {
+                if (!loadBooksFromSnapshot()) {
+                    loadBooksFromFile();
+                    stale[0] = DIRTY_BOOKS;
+                }
+                completionsLoaded = loadCompletions();
+            } else if (table == 1 && !loadStudentsFromSnapshot()) {
+                loadStudentsFromFile();
+                stale[1] = DIRTY_STUDENTS;
+            } else if (table == 2) {
+                loadTransactions();
+                if (!loadCirculation(circulationCounted)) {
+                    circulationCounted = 1;
+                    stale[2] = DIRTY_CIRCULATION;
+                }
+            }
+        }
+    });
+    dirtyTables = stale[0] | stale[1] | stale[2];
+    if (!completionsLoaded) {
+        rebuildCompletions(); // Needs the history for the borrow counts
+        dirtyTables |= DIRTY_COMPLETIONS;
+    }
+    if (catchUpCirculation(circulationCounted)) {
+        dirtyTables |= DIRTY_CIRCULATION;
+    }
+    if (transactionsMigrated) {
+        dirtyTables |= DIRTY_HISTORY;
+    }
+    rebuildLoanIndex();
+    replayJournal();
+    foldBorrows();
+    ++commitCount;
+    lock.unlock();
+    catalog.unlock();
+
+    if (!journal.open()) {
+        printNotice("Unable to open journal.log; changes will only be saved at checkpoints.");
+    }
+    if (transactionsMigrated && checkpoint()) {
+        std::remove("transactions.bin"); // Superseded by history/
+        logOperation("Transactions moved into history/");
+    }
+    startCheckpointer();
+}
+
+// Function to scan one field of every book in a catalog view for a lowercase
+// term. The arena's text blocks are searched in one pass each, spread across
+// the shared thread pool, and every match start is marked in a bitmap of
+// arena offsets (blocks are whole multiples of 64 bytes, so no two threads
+// share a word). The bitmap belongs to the calling thread and is kept zeroed
+// between searches: each block remembers the run of words it marked, and
+// only those runs are cleared afterwards, so a search never allocates or
+// wipes a bitmap the size of the whole arena. A book matches if a mark falls where the term fits inside
+// its title or ISBN; for authors, the interned names are checked once and
+// books are picked by author number. Matches in stale text or spanning two
+// fields fall outside every span and are ignored. Slots are then checked in
+// chunks on the pool and the chunk lists joined in catalog order.
+std::vector<size_t> Library::scanBooks(const CatalogView& view, BookField field, const std::string& lowerTerm) {
+    const size_t SCAN_CHUNK = 16384; // Smaller catalogs are checked inline
+    const size_t m = lowerTerm.size();
+
+    ThreadPool& pool = sharedPool();
+    thread_local std::vector<uint64_t> callerMarks;
+    std::vector<uint64_t>& marks = callerMarks; // Pool workers must reach the caller's bitmap, not their own
+    std::vector<std::pair<size_t, size_t>> marked; // Words [first, last) marked in each block
+    std::vector<char> authorMatches;
+    if (m > 0) {
+        std::vector<CatalogView::TextExtent> extents = view.textExtents();
+        size_t words = (size_t(view.textEnd()) + 63) / 64;
+        if (marks.size() < words) {
+            marks.resize(words, 0);
+        }
+        marked.assign(extents.size(), {0, 0});
+        std::atomic<bool> found(false);
+        pool.parallelFor(extents.size(), 1, [&](size_t, size_t begin, size_t end) {
+            for (size_t e = begin; e < end; ++e) {
+                const CatalogView::TextExtent& extent = extents[e];
+                std::pair<size_t, size_t>& run = marked[e];
+                forEachMatchIgnoreCase(extent.data, extent.length, lowerTerm.data(), m, [&](size_t at) {
+                    size_t offset = extent.offset + at;
+                    marks[offset / 64] |= uint64_t(1) << (offset % 64);
+                    if (run.second == 0) run.first = offset / 64;
+                    run.second = offset / 64 + 1;
+                    return false;
+                });
+                if (run.second > 0) found.store(true, std::memory_order_relaxed);
+            }
+        });
+        if (!found.load()) {
+            return {};
+        }
+        if (field == BookField::Author) {
+            authorMatches.resize(view.authorCount());
+            for (uint32_t number = 0; number < authorMatches.size(); ++number) {
+                std::pair<uint32_t, uint32_t> span = view.authorSpan(number);
+                authorMatches[number] = span.second - span.first >= m && anyBitSet(marks, span.first, span.second - m + 1);
+            }
+        }
+    }
+
+    std::vector<std::vector<size_t>> chunkHits(pool.chunksFor(view.size(), SCAN_CHUNK));
+    pool.parallelFor(view.size(), SCAN_CHUNK, [&](size_t chunk, size_t begin, size_t end) {
+        std::vector<size_t>& hits = chunkHits[chunk];
+        for (size_t i = begin; i < end; ++i) {
+            if (view.id(i) == DELETED_BOOK_ID) continue;
+            bool match = m == 0;
+            if (!match && field == BookField::Author) {
+                match = authorMatches[view.authorNumber(i)];
+            } else if (!match) {
+                std::pair<uint32_t, uint32_t> span = view.textSpan(i, field);
+                match = span.second - span.first >= m && anyBitSet(marks, span.first, span.second - m + 1);
+            }
+            if (match) {
+                hits.push_back(i);
+            }
+        }
+    });
+
+    for (const auto& run : marked) {
+        std::fill(marks.begin() + run.first, marks.begin() + run.second, 0);
+    }
+
+    std::vector<size_t> slots;
+    for (const auto& hits : chunkHits) {
+        slots.insert(slots.end(), hits.begin(), hits.end());
+    }
+    return slots;
+}
+
+// Function to add a new book (refused if the ISBN is taken)
+LibraryStatus Library::addBook(const std::string& title, const std::string& author, const std::string& isbn,
+                               int* newId) {
+    StatTimer timer(StatOp::AddBook);
+    uint64_t record;
+    {
+        std::unique_lock<std::shared_mutex> catalog(catalogMutex);
+        if (isbnExists(isbn, DELETED_BOOK_ID)) {
+            return LibraryStatus::DuplicateIsbn;
+        }
+        std::lock_guard<std::mutex> lock(commitMutex);
+        if (!makeRoomForBook(title.size() + author.size() + isbn.size())) {
+            return LibraryStatus::CatalogFull;
+        }
+        int id = nextBookId++;
+        insertBook(Book(id, title, author, isbn));
+        record = journalBook("AB", bookAt(books.size() - 1));
+        ++commitCount;
+        if (newId != nullptr) *newId = id;
+    }
+    LibraryStatus saved = awaitJournal(record);
+    logOperation("Added book: " + title);
+    checkpointIfDue();
+    return saved;
+}
+
+// Function to change one field of a book
+LibraryStatus Library::updateBook(int id, BookField field, const std::string& value, std::string* oldValue) {
+    StatTimer timer(StatOp::UpdateBook);
+    std::string previous;
+    uint64_t record;
+    {
+        std::unique_lock<std::shared_mutex> catalog(catalogMutex);
+        std::lock_guard<std::mutex> lock(commitMutex);
+        size_t slot = findBookSlot(id);
+        if (slot == NO_SLOT) {
+            return LibraryStatus::BookNotFound;
+        }
+        if (field == BookField::Isbn && isbnExists(value, id)) {
+            return LibraryStatus::DuplicateIsbn;
+        }
+        if (!makeRoomForBook(value.size())) {
+            return LibraryStatus::CatalogFull;
+        }
+        slot = findBookSlot(id); // Compaction renumbers slots
+        previous = std::string(books.text(slot, field));
+        if (field == BookField::Title) {
+            setBookTitle(slot, value);
+        } else if (field == BookField::Author) {
+            setBookAuthor(slot, value);
+        } else {
+            setBookIsbn(slot, value);
+        }
+        record = journalBook("UB", bookAt(slot));
+        compactBooksIfWasteful();
+        ++commitCount;
+    }
+    LibraryStatus saved = awaitJournal(record);
+    logOperation("Updated book ID " + std::to_string(id) + ": " + previous + " -> " + value);
+    if (oldValue != nullptr) *oldValue = previous;
+    checkpointIfDue();
+    return saved;
+}
+
+// Function to delete a book (refused while it is on loan)
+LibraryStatus Library::deleteBook(int id, std::string* title) {
+    StatTimer timer(StatOp::DeleteBook);
+    std::string deleted;
+    uint64_t record;
+    {
+        std::unique_lock<std::shared_mutex> catalog(catalogMutex);
+        std::lock_guard<std::mutex> lock(commitMutex);
+        size_t slot = findBookSlot(id);
+        if (slot == NO_SLOT) {
+            return LibraryStatus::BookNotFound;
+        }
+        if (!books.available(slot)) {
+            return LibraryStatus::BookOnLoan;
+        }
+        deleted = std::string(books.title(slot));
+        removeBook(id);
+        record = journal.append({"DB", std::to_string(id)});
+        ++commitCount;
+    }
+    LibraryStatus saved = awaitJournal(record);
+    logOperation("Deleted book: " + deleted + " (ID: " + std::to_string(id) + ")");
+    if (title != nullptr) *title = deleted;
+    checkpointIfDue();
+    return saved;
+}
+
+// Function to visit the books whose field contains term (case-insensitive),
+// in ID order: the first limit of them with an ID above afterId, so a
+// caller pages by passing the last ID back. A complete ISBN is answered from
+// the ISBN index, terms of three or more characters from the trigram
+// indexes, and anything else by a parallel scan. The indexes are probed and
+// a snapshot taken under one shared catalog lock, so the two agree;
+// candidates are then checked and visited from the snapshot with no lock
+// held. Returns the number of books visited.
+size_t Library::searchBooks(BookField field, const std::string& term,
+                            const std::function<void(const Book&)>& visit, size_t limit, int afterId) const {
+    StatTimer timer(StatOp::Search);
+    std::string lowerTerm = term;
+    std::transform(lowerTerm.begin(), lowerTerm.end(), lowerTerm.begin(),
+                   [](char c) { return static_cast<char>(foldAscii(static_cast<unsigned char>(c))); });
+
+    std::shared_ptr<const LibrarySnapshot> view;
+    std::vector<int> candidateIds;
+    bool exact = field == BookField::Isbn && isFullIsbn(normalizeIsbn(lowerTerm));
+    bool indexed = false;
+    {
+        std::shared_lock<std::shared_mutex> catalog(catalogMutex);
+        view = snapshot();
+        if (exact) {
+            auto it = isbnIndex.find(normalizeIsbn(lowerTerm));
+            if (it != isbnIndex.end()) {
+                candidateIds.push_back(it->second);
+            }
+        } else if (field != BookField::Isbn) {
+            indexed = (field == BookField::Title ? titleGrams : authorGrams).candidates(lowerTerm, candidateIds);
+        }
+    }
+
+    size_t matches = 0;
+    if (exact || indexed) {
+        // Only books holding every trigram of the term can match; verify
+        // those in ID order until the page is full
+        std::sort(candidateIds.begin(), candidateIds.end());
+        auto it = std::upper_bound(candidateIds.begin(), candidateIds.end(), afterId);
+        for (; it != candidateIds.end() && matches < limit; ++it) {
+            std::optional<Book> book = view->findBook(*it);
+            if (book && (exact || containsIgnoreCase(field == BookField::Title ? book->title : book->author,
+                                                     lowerTerm))) {
+                visit(*book);
+                ++matches;
+            }
+        }
+    } else {
+        // Short terms and ISBN fragments: brute-force scan, then keep the
+        // lowest limit IDs above afterId (slots are nearly always in ID order)
+        const CatalogView& books = view->books;
+        std::vector<size_t> slots = scanBooks(books, field, lowerTerm);
+        auto byId = [&books](size_t a, size_t b) { return books.id(a) < books.id(b); };
+        slots.erase(std::remove_if(slots.begin(), slots.end(),
+                                   [&books, afterId](size_t slot) { return books.id(slot) <= afterId; }),
+                    slots.end());
+        if (slots.size() > limit) {
+            std::nth_element(slots.begin(), slots.begin() + limit, slots.end(), byId);
+            slots.resize(limit);
+        }
+        if (!std::is_sorted(slots.begin(), slots.end(), byId)) {
+            std::sort(slots.begin(), slots.end(), byId);
+        }
+        for (size_t slot : slots) {
+            visit(view->bookAt(slot));
+            ++matches;
+        }
+    }
+    return matches;
+}
+
+// Function to visit up to limit books whose title or author matches term
+// with typos: each word of the term within maxDistance edits (fewer for
+// short words) of a word of the field. Books come best first, with their
+// total edits. The word index is probed and a snapshot taken under one
+// shared catalog lock; books are read from the snapshot with no lock held.
+// Returns the number of matches.
+size_t Library::fuzzySearchBooks(BookField field, const std::string& term, unsigned maxDistance, size_t limit,
+                                 const std::function<void(const Book&, unsigned)>& visit) const {
+    StatTimer timer(StatOp::FuzzySearch);
+    if (field == BookField::Isbn) return 0;
+
+    std::shared_ptr<const LibrarySnapshot> view;
+    std::vector<FuzzyIndex::Match> matches;
+    {
+        std::shared_lock<std::shared_mutex> catalog(catalogMutex);
+        view = snapshot();
+        (field == BookField::Title ? titleWords : authorWords).best(term, maxDistance, limit, matches);
+    }
+
+    for (const FuzzyIndex::Match& match : matches) {
+        visit(view->bookAt(slotOf(view->bookSlots, match.id)), match.distance);
+    }
+    return matches.size();
+}
+
+// Function to get the next page of books in a listing order after the
+// cursor, and move the cursor past it. The ordered index is walked and a
+// snapshot taken under one shared catalog lock, so the ids found are all in
+// the snapshot; the books are then read from it with no lock held. Returns
+// true if more books follow.
+bool Library::bookPage(BookOrder order, BookCursor& cursor, size_t pageSize, std::vector<Book>& page) const {
+    StatTimer timer(StatOp::BookPage);
+    page.clear();
+    std::shared_ptr<const LibrarySnapshot> view;
+    std::vector<int> ids;
+    {
+        std::shared_lock<std::shared_mutex> catalog(catalogMutex);
+        view = snapshot();
+        orderIndex(order).after(!cursor.started, cursor.key, cursor.id, pageSize + 1, ids, [&view, order](int id) {
+            return orderKey(view->books, view->bookSlots, order, id);
+        });
+    }
+
+    bool more = ids.size() > pageSize;
+    if (more) ids.pop_back();
+    page.reserve(ids.size());
+    for (int id : ids) {
+        page.push_back(view->bookAt(slotOf(view->bookSlots, id)));
+    }
+    if (!page.empty()) {
+        cursor.started = true;
+        cursor.key = std::string(orderKey(view->books, view->bookSlots, order, page.back().id));
+        cursor.id = page.back().id;
+    }
+    cursor.snapshot = std::move(view);
+    return more;
+}
+
+// Function to get up to limit completions of a title or author prefix, the
+// most borrowed first. Weights lag behind the latest borrows by at most
+// COMPLETION_FOLD_BORROWS. Returns the number found.
+size_t Library::completeBooks(BookField field, const std::string& prefix, size_t limit,
+                              std::vector<PrefixIndex::Completion>& completions) const {
+    StatTimer timer(StatOp::Complete);
+    completions.clear();
+    if (field == BookField::Isbn) return 0;
+
+    std::shared_lock<std::shared_mutex> catalog(catalogMutex);
+    (field == BookField::Title ? titleCompletions : authorCompletions).top(prefix, limit, completions);
+    return completions.size();
+}
+
+// Function to add a new student
+LibraryStatus Library::addStudent(const std::string& name, int* newId) {
+    StatTimer timer(StatOp::AddStudent);
+    uint64_t record;
+    {
+        std::lock_guard<std::mutex> lock(commitMutex);
+        int id = nextStudentId++;
+        insertStudent(Student(id, name));
+        record = journal.append({"AS", std::to_string(id), name});
+        ++commitCount;
+        if (newId != nullptr) *newId = id;
+    }
+    LibraryStatus saved = awaitJournal(record);
+    logOperation("Added student: " + name);
+    checkpointIfDue();
+    return saved;
+}
+
+// Function to lend a book to a student. The check and the commit are a few
+// in-memory updates under the commit lock; readers work from snapshots, so
+// this never waits for a listing or search to finish.
+LibraryStatus Library::borrowBook(int studentId, int bookId, Transaction* made) {
+    StatTimer timer(StatOp::Borrow);
+    Transaction borrow(0, bookId, studentId, TransactionType::Borrow);
+    std::string title;
+    bool foldDue = false;
+    uint64_t record;
+    {
+        std::lock_guard<std::mutex> lock(commitMutex);
+        if (findStudentSlot(studentId) == NO_SLOT) {
+            return LibraryStatus::StudentNotFound;
+        }
+        size_t slot = findBookSlot(bookId);
+        if (slot == NO_SLOT) {
+            return LibraryStatus::BookNotFound;
+        }
+        if (!books.available(slot)) {
+            return LibraryStatus::AlreadyBorrowed;
+        }
+
+        borrow.id = nextTransactionId++;
+        transactionHistory.append(borrow);
+        record = journalTransaction(borrow);
+        books.setAvailable(slot, false);
+        openLoan(bookId, borrow.id, studentId);
+        circulation.borrowed(bookId, studentId, borrow.day);
+        pendingBorrows.push_back(bookId);
+        dirtyTables |= DIRTY_BOOKS | DIRTY_HISTORY | DIRTY_CIRCULATION;
+        foldDue = pendingBorrows.size() >= COMPLETION_FOLD_BORROWS;
+        ++commitCount;
+        title = std::string(books.title(slot));
+    }
+    if (foldDue) {
+        foldBorrowsIfDue();
+    }
+    LibraryStatus saved = awaitJournal(record);
+    if (made != nullptr) *made = borrow;
+    logOperation("Student ID " + std::to_string(studentId) +
+                 " borrowed book: " + title + " (ID: " + std::to_string(bookId) + ")");
+    checkpointIfDue();
+    return saved;
+}
+
+// Function to take a book back from whoever has it
+LibraryStatus Library::returnBook(int bookId, Transaction* made) {
+    StatTimer timer(StatOp::Return);
+    Transaction giveBack(0, bookId, 0, TransactionType::Return);
+    std::string title;
+    uint64_t record;
+    {
+        std::lock_guard<std::mutex> lock(commitMutex);
+        size_t slot = findBookSlot(bookId);
+        if (slot == NO_SLOT) {
+            return LibraryStatus::BookNotFound;
+        }
+        if (books.available(slot)) {
+            return LibraryStatus::NotBorrowed;
+        }
+        if (books.loan(slot).transactionId == 0) {
+            return LibraryStatus::NoLoanRecord;
+        }
+
+        giveBack.studentId = books.loan(slot).studentId;
+        giveBack.id = nextTransactionId++;
+        transactionHistory.append(giveBack);
+        record = journalTransaction(giveBack);
+        books.setAvailable(slot, true);
+        closeLoan(bookId);
+        circulation.returned(giveBack.day);
+        dirtyTables |= DIRTY_BOOKS | DIRTY_HISTORY | DIRTY_CIRCULATION;
+        ++commitCount;
+        title = std::string(books.title(slot));
+    }
+    LibraryStatus saved = awaitJournal(record);
+    if (made != nullptr) *made = giveBack;
+    logOperation("Student ID " + std::to_string(giveBack.studentId) +
+                 " returned book: " + title + " (ID: " + std::to_string(bookId) + ")");
+    checkpointIfDue();
+    return saved;
+}
+
+// Function to report circulation: totals, the top most borrowed books (all
+// time and this month) and borrowing students, and the daily totals in
+// [fromDay, toDay]. Everything is read off the running aggregates, so this
+// holds the commit lock for a few dozen lookups.
+void Library::circulationReport(size_t top, int32_t fromDay, int32_t toDay, CirculationReport& report) const {
+    StatTimer timer(StatOp::Report);
+    std::lock_guard<std::mutex> lock(commitMutex);
+    report.books = liveBooks;
+    report.neverBorrowed = liveBooks - std::min(liveBooks, circulation.booksBorrowed());
+    report.borrows = circulation.borrows();
+    report.returns = circulation.returns();
+    report.month = circulation.month();
+
+    auto rankBooks = [this, top](const std::vector<CirculationStats::Ranked>& ranked, std::vector<RankedBook>& out) {
+        out.clear();
+        for (size_t i = 0; i < ranked.size() && i < top; ++i) {
+            size_t slot = findBookSlot(ranked[i].id);
+            out.push_back({ranked[i].id, slot == NO_SLOT ? std::string() : std::string(books.title(slot)),
+                           ranked[i].count});
+        }
+    };
+    rankBooks(circulation.topBooks(), report.topBooks);
+    rankBooks(circulation.topMonthBooks(), report.monthBooks);
+
+    report.topStudents.clear();
+    const auto& students = circulation.topStudents();
+    for (size_t i = 0; i < students.size() && i < top; ++i) {
+        size_t slot = findStudentSlot(students[i].id);
+        RankedStudent row{students[i].id, std::string(), students[i].count, 0};
+        if (slot != NO_SLOT) {
+            row.name = this->students[slot].name;
+            row.loans = this->students[slot].books.size();
+        }
+        report.topStudents.push_back(std::move(row));
+    }
+    circulation.daysBetween(fromDay, toDay, report.days);
+}
+
+bool Library::hasTransactions() const {
+    std::lock_guard<std::mutex> lock(commitMutex);
+    return !transactionHistory.empty();
+}
+
+// Function to check a transaction against a filter
+static bool transactionMatches(const TransactionFilter& filter, const Transaction& transaction) {
+    if (filter.studentId != 0 && transaction.studentId != filter.studentId) return false;
+    if (filter.bookId != 0 && transaction.bookId != filter.bookId) return false;
+    if (filter.type && transaction.type != *filter.type) return false;
+    if (transaction.id <= filter.afterId) return false;
+    return transaction.day >= filter.fromDay && transaction.day <= filter.toDay;
+}
+
+// Function to fetch the next page of matching transactions, joined with
+// their book and student through the id indexes (one array probe each, no
+// scan of books or students). Scanning starts at cursor and stops as soon as
+// the page is full, so a listing holds at most one page plus the candidate
+// rows of one segment in memory. Segments and blocks whose date, book and
+// student ranges miss the filter are skipped without being decoded. Every
+// page is read against the snapshot the first one took, so transactions
+// committed after it are left out. A filter with afterId skips the sealed
+// segments that end before it, so a listing can also resume from the last
+// ID it was given. Returns false once the archive is exhausted.
+bool Library::transactionPage(const TransactionFilter& filter, TransactionCursor& cursor, size_t pageSize,
+                              std::vector<TransactionRow>& page) {
+    StatTimer timer(StatOp::History);
+    if (!cursor.snapshot) {
+        cursor.snapshot = snapshot();
+    }
+    const LibrarySnapshot& view = *cursor.snapshot;
+
+    TransactionBounds bounds;
+    bounds.fromDay = filter.fromDay;
+    bounds.toDay = filter.toDay;
+    bounds.bookId = filter.bookId;
+    bounds.studentId = filter.studentId;
+
+    page.clear();
+    std::string error;
+    size_t segments;
+    {
+        std::lock_guard<std::mutex> lock(commitMutex);
+        segments = transactionHistory.segmentCount();
+        // Resuming after an ID: skip the sealed segments that end at or before it
+        while (!cursor.selected && cursor.segment + 1 < segments &&
+               transactionHistory.segment(cursor.segment).lastId <= filter.afterId) {
+            ++cursor.segment;
+        }
+    }
+    while (cursor.segment < segments) {
+        if (!cursor.selected) {
+            bool read;
+            {
+                std::lock_guard<std::mutex> lock(commitMutex);
+                read = transactionHistory.select(cursor.segment, bounds, cursor.rows, error);
+                segments = transactionHistory.segmentCount();
+            }
+            if (!read) {
+                printNotice("Skipping unreadable history segment: " + error);
+            }
+            cursor.selected = true;
+            cursor.row = 0;
+        }
+
+        while (cursor.row < cursor.rows.size() && page.size() < pageSize) {
+            const Transaction& transaction = cursor.rows[cursor.row++];
+            if (transaction.id < view.transactionLimit() && transactionMatches(filter, transaction)) {
+                TransactionRow row{transaction, std::nullopt, std::nullopt};
+                if (std::optional<Book> book = view.findBook(transaction.bookId)) {
+                    row.bookTitle = std::string(book->title);
+                }
+                if (const Student* student = view.findStudent(transaction.studentId)) {
+                    row.studentName = student->name;
+                }
+                page.push_back(std::move(row));
+            }
+        }
+        if (cursor.row < cursor.rows.size()) {
+            return true; // Page full
+        }
+        ++cursor.segment;
+        cursor.selected = false;
+        if (page.size() == pageSize) {
+            break;
+        }
+    }
+    return cursor.segment < segments;
+}
+
+// Function to bulk-import books from a CSV or MARC-like file. Rows are
+// parsed and validated in parallel, deduped against the ISBN index (both the
+// catalog and earlier rows of the file), appended with ids from nextBookId
+// exactly as addBook would, and persisted with a single checkpoint at the end
+// instead of one journal record per book. Each parsed batch is committed by
+// itself, so circulation carries on while the file is read. Rejected rows are
+// listed in "<path>.rejected.txt".
+ImportSummary Library::importBooks(const std::string& path, ImportFormat format) {
+    StatTimer timer(StatOp::Import);
+    ImportSummary summary;
+    const auto started = std::chrono::steady_clock::now();
+    std::unique_lock<std::shared_mutex> catalog(catalogMutex);
+    size_t firstSlot;
+    int firstId;
+    {
+        std::lock_guard<std::mutex> lock(commitMutex);
+        firstSlot = books.size();
+        firstId = nextBookId;
+    }
+    summary.rejectPath = path + ".rejected.txt";
+    std::remove(summary.rejectPath.c_str());
+    std::ofstream rejectFile;
+
+    auto reject = [&](size_t line, const std::string& reason) {
+        if (!rejectFile.is_open()) {
+            rejectFile.open(summary.rejectPath);
+        }
+        std::string message = "line " + std::to_string(line) + ": " + reason;
+        rejectFile << message << '\n';
+        if (summary.samples.size() < LOAD_REPORT_SAMPLES) {
+            summary.samples.push_back(message);
+        }
+        ++summary.rejected;
+    };
+
+    importRecords(path, format, [&](ImportBatch& batch) {
+        std::lock_guard<std::mutex> lock(commitMutex);
+        auto rejection = batch.rejects.begin();
+        for (auto& row : batch.rows) {
+            for (; rejection != batch.rejects.end() && rejection->line < row.line; ++rejection) {
+                reject(rejection->line, rejection->reason);
+            }
+            // No compaction here: the new books' slots are indexed afterwards
+            if (!books.hasRoom(row.title.size() + row.author.size() + row.isbn.size())) {
+                reject(row.line, "no room left in the catalog for more text (4 GB)");
+                continue;
+            }
+            auto slot = isbnIndex.emplace(std::move(row.key), nextBookId);
+            if (!slot.second) {
+                int existing = slot.first->second;
+                reject(row.line, "duplicate ISBN '" + row.isbn + "' (" +
+                       (existing >= firstId ? "book " + std::to_string(existing) + " earlier in this file"
+                                            : "already in catalog as book " + std::to_string(existing)) + ")");
+                continue;
+            }
+            int id = nextBookId++;
+            setSlot(bookSlots, id, books.append(id, row.title, row.author, row.isbn, true));
+            ++liveBooks;
+            ++summary.imported;
+        }
+        for (; rejection != batch.rejects.end(); ++rejection) {
+            reject(rejection->line, rejection->reason);
+        }
+        ++commitCount;
+    }, summary.stats, summary.error);
+    const auto parsed = std::chrono::steady_clock::now();
+
+    if (summary.imported > 0) {
+        CatalogView view;
+        {
+            std::lock_guard<std::mutex> lock(commitMutex);
+            view = books.snapshot();
+        }
+        indexNewBooks(view, firstSlot);
+        std::lock_guard<std::mutex> lock(commitMutex);
+        dirtyTables |= DIRTY_BOOKS | DIRTY_COMPLETIONS;
+    }
+    catalog.unlock();
+    if (summary.imported > 0) {
+        summary.persisted = checkpoint(); // The books are in no journal record
+    }
+    if (rejectFile.is_open()) {
+        countWritten(summary.rejectPath, rejectFile);
+    }
+    const auto finished = std::chrono::steady_clock::now();
+
+    summary.parseSeconds = std::chrono::duration<double>(parsed - started).count();
+    summary.totalSeconds = std::chrono::duration<double>(finished - started).count();
+    logOperation("Imported " + std::to_string(summary.imported) + " books from " + path +
+                 " (" + std::to_string(summary.rejected) + " rejected)");
+    return summary;
+}
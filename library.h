@@ -0,0 +1,527 @@
+#ifndef LIBRARY_H
+#define LIBRARY_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "bulk_import.h"
+#include "catalog_store.h"
+#include "circulation_stats.h"
+#include "cow_vector.h"
+#include "fuzzy_index.h"
+#include "journal.h"
+#include "operation_log.h"
+#include "ordered_index.h"
+#include "prefix_index.h"
+#include "transaction.h"
+#include "transaction_archive.h"
+#include "trigram_index.h"
+
+// The library engine: the catalog, students, loans and transaction history,
+// their indexes, persistence (snapshots, journal, history archive) and every
+// operation on them. The menu in main.cpp and the socket server in
+// library_server.h are both front ends over one Library.
+//
+// Every public function is safe to call from many threads at once.
+//
+// Reads go through a LibrarySnapshot: a copy-on-write view of the catalog,
+// availability, loans and students as of one commit. Taking one is a short
+// lock and a pointer copy per few thousand books; reading it takes no lock,
+// so listings, reports and exports never hold up borrowing or editing, and
+// always see a consistent state. Writers take
+//
+//   catalogMutex   exclusive while adding, updating or deleting books,
+//                  loading, importing and starting a checkpoint; it guards
+//                  the ISBN, trigram, word, ordered and prefix indexes, which
+//                  searches, listings and completions probe under it shared
+//                  (as a checkpoint does while it writes its files)
+//   commitMutex    around every change to the versioned state and the
+//                  transaction history: ids, the archive, the journal order
+//                  and publishing snapshots. Borrow and return take only this,
+//                  for a few microseconds.
+//
+// in that order.
+
+// Structure to represent a Book. The catalog itself is stored column by
+// column (see CatalogStore); a Book is a view of one entry, and its text is
+// only valid until the catalog next changes.
+struct Book {
+    int id;
+    std::string_view title;
+    std::string_view author;
+    std::string_view isbn;
+    bool available;
+
+    // Constructor
+    Book(int _id, std::string_view _title, std::string_view _author, std::string_view _isbn, bool _available = true)
+        : id(_id), title(_title), author(_author), isbn(_isbn), available(_available) {}
+};
+
+// A book copied out of the catalog, safe to keep after the call returns
+struct BookInfo {
+    int id;
+    std::string title;
+    std::string author;
+    std::string isbn;
+    bool available;
+
+    explicit BookInfo(const Book& book)
+        : id(book.id), title(book.title), author(book.author), isbn(book.isbn), available(book.available) {}
+};
+
+// Structure to represent a Student
+struct Student {
+    int id;
+    std::string name;
+    std::vector<int> books; // Books on loan, by ascending id
+
+    // Constructor
+    Student(int _id, std::string _name) : id(_id), name(_name) {}
+};
+
+// One of a student's open loans, joined with the book's title (empty if
+// the book is gone)
+struct LoanRow {
+    int bookId;
+    int transactionId;
+    std::optional<std::string> bookTitle;
+};
+
+// Filter for transaction listings; zero/empty fields match anything
+struct TransactionFilter {
+    int studentId = 0;
+    int bookId = 0;
+    std::optional<TransactionType> type;
+    int32_t fromDay = std::numeric_limits<int32_t>::min(); // Inclusive
+    int32_t toDay = std::numeric_limits<int32_t>::max();   // Inclusive
+    int afterId = 0;                                        // Only transactions with a greater ID
+};
+
+// A transaction joined with its book title and student name (empty if
+// deleted or unknown)
+struct TransactionRow {
+    Transaction transaction;
+    std::optional<std::string> bookTitle;
+    std::optional<std::string> studentName;
+};
+
+class LibrarySnapshot;
+
+// Orders a catalog listing can be sorted in (text orders ignore case and
+// break ties by id)
+enum class BookOrder {
+    Id,
+    Title,
+    Author
+};
+
+// Position in a sorted catalog listing: just after the last book handed out
+// (the start if started is false). It holds the sort key rather than a slot,
+// so paging carries on correctly however the catalog changes in between.
+// snapshot is the view the last page was read from; that page's books point
+// into it.
+struct BookCursor {
+    bool started = false;
+    std::string key;
+    int id = 0;
+    std::shared_ptr<const LibrarySnapshot> snapshot;
+};
+
+// Position in the transaction archive: a segment, the rows selected from it
+// and the next of those to test, plus the snapshot the listing reads, so
+// every page comes from the same point in time
+struct TransactionCursor {
+    size_t segment = 0;
+    bool selected = false;
+    std::vector<Transaction> rows;
+    size_t row = 0;
+    std::shared_ptr<const LibrarySnapshot> snapshot;
+};
+
+// Outcome of an operation that can be refused
+enum class LibraryStatus {
+    Ok,
+    BookNotFound,
+    StudentNotFound,
+    DuplicateIsbn,
+    BookOnLoan,
+    AlreadyBorrowed,
+    NotBorrowed,
+    NoLoanRecord,
+    NotSaved,   // Done, but its journal record could not be written
+    CatalogFull // The catalog's text arena has no room for it
+};
+
+// Function to describe a status for the user
+inline const char* statusMessage(LibraryStatus status) {
+    switch (status) {
+        case LibraryStatus::Ok: return "OK.";
+        case LibraryStatus::BookNotFound: return "Book not found.";
+        case LibraryStatus::StudentNotFound: return "Student not found.";
+        case LibraryStatus::DuplicateIsbn: return "A book with this ISBN already exists!";
+        case LibraryStatus::BookOnLoan: return "Cannot delete this book as it is currently borrowed.";
+        case LibraryStatus::AlreadyBorrowed: return "This book is already borrowed.";
+        case LibraryStatus::NotBorrowed: return "This book is not currently borrowed.";
+        case LibraryStatus::NoLoanRecord: return "Error: Could not find borrow transaction for this book.";
+        case LibraryStatus::NotSaved: return "Error: The change was made but could not be written to disk; "
+                                             "it may be lost if the program stops before the next save.";
+        case LibraryStatus::CatalogFull: return "Error: The catalog has no room left for more title, author and ISBN "
+                                                "text (4 GB).";
+    }
+    return "Unknown error.";
+}
+
+// A ranked book or student in a circulation report, with its title or name
+// (empty if the book has gone since it was ranked)
+struct RankedBook {
+    int id;
+    std::string title;
+    uint32_t borrows;
+};
+
+struct RankedStudent {
+    int id;
+    std::string name;
+    uint32_t borrows;
+    size_t loans; // Books out now
+};
+
+// Circulation as of one commit (see CirculationStats)
+struct CirculationReport {
+    size_t books = 0;
+    size_t neverBorrowed = 0;
+    uint64_t borrows = 0;
+    uint64_t returns = 0;
+    int32_t month = CirculationStats::NO_MONTH; // Of monthBooks
+    std::vector<RankedBook> topBooks;
+    std::vector<RankedBook> monthBooks;
+    std::vector<RankedStudent> topStudents;
+    std::vector<CirculationStats::Day> days;
+};
+
+// What a bulk import did
+struct ImportSummary {
+    size_t imported = 0;
+    size_t rejected = 0;
+    ImportStats stats;
+    std::vector<std::string> samples; // First few rejections
+    std::string rejectPath;
+    std::string error;                // Why reading stopped early, if it did
+    bool persisted = true;
+    double parseSeconds = 0;
+    double totalSeconds = 0;
+};
+
+const size_t JOURNAL_CHECKPOINT_RECORDS = 50000; // Journal records that bring a checkpoint forward
+const int CHECKPOINT_INTERVAL_SECONDS = 60;       // Checkpoint changes at least this often
+const size_t COMPLETION_FOLD_BORROWS = 64; // Borrows held back from the completion weights at most
+const size_t STUDENT_CHUNK = 256; // Students per copy-on-write chunk
+
+// Id -> slot + 1 (0: no such id). Ids are handed out in sequence, so a
+// dense array is both smaller and faster than a hash map, and it is
+// versioned like the tables it indexes.
+using SlotIndex = CowVector<uint32_t, CATALOG_CHUNK>;
+const size_t NO_SLOT = static_cast<size_t>(-1);
+
+// Function to look up an id's slot (NO_SLOT if it has none)
+inline size_t slotOf(const SlotIndex& index, int id) {
+    if (id <= 0 || static_cast<size_t>(id) >= index.size() || index[id] == 0) {
+        return NO_SLOT;
+    }
+    return index[id] - 1;
+}
+
+// A consistent, read-only view of the library as of one commit: books,
+// availability, open loans and students, and how far the transaction history
+// had got. It never changes while held, whatever writers do meanwhile, and
+// reading it takes no lock. Book views it hands out stay valid as long as it.
+class LibrarySnapshot {
+public:
+    size_t bookCount() const {
+        return liveBooks;
+    }
+
+    size_t availableCount() const {
+        return books.countAvailable();
+    }
+
+    size_t studentCount() const {
+        return students.size();
+    }
+
+    // Function to get the first transaction id this snapshot does not include
+    int transactionLimit() const {
+        return nextTransactionId;
+    }
+
+    std::optional<Book> findBook(int id) const;
+    const Student* findStudent(int id) const;
+    void forEachBook(const std::function<void(const Book&)>& visit) const;
+    void forEachStudent(const std::function<void(const Student&)>& visit) const;
+    LibraryStatus studentLoans(int studentId, std::string& name, std::vector<LoanRow>& rows) const;
+
+    // All-time borrows of a book or by a student (0 for unknown ids)
+    uint32_t bookBorrows(int bookId) const;
+    uint32_t studentBorrows(int studentId) const;
+    bool neverBorrowedPage(int afterId, size_t pageSize, std::vector<Book>& page) const;
+    bool studentPage(int afterId, size_t pageSize, std::vector<Student>& page) const;
+
+private:
+    friend class Library;
+
+    Book bookAt(size_t slot) const;
+
+    CatalogView books;
+    SlotIndex bookSlots;
+    CowVector<Student, STUDENT_CHUNK> students;
+    SlotIndex studentSlots;
+    CirculationStats::Counts bookBorrowCounts;
+    CirculationStats::Counts studentBorrowCounts;
+    size_t liveBooks = 0;
+    int nextBookId = 1;
+    int nextStudentId = 1;
+    int nextTransactionId = 1;
+    uint64_t commit = 0;
+};
+
+class Library {
+public:
+    Library();
+    ~Library();
+
+    Library(const Library&) = delete;
+    Library& operator=(const Library&) = delete;
+
+    // Persistence
+    void setSegmentMonths(int months);
+    void setCheckpointPolicy(int seconds, size_t changes);
+    void load();
+    bool save();
+    void exportText();
+    ImportSummary importBooks(const std::string& path, ImportFormat format);
+
+    // Function to get a view of the library as of the latest commit
+    std::shared_ptr<const LibrarySnapshot> snapshot() const;
+
+    // Books
+    LibraryStatus addBook(const std::string& title, const std::string& author, const std::string& isbn,
+                          int* newId = nullptr);
+    LibraryStatus updateBook(int id, BookField field, const std::string& value, std::string* oldValue = nullptr);
+    LibraryStatus deleteBook(int id, std::string* title = nullptr);
+    size_t searchBooks(BookField field, const std::string& term, const std::function<void(const Book&)>& visit,
+                       size_t limit = std::numeric_limits<size_t>::max(), int afterId = 0) const;
+    size_t fuzzySearchBooks(BookField field, const std::string& term, unsigned maxDistance, size_t limit,
+                            const std::function<void(const Book&, unsigned)>& visit) const;
+    bool bookPage(BookOrder order, BookCursor& cursor, size_t pageSize, std::vector<Book>& page) const;
+    size_t completeBooks(BookField field, const std::string& prefix, size_t limit,
+                         std::vector<PrefixIndex::Completion>& completions) const;
+
+    // Students
+    LibraryStatus addStudent(const std::string& name, int* newId = nullptr);
+
+    // Circulation
+    LibraryStatus borrowBook(int studentId, int bookId, Transaction* made = nullptr);
+    LibraryStatus returnBook(int bookId, Transaction* made = nullptr);
+
+    // Reports
+    void circulationReport(size_t top, int32_t fromDay, int32_t toDay, CirculationReport& report) const;
+
+    // Transaction history
+    bool hasTransactions() const;
+    bool transactionPage(const TransactionFilter& filter, TransactionCursor& cursor, size_t pageSize,
+                         std::vector<TransactionRow>& page);
+
+    // Operation log (timestamps as from parseOperationTime)
+    void logOperation(const std::string& operation);
+    void recentOperations(size_t count, std::vector<std::string>& entries);
+    bool operationsBetween(int64_t from, int64_t to, size_t skip, size_t limit, std::vector<std::string>& entries);
+
+private:
+    // Indexes (caller holds both locks, or catalogMutex exclusively for the
+    // ISBN, trigram, word, ordered and prefix indexes)
+    void rebuildIsbnIndex();
+    bool isbnExists(const std::string& isbn, int excludeId) const;
+    void unindexIsbn(const std::string& isbn, int id);
+    template <typename Index>
+    void rebuildTextIndex(Index& index, BookField field);
+    void rebuildBookIndex();
+    void rebuildStudentIndex();
+    void rebuildBookIndexes();
+    void indexNewBooks(const CatalogView& view, size_t first);
+    OrderedIndex& orderIndex(BookOrder order);
+    const OrderedIndex& orderIndex(BookOrder order) const;
+    void rebuildOrderIndex(BookOrder order, size_t live);
+    void orderBook(const CatalogView& view, BookOrder order, size_t slot);
+    void unorderBook(BookOrder order, size_t slot);
+    Book bookAt(size_t slot) const;
+    size_t findBookSlot(int id) const;
+    size_t findStudentSlot(int id) const;
+    void insertBook(const Book& book);
+    void setBookTitle(size_t slot, const std::string& title);
+    void setBookAuthor(size_t slot, const std::string& author);
+    void setBookIsbn(size_t slot, const std::string& isbn);
+    void insertStudent(const Student& student);
+    void compactBooks();
+    void compactBooksIfWasteful();
+    bool makeRoomForBook(size_t textBytes);
+    bool removeBook(int id);
+    static std::vector<size_t> scanBooks(const CatalogView& view, BookField field, const std::string& lowerTerm);
+
+    // Loans (caller holds commitMutex)
+    void openLoan(int bookId, int transactionId, int studentId);
+    bool closeLoan(int bookId);
+    void rebuildLoanIndex();
+
+    // Files (caller holds both locks, except for the text exports and the
+    // table snapshots, which read a snapshot, and the history, completion
+    // and circulation saves, which a checkpoint makes under catalogMutex
+    // shared)
+    void reportTextLoad(const std::string& path, const std::string& table, const LoadReport& report);
+    void saveBooksToFile(const LibrarySnapshot& view);
+    void loadBooksFromFile();
+    void saveStudentsToFile(const LibrarySnapshot& view);
+    void loadStudentsFromFile();
+    void saveTransactionsToFile(const LibrarySnapshot& view);
+    bool loadTransactionsFromFile(std::vector<Transaction>& rows);
+    bool saveBooksSnapshot(const LibrarySnapshot& view);
+    bool loadBooksFromSnapshot();
+    bool saveStudentsSnapshot(const LibrarySnapshot& view);
+    bool loadStudentsFromSnapshot();
+    bool saveTransactionsSnapshot(TransactionArchive::Checkpoint& history);
+    void loadTransactions();
+    bool loadCompletions();
+    void rebuildCompletions();
+    bool saveCompletions();
+    bool loadCirculation(int64_t& counted);
+    bool catchUpCirculation(int64_t counted);
+    bool saveCirculation(const CirculationStats& counts, int nextId);
+
+    // Checkpoints (see dirtyTables)
+    std::shared_ptr<const LibrarySnapshot> snapshotLocked() const;
+    bool checkpoint();
+    void checkpointIfDue();
+    void startCheckpointer();
+    void stopCheckpointer();
+    void checkpointLoop();
+
+    // Journal
+    uint64_t journalBook(const std::string& op, const Book& book);
+    uint64_t journalTransaction(const Transaction& transaction);
+    LibraryStatus awaitJournal(uint64_t record);
+    bool applyJournalRecord(const std::vector<std::string>& fields);
+    void replayJournal();
+
+    // Completion weights (caller holds both locks, except for the IfDue form)
+    void foldBorrows();
+    void foldBorrowsIfDue();
+
+    mutable std::shared_mutex catalogMutex;
+    mutable std::mutex commitMutex;
+
+    // Files a checkpoint has to rewrite, as bits of dirtyTables
+    enum DirtyTable : unsigned {
+        DIRTY_BOOKS = 1,       // books.bin
+        DIRTY_STUDENTS = 2,    // students.bin
+        DIRTY_HISTORY = 4,     // history/
+        DIRTY_COMPLETIONS = 8, // The completion files (always rewritten with books.bin)
+        DIRTY_CIRCULATION = 16 // circulation.bin
+    };
+
+    // Versioned state: changed only under commitMutex, and copied (cheaply,
+    // chunk by chunk) into the snapshots readers get
+    CatalogStore books;
+    CowVector<Student, STUDENT_CHUNK> students;
+    int nextBookId = 1;
+    int nextStudentId = 1;
+
+    // Id -> slot indexes into books/students. Deleting a book leaves a
+    // tombstone (id 0, never a valid id) in its slot so no other slot moves;
+    // the tombstones are squeezed out by compactBooks() once they make up
+    // half of the catalog, or the text left behind by edits and deletes
+    // makes up half of the arena.
+    SlotIndex bookSlots;
+    SlotIndex studentSlots;
+    size_t liveBooks = 0;
+    size_t bookTombstones = 0;
+
+    // Bumped by every commit; snapshot() reuses the last snapshot it
+    // published until this moves on, as long as someone still holds it
+    uint64_t commitCount = 0;
+    mutable std::weak_ptr<const LibrarySnapshot> published;
+
+    // Normalized ISBN -> book id, used for duplicate checks and exact
+    // lookups. See normalizeIsbn() for what counts as the same ISBN.
+    std::unordered_map<std::string, int> isbnIndex;
+
+    // Trigram indexes over title and author for substring search
+    TrigramIndex titleGrams;
+    TrigramIndex authorGrams;
+
+    // Word indexes over title and author for typo-tolerant search
+    FuzzyIndex titleWords;
+    FuzzyIndex authorWords;
+
+    // Book ids in each listing order, for sorted paging
+    OrderedIndex idOrder;
+    OrderedIndex titleOrder;
+    OrderedIndex authorOrder;
+
+    // Prefix indexes over title and author for type-ahead, weighted by
+    // borrows. A borrow takes only commitMutex, so it queues its book here
+    // (under commitMutex) and the queue is folded into the weights under
+    // both locks: every COMPLETION_FOLD_BORROWS borrows and at checkpoints.
+    // The index files match the books.bin whose checksum is catalogCrc
+    // (which only load and checkpoints touch).
+    PrefixIndex titleCompletions;
+    PrefixIndex authorCompletions;
+    std::vector<int> pendingBorrows;
+    uint32_t catalogCrc = 0;
+    bool catalogCrcKnown = false; // Books came from books.bin or were saved to it
+
+    // Borrow counts, daily totals and rankings, updated by every borrow and
+    // return (under commitMutex) and saved with each checkpoint
+    CirculationStats circulation;
+
+    // Transaction history (under commitMutex)
+    TransactionArchive transactionHistory;
+    int nextTransactionId = 1;
+    bool transactionsMigrated = false; // Loaded from the pre-archive files; checkpoint once loaded
+
+    // Write-ahead journal: every mutation appends one record here instead of
+    // rewriting the data files. The data files are the snapshot; a checkpoint
+    // rewrites the ones whose tables changed and then drops the records they
+    // hold. Mutations only mark their tables in dirtyTables (under
+    // commitMutex); a background thread checkpoints every checkpointInterval,
+    // or as soon as the journal holds checkpointChanges records, and save()
+    // checkpoints at once. checkpointMutex keeps checkpoints one at a time.
+    Journal journal;
+    unsigned dirtyTables = 0;
+    std::mutex checkpointMutex;
+    std::chrono::seconds checkpointInterval{CHECKPOINT_INTERVAL_SECONDS};
+    size_t checkpointChanges = JOURNAL_CHECKPOINT_RECORDS;
+    std::thread checkpointer;
+    std::mutex checkpointerMutex; // Guards the two flags below
+    std::condition_variable checkpointerWake;
+    bool checkpointDue = false;
+    bool checkpointerStopping = false;
+
+    // Recent operations in memory, the full trail in operations/
+    OperationLog operationLog;
+};
+
+// Function to print a one-line notice (safe from any thread)
+void printNotice(const std::string& notice);
+
+#endif
@@ -0,0 +1,738 @@
+#ifndef LIBRARY_SERVER_H
+#define LIBRARY_SERVER_H
+
+#ifndef _WIN32
+
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <csignal>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <limits>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "civil_date.h"
+#include "library.h"
+#include "protocol.h"
+#include "stats.h"
+#include "text_loader.h"
+#include "thread_pool.h"
+
+// Daemon front end: serves one Library to many local clients over a Unix
+// domain socket, speaking the line protocol in protocol.h.
+//
+// One I/O thread owns the listening socket and every connection and waits
+// on all of them with poll(). Each complete request line is handed to a
+// pool of worker threads, which run it against the Library (whose own
+// locking lets lookups and circulation on different books run side by
+// side). A connection has at most one request in flight, so its responses
+// come back in request order; it is left out of the poll set while busy,
+// and the worker wakes the I/O thread through a self-pipe when done.
+//
+// Commands (arguments are '|'-separated fields):
+//   PING                               OK|0
+//   BOOK|id                            OK|1   id|title|author|isbn|available
+//   BOOKS|limit[|afterId]              OK|n   the next limit books by ID after afterId,
+//                                             as BOOK (BOOKS alone is refused: page
+//                                             through the catalog instead)
+//   BOOKS|id/title/author|limit[|key|id]
+//                                      OK|n   the next limit books in that order after
+//                                             the book with that sort key and id
+//                                             (key blank for id order), as BOOK
+//   SEARCH|title/author/isbn|term[|limit[|afterId]]
+//                                      OK|n   the next limit matching books by ID after
+//                                             afterId, as BOOK
+//   FUZZY|title/author|term[|edits[|limit]]
+//                                      OK|n   the closest books, allowing up to edits
+//                                             typos a word (default 2, at most 3),
+//                                             as BOOK plus |edits made
+//   COMPLETE|title/author|prefix[|limit]
+//                                      OK|n   text|books|borrows: the most borrowed
+//                                             completions of prefix (normalized)
+//   ADDBOOK|title|author|isbn          OK|1   new book id
+//   UPDATEBOOK|id|title/author/isbn|v  OK|1   previous value
+//   DELETEBOOK|id                      OK|0
+//   ADDSTUDENT|name                    OK|1   new student id
+//   STUDENTS[|limit[|afterId]]         OK|n   id|name of the next limit students by ID
+//                                             after afterId
+//   BORROW|studentId|bookId            OK|1   transactionId|date
+//   RETURN|bookId                      OK|1   transactionId|studentId|date
+//   LOANS|studentId                    OK|n   bookId|transactionId|title
+//   REPORT                             OK|1   books|neverBorrowed|onLoan|borrows|returns|month
+//                                             (month of TOPBOOKS|month, YYYY-MM or blank)
+//   TOPBOOKS|all/month[|limit]         OK|n   id|title|borrows, most borrowed first
+//                                             (at most CirculationStats::TOP_TRACKED)
+//   TOPSTUDENTS[|limit]                OK|n   id|name|borrows|loans, most borrowing first
+//   CIRCULATION|from|to                OK|n   date|borrows|returns for each day with any
+//   UNBORROWED|limit[|afterId]         OK|n   books never borrowed, by ID after afterId,
+//                                             as BOOK
+//   TRANSACTIONS|student|book|type|from|to|limit[|afterId]
+//                                      OK|n   id|type|date|studentId|student|bookId|title
+//                                             of the next limit matches by ID after
+//                                             afterId (blank or 0 filters match anything)
+//   OPERATIONS|n                       OK|n   the last n operation log entries, oldest first
+//   OPERATIONS|from|to|limit[|skip]    OK|n   up to limit entries timed from..to
+//                                             ("Y-M-D[ h:m[:s]]", blank to = now),
+//                                             after skipping the first skip
+//   SAVE                               OK|0   checkpoint now
+//   STATS[|json]                       OK|n   the statistics dump (stats.h), one line
+//                                             per text line, or one JSON line
+//   QUIT                               OK|0   then the connection closes
+// Refused or malformed requests get ERR|message.
+//
+// BOOKS, SEARCH, STUDENTS, TRANSACTIONS and UNBORROWED are paged: a reply
+// holds at most SERVER_PAGE_LIMIT rows whatever limit asks for (and that
+// many when limit is left out). A client gets the next page by passing the
+// last row's ID back as afterId (with its key, for BOOKS in title or author
+// order); a page with fewer rows than that is the last.
+
+const size_t SERVER_PAGE_LIMIT = 1000;        // Most rows per paged reply, and the default page
+const size_t SERVER_FUZZY_LIMIT = 20;         // Books per FUZZY reply unless asked otherwise
+const size_t SERVER_COMPLETE_LIMIT = 10;      // Completions per COMPLETE reply unless asked otherwise
+const size_t SERVER_RANKED_LIMIT = 10;        // Rows per TOPBOOKS/TOPSTUDENTS reply unless asked otherwise
+
+class LibraryServer {
+public:
+    LibraryServer(Library& served, std::string socketPath, size_t workerCount)
+        : library(served), path(std::move(socketPath)),
+          workers(std::max<size_t>(1, workerCount)) {}
+
+    ~LibraryServer() {
+        closeAll();
+    }
+
+    LibraryServer(const LibraryServer&) = delete;
+    LibraryServer& operator=(const LibraryServer&) = delete;
+
+    // Function to bind the socket (replacing a stale one left by a crash)
+    bool listen(std::string& error) {
+        sockaddr_un address{};
+        if (path.size() >= sizeof(address.sun_path)) {
+            error = "socket path is too long";
+            return false;
+        }
+        if (::pipe(wakePipe) != 0) {
+            error = std::string("pipe: ") + std::strerror(errno);
+            return false;
+        }
+        setNonBlocking(wakePipe[0]);
+        setNonBlocking(wakePipe[1]);
+
+        listener = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        if (listener < 0) {
+            error = std::string("socket: ") + std::strerror(errno);
+            return false;
+        }
+        address.sun_family = AF_UNIX;
+        std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+        ::unlink(path.c_str());
+        if (::bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+            ::listen(listener, SOMAXCONN) != 0) {
+            error = path + ": " + std::strerror(errno);
+            return false;
+        }
+        setNonBlocking(listener);
+        return true;
+    }
+
+    // Function to serve until stop() is called. Requests already running
+    // finish before this returns.
+    void run() {
+        std::vector<pollfd> fds;
+        std::vector<uint64_t> ids; // Connection of each fds entry past the first two
+        while (!stopping) {
+            fds.clear();
+            ids.clear();
+            fds.push_back(pollfd{wakePipe[0], POLLIN, 0});
+            fds.push_back(pollfd{listener, POLLIN, 0});
+            for (const auto& entry : connections) {
+                const Connection& connection = entry.second;
+                short events = 0;
+                if (!connection.busy && !connection.closing && !connection.eof) events |= POLLIN;
+                if (!connection.out.empty()) events |= POLLOUT;
+                if (events == 0 && connection.busy) continue; // Finished via the wake pipe
+                fds.push_back(pollfd{connection.fd, events, 0});
+                ids.push_back(entry.first);
+            }
+
+            if (::poll(fds.data(), fds.size(), -1) < 0) {
+                if (errno == EINTR) continue;
+                break;
+            }
+
+            if (fds[0].revents & POLLIN) {
+                drainWakePipe();
+                collectResponses();
+            }
+            if (fds[1].revents & POLLIN) {
+                acceptClients();
+            }
+            for (size_t i = 2; i < fds.size(); ++i) {
+                if (fds[i].revents != 0) {
+                    service(ids[i - 2], fds[i].revents);
+                }
+            }
+        }
+
+        // Let in-flight requests finish before the Library is saved
+        std::unique_lock<std::mutex> lock(doneMutex);
+        idle.wait(lock, [this]() { return inFlight == 0; });
+    }
+
+    // Function to make run() return (safe from a signal handler)
+    void stop() {
+        stopping = 1;
+        wake();
+    }
+
+private:
+    struct Connection {
+        int fd = -1;
+        std::string in;   // Bytes received but not yet handled
+        std::string out;  // Response bytes not yet sent
+        bool busy = false;    // A request is with a worker
+        bool eof = false;     // Client sent everything; answer what is in, then close
+        bool closing = false; // Close once out is sent (QUIT, error, bad line)
+    };
+
+    struct Response {
+        uint64_t connection;
+        std::string text;
+        bool quit;
+    };
+
+    static void setNonBlocking(int fd) {
+        ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+    }
+
+    void wake() {
+        char byte = 1;
+        ssize_t ignored = ::write(wakePipe[1], &byte, 1);
+        (void)ignored;
+    }
+
+    void drainWakePipe() {
+        char buffer[256];
+        while (::read(wakePipe[0], buffer, sizeof(buffer)) > 0) {
+        }
+    }
+
+    void acceptClients() {
+        for (;;) {
+            int fd = ::accept(listener, nullptr, nullptr);
+            if (fd < 0) return;
+            setNonBlocking(fd);
+            Connection& connection = connections[nextConnection++];
+            connection.fd = fd;
+        }
+    }
+
+    // Function to read from, write to or retire one connection
+    void service(uint64_t id, short revents) {
+        auto it = connections.find(id);
+        if (it == connections.end()) return;
+        Connection& connection = it->second;
+
+        if (revents & POLLIN) {
+            char buffer[16384];
+            ssize_t got;
+            while ((got = ::recv(connection.fd, buffer, sizeof(buffer), 0)) > 0) {
+                connection.in.append(buffer, static_cast<size_t>(got));
+            }
+            if (got == 0) {
+                connection.eof = true;
+            } else if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                connection.closing = true;
+                connection.out.clear();
+            }
+            dispatch(id, connection);
+        } else if (revents & (POLLHUP | POLLERR)) {
+            connection.eof = true;
+        }
+
+        if ((revents & POLLOUT) && !connection.out.empty()) {
+            ssize_t sent = ::send(connection.fd, connection.out.data(), connection.out.size(), MSG_NOSIGNAL);
+            if (sent > 0) {
+                connection.out.erase(0, static_cast<size_t>(sent));
+            } else if (sent < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+                connection.closing = true;
+                connection.out.clear();
+            }
+        }
+        retireIfDone(id);
+    }
+
+    // Function to hand a connection's next complete request to a worker
+    void dispatch(uint64_t id, Connection& connection) {
+        if (connection.busy || connection.closing) return;
+
+        size_t newline = connection.in.find('\n');
+        if (newline == std::string::npos) {
+            if (connection.in.size() > PROTOCOL_MAX_LINE) {
+                connection.out += "ERR|Request line too long\n";
+                connection.in.clear();
+                connection.closing = true;
+            }
+            return;
+        }
+
+        std::string line = connection.in.substr(0, newline);
+        connection.in.erase(0, newline + 1);
+        connection.busy = true;
+        {
+            std::lock_guard<std::mutex> lock(doneMutex);
+            ++inFlight;
+        }
+        workers.post([this, id, line]() {
+            bool quit = false;
+            std::string text = handle(decodeProtocolLine(line), quit);
+            {
+                std::lock_guard<std::mutex> lock(doneMutex);
+                done.push_back(Response{id, std::move(text), quit});
+                --inFlight;
+                // Still under the lock, so run() cannot return and close the
+                // pipe before this worker is done with it
+                idle.notify_all();
+                wake();
+            }
+        });
+    }
+
+    // Function to pick up finished requests and queue their responses
+    void collectResponses() {
+        std::deque<Response> finished;
+        {
+            std::lock_guard<std::mutex> lock(doneMutex);
+            finished.swap(done);
+        }
+        for (auto& response : finished) {
+            auto it = connections.find(response.connection);
+            if (it == connections.end()) continue;
+            Connection& connection = it->second;
+            connection.busy = false;
+            if (!connection.closing) {
+                connection.out += response.text;
+                connection.closing = response.quit;
+                dispatch(response.connection, connection); // Pipelined requests
+            }
+            retireIfDone(response.connection);
+        }
+    }
+
+    void retireIfDone(uint64_t id) {
+        auto it = connections.find(id);
+        if (it == connections.end()) return;
+        const Connection& connection = it->second;
+        bool drained = connection.closing || (connection.eof && connection.in.find('\n') == std::string::npos);
+        if (drained && !connection.busy && connection.out.empty()) {
+            ::close(it->second.fd);
+            connections.erase(it);
+        }
+    }
+
+    void closeAll() {
+        for (auto& entry : connections) {
+            ::close(entry.second.fd);
+        }
+        connections.clear();
+        if (listener >= 0) {
+            ::close(listener);
+            ::unlink(path.c_str());
+            listener = -1;
+        }
+        for (int& fd : wakePipe) {
+            if (fd >= 0) ::close(fd);
+            fd = -1;
+        }
+    }
+
+    static std::string ok(size_t lines) {
+        return "OK|" + std::to_string(lines) + "\n";
+    }
+
+    static std::string refuse(const std::string& message) {
+        std::string text = "ERR|";
+        appendEscapedField(text, message);
+        return text + "\n";
+    }
+
+    static std::string refuse(LibraryStatus status) {
+        return refuse(statusMessage(status));
+    }
+
+    static bool parseField(const std::string& name, BookField& field) {
+        if (name == "title") field = BookField::Title;
+        else if (name == "author") field = BookField::Author;
+        else if (name == "isbn") field = BookField::Isbn;
+        else return false;
+        return true;
+    }
+
+    static bool parseOrder(const std::string& name, BookOrder& order) {
+        if (name == "id") order = BookOrder::Id;
+        else if (name == "title") order = BookOrder::Title;
+        else if (name == "author") order = BookOrder::Author;
+        else return false;
+        return true;
+    }
+
+    static void appendBook(std::string& body, const Book& book) {
+        appendEscapedField(body, std::to_string(book.id));
+        body += '|';
+        appendEscapedField(body, book.title);
+        body += '|';
+        appendEscapedField(body, book.author);
+        body += '|';
+        appendEscapedField(body, book.isbn);
+        body += book.available ? "|1\n" : "|0\n";
+    }
+
+    // Function to run one request against the Library and build its response
+    std::string handle(const std::vector<std::string>& fields, bool& quit) {
+        const std::string& command = fields[0];
+        const size_t args = fields.size() - 1;
+        int first = 0, second = 0;
+        bool firstInt = args >= 1 && parseInt(fields[1], first);
+        bool secondInt = args >= 2 && parseInt(fields[2], second);
+
+        if (command == "PING" && args == 0) {
+            return ok(0);
+        } else if (command == "BOOK" && args == 1 && firstInt) {
+            std::shared_ptr<const LibrarySnapshot> view = library.snapshot();
+            std::optional<Book> book = view->findBook(first);
+            if (!book) return refuse(LibraryStatus::BookNotFound);
+            std::string body;
+            appendBook(body, *book);
+            return ok(1) + body;
+        } else if (command == "BOOKS" && args == 0) {
+            return refuse("BOOKS is paged: send BOOKS|limit, then BOOKS|limit|afterId with the last ID returned");
+        } else if (command == "BOOKS" && (args == 1 || args == 2) && firstInt) {
+            // ID order: BOOKS|limit[|afterId]
+            if (first <= 0) return refuse("Bad limit '" + fields[1] + "'");
+            if (args == 2 && !secondInt) return refuse("Bad book ID '" + fields[2] + "'");
+            BookCursor cursor;
+            cursor.started = args == 2;
+            cursor.id = second;
+            return bookPage(BookOrder::Id, cursor, first);
+        } else if (command == "BOOKS" && (args == 2 || args == 4)) {
+            BookOrder order;
+            int limit;
+            BookCursor cursor;
+            if (!parseOrder(fields[1], order)) return refuse("Unknown order '" + fields[1] + "'");
+            if (!parseInt(fields[2], limit) || limit <= 0) return refuse("Bad limit '" + fields[2] + "'");
+            if (args == 4) {
+                cursor.started = true;
+                cursor.key = fields[3];
+                if (!parseInt(fields[4], cursor.id)) return refuse("Bad book ID '" + fields[4] + "'");
+            }
+            return bookPage(order, cursor, limit);
+        } else if (command == "SEARCH" && args >= 2 && args <= 4) {
+            BookField field;
+            int limit = static_cast<int>(SERVER_PAGE_LIMIT), after = 0;
+            if (!parseField(fields[1], field)) return refuse("Unknown field '" + fields[1] + "'");
+            if (args >= 3 && (!parseInt(fields[3], limit) || limit <= 0)) return refuse("Bad limit '" + fields[3] + "'");
+            if (args == 4 && !parseInt(fields[4], after)) return refuse("Bad book ID '" + fields[4] + "'");
+            std::string body;
+            size_t count = library.searchBooks(field, fields[2], [&](const Book& book) { appendBook(body, book); },
+                                               std::min(static_cast<size_t>(limit), SERVER_PAGE_LIMIT), after);
+            return ok(count) + body;
+        } else if (command == "FUZZY" && args >= 2 && args <= 4) {
+            BookField field;
+            int edits = 2, limit = static_cast<int>(SERVER_FUZZY_LIMIT);
+            if (!parseField(fields[1], field) || field == BookField::Isbn) {
+                return refuse("Unknown field '" + fields[1] + "'");
+            }
+            if ((args >= 3 && (!parseInt(fields[3], edits) || edits < 0 ||
+                               edits > static_cast<int>(FuzzyIndex::MAX_DISTANCE))) ||
+                (args == 4 && (!parseInt(fields[4], limit) || limit <= 0))) {
+                return refuse("Bad number in FUZZY");
+            }
+            std::string body;
+            size_t count = library.fuzzySearchBooks(field, fields[2], static_cast<unsigned>(edits),
+                                                    static_cast<size_t>(limit), [&](const Book& book, unsigned distance) {
+                appendBook(body, book);
+                body.back() = '|';
+                body += std::to_string(distance) + "\n";
+            });
+            return ok(count) + body;
+        } else if (command == "COMPLETE" && (args == 2 || args == 3)) {
+            BookField field;
+            int limit = static_cast<int>(SERVER_COMPLETE_LIMIT);
+            if (!parseField(fields[1], field) || field == BookField::Isbn) {
+                return refuse("Unknown field '" + fields[1] + "'");
+            }
+            if (args == 3 && (!parseInt(fields[3], limit) || limit <= 0)) {
+                return refuse("Bad limit '" + fields[3] + "'");
+            }
+            std::vector<PrefixIndex::Completion> completions;
+            library.completeBooks(field, fields[2], static_cast<size_t>(limit), completions);
+            std::string body;
+            for (const auto& completion : completions) {
+                appendEscapedField(body, completion.text);
+                body += "|" + std::to_string(completion.records) + "|" + std::to_string(completion.weight) + "\n";
+            }
+            return ok(completions.size()) + body;
+        } else if (command == "ADDBOOK" && args == 3) {
+            int id;
+            LibraryStatus status = library.addBook(fields[1], fields[2], fields[3], &id);
+            return status == LibraryStatus::Ok ? ok(1) + std::to_string(id) + "\n" : refuse(status);
+        } else if (command == "UPDATEBOOK" && args == 3 && firstInt) {
+            BookField field;
+            if (!parseField(fields[2], field)) return refuse("Unknown field '" + fields[2] + "'");
+            std::string previous;
+            LibraryStatus status = library.updateBook(first, field, fields[3], &previous);
+            if (status != LibraryStatus::Ok) return refuse(status);
+            std::string body;
+            appendEscapedField(body, previous);
+            return ok(1) + body + "\n";
+        } else if (command == "DELETEBOOK" && args == 1 && firstInt) {
+            LibraryStatus status = library.deleteBook(first);
+            return status == LibraryStatus::Ok ? ok(0) : refuse(status);
+        } else if (command == "ADDSTUDENT" && args == 1) {
+            int id;
+            LibraryStatus status = library.addStudent(fields[1], &id);
+            return status == LibraryStatus::Ok ? ok(1) + std::to_string(id) + "\n" : refuse(status);
+        } else if (command == "STUDENTS" && args <= 2 && (args == 0 || (firstInt && first > 0)) &&
+                   (args < 2 || secondInt)) {
+            std::vector<Student> page;
+            size_t limit = args >= 1 ? std::min(static_cast<size_t>(first), SERVER_PAGE_LIMIT) : SERVER_PAGE_LIMIT;
+            library.snapshot()->studentPage(args == 2 ? second : 0, limit, page);
+            std::string body;
+            for (const Student& student : page) {
+                body += std::to_string(student.id) + "|";
+                appendEscapedField(body, student.name);
+                body += '\n';
+            }
+            return ok(page.size()) + body;
+        } else if (command == "BORROW" && args == 2 && firstInt && secondInt) {
+            Transaction made(0, 0, 0, TransactionType::Borrow, 0);
+            LibraryStatus status = library.borrowBook(first, second, &made);
+            if (status != LibraryStatus::Ok) return refuse(status);
+            return ok(1) + std::to_string(made.id) + "|" + formatDay(made.day) + "\n";
+        } else if (command == "RETURN" && args == 1 && firstInt) {
+            Transaction made(0, 0, 0, TransactionType::Return, 0);
+            LibraryStatus status = library.returnBook(first, &made);
+            if (status != LibraryStatus::Ok) return refuse(status);
+            return ok(1) + std::to_string(made.id) + "|" + std::to_string(made.studentId) + "|" +
+                   formatDay(made.day) + "\n";
+        } else if (command == "LOANS" && args == 1 && firstInt) {
+            std::string name;
+            std::vector<LoanRow> rows;
+            LibraryStatus status = library.snapshot()->studentLoans(first, name, rows);
+            if (status != LibraryStatus::Ok) return refuse(status);
+            std::string body;
+            for (const auto& row : rows) {
+                body += std::to_string(row.bookId) + "|" + std::to_string(row.transactionId) + "|";
+                appendEscapedField(body, row.bookTitle ? *row.bookTitle : "Unknown");
+                body += '\n';
+            }
+            return ok(rows.size()) + body;
+        } else if (command == "REPORT" && args == 0) {
+            std::shared_ptr<const LibrarySnapshot> view = library.snapshot();
+            CirculationReport report;
+            library.circulationReport(0, 1, 0, report);
+            return ok(1) + std::to_string(report.books) + "|" + std::to_string(report.neverBorrowed) + "|" +
+                   std::to_string(view->bookCount() - view->availableCount()) + "|" +
+                   std::to_string(report.borrows) + "|" + std::to_string(report.returns) + "|" +
+                   (report.month == CirculationStats::NO_MONTH ? "" : CirculationStats::monthName(report.month)) +
+                   "\n";
+        } else if ((command == "TOPBOOKS" && (args == 1 || args == 2)) ||
+                   (command == "TOPSTUDENTS" && args <= 1)) {
+            return ranked(fields);
+        } else if (command == "CIRCULATION" && args == 2) {
+            int32_t from, to;
+            if (!parseDay(fields[1], from) || !parseDay(fields[2], to)) {
+                return refuse("Bad date in CIRCULATION (expected YYYY-MM-DD)");
+            }
+            CirculationReport report;
+            library.circulationReport(0, from, to, report);
+            std::string body;
+            for (const auto& day : report.days) {
+                body += formatDay(day.day) + "|" + std::to_string(day.borrows) + "|" + std::to_string(day.returns) +
+                        "\n";
+            }
+            return ok(report.days.size()) + body;
+        } else if (command == "UNBORROWED" && (args == 1 || args == 2) && firstInt && first > 0 &&
+                   (args == 1 || secondInt)) {
+            std::vector<Book> page;
+            std::shared_ptr<const LibrarySnapshot> view = library.snapshot();
+            view->neverBorrowedPage(args == 2 ? second : 0, std::min(static_cast<size_t>(first), SERVER_PAGE_LIMIT),
+                                    page);
+            std::string body;
+            for (const Book& book : page) {
+                appendBook(body, book);
+            }
+            return ok(page.size()) + body;
+        } else if (command == "TRANSACTIONS" && (args == 6 || args == 7)) {
+            return transactions(fields);
+        } else if (command == "OPERATIONS" && args == 1 && firstInt && first > 0) {
+            std::vector<std::string> entries;
+            library.recentOperations(static_cast<size_t>(first), entries);
+            return ok(entries.size()) + protocolLines(entries);
+        } else if (command == "OPERATIONS" && (args == 3 || args == 4)) {
+            return operations(fields);
+        } else if (command == "SAVE" && args == 0) {
+            return library.save() ? ok(0) : refuse("Unable to write the data files");
+        } else if (command == "STATS" && (args == 0 || (args == 1 && (fields[1] == "text" || fields[1] == "json")))) {
+            StatsReport report = stats().report();
+            std::string dump = (args == 1 && fields[1] == "json") ? formatStatsJson(report) : formatStatsText(report);
+            std::string body;
+            size_t count = 0;
+            for (size_t start = 0; start < dump.size();) {
+                size_t end = dump.find('\n', start);
+                appendEscapedField(body, std::string_view(dump).substr(start, end - start));
+                body += '\n';
+                ++count;
+                start = end + 1;
+            }
+            return ok(count) + body;
+        } else if (command == "QUIT" && args == 0) {
+            quit = true;
+            return ok(0);
+        }
+        return refuse("Unknown command or wrong arguments: " + command);
+    }
+
+    // Function to answer a BOOKS page of at most SERVER_PAGE_LIMIT books
+    std::string bookPage(BookOrder order, BookCursor& cursor, int limit) {
+        std::vector<Book> page;
+        library.bookPage(order, cursor, std::min(static_cast<size_t>(limit), SERVER_PAGE_LIMIT), page);
+        std::string body;
+        for (const Book& book : page) {
+            appendBook(body, book);
+        }
+        return ok(page.size()) + body;
+    }
+
+    // Function to answer TOPBOOKS|all/month[|limit] and TOPSTUDENTS[|limit]
+    std::string ranked(const std::vector<std::string>& fields) {
+        const bool students = fields[0] == "TOPSTUDENTS";
+        const size_t limitField = students ? 1 : 2;
+        int limit = static_cast<int>(SERVER_RANKED_LIMIT);
+        if (!students && fields[1] != "all" && fields[1] != "month") {
+            return refuse("Unknown period '" + fields[1] + "'");
+        }
+        if (fields.size() > limitField && (!parseInt(fields[limitField], limit) || limit <= 0)) {
+            return refuse("Bad limit '" + fields[limitField] + "'");
+        }
+
+        CirculationReport report;
+        library.circulationReport(static_cast<size_t>(limit), 1, 0, report);
+        std::string body;
+        size_t count = 0;
+        if (students) {
+            for (const auto& student : report.topStudents) {
+                body += std::to_string(student.id) + "|";
+                appendEscapedField(body, student.name);
+                body += "|" + std::to_string(student.borrows) + "|" + std::to_string(student.loans) + "\n";
+            }
+            count = report.topStudents.size();
+        } else {
+            const std::vector<RankedBook>& books = fields[1] == "all" ? report.topBooks : report.monthBooks;
+            for (const auto& book : books) {
+                body += std::to_string(book.id) + "|";
+                appendEscapedField(body, book.title);
+                body += "|" + std::to_string(book.borrows) + "\n";
+            }
+            count = books.size();
+        }
+        return ok(count) + body;
+    }
+
+    // Function to answer OPERATIONS|from|to|limit[|skip]
+    std::string operations(const std::vector<std::string>& fields) {
+        int64_t from, to = std::numeric_limits<int64_t>::max();
+        int limit, skip = 0;
+        if (!parseOperationTime(fields[1], false, from) ||
+            (!fields[2].empty() && !parseOperationTime(fields[2], true, to))) {
+            return refuse("Bad time in OPERATIONS (expected YYYY-MM-DD[ hh:mm[:ss]])");
+        }
+        if (!parseInt(fields[3], limit) || limit <= 0 || (fields.size() == 5 && (!parseInt(fields[4], skip) || skip < 0))) {
+            return refuse("Bad number in OPERATIONS");
+        }
+        std::vector<std::string> entries;
+        library.operationsBetween(from, to, static_cast<size_t>(skip), static_cast<size_t>(limit), entries);
+        return ok(entries.size()) + protocolLines(entries);
+    }
+
+    // Function to format text lines as one protocol field each
+    static std::string protocolLines(const std::vector<std::string>& lines) {
+        std::string body;
+        for (const auto& line : lines) {
+            appendEscapedField(body, line);
+            body += '\n';
+        }
+        return body;
+    }
+
+    // Function to answer TRANSACTIONS|student|book|type|from|to|limit[|afterId]
+    std::string transactions(const std::vector<std::string>& fields) {
+        TransactionFilter filter;
+        int limit = static_cast<int>(SERVER_PAGE_LIMIT);
+        TransactionType type;
+        if ((!fields[1].empty() && !parseInt(fields[1], filter.studentId)) ||
+            (!fields[2].empty() && !parseInt(fields[2], filter.bookId)) ||
+            (!fields[6].empty() && (!parseInt(fields[6], limit) || limit <= 0)) ||
+            (fields.size() > 7 && !fields[7].empty() && !parseInt(fields[7], filter.afterId))) {
+            return refuse("Bad number in TRANSACTIONS filter");
+        }
+        if (!fields[3].empty()) {
+            if (!parseTransactionType(fields[3], type)) return refuse("Unknown type '" + fields[3] + "'");
+            filter.type = type;
+        }
+        if ((!fields[4].empty() && !parseDay(fields[4], filter.fromDay)) ||
+            (!fields[5].empty() && !parseDay(fields[5], filter.toDay))) {
+            return refuse("Bad date in TRANSACTIONS filter (expected YYYY-MM-DD)");
+        }
+
+        TransactionCursor cursor;
+        std::vector<TransactionRow> page;
+        library.transactionPage(filter, cursor, std::min(static_cast<size_t>(limit), SERVER_PAGE_LIMIT), page);
+        std::string body;
+        for (const auto& row : page) {
+            const Transaction& transaction = row.transaction;
+            body += std::to_string(transaction.id) + "|" + transactionTypeName(transaction.type) + "|" +
+                    formatDay(transaction.day) + "|" + std::to_string(transaction.studentId) + "|";
+            appendEscapedField(body, row.studentName ? *row.studentName : "Unknown");
+            body += "|" + std::to_string(transaction.bookId) + "|";
+            appendEscapedField(body, row.bookTitle ? *row.bookTitle : "Unknown");
+            body += '\n';
+        }
+        return ok(page.size()) + body;
+    }
+
+    Library& library;
+    std::string path;
+    int listener = -1;
+    int wakePipe[2] = {-1, -1};
+    volatile sig_atomic_t stopping = 0;
+
+    // Touched only by the I/O thread
+    std::unordered_map<uint64_t, Connection> connections;
+    uint64_t nextConnection = 0;
+
+    // Finished requests on their way back to the I/O thread
+    std::mutex doneMutex;
+    std::condition_variable idle;
+    std::deque<Response> done;
+    size_t inFlight = 0;
+
+    ThreadPool workers; // Last, so it drains before the rest is destroyed
+};
+
+#endif
+
+#endif
@@ -2,260 +2,31 @@
 #include <fstream>
 #include <vector>
 #include <string>
-#include <ctime>
 #include <iomanip>
 #include <algorithm>
 #include <limits>
+#include <optional>
+#include <csignal>
+#include <thread>
+#include <charconv>
+#include <string_view>
+#include "civil_date.h"
+#include "coarse_clock.h"
+#include "text_loader.h"
+#include "bulk_import.h"
+#include "transaction.h"
+#include "library.h"
+#include "library_server.h"
+#include "stats.h"
 
-// Structure to represent a Book
-struct Book {
-    int id;
-    std::string title;
-    std::string author;
-    std::string isbn;
-    bool available;
-    
-    // Constructor
-    Book(int _id, std::string _title, std::string _author, std::string _isbn, bool _available = true)
-        : id(_id), title(_title), author(_author), isbn(_isbn), available(_available) {}
-};
-
-// Structure to represent a Student
-struct Student {
-    int id;
-    std::string name;
-    
-    // Constructor
-    Student(int _id, std::string _name) : id(_id), name(_name) {}
-};
-
-// Structure to represent a Transaction
-struct Transaction {
-    int id;
-    int bookId;
-    int studentId;
-    std::string type; // "borrow" or "return"
-    std::string date;
-    
-    // Constructor
-    Transaction(int _id, int _bookId, int _studentId, std::string _type)
-        : id(_id), bookId(_bookId), studentId(_studentId), type(_type) {
-        // Get current date/time
-        time_t now = time(0);
-        tm* ltm = localtime(&now);
-        
-        // Format date as YYYY-MM-DD
-        date = std::to_string(1900 + ltm->tm_year) + "-" + 
-               std::to_string(1 + ltm->tm_mon) + "-" +
-               std::to_string(ltm->tm_mday);
-    }
-    
-    // Constructor with date (for loading from file)
-    Transaction(int _id, int _bookId, int _studentId, std::string _type, std::string _date)
-        : id(_id), bookId(_bookId), studentId(_studentId), type(_type), date(_date) {}
-};
-
-// Global variables
-std::vector<Book> books;
-std::vector<Student> students;
-std::vector<Transaction> transactions;
-std::vector<std::string> operationHistory;
-int nextBookId = 1;
-int nextStudentId = 1;
-int nextTransactionId = 1;
+// The library engine behind the menu (and behind --serve)
+Library library;
 
 // Function to clear the screen (works on most systems)
 void clearScreen() {
     std::cout << "\033[2J\033[1;1H"; // ANSI escape sequence to clear screen
 }
 
-// Function to log an operation
-void logOperation(const std::string& operation) {
-    // Get current date/time
-    time_t now = time(0);
-    tm* ltm = localtime(&now);
-    
-    // Format date and time
-    std::string timestamp = 
-        std::to_string(1900 + ltm->tm_year) + "-" + 
-        std::to_string(1 + ltm->tm_mon) + "-" +
-        std::to_string(ltm->tm_mday) + " " +
-        std::to_string(ltm->tm_hour) + ":" +
-        std::to_string(ltm->tm_min) + ":" +
-        std::to_string(ltm->tm_sec);
-    
-    // Add to history
-    operationHistory.push_back(timestamp + ": " + operation);
-    
-    // Save history to file
-    std::ofstream historyFile("operation_history.txt", std::ios::app);
-    if (historyFile.is_open()) {
-        historyFile << timestamp << ": " << operation << std::endl;
-        historyFile.close();
-    }
-}
-
-// Function to save books to file
-void saveBooksToFile() {
-    std::ofstream file("books.txt");
-    if (file.is_open()) {
-        file << nextBookId << std::endl; // Save next ID
-        for (const auto& book : books) {
-            file << book.id << "|" << book.title << "|" << book.author << "|" 
-                 << book.isbn << "|" << book.available << std::endl;
-        }
-        file.close();
-        logOperation("Books saved to file");
-    } else {
-        std::cout << "Unable to open file for saving books." << std::endl;
-    }
-}
-
-// Function to load books from file
-void loadBooksFromFile() {
-    std::ifstream file("books.txt");
-    if (file.is_open()) {
-        books.clear();
-        file >> nextBookId;
-        file.ignore(); // Skip newline
-        
-        std::string line;
-        while (std::getline(file, line)) {
-            if (line.empty()) continue;
-            
-            size_t pos = 0;
-            std::string delimiter = "|";
-            std::vector<std::string> tokens;
-            
-            while ((pos = line.find(delimiter)) != std::string::npos) {
-                tokens.push_back(line.substr(0, pos));
-                line.erase(0, pos + delimiter.length());
-            }
-            tokens.push_back(line); // Add the last part
-            
-            if (tokens.size() >= 5) {
-                int id = std::stoi(tokens[0]);
-                std::string title = tokens[1];
-                std::string author = tokens[2];
-                std::string isbn = tokens[3];
-                bool available = (tokens[4] == "1");
-                
-                books.push_back(Book(id, title, author, isbn, available));
-            }
-        }
-        file.close();
-        logOperation("Books loaded from file");
-    }
-}
-
-// Function to save students to file
-void saveStudentsToFile() {
-    std::ofstream file("students.txt");
-    if (file.is_open()) {
-        file << nextStudentId << std::endl; // Save next ID
-        for (const auto& student : students) {
-            file << student.id << "|" << student.name << std::endl;
-        }
-        file.close();
-        logOperation("Students saved to file");
-    } else {
-        std::cout << "Unable to open file for saving students." << std::endl;
-    }
-}
-
-// Function to load students from file
-void loadStudentsFromFile() {
-    std::ifstream file("students.txt");
-    if (file.is_open()) {
-        students.clear();
-        file >> nextStudentId;
-        file.ignore(); // Skip newline
-        
-        std::string line;
-        while (std::getline(file, line)) {
-            if (line.empty()) continue;
-            
-            size_t pos = line.find("|");
-            if (pos != std::string::npos) {
-                int id = std::stoi(line.substr(0, pos));
-                std::string name = line.substr(pos + 1);
-                
-                students.push_back(Student(id, name));
-            }
-        }
-        file.close();
-        logOperation("Students loaded from file");
-    }
-}
-
-// Function to save transactions to file
-void saveTransactionsToFile() {
-    std::ofstream file("transactions.txt");
-    if (file.is_open()) {
-        file << nextTransactionId << std::endl; // Save next ID
-        for (const auto& transaction : transactions) {
-            file << transaction.id << "|" << transaction.bookId << "|" 
-                 << transaction.studentId << "|" << transaction.type << "|" 
-                 << transaction.date << std::endl;
-        }
-        file.close();
-        logOperation("Transactions saved to file");
-    } else {
-        std::cout << "Unable to open file for saving transactions." << std::endl;
-    }
-}
-
-// Function to load transactions from file
-void loadTransactionsFromFile() {
-    std::ifstream file("transactions.txt");
-    if (file.is_open()) {
-        transactions.clear();
-        file >> nextTransactionId;
-        file.ignore(); // Skip newline
-        
-        std::string line;
-        while (std::getline(file, line)) {
-            if (line.empty()) continue;
-            
-            size_t pos = 0;
-            std::string delimiter = "|";
-            std::vector<std::string> tokens;
-            
-            while ((pos = line.find(delimiter)) != std::string::npos) {
-                tokens.push_back(line.substr(0, pos));
-                line.erase(0, pos + delimiter.length());
-            }
-            tokens.push_back(line); // Add the last part
-            
-            if (tokens.size() >= 5) {
-                int id = std::stoi(tokens[0]);
-                int bookId = std::stoi(tokens[1]);
-                int studentId = std::stoi(tokens[2]);
-                std::string type = tokens[3];
-                std::string date = tokens[4];
-                
-                transactions.push_back(Transaction(id, bookId, studentId, type, date));
-            }
-        }
-        file.close();
-        logOperation("Transactions loaded from file");
-    }
-}
-
-// Function to save all data to files
-void saveAllData() {
-    saveBooksToFile();
-    saveStudentsToFile();
-    saveTransactionsToFile();
-}
-
-// Function to load all data from files
-void loadAllData() {
-    loadBooksFromFile();
-    loadStudentsFromFile();
-    loadTransactionsFromFile();
-}
-
 // Function to add a new book
 void addBook() {
     clearScreen();
@@ -273,58 +44,143 @@ void addBook() {
     std::cout << "Enter ISBN: ";
     std::getline(std::cin, isbn);
     
-    // Check if ISBN already exists
-    for (const auto& book : books) {
-        if (book.isbn == isbn) {
-            std::cout << "A book with this ISBN already exists!" << std::endl;
-            std::cout << "Press Enter to continue...";
-            std::cin.get();
-            return;
-        }
+    // Add new book (refused if the ISBN already exists)
+    LibraryStatus status = library.addBook(title, author, isbn);
+    if (status == LibraryStatus::Ok) {
+        std::cout << "Book added successfully!" << std::endl;
+    } else {
+        std::cout << statusMessage(status) << std::endl;
     }
     
-    // Add new book
-    books.push_back(Book(nextBookId++, title, author, isbn));
-    saveBooksToFile();
-    
-    std::cout << "Book added successfully!" << std::endl;
-    logOperation("Added book: " + title);
-    
     std::cout << "Press Enter to continue...";
     std::cin.get();
 }
 
-// Function to display all books
+// Function to ask for one line of input
+std::string promptLine(const std::string& prompt) {
+    std::string value;
+    std::cout << prompt;
+    std::getline(std::cin, value);
+    return value;
+}
+
+// Function to print the book table header
+void printBookHeader() {
+    std::cout << std::left << std::setw(5) << "ID" 
+              << std::setw(30) << "Title" 
+              << std::setw(20) << "Author" 
+              << std::setw(15) << "ISBN" 
+              << "Available" << std::endl;
+    std::cout << std::string(80, '-') << std::endl;
+}
+
+// Function to append text padded with spaces to width (longer text is
+// kept whole, as std::setw does)
+void appendPadded(std::string& out, std::string_view text, size_t width) {
+    out.append(text.data(), text.size());
+    if (text.size() < width) {
+        out.append(width - text.size(), ' ');
+    }
+}
+
+// Function to format one row of the book table onto out. Rows are built in
+// one buffer and written together, rather than field by field through the
+// stream.
+void appendBookRow(std::string& out, const Book& book) {
+    char id[16];
+    std::to_chars_result end = std::to_chars(id, id + sizeof(id), book.id);
+    appendPadded(out, std::string_view(id, end.ptr - id), 5);
+    appendPadded(out, book.title.substr(0, 28), 30);
+    appendPadded(out, book.author.substr(0, 18), 20);
+    appendPadded(out, book.isbn, 15);
+    out += book.available ? "Yes\n" : "No\n";
+}
+
+// Function to display the catalog sorted by ID, title or author, a page at
+// a time. Each page is read from the ordered index after the last book shown,
+// so any page costs the same however far into the catalog it is.
 void displayBooks() {
+    const size_t PAGE_SIZE = 50;
+    
     clearScreen();
     std::cout << "\n=== Book List ===\n";
+    std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
     
-    if (books.empty()) {
+    std::shared_ptr<const LibrarySnapshot> view = library.snapshot();
+    size_t total = view->bookCount();
+    size_t available = view->availableCount();
+    view.reset();
+    if (total == 0) {
         std::cout << "No books in the library." << std::endl;
-    } else {
-        std::cout << std::left << std::setw(5) << "ID" 
-                  << std::setw(30) << "Title" 
-                  << std::setw(20) << "Author" 
-                  << std::setw(15) << "ISBN" 
-                  << "Available" << std::endl;
-        std::cout << std::string(80, '-') << std::endl;
+        std::cout << "\nPress Enter to continue...";
+        std::cin.get();
+        return;
+    }
+    
+    std::string answer = promptLine("Sort by 1. ID, 2. Title or 3. Author (blank = ID): ");
+    BookOrder order = (answer == "2") ? BookOrder::Title
+                    : (answer == "3") ? BookOrder::Author
+                    : BookOrder::Id;
+    
+    std::cout << std::endl;
+    printBookHeader();
+    
+    BookCursor cursor;
+    std::vector<Book> page;
+    std::string rows;
+    size_t shown = 0;
+    
+    while (true) {
+        bool more = library.bookPage(order, cursor, PAGE_SIZE, page);
         
-        for (const auto& book : books) {
-            std::cout << std::left << std::setw(5) << book.id 
-                      << std::setw(30) << book.title.substr(0, 28) 
-                      << std::setw(20) << book.author.substr(0, 18) 
-                      << std::setw(15) << book.isbn
-                      << (book.available ? "Yes" : "No") << std::endl;
+        rows.clear();
+        for (const auto& book : page) {
+            appendBookRow(rows, book);
         }
+        std::cout << rows;
+        shown += page.size();
+        
+        if (!more) break;
+        
+        answer = promptLine("-- " + std::to_string(shown) + " of " + std::to_string(total) +
+                            " shown. Enter for more, q to stop: ");
+        if (answer == "q" || answer == "Q") break;
     }
     
+    std::cout << std::string(80, '-') << std::endl;
+    std::cout << total << " book(s), " << available << " available." << std::endl;
+    
     std::cout << "\nPress Enter to continue...";
-    std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
     std::cin.get();
 }
 
+// Function to list the most borrowed completions of a title or author prefix
+// and let the user pick one. Returns the completion picked, or "" for none.
+std::string pickCompletion(BookField field, const std::string& prefix) {
+    const size_t COMPLETIONS_SHOWN = 10;
+    
+    std::vector<PrefixIndex::Completion> completions;
+    library.completeBooks(field, prefix, COMPLETIONS_SHOWN, completions);
+    if (completions.empty()) {
+        std::cout << "No completions for '" << prefix << "'." << std::endl;
+        return "";
+    }
+    for (size_t i = 0; i < completions.size(); ++i) {
+        std::cout << std::setw(3) << i + 1 << ". " << completions[i].text << " (" << completions[i].records
+                  << " book(s), borrowed " << completions[i].weight << " time(s))\n";
+    }
+    std::string answer = promptLine("Pick a number, or Enter to search for '" + prefix + "': ");
+    int number;
+    if (parseInt(answer, number) && number >= 1 && static_cast<size_t>(number) <= completions.size()) {
+        return completions[number - 1].text;
+    }
+    return "";
+}
+
 // Function to search for books
 void searchBooks() {
+    const size_t FUZZY_RESULTS = 20;
+    
     clearScreen();
     std::cout << "\n=== Search Books ===\n";
     
@@ -332,6 +188,8 @@ void searchBooks() {
     std::cout << "1. Search by Title\n";
     std::cout << "2. Search by Author\n";
     std::cout << "3. Search by ISBN\n";
+    std::cout << "4. Search by Title, allowing typos\n";
+    std::cout << "5. Search by Author, allowing typos\n";
     std::cout << "Enter your choice: ";
     
     int choice;
@@ -339,34 +197,43 @@ void searchBooks() {
     std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
     
     std::string searchTerm;
-    std::cout << "Enter search term: ";
+    if (choice == 1 || choice == 2) {
+        std::cout << "Enter search term (end with * to pick from completions): ";
+    } else {
+        std::cout << "Enter search term: ";
+    }
     std::getline(std::cin, searchTerm);
     
-    // Convert search term to lowercase for case-insensitive search
-    std::transform(searchTerm.begin(), searchTerm.end(), searchTerm.begin(), ::tolower);
-    
-    std::vector<Book> results;
+    std::string completion;
+    if ((choice == 1 || choice == 2) && !searchTerm.empty() && searchTerm.back() == '*') {
+        searchTerm.pop_back();
+        completion = pickCompletion(choice == 1 ? BookField::Title : BookField::Author, searchTerm);
+    }
     
-    for (const auto& book : books) {
-        std::string fieldToSearch;
-        
-        if (choice == 1) {
-            fieldToSearch = book.title;
-        } else if (choice == 2) {
-            fieldToSearch = book.author;
-        } else if (choice == 3) {
-            fieldToSearch = book.isbn;
-        } else {
-            break;
-        }
-        
-        // Convert to lowercase
-        std::transform(fieldToSearch.begin(), fieldToSearch.end(), fieldToSearch.begin(), ::tolower);
-        
-        // Check if search term is in the field
-        if (fieldToSearch.find(searchTerm) != std::string::npos) {
-            results.push_back(book);
+    std::vector<BookInfo> results;
+    if (!completion.empty()) {
+        // The books whose field normalizes to the completion: search for its
+        // longest word and keep those
+        BookField field = (choice == 1) ? BookField::Title : BookField::Author;
+        std::string_view longest;
+        for (size_t start = 0, end; start < completion.size(); start = end + 1) {
+            end = std::min(completion.find(' ', start), completion.size());
+            if (end - start > longest.size()) longest = std::string_view(completion).substr(start, end - start);
         }
+        library.searchBooks(field, std::string(longest), [&](const Book& book) {
+            if (PrefixIndex::normalize(field == BookField::Title ? book.title : book.author) == completion) {
+                results.emplace_back(book);
+            }
+        });
+    } else if (choice >= 1 && choice <= 3) {
+        BookField field = (choice == 1) ? BookField::Title
+                        : (choice == 2) ? BookField::Author
+                        : BookField::Isbn;
+        library.searchBooks(field, searchTerm, [&results](const Book& book) { results.emplace_back(book); });
+    } else if (choice == 4 || choice == 5) {
+        // Closest matches first, up to two typos per word
+        library.fuzzySearchBooks(choice == 4 ? BookField::Title : BookField::Author, searchTerm, 2,
+                                 FUZZY_RESULTS, [&results](const Book& book, unsigned) { results.emplace_back(book); });
     }
     
     clearScreen();
@@ -375,20 +242,12 @@ void searchBooks() {
     if (results.empty()) {
         std::cout << "No matching books found." << std::endl;
     } else {
-        std::cout << std::left << std::setw(5) << "ID" 
-                  << std::setw(30) << "Title" 
-                  << std::setw(20) << "Author" 
-                  << std::setw(15) << "ISBN" 
-                  << "Available" << std::endl;
-        std::cout << std::string(80, '-') << std::endl;
-        
+        printBookHeader();
+        std::string rows;
         for (const auto& book : results) {
-            std::cout << std::left << std::setw(5) << book.id 
-                      << std::setw(30) << book.title.substr(0, 28) 
-                      << std::setw(20) << book.author.substr(0, 18) 
-                      << std::setw(15) << book.isbn
-                      << (book.available ? "Yes" : "No") << std::endl;
+            appendBookRow(rows, Book(book.id, book.title, book.author, book.isbn, book.available));
         }
+        std::cout << rows;
     }
     
     std::cout << "\nPress Enter to continue...";
@@ -406,12 +265,11 @@ void updateBook() {
     std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
     
     // Find the book
-    auto it = std::find_if(books.begin(), books.end(), [id](const Book& book) {
-        return book.id == id;
-    });
+    std::shared_ptr<const LibrarySnapshot> view = library.snapshot();
+    std::optional<Book> book = view->findBook(id);
     
-    if (it != books.end()) {
-        std::cout << "Book found: " << it->title << " by " << it->author << std::endl;
+    if (book) {
+        std::cout << "Book found: " << book->title << " by " << book->author << std::endl;
         std::cout << "\nUpdate:\n";
         std::cout << "1. Title\n";
         std::cout << "2. Author\n";
@@ -426,31 +284,19 @@ void updateBook() {
         std::cout << "Enter new value: ";
         std::getline(std::cin, newValue);
         
-        std::string oldValue;
-        if (choice == 1) {
-            oldValue = it->title;
-            it->title = newValue;
-        } else if (choice == 2) {
-            oldValue = it->author;
-            it->author = newValue;
-        } else if (choice == 3) {
-            // Check if ISBN already exists
-            for (const auto& book : books) {
-                if (book.isbn == newValue && book.id != id) {
-                    std::cout << "A book with this ISBN already exists!" << std::endl;
-                    std::cout << "Press Enter to continue...";
-                    std::cin.get();
-                    return;
-                }
+        if (choice < 1 || choice > 3) {
+            std::cout << "Invalid choice." << std::endl;
+        } else {
+            BookField field = (choice == 1) ? BookField::Title
+                            : (choice == 2) ? BookField::Author
+                            : BookField::Isbn;
+            LibraryStatus status = library.updateBook(id, field, newValue);
+            if (status == LibraryStatus::Ok) {
+                std::cout << "Book updated successfully!" << std::endl;
+            } else {
+                std::cout << statusMessage(status) << std::endl;
             }
-            oldValue = it->isbn;
-            it->isbn = newValue;
         }
-        
-        saveBooksToFile();
-        
-        std::cout << "Book updated successfully!" << std::endl;
-        logOperation("Updated book ID " + std::to_string(id) + ": " + oldValue + " -> " + newValue);
     } else {
         std::cout << "Book not found." << std::endl;
     }
@@ -469,28 +315,12 @@ void deleteBook() {
     std::cin >> id;
     std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
     
-    // Find the book
-    auto it = std::find_if(books.begin(), books.end(), [id](const Book& book) {
-        return book.id == id;
-    });
-    
-    if (it != books.end()) {
-        // Check if the book is currently borrowed
-        if (!it->available) {
-            std::cout << "Cannot delete this book as it is currently borrowed." << std::endl;
-            std::cout << "Press Enter to continue...";
-            std::cin.get();
-            return;
-        }
-        
-        std::string title = it->title;
-        books.erase(it);
-        saveBooksToFile();
-        
+    // Delete the book (refused while it is borrowed)
+    LibraryStatus status = library.deleteBook(id);
+    if (status == LibraryStatus::Ok) {
         std::cout << "Book deleted successfully!" << std::endl;
-        logOperation("Deleted book: " + title + " (ID: " + std::to_string(id) + ")");
     } else {
-        std::cout << "Book not found." << std::endl;
+        std::cout << statusMessage(status) << std::endl;
     }
     
     std::cout << "Press Enter to continue...";
@@ -509,11 +339,12 @@ void addStudent() {
     std::getline(std::cin, name);
     
     // Add new student
-    students.push_back(Student(nextStudentId++, name));
-    saveStudentsToFile();
-    
-    std::cout << "Student added successfully!" << std::endl;
-    logOperation("Added student: " + name);
+    LibraryStatus status = library.addStudent(name);
+    if (status == LibraryStatus::Ok) {
+        std::cout << "Student added successfully!" << std::endl;
+    } else {
+        std::cout << statusMessage(status) << std::endl;
+    }
     
     std::cout << "Press Enter to continue...";
     std::cin.get();
@@ -524,17 +355,22 @@ void displayStudents() {
     clearScreen();
     std::cout << "\n=== Student List ===\n";
     
-    if (students.empty()) {
+    std::shared_ptr<const LibrarySnapshot> view = library.snapshot();
+    if (view->studentCount() == 0) {
         std::cout << "No students registered." << std::endl;
     } else {
         std::cout << std::left << std::setw(5) << "ID" 
-                  << "Name" << std::endl;
-        std::cout << std::string(40, '-') << std::endl;
+                  << std::setw(30) << "Name" 
+                  << std::setw(8) << "Loans" 
+                  << "Borrowed" << std::endl;
+        std::cout << std::string(60, '-') << std::endl;
         
-        for (const auto& student : students) {
+        view->forEachStudent([&view](const Student& student) {
             std::cout << std::left << std::setw(5) << student.id 
-                      << student.name << std::endl;
-        }
+                      << std::setw(30) << student.name 
+                      << std::setw(8) << student.books.size() 
+                      << view->studentBorrows(student.id) << std::endl;
+        });
     }
     
     std::cout << "\nPress Enter to continue...";
@@ -548,7 +384,8 @@ void borrowBook() {
     std::cout << "\n=== Borrow Book ===\n";
     
     // Check if there are any students
-    if (students.empty()) {
+    std::shared_ptr<const LibrarySnapshot> view = library.snapshot();
+    if (view->studentCount() == 0) {
         std::cout << "No students registered. Please add a student first." << std::endl;
         std::cout << "Press Enter to continue...";
         std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
@@ -557,7 +394,7 @@ void borrowBook() {
     }
     
     // Check if there are any books
-    if (books.empty()) {
+    if (view->bookCount() == 0) {
         std::cout << "No books in the library. Please add a book first." << std::endl;
         std::cout << "Press Enter to continue...";
         std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
@@ -570,11 +407,7 @@ void borrowBook() {
     std::cin >> studentId;
     
     // Find the student
-    auto studentIt = std::find_if(students.begin(), students.end(), [studentId](const Student& student) {
-        return student.id == studentId;
-    });
-    
-    if (studentIt == students.end()) {
+    if (library.snapshot()->findStudent(studentId) == nullptr) {
         std::cout << "Student not found." << std::endl;
         std::cout << "Press Enter to continue...";
         std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
@@ -586,28 +419,11 @@ void borrowBook() {
     std::cout << "Enter book ID: ";
     std::cin >> bookId;
     
-    // Find the book
-    auto bookIt = std::find_if(books.begin(), books.end(), [bookId](const Book& book) {
-        return book.id == bookId;
-    });
-    
-    if (bookIt == books.end()) {
-        std::cout << "Book not found." << std::endl;
-    } else if (!bookIt->available) {
-        std::cout << "This book is already borrowed." << std::endl;
-    } else {
-        // Update book status
-        bookIt->available = false;
-        
-        // Create transaction
-        transactions.push_back(Transaction(nextTransactionId++, bookId, studentId, "borrow"));
-        
-        saveBooksToFile();
-        saveTransactionsToFile();
-        
+    LibraryStatus status = library.borrowBook(studentId, bookId);
+    if (status == LibraryStatus::Ok) {
         std::cout << "Book borrowed successfully!" << std::endl;
-        logOperation("Student ID " + std::to_string(studentId) + 
-                    " borrowed book: " + bookIt->title + " (ID: " + std::to_string(bookId) + ")");
+    } else {
+        std::cout << statusMessage(status) << std::endl;
     }
     
     std::cout << "Press Enter to continue...";
@@ -624,42 +440,11 @@ void returnBook() {
     std::cout << "Enter book ID: ";
     std::cin >> bookId;
     
-    // Find the book
-    auto bookIt = std::find_if(books.begin(), books.end(), [bookId](const Book& book) {
-        return book.id == bookId;
-    });
-    
-    if (bookIt == books.end()) {
-        std::cout << "Book not found." << std::endl;
-    } else if (bookIt->available) {
-        std::cout << "This book is not currently borrowed." << std::endl;
+    LibraryStatus status = library.returnBook(bookId);
+    if (status == LibraryStatus::Ok) {
+        std::cout << "Book returned successfully!" << std::endl;
     } else {
-        // Find the corresponding borrow transaction
-        auto transactionIt = std::find_if(
-            transactions.rbegin(), transactions.rend(), 
-            [bookId](const Transaction& t) {
-                return t.bookId == bookId && t.type == "borrow";
-            }
-        );
-        
-        if (transactionIt != transactions.rend()) {
-            int studentId = transactionIt->studentId;
-            
-            // Update book status
-            bookIt->available = true;
-            
-            // Create return transaction
-            transactions.push_back(Transaction(nextTransactionId++, bookId, studentId, "return"));
-            
-            saveBooksToFile();
-            saveTransactionsToFile();
-            
-            std::cout << "Book returned successfully!" << std::endl;
-            logOperation("Student ID " + std::to_string(studentId) + 
-                        " returned book: " + bookIt->title + " (ID: " + std::to_string(bookId) + ")");
-        } else {
-            std::cout << "Error: Could not find borrow transaction for this book." << std::endl;
-        }
+        std::cout << statusMessage(status) << std::endl;
     }
     
     std::cout << "Press Enter to continue...";
@@ -667,39 +452,123 @@ void returnBook() {
     std::cin.get();
 }
 
+// Function to ask for an optional date bound as a day number (unbounded
+// if left blank or invalid)
+int32_t promptDate(const std::string& prompt, int32_t unbounded) {
+    std::string value = promptLine(prompt);
+    if (value.empty()) return unbounded;
+    
+    int32_t day;
+    if (!parseDay(value, day)) {
+        std::cout << "Invalid date, ignoring this bound." << std::endl;
+        return unbounded;
+    }
+    return day;
+}
+
+
 // Function to display transaction history
 void displayTransactions() {
+    const size_t PAGE_SIZE = 20;
+    
     clearScreen();
     std::cout << "\n=== Transaction History ===\n";
+    std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
     
-    if (transactions.empty()) {
+    if (!library.hasTransactions()) {
         std::cout << "No transactions recorded." << std::endl;
+        std::cout << "\nPress Enter to continue...";
+        std::cin.get();
+        return;
+    }
+    
+    TransactionFilter filter;
+    std::string answer = promptLine("Filter results? (y/N): ");
+    if (answer == "y" || answer == "Y") {
+        filter.studentId = std::atoi(promptLine("Student ID (blank = any): ").c_str());
+        filter.bookId = std::atoi(promptLine("Book ID (blank = any): ").c_str());
+        std::string type = promptLine("Type - borrow/return (blank = any): ");
+        TransactionType parsed;
+        if (parseTransactionType(type, parsed)) {
+            filter.type = parsed;
+        } else if (!type.empty()) {
+            std::cout << "Unknown type, ignoring this filter." << std::endl;
+        }
+        filter.fromDay = promptDate("From date YYYY-MM-DD (blank = any): ", filter.fromDay);
+        filter.toDay = promptDate("To date YYYY-MM-DD (blank = any): ", filter.toDay);
+    }
+    
+    std::cout << std::endl;
+    std::cout << std::left << std::setw(6) << "ID" 
+              << std::setw(8) << "Type" 
+              << std::setw(12) << "Date" 
+              << std::setw(8) << "Stu ID" 
+              << std::setw(18) << "Student" 
+              << std::setw(8) << "Book ID"
+              << "Book Title" << std::endl;
+    std::cout << std::string(80, '-') << std::endl;
+    
+    std::vector<TransactionRow> page;
+    TransactionCursor cursor;
+    size_t shown = 0;
+    
+    while (true) {
+        bool more = library.transactionPage(filter, cursor, PAGE_SIZE, page);
+        
+        for (const auto& row : page) {
+            const Transaction& transaction = row.transaction;
+            std::cout << std::left << std::setw(6) << transaction.id 
+                      << std::setw(8) << transactionTypeName(transaction.type)
+                      << std::setw(12) << formatDay(transaction.day)
+                      << std::setw(8) << transaction.studentId
+                      << std::setw(18) << (row.studentName ? row.studentName->substr(0, 16) : "Unknown")
+                      << std::setw(8) << transaction.bookId
+                      << (row.bookTitle ? *row.bookTitle : "Unknown") << std::endl;
+        }
+        shown += page.size();
+        
+        if (!more) break;
+        
+        answer = promptLine("-- " + std::to_string(shown) + " shown. Enter for more, q to stop: ");
+        if (answer == "q" || answer == "Q") break;
+    }
+    
+    if (shown == 0) {
+        std::cout << "No matching transactions." << std::endl;
+    }
+    
+    std::cout << "\nPress Enter to continue...";
+    std::cin.get();
+}
+
+
+// Function to display the books a student currently has out
+void displayStudentLoans() {
+    clearScreen();
+    std::cout << "\n=== Student Loans ===\n";
+    
+    int studentId;
+    std::cout << "Enter student ID: ";
+    std::cin >> studentId;
+    
+    std::string name;
+    std::vector<LoanRow> loans;
+    
+    if (library.snapshot()->studentLoans(studentId, name, loans) != LibraryStatus::Ok) {
+        std::cout << "Student not found." << std::endl;
+    } else if (loans.empty()) {
+        std::cout << name << " has no books on loan." << std::endl;
     } else {
-        std::cout << std::left << std::setw(5) << "ID" 
-                  << std::setw(10) << "Type" 
-                  << std::setw(12) << "Date" 
-                  << std::setw(12) << "Student ID" 
-                  << std::setw(10) << "Book ID"
+        std::cout << name << " has " << loans.size() << " book(s) on loan:\n";
+        std::cout << std::left << std::setw(10) << "Book ID" 
+                  << std::setw(10) << "Trans ID" 
                   << "Book Title" << std::endl;
-        std::cout << std::string(80, '-') << std::endl;
+        std::cout << std::string(60, '-') << std::endl;
         
-        for (const auto& transaction : transactions) {
-            // Find book title
-            std::string bookTitle = "Unknown";
-            auto bookIt = std::find_if(books.begin(), books.end(), [&transaction](const Book& book) {
-                return book.id == transaction.bookId;
-            });
-            
-            if (bookIt != books.end()) {
-                bookTitle = bookIt->title;
-            }
-            
-            std::cout << std::left << std::setw(5) << transaction.id 
-                      << std::setw(10) << transaction.type
-                      << std::setw(12) << transaction.date
-                      << std::setw(12) << transaction.studentId
-                      << std::setw(10) << transaction.bookId
-                      << bookTitle << std::endl;
+        for (const auto& loan : loans) {
+            std::cout << std::left << std::setw(10) << loan.bookId 
+                      << std::setw(10) << loan.transactionId
+                      << (loan.bookTitle ? *loan.bookTitle : "Unknown") << std::endl;
         }
     }
     
@@ -708,24 +577,260 @@ void displayTransactions() {
     std::cin.get();
 }
 
-// Function to display operation history
+// Function to display operation history: the latest entries, or those
+// between two times a page at a time
 void displayHistory() {
+    const size_t PAGE_SIZE = 50;
+    
     clearScreen();
     std::cout << "\n=== Operation History ===\n";
+    std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
     
-    if (operationHistory.empty()) {
-        std::cout << "No operations recorded." << std::endl;
+    std::vector<std::string> entries;
+    std::string answer = promptLine("Show 1. the latest entries or 2. entries between two times (blank = 1): ");
+    if (answer != "2") {
+        answer = promptLine("How many (blank = " + std::to_string(PAGE_SIZE) + "): ");
+        int count = answer.empty() ? static_cast<int>(PAGE_SIZE) : std::atoi(answer.c_str());
+        library.recentOperations(count > 0 ? static_cast<size_t>(count) : PAGE_SIZE, entries);
+        for (const auto& entry : entries) {
+            std::cout << entry << std::endl;
+        }
+        if (entries.empty()) {
+            std::cout << "No operations recorded." << std::endl;
+        }
     } else {
-        for (const auto& operation : operationHistory) {
-            std::cout << operation << std::endl;
+        int64_t from = 0, to = std::numeric_limits<int64_t>::max();
+        answer = promptLine("From YYYY-MM-DD [hh:mm[:ss]]: ");
+        bool valid = parseOperationTime(answer, false, from);
+        answer = valid ? promptLine("To YYYY-MM-DD [hh:mm[:ss]] (blank = now): ") : "";
+        valid = valid && (answer.empty() || parseOperationTime(answer, true, to));
+        
+        if (!valid) {
+            std::cout << "Invalid time." << std::endl;
+        } else {
+            // Page on (time of the last entry shown, entries shown at that time)
+            size_t skip = 0, shown = 0;
+            while (true) {
+                bool more = library.operationsBetween(from, to, skip, PAGE_SIZE, entries);
+                for (const auto& entry : entries) {
+                    int64_t time = from;
+                    operationLineTime(entry, time);
+                    skip = (time == from) ? skip + 1 : 1;
+                    from = time;
+                    std::cout << entry << std::endl;
+                }
+                shown += entries.size();
+                
+                if (!more) break;
+                
+                answer = promptLine("-- " + std::to_string(shown) + " shown. Enter for more, q to stop: ");
+                if (answer == "q" || answer == "Q") break;
+            }
+            if (shown == 0) {
+                std::cout << "No operations in that range." << std::endl;
+            }
         }
     }
     
+    std::cout << "\nPress Enter to continue...";
+    std::cin.get();
+}
+
+// Function to display the latency histograms and I/O counters
+void displayStatistics() {
+    clearScreen();
+    std::cout << "\n=== Statistics ===\n";
+    std::cout << "Latencies in microseconds since startup; file counters include startup loading.\n\n";
+    std::cout << formatStatsText(stats().report());
+
     std::cout << "\nPress Enter to continue...";
     std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
     std::cin.get();
 }
 
+// Function to print a ranked list of books
+void printRankedBooks(const std::vector<RankedBook>& ranked) {
+    if (ranked.empty()) {
+        std::cout << "No borrows yet." << std::endl;
+        return;
+    }
+    for (size_t i = 0; i < ranked.size(); ++i) {
+        std::cout << std::right << std::setw(3) << i + 1 << ". " << std::left << std::setw(30)
+                  << ranked[i].title.substr(0, 28) << "(ID: " << ranked[i].id << ") borrowed "
+                  << ranked[i].borrows << " time(s)\n";
+    }
+}
+
+// Function to display the circulation reports: totals, the most borrowed
+// books and the busiest students, the last few weeks day by day, and, on
+// request, the books never borrowed a page at a time
+void displayReports() {
+    const size_t TOP_SHOWN = 10;
+    const int32_t DAYS_SHOWN = 14;
+    const size_t PAGE_SIZE = 50;
+    
+    clearScreen();
+    std::cout << "\n=== Circulation Reports ===\n";
+    std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+    
+    std::shared_ptr<const LibrarySnapshot> view = library.snapshot();
+    int32_t today = coarseClock().today();
+    CirculationReport report;
+    library.circulationReport(TOP_SHOWN, today - DAYS_SHOWN + 1, today, report);
+    
+    std::cout << report.books << " book(s), " << view->bookCount() - view->availableCount() << " on loan, "
+              << report.neverBorrowed << " never borrowed." << std::endl;
+    std::cout << report.borrows << " borrow(s) and " << report.returns << " return(s) in all." << std::endl;
+    
+    std::cout << "\nMost borrowed books:\n";
+    printRankedBooks(report.topBooks);
+    if (report.month != CirculationStats::NO_MONTH) {
+        std::cout << "\nMost borrowed books in " << CirculationStats::monthName(report.month) << ":\n";
+        printRankedBooks(report.monthBooks);
+    }
+    
+    if (!report.topStudents.empty()) {
+        std::cout << "\nStudents who borrowed most:\n";
+        for (size_t i = 0; i < report.topStudents.size(); ++i) {
+            const RankedStudent& student = report.topStudents[i];
+            std::cout << std::right << std::setw(3) << i + 1 << ". " << std::left << std::setw(30) << student.name
+                      << "(ID: " << student.id << ") borrowed " << student.borrows << ", has "
+                      << student.loans << " out\n";
+        }
+    }
+    
+    std::cout << "\nLast " << DAYS_SHOWN << " days:\n";
+    std::cout << std::left << std::setw(12) << "Date" << std::setw(10) << "Borrows" << "Returns" << std::endl;
+    size_t next = 0;
+    for (int32_t day = today - DAYS_SHOWN + 1; day <= today; ++day) {
+        uint32_t borrows = 0, returns = 0;
+        if (next < report.days.size() && report.days[next].day == day) {
+            borrows = report.days[next].borrows;
+            returns = report.days[next].returns;
+            ++next;
+        }
+        std::cout << std::left << std::setw(12) << formatDay(day) << std::setw(10) << borrows << returns
+                  << std::endl;
+    }
+    
+    if (report.neverBorrowed > 0 && promptLine("\nList the books never borrowed? (y/N): ") == "y") {
+        std::cout << std::endl;
+        printBookHeader();
+        std::vector<Book> page;
+        std::string rows;
+        size_t shown = 0;
+        int after = 0;
+        while (true) {
+            bool more = view->neverBorrowedPage(after, PAGE_SIZE, page);
+            rows.clear();
+            for (const auto& book : page) {
+                appendBookRow(rows, book);
+            }
+            std::cout << rows;
+            shown += page.size();
+            if (!page.empty()) after = page.back().id;
+            
+            if (!more) break;
+            
+            std::string answer = promptLine("-- " + std::to_string(shown) + " shown. Enter for more, q to stop: ");
+            if (answer == "q" || answer == "Q") break;
+        }
+    }
+    
+    std::cout << "\nPress Enter to continue...";
+    std::cin.get();
+}
+
+// Function to export all data to the text files
+void exportData() {
+    clearScreen();
+    std::cout << "\n=== Export Data ===\n";
+    
+    library.exportText();
+    std::cout << "Data exported to books.txt, students.txt and transactions.txt." << std::endl;
+    
+    std::cout << "\nPress Enter to continue...";
+    std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+    std::cin.get();
+}
+
+// Function to bulk-import books and report the outcome. Returns false if
+// nothing could be imported.
+bool importBooks(const std::string& path, ImportFormat format) {
+    ImportSummary summary = library.importBooks(path, format);
+
+    if (!summary.error.empty()) {
+        std::cout << "Import stopped: " << summary.error << std::endl;
+    }
+    std::cout << "Imported " << summary.imported << " of " << summary.stats.records << " record(s) from " << path
+              << ", " << summary.rejected << " rejected." << std::endl;
+    std::cout << std::fixed << std::setprecision(2)
+              << "Read and parsed " << summary.stats.bytes / (1024.0 * 1024.0) << " MB in "
+              << summary.parseSeconds << " s (" << std::setprecision(0)
+              << (summary.parseSeconds > 0 ? summary.stats.records / summary.parseSeconds : 0.0)
+              << " records/s); " << std::setprecision(2) << summary.totalSeconds
+              << " s including indexing and save." << std::defaultfloat << std::endl;
+    for (const auto& sample : summary.samples) {
+        std::cout << "  " << sample << std::endl;
+    }
+    if (summary.rejected > summary.samples.size()) {
+        std::cout << "  ... " << summary.rejected - summary.samples.size() << " more" << std::endl;
+    }
+    if (summary.rejected > 0) {
+        std::cout << "All rejected rows are listed in " << summary.rejectPath << "." << std::endl;
+    }
+    if (!summary.persisted) {
+        std::cout << "Unable to write the data files; the imported books were not saved." << std::endl;
+    }
+    return summary.persisted && (summary.imported > 0 || summary.error.empty());
+}
+
+#ifndef _WIN32
+// Server being run by serve(), for the shutdown signal handler
+LibraryServer* activeServer = nullptr;
+
+// Function to stop the server on SIGINT/SIGTERM
+void stopServer(int) {
+    if (activeServer != nullptr) {
+        activeServer->stop();
+    }
+}
+#endif
+
+// Function to serve the library on a Unix socket until SIGINT/SIGTERM, then
+// checkpoint
+int serve(const std::string& socketPath, size_t workers) {
+#ifdef _WIN32
+    (void)workers;
+    std::cerr << "Server mode needs Unix domain sockets and is not available on Windows (" << socketPath << ")."
+              << std::endl;
+    return 1;
+#else
+    LibraryServer server(library, socketPath, workers);
+    std::string error;
+    if (!server.listen(error)) {
+        std::cerr << "Unable to listen: " << error << std::endl;
+        return 1;
+    }
+
+    activeServer = &server;
+    std::signal(SIGINT, stopServer);
+    std::signal(SIGTERM, stopServer);
+    std::signal(SIGPIPE, SIG_IGN);
+    library.logOperation("Server started on " + socketPath);
+    printNotice("Serving on " + socketPath + " with " + std::to_string(workers) +
+                " worker(s); stop with Ctrl-C or SIGTERM.");
+
+    server.run();
+    activeServer = nullptr;
+
+    bool saved = library.save();
+    library.logOperation("Server stopped");
+    printNotice(saved ? "Server stopped; data saved." : "Server stopped; unable to write the data files.");
+    return saved ? 0 : 1;
+#endif
+}
+
 // Function to display the main menu
 void displayMenu() {
     clearScreen();
@@ -741,14 +846,36 @@ void displayMenu() {
     std::cout << "9. Return Book\n";
     std::cout << "10. Display Transactions\n";
     std::cout << "11. Display Operation History\n";
+    std::cout << "12. Display Student Loans\n";
+    std::cout << "13. Export Data to Text Files\n";
+    std::cout << "14. Display Statistics\n";
+    std::cout << "15. Circulation Reports\n";
     std::cout << "0. Exit\n";
     std::cout << "Enter your choice: ";
 }
 
-int main() {
-    // Load data from files
-    loadAllData();
-    
+
+// Function to print the command-line usage
+void printUsage(const char* program) {
+    std::cerr << "Usage: " << program << " [--import <file> [--format csv|marc]] [--segment-months <n>]"
+              << " [--checkpoint-seconds <n>] [--checkpoint-changes <n>] [--stats [text|json]]\n"
+              << "       " << program << " --serve <socket> [--workers <n>] [--segment-months <n>]"
+              << " [--checkpoint-seconds <n>] [--checkpoint-changes <n>] [--stats [text|json]]\n"
+              << "  --import <file>           Add the books in a CSV (title,author,isbn) or MARC .mrk file, then exit\n"
+              << "  --format <fmt>            Input format; by default .mrk/.marc files are MARC and others CSV\n"
+              << "  --segment-months <n>      Months per transaction history segment (default "
+              << HISTORY_SEGMENT_MONTHS << "); only used when history/ is first created\n"
+              << "  --checkpoint-seconds <n>  Write changed tables to the data files every n seconds (default "
+              << CHECKPOINT_INTERVAL_SECONDS << ")\n"
+              << "  --checkpoint-changes <n>  Checkpoint sooner once n changes are journaled (default "
+              << JOURNAL_CHECKPOINT_RECORDS << ")\n"
+              << "  --serve <socket>          Serve clients on a Unix domain socket instead of showing the menu\n"
+              << "  --workers <n>             Threads answering server requests (default: one per core)\n"
+              << "  --stats [text|json]       On exit, print operation latencies and file I/O counters to stdout\n";
+}
+
+// Function to run the interactive menu until the user exits
+void runMenu() {
     int choice;
     bool running = true;
     
@@ -790,8 +917,20 @@ int main() {
             case 11:
                 displayHistory();
                 break;
+            case 12:
+                displayStudentLoans();
+                break;
+            case 13:
+                exportData();
+                break;
+            case 14:
+                displayStatistics();
+                break;
+            case 15:
+                displayReports();
+                break;
             case 0:
-                saveAllData();
+                library.save();
                 running = false;
                 std::cout << "Thank you for using the Library Management System!" << std::endl;
                 break;
@@ -804,5 +943,76 @@ int main() {
         }
     }
     
+}
+
+// Function to run what the command line asked for (import, serve or the
+// menu) once the data is loaded, returning the exit status
+int runMode(const std::string& importPath, const std::string& formatName, const std::string& socketPath,
+            int workers) {
+    if (!importPath.empty()) {
+        ImportFormat format = formatName.empty() ? importFormatFor(importPath)
+                            : (formatName == "marc" ? ImportFormat::Marc : ImportFormat::Csv);
+        return importBooks(importPath, format) ? 0 : 1;
+    }
+    if (!socketPath.empty()) {
+        return serve(socketPath, workers != 0 ? static_cast<size_t>(workers)
+                                              : std::max(1u, std::thread::hardware_concurrency()));
+    }
+    runMenu();
     return 0;
-}
\ No newline at end of file
+}
+
+int main(int argc, char* argv[]) {
+    std::string importPath;
+    std::string formatName;
+    std::string socketPath;
+    std::string statsFormat;
+    int workers = 0;
+    int checkpointSeconds = CHECKPOINT_INTERVAL_SECONDS;
+    int checkpointChanges = static_cast<int>(JOURNAL_CHECKPOINT_RECORDS);
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        int months;
+        if ((arg == "--import" || arg == "--format" || arg == "--serve") && i + 1 < argc) {
+            (arg == "--import" ? importPath : arg == "--format" ? formatName : socketPath) = argv[++i];
+        } else if (arg == "--segment-months" && i + 1 < argc && parseInt(argv[i + 1], months) &&
+                   months >= 1 && months <= 120) {
+            library.setSegmentMonths(months);
+            ++i;
+        } else if (arg == "--checkpoint-seconds" && i + 1 < argc && parseInt(argv[i + 1], checkpointSeconds) &&
+                   checkpointSeconds >= 1 && checkpointSeconds <= 86400) {
+            ++i;
+        } else if (arg == "--checkpoint-changes" && i + 1 < argc && parseInt(argv[i + 1], checkpointChanges) &&
+                   checkpointChanges >= 1) {
+            ++i;
+        } else if (arg == "--workers" && i + 1 < argc && parseInt(argv[i + 1], workers) &&
+                   workers >= 1 && workers <= 1024) {
+            ++i;
+        } else if (arg == "--stats") {
+            statsFormat = "text";
+            if (i + 1 < argc && (std::string(argv[i + 1]) == "text" || std::string(argv[i + 1]) == "json")) {
+                statsFormat = argv[++i];
+            }
+        } else {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+    if ((!formatName.empty() && (importPath.empty() || (formatName != "csv" && formatName != "marc"))) ||
+        (!socketPath.empty() && !importPath.empty()) || (workers != 0 && socketPath.empty())) {
+        printUsage(argv[0]);
+        return 1;
+    }
+    
+    // Load data from files
+    library.setCheckpointPolicy(checkpointSeconds, static_cast<size_t>(checkpointChanges));
+    library.load();
+    
+    int status = runMode(importPath, formatName, socketPath, workers);
+    if (statsFormat == "json") {
+        std::cout << formatStatsJson(stats().report()) << std::flush;
+    } else if (statsFormat == "text") {
+        std::cout << formatStatsText(stats().report()) << std::flush;
+    }
+    return status;
+}
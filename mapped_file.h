@@ -0,0 +1,135 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <string>
+#include <utility>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "stats.h"
+
+// Read-only memory mapping of a whole file. The mapping lives as long as the
+// object; move it to hand ownership on. An empty file opens successfully with
+// a null data() and size() 0. The size of each file mapped is counted as
+// bytes read in the I/O statistics, under its path or the counters given.
+class MappedFile {
+public:
+    MappedFile() = default;
+
+    ~MappedFile() {
+        close();
+    }
+
+    MappedFile(MappedFile&& other) noexcept {
+        *this = std::move(other);
+    }
+
+    MappedFile& operator=(MappedFile&& other) noexcept {
+        if (this != &other) {
+            close();
+            std::swap(bytes, other.bytes);
+            std::swap(length, other.length);
+            std::swap(opened, other.opened);
+        }
+        return *this;
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // Function to map a file (false if it is missing or cannot be mapped)
+    bool open(const std::string& path) {
+        return open(path, ioCounters(path));
+    }
+
+    bool open(const std::string& path, IoCounters& counters) {
+        close();
+#ifdef _WIN32
+        HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                                  OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (file == INVALID_HANDLE_VALUE) return false;
+
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(file, &size)) {
+            CloseHandle(file);
+            return false;
+        }
+        length = static_cast<size_t>(size.QuadPart);
+        if (length > 0) {
+            HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            if (mapping != nullptr) {
+                bytes = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+                CloseHandle(mapping);
+            }
+        }
+        CloseHandle(file);
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+
+        struct stat info;
+        if (::fstat(fd, &info) != 0) {
+            ::close(fd);
+            return false;
+        }
+        length = static_cast<size_t>(info.st_size);
+        if (length > 0) {
+            void* mapped = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapped != MAP_FAILED) {
+                bytes = static_cast<const char*>(mapped);
+                ::madvise(mapped, length, MADV_WILLNEED);
+            }
+        }
+        ::close(fd);
+#endif
+        if (length > 0 && bytes == nullptr) {
+            length = 0;
+            return false;
+        }
+        opened = true;
+        counters.read(length);
+        return true;
+    }
+
+    // Function to unmap the file
+    void close() {
+        if (bytes != nullptr) {
+#ifdef _WIN32
+            UnmapViewOfFile(bytes);
+#else
+            ::munmap(const_cast<char*>(bytes), length);
+#endif
+        }
+        bytes = nullptr;
+        length = 0;
+        opened = false;
+    }
+
+    bool isOpen() const {
+        return opened;
+    }
+
+    const char* data() const {
+        return bytes;
+    }
+
+    size_t size() const {
+        return length;
+    }
+
+private:
+    const char* bytes = nullptr;
+    size_t length = 0;
+    bool opened = false;
+};
+
+#endif
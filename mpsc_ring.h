@@ -0,0 +1,91 @@
+#ifndef MPSC_RING_H
+#define MPSC_RING_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+// Bounded lock-free multi-producer/single-consumer ring (Vyukov's bounded
+// queue, consumer side simplified for one reader).
+//
+// Every slot carries a sequence number. A producer claims position p by
+// CAS-ing the head from p to p + 1 when slot p's sequence equals p, fills the
+// slot, then publishes it by storing p + 1. The consumer takes position t once
+// the slot's sequence reads t + 1, and hands the slot back for the next lap by
+// storing t + capacity. Capacity is rounded up to a power of two.
+template <typename T>
+class MpscRing {
+public:
+    explicit MpscRing(size_t minCapacity) {
+        size_t capacity = 2;
+        while (capacity < minCapacity) capacity <<= 1;
+        mask = capacity - 1;
+        slots.reset(new Slot[capacity]);
+        for (size_t i = 0; i < capacity; ++i) {
+            slots[i].seq.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    MpscRing(const MpscRing&) = delete;
+    MpscRing& operator=(const MpscRing&) = delete;
+
+    size_t capacity() const {
+        return mask + 1;
+    }
+
+    // Function to enqueue from any thread; false if the ring is full
+    bool tryPush(T&& value) {
+        size_t pos = head.load(std::memory_order_relaxed);
+        for (;;) {
+            Slot& slot = slots[pos & mask];
+            size_t seq = slot.seq.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+            if (diff == 0) {
+                if (head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    slot.value = std::move(value);
+                    slot.seq.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = head.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Function to dequeue on the consumer thread; false if nothing is ready
+    bool tryPop(T& out) {
+        Slot& slot = slots[tail & mask];
+        size_t seq = slot.seq.load(std::memory_order_acquire);
+        if (static_cast<intptr_t>(seq) - static_cast<intptr_t>(tail + 1) < 0) {
+            return false;
+        }
+        out = std::move(slot.value);
+        slot.seq.store(tail + mask + 1, std::memory_order_release);
+        ++tail;
+        return true;
+    }
+
+    // Function to get how many pushes have claimed a slot so far
+    size_t claimed() const {
+        return head.load(std::memory_order_acquire);
+    }
+
+private:
+    struct Slot {
+        std::atomic<size_t> seq;
+        T value;
+    };
+
+    std::unique_ptr<Slot[]> slots;
+    size_t mask = 0;
+    char padHead[64]; // Keep the producers' head off the consumer's line
+    std::atomic<size_t> head{0};
+    char padTail[64];
+    size_t tail = 0;
+};
+
+#endif
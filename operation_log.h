@@ -0,0 +1,555 @@
+#ifndef OPERATION_LOG_H
+#define OPERATION_LOG_H
+
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#ifdef _WIN32
+#include <direct.h>
+#include <io.h>
+#else
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "async_logger.h"
+#include "atomic_file.h"
+#include "civil_date.h"
+#include "mapped_file.h"
+#include "stats.h"
+#include "text_loader.h"
+
+// Operation history: a fixed-size ring of recent entries in memory and the
+// full trail on disk in rotated segments.
+//
+//   operations/index.txt   one line per sealed segment: lines, bytes and
+//                          first/last timestamps
+//   operations/000001.log  sealed segments, never rewritten, one entry a line
+//   operations/000001.idx  a sealed segment's offset marks
+//   operations/000007.log  the segment still being appended to
+//
+// Entries are "Y-M-D h:m:s: text" lines as before. The background writer
+// appends them to the current segment and starts a new one once it passes
+// OPERATION_SEGMENT_BYTES. Every OPERATION_MARK_LINES lines it records a mark
+// (line number, byte offset, timestamp), so a read can seek straight to the
+// line it wants. Sealing writes the segment's marks, then index.txt (the
+// commit point); the current segment's marks are rebuilt on startup by
+// scanning it, which is at most one segment's worth of reading.
+//
+// "The last n" comes from the ring when it holds that many, otherwise from
+// the newest segments, reading only their last n lines. "Between two times"
+// skips segments whose timestamps miss the range and seeks by marks inside
+// the rest. Memory use is the ring plus a few numbers per sealed segment,
+// however long the process runs. Timestamps are wall-clock seconds and taken
+// to be non-decreasing; entries logged while the clock stepped back may be
+// missed by a range read.
+//
+// A pre-segment operation_history.txt is moved in as the first segment.
+// Segment reads and writes are counted together as "operations/segments" in
+// the I/O statistics.
+
+const size_t OPERATION_SEGMENT_BYTES = 1 << 20;
+const size_t OPERATION_MARK_LINES = 256;
+const size_t OPERATION_RING_ENTRIES = 1024;
+
+// Function to parse a "Y-M-D[ h:m[:s]]" time into seconds since 1970 (of
+// local clock fields). A missing time of day is the start of the day, or its
+// last second if endOfRange is set; likewise for missing seconds.
+inline bool parseOperationTime(std::string_view text, bool endOfRange, int64_t& key) {
+    std::string_view parts[2];
+    size_t count = splitFields(text, ' ', parts, 2);
+    int32_t day;
+    if (count > 2 || !parseDay(parts[0], day)) return false;
+
+    int clock[3] = {0, 0, 0};
+    size_t fields = 0;
+    if (count == 2) {
+        std::string_view pieces[3];
+        fields = splitFields(parts[1], ':', pieces, 3);
+        if (fields < 2 || fields > 3) return false;
+        for (size_t i = 0; i < fields; ++i) {
+            if (pieces[i].size() > 2 || !parseInt(pieces[i], clock[i]) || clock[i] < 0) return false;
+        }
+        if (clock[0] > 23 || clock[1] > 59 || clock[2] > 59) return false;
+    }
+
+    key = int64_t(day) * 86400 + clock[0] * 3600 + clock[1] * 60 + clock[2];
+    if (endOfRange) {
+        key += fields == 0 ? 86399 : (fields == 2 ? 59 : 0);
+    }
+    return true;
+}
+
+// Function to get the timestamp key of a "Y-M-D h:m:s: text" entry
+inline bool operationLineTime(std::string_view line, int64_t& key) {
+    // The timestamp ends at the first ": "
+    size_t end = line.find(": ");
+    return end != std::string_view::npos && parseOperationTime(line.substr(0, end), false, key);
+}
+
+// Line count, size and time bounds of one segment
+struct OperationSegment {
+    uint32_t seq = 0;
+    uint64_t lines = 0;
+    uint64_t bytes = 0;
+    int64_t firstKey = 0;
+    int64_t lastKey = 0;
+};
+
+// Where a line starts, every OPERATION_MARK_LINES lines
+struct OperationMark {
+    uint64_t line = 0;
+    uint64_t offset = 0;
+    int64_t key = 0;
+};
+
+// The on-disk segments. write(), sync() and close() come from the logger's
+// writer thread; reads may come from any thread.
+class OperationSegments : public LogSink {
+public:
+    OperationSegments(const std::string& segmentDirectory, const std::string& legacyLogPath)
+        : directory(segmentDirectory), legacyPath(legacyLogPath), io(ioCounters(segmentDirectory + "/segments")) {}
+
+    ~OperationSegments() override {
+        close();
+    }
+
+    // Function to append whole lines, starting a new segment whenever the
+    // current one is full
+    void write(const std::string& lines) override {
+        ensureOpen();
+        size_t pos = 0;
+        while (pos < lines.size()) {
+            if (current.bytes >= OPERATION_SEGMENT_BYTES) {
+                seal();
+            }
+            if (file == nullptr) {
+                file = std::fopen(segmentPath(current.seq, ".log").c_str(), "ab");
+                if (file == nullptr) return;
+            }
+
+            // Take lines up to the segment limit, marking as we go
+            std::vector<OperationMark> marks;
+            OperationSegment next = current;
+            size_t end = pos;
+            while (end < lines.size() && (next.bytes < OPERATION_SEGMENT_BYTES || next.lines == 0)) {
+                size_t newline = lines.find('\n', end);
+                size_t after = newline == std::string::npos ? lines.size() : newline + 1;
+                noteLine(std::string_view(lines).substr(end, after - end), next, marks);
+                end = after;
+            }
+
+            io.wrote(std::fwrite(lines.data() + pos, 1, end - pos, file));
+            std::fflush(file);
+            pos = end;
+
+            std::lock_guard<std::mutex> lock(mutex);
+            current = next;
+            currentMarks.insert(currentMarks.end(), marks.begin(), marks.end());
+        }
+    }
+
+    void sync() override {
+        if (file == nullptr) return;
+        std::fflush(file);
+#ifdef _WIN32
+        ::_commit(::_fileno(file));
+#else
+        ::fsync(::fileno(file));
+#endif
+        io.synced();
+    }
+
+    void close() override {
+        if (file != nullptr) {
+            std::fclose(file);
+            file = nullptr;
+        }
+    }
+
+    // Function to collect the last count entries, oldest first
+    void last(size_t count, std::vector<std::string>& out) {
+        std::vector<OperationSegment> segments = snapshotSegments();
+        std::vector<std::vector<std::string>> parts;
+        size_t found = 0;
+        for (size_t s = segments.size(); s-- > 0 && found < count;) {
+            const OperationSegment& segment = segments[s];
+            uint64_t take = std::min<uint64_t>(count - found, segment.lines);
+            if (take == 0) continue;
+            parts.emplace_back();
+            readLines(segment, segment.lines - take, [&](std::string_view line, int64_t) {
+                parts.back().emplace_back(line);
+                return true;
+            });
+            found += parts.back().size();
+        }
+        out.clear();
+        out.reserve(found);
+        for (size_t p = parts.size(); p-- > 0;) {
+            for (auto& line : parts[p]) {
+                out.push_back(std::move(line));
+            }
+        }
+    }
+
+    // Function to collect up to limit entries timed from..to (inclusive),
+    // oldest first, after skipping the first skip of them; returns whether
+    // more entries fall in the range
+    bool between(int64_t from, int64_t to, size_t skip, size_t limit, std::vector<std::string>& out) {
+        out.clear();
+        bool more = false;
+        for (const OperationSegment& segment : snapshotSegments()) {
+            if (segment.lines == 0 || segment.lastKey < from) continue;
+            if (segment.firstKey > to || more) break;
+
+            // Start at the last mark timed before the range
+            std::vector<OperationMark> marks = marksOf(segment);
+            uint64_t startLine = 0;
+            for (const OperationMark& mark : marks) {
+                if (mark.key >= from) break;
+                startLine = mark.line;
+            }
+            bool past = false;
+            readLines(segment, startLine, [&](std::string_view line, int64_t key) {
+                if (key < from) return true;
+                if (key > to) {
+                    past = true;
+                    return false;
+                }
+                if (skip > 0) {
+                    --skip;
+                    return true;
+                }
+                if (out.size() == limit) {
+                    more = true;
+                    return false;
+                }
+                out.emplace_back(line);
+                return true;
+            });
+            if (past) break;
+        }
+        return more;
+    }
+
+private:
+    // Function to count one line into a segment, marking it if it is due.
+    // A mark keeps the latest timestamp up to its line, so every line
+    // before a mark timed before t is too.
+    static void noteLine(std::string_view line, OperationSegment& segment, std::vector<OperationMark>& marks) {
+        int64_t key;
+        if (operationLineTime(line, key)) {
+            if (segment.lines == 0) segment.firstKey = key;
+            segment.lastKey = std::max(segment.lastKey, key);
+        }
+        if (segment.lines % OPERATION_MARK_LINES == 0) {
+            marks.push_back({segment.lines, segment.bytes, segment.lastKey});
+        }
+        ++segment.lines;
+        segment.bytes += line.size();
+    }
+
+    std::string segmentPath(uint32_t seq, const char* extension) const {
+        char name[16];
+        std::snprintf(name, sizeof(name), "%06u", seq);
+        return directory + "/" + name + extension;
+    }
+
+    std::string indexPath() const {
+        return directory + "/index.txt";
+    }
+
+    bool makeDirectory() const {
+#ifdef _WIN32
+        return ::_mkdir(directory.c_str()) == 0 || errno == EEXIST;
+#else
+        return ::mkdir(directory.c_str(), 0755) == 0 || errno == EEXIST;
+#endif
+    }
+
+    // Function to find the segments on first use: read index.txt (or scan the
+    // segment files if it is missing or unreadable) and scan the current
+    // segment for its marks
+    void ensureOpen() {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (opened) return;
+        opened = true;
+
+        std::error_code error;
+        if (!std::filesystem::exists(directory, error)) {
+            makeDirectory();
+            if (std::filesystem::exists(legacyPath, error)) {
+                std::filesystem::rename(legacyPath, segmentPath(1, ".log"), error);
+            }
+        }
+
+        if (!readIndex()) {
+            // Rebuild: every segment file but the last one is sealed
+            sealed.clear();
+            for (uint32_t seq = 1; std::filesystem::exists(segmentPath(seq + 1, ".log"), error); ++seq) {
+                OperationSegment segment;
+                std::vector<OperationMark> marks;
+                scanSegment(seq, segment, marks);
+                writeMarks(segment, marks);
+                sealed.push_back(segment);
+            }
+            writeIndex(sealed);
+        }
+
+        current = OperationSegment();
+        current.seq = sealed.empty() ? 1 : sealed.back().seq + 1;
+        currentMarks.clear();
+        scanSegment(current.seq, current, currentMarks);
+
+        // Cut a line torn by a crash, so appends start on a fresh line
+        if (std::filesystem::exists(segmentPath(current.seq, ".log"), error) &&
+            std::filesystem::file_size(segmentPath(current.seq, ".log"), error) > current.bytes) {
+            std::filesystem::resize_file(segmentPath(current.seq, ".log"), current.bytes, error);
+        }
+    }
+
+    // Function to count a segment's complete lines and mark them
+    void scanSegment(uint32_t seq, OperationSegment& segment, std::vector<OperationMark>& marks) {
+        segment = OperationSegment();
+        segment.seq = seq;
+        marks.clear();
+        MappedFile mapped;
+        if (!mapped.open(segmentPath(seq, ".log"), io) || mapped.size() == 0) return;
+
+        std::string_view text(mapped.data(), mapped.size());
+        for (size_t pos = 0; pos < text.size();) {
+            size_t newline = text.find('\n', pos);
+            if (newline == std::string_view::npos) break;
+            noteLine(text.substr(pos, newline + 1 - pos), segment, marks);
+            pos = newline + 1;
+        }
+        io.parsed(segment.lines);
+    }
+
+    // Function to load the sealed segment list; false if it is missing or
+    // does not match the files
+    bool readIndex() {
+        sealed.clear();
+        std::ifstream file(indexPath());
+        if (!file) return false;
+        std::string line;
+        while (std::getline(file, line)) {
+            if (line.empty() || line[0] == '#') continue;
+            std::string_view fields[5];
+            OperationSegment segment;
+            if (splitFields(line, ' ', fields, 5) != 5 || !parseNumber(fields[0], segment.seq) ||
+                !parseNumber(fields[1], segment.lines) || !parseNumber(fields[2], segment.bytes) ||
+                !parseNumber(fields[3], segment.firstKey) || !parseNumber(fields[4], segment.lastKey) ||
+                segment.seq != sealed.size() + 1) {
+                sealed.clear();
+                return false;
+            }
+            sealed.push_back(segment);
+        }
+        return true;
+    }
+
+    // Function to parse a whole field as a decimal number
+    template <typename T>
+    static bool parseNumber(std::string_view field, T& value) {
+        std::from_chars_result result = std::from_chars(field.data(), field.data() + field.size(), value);
+        return result.ec == std::errc() && result.ptr == field.data() + field.size() && !field.empty();
+    }
+
+    void writeIndex(const std::vector<OperationSegment>& segments) {
+        std::string text = "# seq lines bytes first last\n";
+        for (const OperationSegment& segment : segments) {
+            text += std::to_string(segment.seq) + " " + std::to_string(segment.lines) + " " +
+                    std::to_string(segment.bytes) + " " + std::to_string(segment.firstKey) + " " +
+                    std::to_string(segment.lastKey) + "\n";
+        }
+        AtomicFileWriter file(indexPath());
+        file.write(text);
+        file.commit();
+    }
+
+    void writeMarks(const OperationSegment& segment, const std::vector<OperationMark>& marks) {
+        std::string text;
+        for (const OperationMark& mark : marks) {
+            text += std::to_string(mark.line) + " " + std::to_string(mark.offset) + " " + std::to_string(mark.key) + "\n";
+        }
+        AtomicFileWriter file(segmentPath(segment.seq, ".idx"), io);
+        file.write(text);
+        file.commit();
+    }
+
+    // Function to close the current segment for good and start the next
+    // (writer thread only)
+    void seal() {
+        sync();
+        close();
+        std::vector<OperationSegment> segments;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            writeMarks(current, currentMarks);
+            sealed.push_back(current);
+            segments = sealed;
+            current = OperationSegment();
+            current.seq = sealed.back().seq + 1;
+            currentMarks.clear();
+        }
+        writeIndex(segments);
+    }
+
+    // Function to copy the segment list, the current segment last
+    std::vector<OperationSegment> snapshotSegments() {
+        ensureOpen();
+        std::lock_guard<std::mutex> lock(mutex);
+        std::vector<OperationSegment> segments = sealed;
+        segments.push_back(current);
+        return segments;
+    }
+
+    // Function to get a segment's marks: the current one's from memory, a
+    // sealed one's from its .idx file, or by scanning if that is missing
+    std::vector<OperationMark> marksOf(const OperationSegment& segment) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (segment.seq == current.seq) return currentMarks;
+        }
+        std::vector<OperationMark> marks;
+        std::ifstream file(segmentPath(segment.seq, ".idx"));
+        std::string line;
+        while (std::getline(file, line)) {
+            std::string_view fields[3];
+            OperationMark mark;
+            if (splitFields(line, ' ', fields, 3) != 3 || !parseNumber(fields[0], mark.line) ||
+                !parseNumber(fields[1], mark.offset) || !parseNumber(fields[2], mark.key) ||
+                mark.offset >= segment.bytes) {
+                marks.clear();
+                break;
+            }
+            marks.push_back(mark);
+        }
+        if (marks.empty()) {
+            OperationSegment scanned;
+            scanSegment(segment.seq, scanned, marks);
+        }
+        return marks;
+    }
+
+    // Function to hand visit(line, key) each line of a segment from
+    // firstLine on, until it returns false; only the bytes from the nearest
+    // mark before firstLine are read
+    template <typename Visit>
+    void readLines(const OperationSegment& segment, uint64_t firstLine, Visit visit) {
+        std::vector<OperationMark> marks = marksOf(segment);
+        OperationMark start;
+        for (const OperationMark& mark : marks) {
+            if (mark.line > firstLine) break;
+            start = mark;
+        }
+
+        // Counted below by the bytes actually walked, not the whole mapping
+        IoCounters mappedIo;
+        MappedFile mapped;
+        if (!mapped.open(segmentPath(segment.seq, ".log"), mappedIo)) return;
+        std::string_view text(mapped.data(), std::min<uint64_t>(mapped.size(), segment.bytes));
+
+        uint64_t line = start.line;
+        size_t pos = std::min<uint64_t>(start.offset, text.size());
+        uint64_t parsed = 0;
+        while (pos < text.size()) {
+            size_t newline = text.find('\n', pos);
+            size_t end = newline == std::string_view::npos ? text.size() : newline;
+            if (line++ >= firstLine) {
+                std::string_view entry = text.substr(pos, end - pos);
+                int64_t key = 0;
+                operationLineTime(entry, key);
+                ++parsed;
+                if (!visit(entry, key)) {
+                    pos = end;
+                    break;
+                }
+            }
+            pos = end + 1;
+        }
+        io.read(std::min(pos, text.size()) - std::min<uint64_t>(start.offset, text.size()));
+        io.parsed(parsed);
+    }
+
+    std::string directory;
+    std::string legacyPath;
+    IoCounters& io;
+
+    std::mutex mutex; // Guards the fields below
+    bool opened = false;
+    std::vector<OperationSegment> sealed;
+    OperationSegment current;
+    std::vector<OperationMark> currentMarks;
+
+    std::FILE* file = nullptr; // Writer thread only
+};
+
+// The operation history as a whole: log() keeps the entry in the ring and
+// queues it for the segments.
+class OperationLog {
+public:
+    OperationLog(const std::string& directory, const std::string& legacyPath)
+        : segments(directory, legacyPath), ring(OPERATION_RING_ENTRIES), writer(segments) {}
+
+    // Function to record one "timestamp: text" entry
+    void log(std::string entry) {
+        std::lock_guard<std::mutex> lock(ringMutex);
+        ring[ringNext] = entry;
+        ringNext = (ringNext + 1) % ring.size();
+        ringCount = std::min(ringCount + 1, ring.size());
+        writer.log(std::move(entry));
+    }
+
+    // Function to wait until everything logged so far is on disk
+    void sync() {
+        writer.sync();
+    }
+
+    // Function to collect the last count entries, oldest first
+    void last(size_t count, std::vector<std::string>& out) {
+        {
+            std::lock_guard<std::mutex> lock(ringMutex);
+            if (count <= ringCount) {
+                out.clear();
+                for (size_t i = ringCount - count; i < ringCount; ++i) {
+                    out.push_back(ring[(ringNext + ring.size() - ringCount + i) % ring.size()]);
+                }
+                return;
+            }
+        }
+        writer.flush();
+        segments.last(count, out);
+    }
+
+    // Function to collect up to limit entries timed from..to, oldest first,
+    // after skipping the first skip of them; returns whether more entries
+    // fall in the range. To page, pass the last entry's time as from and
+    // the number of entries seen with that time as skip.
+    bool between(int64_t from, int64_t to, size_t skip, size_t limit, std::vector<std::string>& out) {
+        writer.flush();
+        return segments.between(from, to, skip, limit, out);
+    }
+
+private:
+    OperationSegments segments;
+
+    std::mutex ringMutex;
+    std::vector<std::string> ring;
+    size_t ringNext = 0;
+    size_t ringCount = 0;
+
+    AsyncLogger writer; // Last, so its thread stops before the rest goes
+};
+
+#endif
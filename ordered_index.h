@@ -0,0 +1,225 @@
+#ifndef ORDERED_INDEX_H
+#define ORDERED_INDEX_H
+
+#include <algorithm>
+#include <cstdint>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Ordered index of record ids by a text key, compared case-insensitively
+// with the id breaking ties, for browsing records in sorted order a page at
+// a time.
+//
+// The entries live in a two-level B+-tree: sorted blocks of up to
+// 2 * BLOCK_ENTRIES entries, in order, found by binary search on each
+// block's first entry. Finding a position is two binary searches, an insert
+// or erase moves at most one block's entries (and splits or drops a block
+// now and then), and a page after any position is a walk along the blocks:
+// O(log n + page) whatever the catalog size.
+//
+// Entries are 16 bytes: the id and the first 8 folded bytes of the key, so
+// most comparisons never leave the block. Keys that agree on those bytes are
+// compared in full through a textOf(id) callback returning a record's key,
+// so the index stores no text. textOf must return the key each entry was
+// indexed with: erase a record before changing or dropping its key, and
+// insert it again after.
+class OrderedIndex {
+public:
+    static const size_t BLOCK_ENTRIES = 256; // Blocks split past twice this
+
+    size_t size() const {
+        return count;
+    }
+
+    void clear() {
+        blocks.clear();
+        count = 0;
+    }
+
+    // Function to index one record
+    template <typename TextOf>
+    void insert(int id, std::string_view text, TextOf textOf) {
+        Probe probe(id, text);
+        if (blocks.empty()) {
+            blocks.emplace_back(1, probe.entry);
+            count = 1;
+            return;
+        }
+        ProbeLess<TextOf> less{textOf};
+        size_t b = blockFor(probe, less);
+        std::vector<Entry>& block = blocks[b];
+        block.insert(std::upper_bound(block.begin(), block.end(), probe, less), probe.entry);
+        ++count;
+        if (block.size() > 2 * BLOCK_ENTRIES) {
+            std::vector<Entry> upper(block.begin() + BLOCK_ENTRIES, block.end());
+            block.resize(BLOCK_ENTRIES);
+            blocks.insert(blocks.begin() + b + 1, std::move(upper));
+        }
+    }
+
+    // Function to unindex a record; text must be the key it was indexed with
+    template <typename TextOf>
+    void erase(int id, std::string_view text, TextOf textOf) {
+        if (blocks.empty()) return;
+        Probe probe(id, text);
+        ProbeLess<TextOf> less{textOf};
+        size_t b = blockFor(probe, less);
+        std::vector<Entry>& block = blocks[b];
+        auto pos = std::lower_bound(block.begin(), block.end(), probe, less);
+        if (pos == block.end() || pos->id != id) return;
+        block.erase(pos);
+        --count;
+        if (block.empty()) {
+            blocks.erase(blocks.begin() + b);
+        } else if (block.size() < BLOCK_ENTRIES / 4 && b + 1 < blocks.size() &&
+                   block.size() + blocks[b + 1].size() <= 2 * BLOCK_ENTRIES) {
+            block.insert(block.end(), blocks[b + 1].begin(), blocks[b + 1].end());
+            blocks.erase(blocks.begin() + b + 1);
+        }
+    }
+
+    // Function to index every record from scratch
+    void build(const std::vector<std::pair<int, std::string_view>>& records) {
+        std::vector<Probe> probes;
+        probes.reserve(records.size());
+        for (const auto& record : records) {
+            probes.emplace_back(record.first, record.second);
+        }
+        std::sort(probes.begin(), probes.end(), [](const Probe& a, const Probe& b) {
+            return compare(a, b) < 0;
+        });
+        clear();
+        for (size_t i = 0; i < probes.size(); i += BLOCK_ENTRIES) {
+            std::vector<Entry> block;
+            block.reserve(2 * BLOCK_ENTRIES);
+            for (size_t j = i; j < std::min(i + BLOCK_ENTRIES, probes.size()); ++j) {
+                block.push_back(probes[j].entry);
+            }
+            blocks.push_back(std::move(block));
+        }
+        count = probes.size();
+    }
+
+    // Function to collect up to limit ids in order, starting after the
+    // record keyed (text, id), or from the start when first is set
+    template <typename TextOf>
+    void after(bool first, std::string_view text, int id, size_t limit, std::vector<int>& out,
+               TextOf textOf) const {
+        out.clear();
+        if (blocks.empty()) return;
+        size_t b = 0, pos = 0;
+        if (!first) {
+            Probe probe(id, text);
+            ProbeLess<TextOf> less{textOf};
+            b = blockFor(probe, less);
+            pos = std::upper_bound(blocks[b].begin(), blocks[b].end(), probe, less) - blocks[b].begin();
+        }
+        for (; b < blocks.size() && out.size() < limit; ++b, pos = 0) {
+            const std::vector<Entry>& block = blocks[b];
+            for (; pos < block.size() && out.size() < limit; ++pos) {
+                out.push_back(block[pos].id);
+            }
+        }
+    }
+
+    // Function to estimate the bytes held
+    size_t memoryBytes() const {
+        size_t bytes = blocks.capacity() * sizeof(std::vector<Entry>);
+        for (const auto& block : blocks) {
+            bytes += block.capacity() * sizeof(Entry);
+        }
+        return bytes;
+    }
+
+private:
+    struct Entry {
+        uint64_t prefix;  // First 8 folded bytes, big-endian, zero-padded
+        int32_t id;
+        uint32_t longer;  // 1 if the key goes on past the prefix
+    };
+
+    // An entry together with its full key
+    struct Probe {
+        Probe(int id, std::string_view keyText) : text(keyText) {
+            entry.prefix = 0;
+            for (size_t i = 0; i < 8; ++i) {
+                entry.prefix = (entry.prefix << 8) | (i < text.size() ? fold(text[i]) : 0);
+            }
+            entry.id = id;
+            entry.longer = text.size() > 8 ? 1 : 0;
+        }
+
+        Entry entry;
+        std::string_view text;
+    };
+
+    static unsigned char fold(char c) {
+        unsigned char u = static_cast<unsigned char>(c);
+        return (u >= 'A' && u <= 'Z') ? static_cast<unsigned char>(u + ('a' - 'A')) : u;
+    }
+
+    // Function to compare keys case-insensitively (negative, zero, positive)
+    static int compareText(std::string_view a, std::string_view b) {
+        size_t n = std::min(a.size(), b.size());
+        for (size_t i = 0; i < n; ++i) {
+            unsigned char x = fold(a[i]), y = fold(b[i]);
+            if (x != y) return x < y ? -1 : 1;
+        }
+        return a.size() == b.size() ? 0 : (a.size() < b.size() ? -1 : 1);
+    }
+
+    static int compareIds(int a, int b) {
+        return a == b ? 0 : (a < b ? -1 : 1);
+    }
+
+    // Function to order two records whose keys are at hand
+    static int compare(const Probe& a, const Probe& b) {
+        if (a.entry.prefix != b.entry.prefix) return a.entry.prefix < b.entry.prefix ? -1 : 1;
+        if (a.entry.longer | b.entry.longer) {
+            int order = compareText(a.text, b.text);
+            if (order != 0) return order;
+        }
+        return compareIds(a.entry.id, b.entry.id);
+    }
+
+    // Orders a probe against stored entries, fetching an entry's key only
+    // when the prefixes tie
+    template <typename TextOf>
+    struct ProbeLess {
+        TextOf& textOf;
+
+        bool operator()(const Probe& a, const Entry& b) const {
+            return order(a, b) < 0;
+        }
+
+        bool operator()(const Entry& a, const Probe& b) const {
+            return order(b, a) > 0;
+        }
+
+        int order(const Probe& a, const Entry& b) const {
+            if (a.entry.prefix != b.prefix) return a.entry.prefix < b.prefix ? -1 : 1;
+            if (a.entry.longer | b.longer) {
+                int result = compareText(a.text, textOf(b.id));
+                if (result != 0) return result;
+            }
+            return compareIds(a.entry.id, b.id);
+        }
+    };
+
+    // Function to find the block a probe falls in: the last one whose first
+    // entry is not after it (the first block if there is none)
+    template <typename TextOf>
+    size_t blockFor(const Probe& probe, const ProbeLess<TextOf>& less) const {
+        auto it = std::upper_bound(blocks.begin(), blocks.end(), probe,
+                                   [&less](const Probe& p, const std::vector<Entry>& block) {
+                                       return less(p, block.front());
+                                   });
+        return it == blocks.begin() ? 0 : static_cast<size_t>(it - blocks.begin()) - 1;
+    }
+
+    std::vector<std::vector<Entry>> blocks; // Sorted, none empty
+    size_t count = 0;
+};
+
+#endif
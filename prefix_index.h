@@ -0,0 +1,632 @@
+#ifndef PREFIX_INDEX_H
+#define PREFIX_INDEX_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "atomic_file.h"
+#include "checksum.h"
+#include "mapped_file.h"
+
+// Prefix index for type-ahead: the most popular completions of what has been
+// typed so far.
+//
+// Each record's text is normalized into a term (lowercase words - runs of
+// letters, digits and non-ASCII bytes - joined by single spaces), and equal
+// terms are stored once, with the number of records holding them and a
+// weight: the borrows of those records between them. A term is reachable
+// from the start of each of its first MAX_WORD_STARTS words, so "ring"
+// completes "the lord of the rings" as well as "rings of saturn".
+//
+// Those word starts are the keys: (term, offset) pairs kept sorted by the
+// text from the offset on, in a two-level B+-tree like OrderedIndex's. The
+// keys completing a prefix are therefore one contiguous run, found by two
+// binary searches. Every block also carries the highest weight among its
+// keys. top() visits the blocks of the run heaviest first and stops at the
+// first block that cannot beat the k-th best so far, so the cost follows k
+// and how skewed the weights are, not how common the prefix is. Equal
+// weights rank in key order, i.e. alphabetically from the matched word.
+//
+// Weights change in place: adding a borrow raises the maxima of the term's
+// blocks, removing one rescans them. Terms no record holds any more are
+// dropped from the keys and their slots reused.
+//
+// write() stores the whole index in one file and read() maps it back with a
+// few copies and no sorting or normalizing. The file names the catalog
+// snapshot it was written with (by the snapshot's checksum); read() refuses
+// it for any other catalog, and the caller rebuilds the index instead.
+class PrefixIndex {
+public:
+    static constexpr size_t BLOCK_KEYS = 256;     // Blocks split past twice this
+    static constexpr size_t MAX_WORD_STARTS = 8;  // Later words do not start keys
+
+    struct Completion {
+        std::string text; // Normalized
+        uint32_t records; // Holding it
+        uint64_t weight;  // Their borrows between them
+    };
+
+    // Function to fold text into the form terms are stored and matched in
+    static std::string normalize(std::string_view text) {
+        std::string out;
+        out.reserve(text.size());
+        bool gap = false;
+        for (char ch : text) {
+            unsigned char c = fold(ch);
+            if (!isWordByte(c)) {
+                gap = true;
+                continue;
+            }
+            if (gap && !out.empty()) out += ' ';
+            gap = false;
+            out += static_cast<char>(c);
+        }
+        return out;
+    }
+
+    size_t termCount() const {
+        return liveTerms;
+    }
+
+    size_t keyCount() const {
+        return keys;
+    }
+
+    void clear() {
+        text.clear();
+        terms.clear();
+        freeTerms.clear();
+        blocks.clear();
+        recordTerms.clear();
+        recordBorrows.clear();
+        liveTerms = 0;
+        keys = 0;
+        garbage = 0;
+    }
+
+    // Function to index a record's text (replacing any text it had)
+    void add(int id, std::string_view recordText) {
+        if (id < 0) return;
+        remove(id);
+        track(id);
+        std::string term = normalize(recordText);
+        if (term.empty()) return;
+
+        uint32_t number = find(term);
+        if (number == NO_TERM) {
+            number = newTerm(term);
+            terms[number].records = 1;
+            terms[number].weight = recordBorrows[id];
+            insertKeys(number);
+        } else {
+            ++terms[number].records;
+            raise(number, recordBorrows[id]);
+        }
+        recordTerms[id] = number;
+    }
+
+    // Function to unindex a record. Its borrows are kept, and count again if
+    // it is added back.
+    void remove(int id) {
+        if (id < 0 || static_cast<size_t>(id) >= recordTerms.size() || recordTerms[id] == NO_TERM) return;
+        uint32_t number = recordTerms[id];
+        recordTerms[id] = NO_TERM;
+        Term& term = terms[number];
+        if (--term.records == 0) {
+            eraseKeys(number);
+            garbage += term.length;
+            term = Term();
+            freeTerms.push_back(number);
+            --liveTerms;
+            if (garbage > 4096 && garbage * 2 > text.size()) compactText();
+        } else if (recordBorrows[id] != 0) {
+            term.weight -= recordBorrows[id];
+            lower(number);
+        }
+    }
+
+    // Function to count borrows of a record towards its term's weight
+    void borrowed(int id, uint32_t count = 1) {
+        if (id < 0) return;
+        track(id);
+        recordBorrows[id] += count;
+        if (recordTerms[id] != NO_TERM) raise(recordTerms[id], count);
+    }
+
+    // Function to index every record from scratch, given the borrows of
+    // each id (ids past its end have none)
+    void build(const std::vector<std::pair<int, std::string_view>>& records, const std::vector<uint32_t>& borrows) {
+        clear();
+        recordBorrows = borrows;
+        recordTerms.assign(recordBorrows.size(), NO_TERM);
+        std::unordered_map<std::string, uint32_t> numbers;
+        for (const auto& record : records) {
+            if (record.first < 0) continue;
+            track(record.first);
+            std::string term = normalize(record.second);
+            if (term.empty()) continue;
+            auto found = numbers.emplace(std::move(term), static_cast<uint32_t>(terms.size()));
+            if (found.second) newTerm(found.first->first);
+            Term& entry = terms[found.first->second];
+            ++entry.records;
+            entry.weight += recordBorrows[record.first];
+            recordTerms[record.first] = found.first->second;
+        }
+
+        std::vector<Key> sorted;
+        for (uint32_t number = 0; number < terms.size(); ++number) {
+            forEachStart(number, [&sorted, number](uint32_t offset) { sorted.push_back({number, offset}); });
+        }
+        std::sort(sorted.begin(), sorted.end(), [this](const Key& a, const Key& b) { return compare(a, b) < 0; });
+        fill(sorted.data(), sorted.size());
+    }
+
+    // Function to collect up to limit completions of prefix, heaviest first.
+    // A prefix ending in a separator only completes whole words.
+    void top(std::string_view prefix, size_t limit, std::vector<Completion>& out) const {
+        out.clear();
+        if (limit == 0 || blocks.empty()) return;
+        std::string wanted = normalize(prefix);
+        if (!wanted.empty() && !isWordByte(fold(prefix.back()))) wanted += ' ';
+
+        const Position begin = partition([&](const Key& key) { return suffix(key) < wanted; });
+        const Position end = partition([&](const Key& key) {
+            return suffix(key).substr(0, wanted.size()) <= wanted;
+        });
+
+        // The run's blocks as a max-heap on (weight, earlier block)
+        auto lighter = [](const Span& a, const Span& b) {
+            return a.weight != b.weight ? a.weight < b.weight : a.block > b.block;
+        };
+        std::vector<Span> spans;
+        const size_t stop = end.index == 0 ? end.block : end.block + 1;
+        for (size_t b = begin.block; b < stop; ++b) {
+            spans.push_back({blocks[b].maxWeight, b});
+        }
+        std::make_heap(spans.begin(), spans.end(), lighter);
+
+        std::vector<Hit> hits; // Best first, one per term
+        while (!spans.empty()) {
+            std::pop_heap(spans.begin(), spans.end(), lighter);
+            const Span span = spans.back();
+            spans.pop_back();
+            // Every block left is this light or lighter, and no earlier
+            if (hits.size() == limit && !better(Hit{0, span.weight, span.block, 0}, hits.back())) break;
+
+            const Block& block = blocks[span.block];
+            const size_t from = span.block == begin.block ? begin.index : 0;
+            const size_t to = span.block == end.block ? end.index : block.keys.size();
+            for (size_t i = from; i < to; ++i) {
+                const uint32_t number = block.keys[i].term;
+                offer(hits, Hit{number, terms[number].weight, span.block, i}, limit);
+            }
+        }
+
+        out.reserve(hits.size());
+        for (const Hit& hit : hits) {
+            const Term& term = terms[hit.term];
+            out.push_back({std::string(textOf(hit.term)), term.records, term.weight});
+        }
+    }
+
+    // Function to write the index to path via a temp file, marked with the
+    // checksum of the catalog snapshot it matches
+    bool write(const std::string& path, uint32_t catalogCrc) const {
+        Header header;
+        std::memset(&header, 0, sizeof(header));
+        std::memcpy(header.magic, MAGIC, sizeof(header.magic));
+        header.version = VERSION;
+        header.endianTag = ENDIAN_TAG;
+        header.catalogCrc = catalogCrc;
+        header.termCount = terms.size();
+        header.keyCount = keys;
+        header.recordCount = recordTerms.size();
+        header.textBytes = text.size();
+
+        uint32_t crc = crc32c(terms.data(), terms.size() * sizeof(Term));
+        for (const Block& block : blocks) {
+            crc = crc32c(block.keys.data(), block.keys.size() * sizeof(Key), crc);
+        }
+        crc = crc32c(recordTerms.data(), recordTerms.size() * sizeof(uint32_t), crc);
+        crc = crc32c(recordBorrows.data(), recordBorrows.size() * sizeof(uint32_t), crc);
+        header.payloadCrc = crc32c(text.data(), text.size(), crc);
+        header.headerCrc = crc32c(&header, sizeof(header));
+
+        AtomicFileWriter file(path);
+        file.write(&header, sizeof(header));
+        file.write(terms.data(), terms.size() * sizeof(Term));
+        for (const Block& block : blocks) {
+            file.write(block.keys.data(), block.keys.size() * sizeof(Key));
+        }
+        file.write(recordTerms.data(), recordTerms.size() * sizeof(uint32_t));
+        file.write(recordBorrows.data(), recordBorrows.size() * sizeof(uint32_t));
+        file.write(text);
+        return file.commit();
+    }
+
+    // Function to load an index written for the catalog snapshot with
+    // checksum catalogCrc. On failure the index is empty and error says why,
+    // or is left empty if the file simply does not exist.
+    bool read(const std::string& path, uint32_t catalogCrc, std::string& error) {
+        clear();
+        error.clear();
+        MappedFile file;
+        if (!file.open(path)) return false;
+        if (file.size() < sizeof(Header)) {
+            error = "truncated header";
+            return false;
+        }
+
+        Header header;
+        std::memcpy(&header, file.data(), sizeof(header));
+        Header check = header;
+        check.headerCrc = 0;
+        const uint64_t room = file.size() - sizeof(Header);
+        if (std::memcmp(header.magic, MAGIC, sizeof(header.magic)) != 0) {
+            error = "not a prefix index";
+        } else if (header.endianTag != ENDIAN_TAG) {
+            error = "written on a machine with different byte order";
+        } else if (crc32c(&check, sizeof(check)) != header.headerCrc) {
+            error = "header checksum mismatch";
+        } else if (header.version != VERSION) {
+            error = "unsupported version " + std::to_string(header.version);
+        } else if (header.catalogCrc != catalogCrc) {
+            error = "written for a different catalog";
+        } else if (header.termCount > room / sizeof(Term) || header.keyCount > room / sizeof(Key) ||
+                   header.recordCount > room / (2 * sizeof(uint32_t)) || header.textBytes > room ||
+                   header.termCount * sizeof(Term) + header.keyCount * sizeof(Key) +
+                           header.recordCount * 2 * sizeof(uint32_t) + header.textBytes != room) {
+            error = "section sizes do not match the file";
+        } else if (crc32c(file.data() + sizeof(Header), room) != header.payloadCrc) {
+            error = "data checksum mismatch";
+        }
+        if (!error.empty()) return false;
+
+        const char* at = file.data() + sizeof(Header);
+        terms.resize(header.termCount);
+        std::memcpy(terms.data(), at, terms.size() * sizeof(Term));
+        at += terms.size() * sizeof(Term);
+        std::vector<Key> sorted(header.keyCount);
+        std::memcpy(sorted.data(), at, sorted.size() * sizeof(Key));
+        at += sorted.size() * sizeof(Key);
+        recordTerms.resize(header.recordCount);
+        std::memcpy(recordTerms.data(), at, recordTerms.size() * sizeof(uint32_t));
+        at += recordTerms.size() * sizeof(uint32_t);
+        recordBorrows.resize(header.recordCount);
+        std::memcpy(recordBorrows.data(), at, recordBorrows.size() * sizeof(uint32_t));
+        at += recordBorrows.size() * sizeof(uint32_t);
+        text.assign(at, header.textBytes);
+
+        // The checksum vouches for the bytes; check that they also agree
+        size_t liveBytes = 0;
+        for (uint32_t number = 0; number < terms.size(); ++number) {
+            const Term& term = terms[number];
+            if (uint64_t(term.offset) + term.length > text.size() || (term.records == 0) != (term.length == 0)) {
+                error = "term out of range";
+            } else if (term.records == 0) {
+                freeTerms.push_back(number);
+            } else {
+                ++liveTerms;
+                liveBytes += term.length;
+            }
+        }
+        for (size_t i = 0; i < sorted.size() && error.empty(); ++i) {
+            const Key& key = sorted[i];
+            if (key.term >= terms.size() || key.offset >= terms[key.term].length) {
+                error = "key out of range";
+            }
+        }
+        for (uint32_t number : recordTerms) {
+            if (number != NO_TERM && (number >= terms.size() || terms[number].records == 0)) {
+                error = "record with no term";
+                break;
+            }
+        }
+        if (!error.empty()) {
+            clear();
+            return false;
+        }
+        garbage = text.size() - liveBytes;
+        fill(sorted.data(), sorted.size());
+        ioCounters(path).parsed(terms.size());
+        return true;
+    }
+
+private:
+    static constexpr uint32_t NO_TERM = ~uint32_t(0);
+    static constexpr uint32_t VERSION = 1;
+    static constexpr uint32_t ENDIAN_TAG = 0x01020304;
+    static constexpr char MAGIC[8] = {'L', 'M', 'S', 'P', 'R', 'E', 'F', '\0'};
+
+    // A distinct term: its text in the arena and its records' totals
+    struct Term {
+        uint32_t offset = 0;
+        uint32_t length = 0;
+        uint32_t records = 0;
+        uint32_t reserved = 0;
+        uint64_t weight = 0;
+    };
+    static_assert(sizeof(Term) == 24, "prefix index term layout changed");
+
+    // A term as reached from the word starting offset bytes in
+    struct Key {
+        uint32_t term;
+        uint32_t offset;
+    };
+    static_assert(sizeof(Key) == 8, "prefix index key layout changed");
+
+    struct Block {
+        std::vector<Key> keys; // Sorted, never empty
+        uint64_t maxWeight = 0;
+    };
+
+    struct Position {
+        size_t block;
+        size_t index;
+    };
+
+    struct Span {
+        uint64_t weight;
+        size_t block;
+    };
+
+    struct Hit {
+        uint32_t term;
+        uint64_t weight;
+        size_t block;
+        size_t index;
+    };
+
+    // File layout: the header, then terms, keys in order, each record's
+    // term and borrows, and the text arena
+    struct Header {
+        char magic[8];
+        uint32_t version;
+        uint32_t endianTag;
+        uint32_t catalogCrc; // Payload checksum of the catalog snapshot
+        uint32_t payloadCrc;
+        uint64_t termCount;
+        uint64_t keyCount;
+        uint64_t recordCount;
+        uint64_t textBytes;
+        uint32_t reserved;
+        uint32_t headerCrc; // With this field zeroed
+    };
+    static_assert(sizeof(Header) == 64, "prefix index header layout changed");
+
+    static unsigned char fold(char c) {
+        unsigned char u = static_cast<unsigned char>(c);
+        return (u >= 'A' && u <= 'Z') ? static_cast<unsigned char>(u + ('a' - 'A')) : u;
+    }
+
+    static bool isWordByte(unsigned char c) {
+        return (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c >= 0x80;
+    }
+
+    // Function to rank hits: heavier first, then in key order
+    static bool better(const Hit& a, const Hit& b) {
+        if (a.weight != b.weight) return a.weight > b.weight;
+        return a.block != b.block ? a.block < b.block : a.index < b.index;
+    }
+
+    // Function to keep a hit if it is among the best limit, once per term
+    static void offer(std::vector<Hit>& hits, const Hit& hit, size_t limit) {
+        if (hits.size() == limit && !better(hit, hits.back())) return;
+        auto same = std::find_if(hits.begin(), hits.end(), [&hit](const Hit& h) { return h.term == hit.term; });
+        if (same != hits.end()) {
+            if (!better(hit, *same)) return; // The term's earlier key already placed it
+            hits.erase(same);
+        } else if (hits.size() == limit) {
+            hits.pop_back();
+        }
+        hits.insert(std::upper_bound(hits.begin(), hits.end(), hit, better), hit);
+    }
+
+    std::string_view textOf(uint32_t number) const {
+        return std::string_view(text).substr(terms[number].offset, terms[number].length);
+    }
+
+    // Function to get the text a key is sorted by
+    std::string_view suffix(const Key& key) const {
+        return textOf(key.term).substr(key.offset);
+    }
+
+    // Function to order keys: by text from their word on, then by offset
+    // (so a term's own key leads the keys with its text), then by term
+    int compare(const Key& a, const Key& b) const {
+        int order = suffix(a).compare(suffix(b));
+        if (order != 0) return order;
+        if (a.offset != b.offset) return a.offset < b.offset ? -1 : 1;
+        return a.term == b.term ? 0 : (a.term < b.term ? -1 : 1);
+    }
+
+    // Function to call visit with the offset of each of a term's first
+    // MAX_WORD_STARTS words
+    template <typename Visit>
+    void forEachStart(uint32_t number, Visit visit) const {
+        std::string_view term = textOf(number);
+        if (term.empty()) return;
+        visit(0u);
+        size_t starts = 1;
+        for (size_t i = 0; i < term.size() && starts < MAX_WORD_STARTS; ++i) {
+            if (term[i] == ' ') {
+                visit(static_cast<uint32_t>(i + 1));
+                ++starts;
+            }
+        }
+    }
+
+    // Function to find the first key for which before() is false (keys
+    // before() holds for must all come first)
+    template <typename Before>
+    Position partition(Before before) const {
+        auto block = std::partition_point(blocks.begin(), blocks.end(),
+                                          [&before](const Block& b) { return before(b.keys.back()); });
+        if (block == blocks.end()) return {blocks.size(), 0};
+        auto key = std::partition_point(block->keys.begin(), block->keys.end(), before);
+        return {static_cast<size_t>(block - blocks.begin()), static_cast<size_t>(key - block->keys.begin())};
+    }
+
+    Position locate(const Key& key) const {
+        return partition([this, &key](const Key& k) { return compare(k, key) < 0; });
+    }
+
+    // Function to find a term by its text
+    uint32_t find(const std::string& term) const {
+        Position at = partition([this, &term](const Key& k) { return suffix(k) < term; });
+        if (at.block == blocks.size()) return NO_TERM;
+        const Key& key = blocks[at.block].keys[at.index];
+        return key.offset == 0 && suffix(key) == term ? key.term : NO_TERM;
+    }
+
+    // Function to store a new term's text, in a free slot if there is one
+    uint32_t newTerm(std::string_view term) {
+        uint32_t number;
+        if (freeTerms.empty()) {
+            number = static_cast<uint32_t>(terms.size());
+            terms.emplace_back();
+        } else {
+            number = freeTerms.back();
+            freeTerms.pop_back();
+            terms[number] = Term();
+        }
+        terms[number].offset = static_cast<uint32_t>(text.size());
+        terms[number].length = static_cast<uint32_t>(term.size());
+        text += term;
+        ++liveTerms;
+        return number;
+    }
+
+    // Function to squeeze the text of dropped terms out of the arena
+    void compactText() {
+        std::string packed;
+        packed.reserve(text.size() - garbage);
+        for (Term& term : terms) {
+            const uint32_t offset = static_cast<uint32_t>(packed.size());
+            packed.append(text, term.offset, term.length);
+            term.offset = offset;
+        }
+        text.swap(packed);
+        garbage = 0;
+    }
+
+    // Function to make room for a record id
+    void track(int id) {
+        if (static_cast<size_t>(id) >= recordTerms.size()) recordTerms.resize(id + 1, NO_TERM);
+        if (static_cast<size_t>(id) >= recordBorrows.size()) recordBorrows.resize(id + 1, 0);
+    }
+
+    uint64_t heaviest(const Block& block) const {
+        uint64_t weight = 0;
+        for (const Key& key : block.keys) {
+            weight = std::max(weight, terms[key.term].weight);
+        }
+        return weight;
+    }
+
+    // Function to lay sorted keys out in blocks
+    void fill(const Key* sorted, size_t count) {
+        blocks.clear();
+        blocks.reserve(count / BLOCK_KEYS + 1);
+        for (size_t i = 0; i < count; i += BLOCK_KEYS) {
+            Block block;
+            block.keys.reserve(2 * BLOCK_KEYS);
+            block.keys.assign(sorted + i, sorted + std::min(i + BLOCK_KEYS, count));
+            block.maxWeight = heaviest(block);
+            blocks.push_back(std::move(block));
+        }
+        keys = count;
+    }
+
+    void insertKeys(uint32_t number) {
+        forEachStart(number, [this, number](uint32_t offset) { insertKey(Key{number, offset}); });
+    }
+
+    void eraseKeys(uint32_t number) {
+        forEachStart(number, [this, number](uint32_t offset) { eraseKey(Key{number, offset}); });
+    }
+
+    void insertKey(const Key& key) {
+        ++keys;
+        const uint64_t weight = terms[key.term].weight;
+        if (blocks.empty()) {
+            blocks.push_back(Block{{key}, weight});
+            return;
+        }
+        Position at = locate(key);
+        if (at.block == blocks.size()) at = {blocks.size() - 1, blocks.back().keys.size()};
+        Block& block = blocks[at.block];
+        block.keys.insert(block.keys.begin() + at.index, key);
+        block.maxWeight = std::max(block.maxWeight, weight);
+        if (block.keys.size() > 2 * BLOCK_KEYS) {
+            Block upper;
+            upper.keys.assign(block.keys.begin() + BLOCK_KEYS, block.keys.end());
+            block.keys.resize(BLOCK_KEYS);
+            block.maxWeight = heaviest(block);
+            upper.maxWeight = heaviest(upper);
+            blocks.insert(blocks.begin() + at.block + 1, std::move(upper));
+        }
+    }
+
+    void eraseKey(const Key& key) {
+        Position at = locate(key);
+        if (at.block == blocks.size()) return;
+        Block& block = blocks[at.block];
+        if (block.keys[at.index].term != key.term || block.keys[at.index].offset != key.offset) return;
+        block.keys.erase(block.keys.begin() + at.index);
+        --keys;
+        if (block.keys.empty()) {
+            blocks.erase(blocks.begin() + at.block);
+            return;
+        }
+        if (block.keys.size() < BLOCK_KEYS / 4 && at.block + 1 < blocks.size() &&
+            block.keys.size() + blocks[at.block + 1].keys.size() <= 2 * BLOCK_KEYS) {
+            Block& next = blocks[at.block + 1];
+            block.keys.insert(block.keys.end(), next.keys.begin(), next.keys.end());
+            blocks.erase(blocks.begin() + at.block + 1);
+        }
+        block.maxWeight = heaviest(block);
+    }
+
+    // Function to add to a term's weight and lift its blocks' maxima
+    void raise(uint32_t number, uint64_t delta) {
+        if (delta == 0) return;
+        terms[number].weight += delta;
+        const uint64_t weight = terms[number].weight;
+        forEachStart(number, [this, number, weight](uint32_t offset) {
+            Position at = locate(Key{number, offset});
+            if (at.block < blocks.size()) {
+                blocks[at.block].maxWeight = std::max(blocks[at.block].maxWeight, weight);
+            }
+        });
+    }
+
+    // Function to recompute the maxima of a term's blocks after its weight
+    // fell
+    void lower(uint32_t number) {
+        forEachStart(number, [this, number](uint32_t offset) {
+            Position at = locate(Key{number, offset});
+            if (at.block < blocks.size()) {
+                blocks[at.block].maxWeight = heaviest(blocks[at.block]);
+            }
+        });
+    }
+
+    std::string text;                    // Every term's text, back to back
+    std::vector<Term> terms;             // By term number
+    std::vector<uint32_t> freeTerms;     // Slots of dropped terms
+    std::vector<Block> blocks;           // In key order
+    std::vector<uint32_t> recordTerms;   // By record id; NO_TERM if none
+    std::vector<uint32_t> recordBorrows; // By record id
+    size_t liveTerms = 0;
+    size_t keys = 0;
+    size_t garbage = 0; // Arena bytes of dropped terms
+};
+
+#endif
@@ -0,0 +1,47 @@
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "escaped_fields.h"
+
+// Line protocol spoken by the server mode (see library_server.h).
+//
+// Every request and every response line is a list of fields separated by
+// '|', ended by '\n'. Inside a field '\', '|' and newlines are written as
+// "\\", "\|" and "\n" (escaped_fields.h, shared with the journal), so titles
+// and names may contain any character.
+//
+// A request is a command name followed by its arguments:
+//     BORROW|12|345
+// A response is a header line, then as many data lines as it announces:
+//     OK|2            ERR|Book not found.
+//     12|Dune|...
+//     ...
+
+const size_t PROTOCOL_MAX_LINE = 1 << 20; // Longest request line accepted
+
+// Function to encode fields as one protocol line (with its newline)
+inline std::string encodeProtocolLine(const std::vector<std::string>& fields) {
+    std::string line;
+    appendEscapedFields(line, fields);
+    line += '\n';
+    return line;
+}
+
+// Function to split one protocol line (without its newline) into fields.
+// A trailing '\r' is dropped so the server can be driven by hand with
+// telnet-style clients.
+inline std::vector<std::string> decodeProtocolLine(std::string_view line) {
+    if (!line.empty() && line.back() == '\r') {
+        line.remove_suffix(1);
+    }
+
+    std::vector<std::string> fields;
+    splitEscapedFields(line, fields);
+    return fields;
+}
+
+#endif
@@ -0,0 +1,185 @@
+#ifndef SCAN_KERNEL_H
+#define SCAN_KERNEL_H
+
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SCAN_KERNEL_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SCAN_KERNEL_AVX2 1
+#include <immintrin.h>
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// Case-insensitive substring kernel used by the catalog scan.
+//
+// The needle must already be lowercase; only the haystack is folded, and only
+// ASCII letters are folded (the same as ::tolower in the "C" locale). Nothing
+// is allocated. The SIMD paths use the first/last character filter: fold a
+// block of haystack at offset i and at offset i + m - 1, compare against the
+// needle's first and last characters, and fully compare only the positions
+// where both match. AVX2 is picked at runtime on GCC/Clang x86 builds, SSE2
+// is the x86-64 baseline, and everything else uses the scalar loop.
+//
+// The vector loops only pay off on long haystacks, so the catalog scan runs
+// forEachMatchIgnoreCase over whole arena blocks (a megabyte of packed text)
+// and maps each match back to its book, rather than calling the kernel per
+// title. containsIgnoreCase is kept for checking a single field.
+
+// Function to fold one ASCII character to lowercase
+inline unsigned char foldAscii(unsigned char c) {
+    return (static_cast<unsigned>(c - 'A') < 26u) ? static_cast<unsigned char>(c | 0x20) : c;
+}
+
+// Function to compare m haystack bytes, folded, against a lowercase needle
+inline bool equalsFolded(const char* text, const char* lowerNeedle, size_t m) {
+    for (size_t i = 0; i < m; ++i) {
+        if (foldAscii(static_cast<unsigned char>(text[i])) != static_cast<unsigned char>(lowerNeedle[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Function to find the lowest set bit of a non-zero match mask
+inline unsigned lowestBit(unsigned mask) {
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return static_cast<unsigned>(index);
+#else
+    return static_cast<unsigned>(__builtin_ctz(mask));
+#endif
+}
+
+// Function to call hit(position) for each match from position `from` on,
+// one byte at a time, until hit returns true. Returns whether it did.
+template <typename Hit>
+inline bool forEachMatchScalar(const char* text, size_t n, const char* lowerNeedle, size_t m, size_t from, Hit& hit) {
+    if (n < m) return false;
+
+    const unsigned char first = static_cast<unsigned char>(lowerNeedle[0]);
+    for (size_t i = from; i + m <= n; ++i) {
+        if (foldAscii(static_cast<unsigned char>(text[i])) == first &&
+            equalsFolded(text + i + 1, lowerNeedle + 1, m - 1) && hit(i)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+#ifdef SCAN_KERNEL_SSE2
+// Function to fold 16 bytes to lowercase: bytes in 'A'..'Z' get 0x20 or-ed in.
+// SSE2 has no unsigned byte compare, so (x - 'A') < 26 is tested as a signed
+// compare after flipping the sign bit of both sides.
+inline __m128i foldSse2(__m128i x) {
+    const __m128i shifted = _mm_xor_si128(_mm_sub_epi8(x, _mm_set1_epi8('A')), _mm_set1_epi8(static_cast<char>(0x80)));
+    const __m128i upper = _mm_cmpgt_epi8(_mm_set1_epi8(static_cast<char>(-128 + 26)), shifted);
+    return _mm_or_si128(x, _mm_and_si128(upper, _mm_set1_epi8(0x20)));
+}
+
+// Function to check 16 candidate positions per step with SSE2 (see forEachMatchScalar)
+template <typename Hit>
+inline bool forEachMatchSse2(const char* text, size_t n, const char* lowerNeedle, size_t m, Hit& hit) {
+    if (n < m) return false;
+
+    const __m128i first = _mm_set1_epi8(lowerNeedle[0]);
+    const __m128i last = _mm_set1_epi8(lowerNeedle[m - 1]);
+
+    size_t i = 0;
+    for (; i + m - 1 + 16 <= n; i += 16) {
+        const __m128i blockFirst = foldSse2(_mm_loadu_si128(reinterpret_cast<const __m128i*>(text + i)));
+        const __m128i blockLast = foldSse2(_mm_loadu_si128(reinterpret_cast<const __m128i*>(text + i + m - 1)));
+        unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(
+            _mm_and_si128(_mm_cmpeq_epi8(blockFirst, first), _mm_cmpeq_epi8(blockLast, last))));
+        while (mask != 0) {
+            const size_t at = i + lowestBit(mask);
+            if (equalsFolded(text + at, lowerNeedle, m) && hit(at)) {
+                return true;
+            }
+            mask &= mask - 1;
+        }
+    }
+    return forEachMatchScalar(text, n, lowerNeedle, m, i, hit);
+}
+#endif
+
+#ifdef SCAN_KERNEL_AVX2
+// Function to fold 32 bytes to lowercase (see foldSse2)
+__attribute__((target("avx2")))
+inline __m256i foldAvx2(__m256i x) {
+    const __m256i shifted = _mm256_xor_si256(_mm256_sub_epi8(x, _mm256_set1_epi8('A')), _mm256_set1_epi8(static_cast<char>(0x80)));
+    const __m256i upper = _mm256_cmpgt_epi8(_mm256_set1_epi8(static_cast<char>(-128 + 26)), shifted);
+    return _mm256_or_si256(x, _mm256_and_si256(upper, _mm256_set1_epi8(0x20)));
+}
+
+// Function to check 32 candidate positions per step with AVX2 (see forEachMatchScalar)
+template <typename Hit>
+__attribute__((target("avx2")))
+inline bool forEachMatchAvx2(const char* text, size_t n, const char* lowerNeedle, size_t m, Hit& hit) {
+    if (n < m) return false;
+
+    const __m256i first = _mm256_set1_epi8(lowerNeedle[0]);
+    const __m256i last = _mm256_set1_epi8(lowerNeedle[m - 1]);
+
+    size_t i = 0;
+    for (; i + m - 1 + 32 <= n; i += 32) {
+        const __m256i blockFirst = foldAvx2(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(text + i)));
+        const __m256i blockLast = foldAvx2(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(text + i + m - 1)));
+        unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(
+            _mm256_and_si256(_mm256_cmpeq_epi8(blockFirst, first), _mm256_cmpeq_epi8(blockLast, last))));
+        while (mask != 0) {
+            const size_t at = i + lowestBit(mask);
+            if (equalsFolded(text + at, lowerNeedle, m) && hit(at)) {
+                return true;
+            }
+            mask &= mask - 1;
+        }
+    }
+    return forEachMatchScalar(text, n, lowerNeedle, m, i, hit);
+}
+
+// Function to check (once) whether this CPU can run the AVX2 path
+inline bool cpuHasAvx2() {
+    static const bool hasAvx2 = __builtin_cpu_supports("avx2") != 0;
+    return hasAvx2;
+}
+#endif
+
+// Function to call hit(position) for each place text contains a non-empty
+// lowercase needle, ignoring ASCII case, until hit returns true. Positions
+// come in increasing order; returns whether hit stopped the search.
+template <typename Hit>
+inline bool forEachMatchIgnoreCase(const char* text, size_t n, const char* lowerNeedle, size_t m, Hit hit) {
+#if defined(SCAN_KERNEL_AVX2)
+    if (cpuHasAvx2()) {
+        return forEachMatchAvx2(text, n, lowerNeedle, m, hit);
+    }
+#endif
+#if defined(SCAN_KERNEL_SSE2)
+    return forEachMatchSse2(text, n, lowerNeedle, m, hit);
+#else
+    return forEachMatchScalar(text, n, lowerNeedle, m, 0, hit);
+#endif
+}
+
+// Function to check if text contains a lowercase needle, ignoring ASCII case
+inline bool containsIgnoreCase(const char* text, size_t n, const char* lowerNeedle, size_t m) {
+    if (m == 0) return true;
+    return forEachMatchIgnoreCase(text, n, lowerNeedle, m, [](size_t) { return true; });
+}
+
+inline bool containsIgnoreCase(std::string_view text, std::string_view lowerNeedle) {
+    return containsIgnoreCase(text.data(), text.size(), lowerNeedle.data(), lowerNeedle.size());
+}
+
+#endif
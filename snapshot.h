@@ -0,0 +1,254 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "atomic_file.h"
+#include "checksum.h"
+#include "mapped_file.h"
+
+// Binary snapshot of one table (books.bin, students.bin, transactions.bin).
+//
+//   [SnapshotHeader][record 0][record 1]...[string heap]
+//
+// Records are fixed-width PODs; their text fields are StringRefs (offset and
+// length into the heap) rather than pointers, so a file can be mmapped and
+// read in place. The header carries a format version, a byte-order tag, the
+// table kind and record width (so a file is never read with the wrong
+// layout), the table's next id, and CRC-32Cs of the header and of everything
+// after it. Files are written in host byte order; a reader on a machine of
+// the other endianness rejects them rather than misreading them.
+
+// Version 2 stores transaction dates as day numbers; version 1 files (dates
+// as heap strings) are still read. Book and student records are unchanged.
+const uint32_t SNAPSHOT_VERSION = 2;
+const uint32_t SNAPSHOT_ENDIAN_TAG = 0x01020304;
+const char SNAPSHOT_MAGIC[8] = {'L', 'M', 'S', 'S', 'N', 'A', 'P', '\0'};
+
+enum SnapshotTable : uint32_t {
+    SNAPSHOT_BOOKS = 1,
+    SNAPSHOT_STUDENTS = 2,
+    SNAPSHOT_TRANSACTIONS = 3
+};
+
+struct SnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t endianTag;
+    uint32_t table;
+    uint32_t recordSize;
+    uint64_t recordCount;
+    int64_t nextId;
+    uint64_t recordsOffset;
+    uint64_t heapOffset;
+    uint64_t heapSize;
+    uint32_t payloadCrc; // CRC-32C of records and heap
+    uint32_t headerCrc;  // CRC-32C of this header with headerCrc zeroed
+};
+static_assert(sizeof(SnapshotHeader) == 72, "snapshot header layout changed");
+
+struct StringRef {
+    uint32_t offset;
+    uint32_t length;
+};
+
+struct BookRecord {
+    int32_t id;
+    uint32_t available;
+    StringRef title;
+    StringRef author;
+    StringRef isbn;
+};
+static_assert(sizeof(BookRecord) == 32, "book record layout changed");
+
+struct StudentRecord {
+    int32_t id;
+    uint32_t reserved;
+    StringRef name;
+};
+static_assert(sizeof(StudentRecord) == 16, "student record layout changed");
+
+struct TransactionRecord {
+    int32_t id;
+    int32_t bookId;
+    int32_t studentId;
+    uint32_t type; // 0 = borrow, 1 = return
+    int32_t day;   // Days since 1970-01-01
+    uint32_t reserved;
+};
+static_assert(sizeof(TransactionRecord) == 24, "transaction record layout changed");
+
+// Transaction record as written by version 1
+struct TransactionRecordV1 {
+    int32_t id;
+    int32_t bookId;
+    int32_t studentId;
+    uint32_t type;
+    StringRef date;
+};
+static_assert(sizeof(TransactionRecordV1) == sizeof(TransactionRecord), "v1 transaction record layout changed");
+
+// Builds one table snapshot in memory and writes it atomically.
+class SnapshotWriter {
+public:
+    SnapshotWriter(SnapshotTable snapshotTable, uint32_t snapshotRecordSize, size_t expectedRecords = 0)
+        : table(snapshotTable), recordSize(snapshotRecordSize) {
+        records.reserve(expectedRecords * recordSize);
+    }
+
+    // Function to copy text into the heap and get its reference
+    StringRef addString(std::string_view text) {
+        if (heap.size() + text.size() > std::numeric_limits<uint32_t>::max()) {
+            overflow = true; // The heap is addressed with 32-bit offsets
+            return StringRef{0, 0};
+        }
+        StringRef ref{static_cast<uint32_t>(heap.size()), static_cast<uint32_t>(text.size())};
+        heap += text;
+        return ref;
+    }
+
+    // Function to append one fixed-width record
+    void addRecord(const void* record) {
+        const char* bytes = static_cast<const char*>(record);
+        records.insert(records.end(), bytes, bytes + recordSize);
+    }
+
+    // Function to write header, records and heap to path via a temp file.
+    // payloadCrc, if given, gets the checksum of the records and heap.
+    bool write(const std::string& path, int64_t nextId, uint32_t* payloadCrc = nullptr) const {
+        if (overflow) return false;
+
+        SnapshotHeader header;
+        std::memset(&header, 0, sizeof(header));
+        std::memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+        header.version = SNAPSHOT_VERSION;
+        header.endianTag = SNAPSHOT_ENDIAN_TAG;
+        header.table = table;
+        header.recordSize = recordSize;
+        header.recordCount = records.size() / recordSize;
+        header.nextId = nextId;
+        header.recordsOffset = sizeof(SnapshotHeader);
+        header.heapOffset = header.recordsOffset + records.size();
+        header.heapSize = heap.size();
+        header.payloadCrc = crc32c(heap.data(), heap.size(), crc32c(records.data(), records.size()));
+        header.headerCrc = crc32c(&header, sizeof(header));
+        if (payloadCrc != nullptr) *payloadCrc = header.payloadCrc;
+
+        AtomicFileWriter file(path);
+        file.write(&header, sizeof(header));
+        file.write(records.data(), records.size());
+        file.write(heap);
+        return file.commit();
+    }
+
+private:
+    SnapshotTable table;
+    uint32_t recordSize;
+    std::vector<char> records;
+    std::string heap;
+    bool overflow = false;
+};
+
+// Maps one table snapshot and validates it; records and strings are then read
+// straight out of the mapping.
+class SnapshotReader {
+public:
+    // Function to map and check a snapshot. On failure error says why, or is
+    // left empty if the file simply does not exist.
+    bool open(const std::string& path, SnapshotTable expectedTable, uint32_t expectedRecordSize,
+              std::string& error) {
+        error.clear();
+        if (!file.open(path)) {
+            return false;
+        }
+        if (file.size() < sizeof(SnapshotHeader)) {
+            error = "truncated header";
+            return false;
+        }
+
+        std::memcpy(&header, file.data(), sizeof(header));
+        SnapshotHeader check = header;
+        check.headerCrc = 0;
+        if (std::memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) != 0) {
+            error = "not a snapshot file";
+        } else if (header.endianTag != SNAPSHOT_ENDIAN_TAG) {
+            error = "written on a machine with different byte order";
+        } else if (crc32c(&check, sizeof(check)) != header.headerCrc) {
+            error = "header checksum mismatch";
+        } else if (header.version == 0 || header.version > SNAPSHOT_VERSION) {
+            error = "unsupported version " + std::to_string(header.version);
+        } else if (header.table != expectedTable || header.recordSize != expectedRecordSize) {
+            error = "wrong table or record layout";
+        } else if (header.recordsOffset != sizeof(SnapshotHeader) ||
+                   header.recordCount > (file.size() - header.recordsOffset) / header.recordSize ||
+                   header.heapOffset != header.recordsOffset + header.recordCount * header.recordSize ||
+                   header.heapSize != file.size() - header.heapOffset) {
+            error = "section sizes do not match the file";
+        } else if (crc32c(file.data() + header.recordsOffset, file.size() - header.recordsOffset) !=
+                   header.payloadCrc) {
+            error = "data checksum mismatch";
+        } else {
+            ioCounters(path).parsed(count());
+            return true;
+        }
+        file.close();
+        return false;
+    }
+
+    size_t count() const {
+        return static_cast<size_t>(header.recordCount);
+    }
+
+    int64_t nextId() const {
+        return header.nextId;
+    }
+
+    uint32_t version() const {
+        return header.version;
+    }
+
+    // Function to get the checksum of the records and heap, which tells
+    // one snapshot of a table from another
+    uint32_t payloadCrc() const {
+        return header.payloadCrc;
+    }
+
+    size_t heapSize() const {
+        return static_cast<size_t>(header.heapSize);
+    }
+
+    // Function to view record i in place
+    template <typename Record>
+    const Record& record(size_t i) const {
+        return reinterpret_cast<const Record*>(file.data() + header.recordsOffset)[i];
+    }
+
+    // Function to check that a reference lies inside the heap
+    bool valid(StringRef ref) const {
+        return static_cast<uint64_t>(ref.offset) + ref.length <= header.heapSize;
+    }
+
+    // Function to get a pointer to referenced text inside the mapping
+    const char* text(StringRef ref) const {
+        return file.data() + header.heapOffset + ref.offset;
+    }
+
+    std::string toString(StringRef ref) const {
+        return std::string(text(ref), ref.length);
+    }
+
+    std::string_view view(StringRef ref) const {
+        return std::string_view(text(ref), ref.length);
+    }
+
+private:
+    MappedFile file;
+    SnapshotHeader header = SnapshotHeader();
+};
+
+#endif
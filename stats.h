@@ -0,0 +1,418 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// Built-in instrumentation: latency histograms for the engine's operations
+// and I/O counters for the files it reads and writes, dumped in a fixed text
+// or JSON layout (menu entry, --stats, STATS server command).
+//
+// Latencies are kept in nanoseconds in log-linear buckets, as HDR histograms
+// do: values below 16 have a bucket each and every power of two above that is
+// split into 16 buckets, so a value is reported to within 1/16 of itself over
+// the whole 64-bit range with under a thousand buckets. Each thread records
+// into its own shard, which only that thread writes, so recording is a few
+// relaxed loads and stores with no lock and no shared cache lines. Reading
+// merges the shards of live threads with the totals of threads that exited.
+//
+// I/O is counted per file name (history segments share one name). Updates
+// happen once per file opened, buffer written, fsync or table parsed, so
+// these are ordinary shared atomics.
+
+enum class StatOp {
+    AddBook,
+    UpdateBook,
+    DeleteBook,
+    AddStudent,
+    Search,
+    FuzzySearch,
+    Complete,
+    BookPage,
+    Borrow,
+    Return,
+    History,
+    Operations,
+    Report,
+    Save,
+    Load,
+    Import
+};
+
+const size_t STAT_OP_COUNT = 16;
+
+// Function to get an operation's name in the stats dump
+inline const char* statOpName(StatOp op) {
+    static const char* const names[STAT_OP_COUNT] = {
+        "add_book", "update_book", "delete_book", "add_student", "search", "fuzzy_search", "complete",
+        "book_page", "borrow", "return", "history_page", "operations", "report", "save", "load", "import"};
+    return names[static_cast<size_t>(op)];
+}
+
+const unsigned LATENCY_SUB_BITS = 4;
+const size_t LATENCY_SUB_BUCKETS = size_t(1) << LATENCY_SUB_BITS;
+const size_t LATENCY_BUCKETS = (64 - LATENCY_SUB_BITS + 1) * LATENCY_SUB_BUCKETS;
+
+// Function to find the bucket holding a value
+inline size_t latencyBucket(uint64_t value) {
+    if (value < LATENCY_SUB_BUCKETS) return static_cast<size_t>(value);
+#ifdef _MSC_VER
+    unsigned long top;
+    _BitScanReverse64(&top, value);
+#else
+    unsigned top = 63 - static_cast<unsigned>(__builtin_clzll(value));
+#endif
+    unsigned shift = static_cast<unsigned>(top) - LATENCY_SUB_BITS;
+    return (shift + 1) * LATENCY_SUB_BUCKETS + static_cast<size_t>((value >> shift) - LATENCY_SUB_BUCKETS);
+}
+
+// Function to get the largest value a bucket holds
+inline uint64_t latencyBucketTop(size_t bucket) {
+    if (bucket < LATENCY_SUB_BUCKETS) return bucket;
+    unsigned shift = static_cast<unsigned>(bucket / LATENCY_SUB_BUCKETS) - 1;
+    uint64_t low = static_cast<uint64_t>(LATENCY_SUB_BUCKETS + bucket % LATENCY_SUB_BUCKETS) << shift;
+    return low + ((uint64_t(1) << shift) - 1);
+}
+
+// Merged latencies of one operation
+struct LatencyHistogram {
+    uint64_t count = 0;
+    uint64_t totalNanos = 0;
+    uint64_t maxNanos = 0;
+    std::vector<uint64_t> buckets = std::vector<uint64_t>(LATENCY_BUCKETS);
+
+    // Function to get the value at or below which fraction of the samples
+    // fall (the top of its bucket, never above the largest sample)
+    uint64_t percentile(double fraction) const {
+        if (count == 0) return 0;
+        uint64_t rank = static_cast<uint64_t>(fraction * count + 0.5);
+        if (rank < 1) rank = 1;
+        uint64_t seen = 0;
+        for (size_t b = 0; b < LATENCY_BUCKETS; ++b) {
+            seen += buckets[b];
+            if (seen >= rank) return std::min(latencyBucketTop(b), maxNanos);
+        }
+        return maxNanos;
+    }
+
+    uint64_t meanNanos() const {
+        return count == 0 ? 0 : totalNanos / count;
+    }
+};
+
+// One thread's latency counts. Only the owning thread writes; any thread may
+// read.
+class LatencyShard {
+public:
+    void record(StatOp op, uint64_t nanos) {
+        size_t o = static_cast<size_t>(op);
+        bump(buckets[o][latencyBucket(nanos)], 1);
+        bump(counts[o], 1);
+        bump(totals[o], nanos);
+        if (nanos > maxima[o].load(std::memory_order_relaxed)) {
+            maxima[o].store(nanos, std::memory_order_relaxed);
+        }
+    }
+
+    // Function to add this shard's counts into merged histograms
+    void addTo(std::vector<LatencyHistogram>& merged) const {
+        for (size_t o = 0; o < STAT_OP_COUNT; ++o) {
+            LatencyHistogram& histogram = merged[o];
+            histogram.count += counts[o].load(std::memory_order_relaxed);
+            histogram.totalNanos += totals[o].load(std::memory_order_relaxed);
+            histogram.maxNanos = std::max(histogram.maxNanos, maxima[o].load(std::memory_order_relaxed));
+            for (size_t b = 0; b < LATENCY_BUCKETS; ++b) {
+                histogram.buckets[b] += buckets[o][b].load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+private:
+    static void bump(std::atomic<uint64_t>& counter, uint64_t by) {
+        counter.store(counter.load(std::memory_order_relaxed) + by, std::memory_order_relaxed);
+    }
+
+    std::atomic<uint64_t> buckets[STAT_OP_COUNT][LATENCY_BUCKETS] = {};
+    std::atomic<uint64_t> counts[STAT_OP_COUNT] = {};
+    std::atomic<uint64_t> totals[STAT_OP_COUNT] = {};
+    std::atomic<uint64_t> maxima[STAT_OP_COUNT] = {};
+};
+
+// I/O counters of one file
+struct IoCounters {
+    std::atomic<uint64_t> bytesRead{0};
+    std::atomic<uint64_t> bytesWritten{0};
+    std::atomic<uint64_t> fsyncs{0};
+    std::atomic<uint64_t> recordsParsed{0};
+
+    void read(uint64_t bytes) {
+        bytesRead.fetch_add(bytes, std::memory_order_relaxed);
+    }
+
+    void wrote(uint64_t bytes) {
+        bytesWritten.fetch_add(bytes, std::memory_order_relaxed);
+    }
+
+    void synced() {
+        fsyncs.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void parsed(uint64_t records) {
+        recordsParsed.fetch_add(records, std::memory_order_relaxed);
+    }
+};
+
+// Point-in-time copy of every statistic
+struct StatsReport {
+    struct File {
+        std::string name;
+        uint64_t bytesRead = 0;
+        uint64_t bytesWritten = 0;
+        uint64_t fsyncs = 0;
+        uint64_t recordsParsed = 0;
+    };
+
+    std::vector<LatencyHistogram> operations = std::vector<LatencyHistogram>(STAT_OP_COUNT);
+    std::vector<File> files; // Sorted by name
+};
+
+// The process's statistics; use the one stats() returns (a thread's shard
+// belongs to whichever registry it first recorded into).
+class StatsRegistry {
+public:
+    // Function to record one operation's latency on the calling thread's shard
+    void record(StatOp op, uint64_t nanos) {
+        thread_local ShardHandle handle(*this);
+        handle.shard->record(op, nanos);
+    }
+
+    // Function to get the counters for a file, creating them on first use.
+    // The reference stays valid for the life of the program.
+    IoCounters& io(const std::string& file) {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::unique_ptr<IoCounters>& counters = files[file];
+        if (!counters) counters.reset(new IoCounters());
+        return *counters;
+    }
+
+    // Function to merge everything recorded so far
+    StatsReport report() const {
+        StatsReport result;
+        std::lock_guard<std::mutex> lock(mutex);
+        retired.addTo(result.operations);
+        for (const LatencyShard* shard : live) {
+            shard->addTo(result.operations);
+        }
+        for (const auto& entry : files) {
+            StatsReport::File file;
+            file.name = entry.first;
+            file.bytesRead = entry.second->bytesRead.load(std::memory_order_relaxed);
+            file.bytesWritten = entry.second->bytesWritten.load(std::memory_order_relaxed);
+            file.fsyncs = entry.second->fsyncs.load(std::memory_order_relaxed);
+            file.recordsParsed = entry.second->recordsParsed.load(std::memory_order_relaxed);
+            result.files.push_back(file);
+        }
+        return result;
+    }
+
+private:
+    // Owns a thread's shard; folds it into the retired totals at thread exit
+    struct ShardHandle {
+        explicit ShardHandle(StatsRegistry& owner) : registry(owner), shard(new LatencyShard()) {
+            std::lock_guard<std::mutex> lock(registry.mutex);
+            registry.live.push_back(shard);
+        }
+
+        ~ShardHandle() {
+            std::lock_guard<std::mutex> lock(registry.mutex);
+            registry.retired.absorb(*shard);
+            registry.live.erase(std::find(registry.live.begin(), registry.live.end(), shard));
+            delete shard;
+        }
+
+        StatsRegistry& registry;
+        LatencyShard* shard;
+    };
+
+    // Totals of exited threads, kept as one more shard
+    struct RetiredShard {
+        std::vector<LatencyHistogram> operations = std::vector<LatencyHistogram>(STAT_OP_COUNT);
+
+        void absorb(const LatencyShard& shard) {
+            shard.addTo(operations);
+        }
+
+        void addTo(std::vector<LatencyHistogram>& merged) const {
+            for (size_t o = 0; o < STAT_OP_COUNT; ++o) {
+                merged[o].count += operations[o].count;
+                merged[o].totalNanos += operations[o].totalNanos;
+                merged[o].maxNanos = std::max(merged[o].maxNanos, operations[o].maxNanos);
+                for (size_t b = 0; b < LATENCY_BUCKETS; ++b) {
+                    merged[o].buckets[b] += operations[o].buckets[b];
+                }
+            }
+        }
+    };
+
+    mutable std::mutex mutex;
+    std::vector<LatencyShard*> live;
+    RetiredShard retired;
+    std::map<std::string, std::unique_ptr<IoCounters>> files;
+};
+
+// Function to get the process-wide statistics. Never destroyed, so threads
+// that exit during static destruction can still retire their shards.
+inline StatsRegistry& stats() {
+    static StatsRegistry* registry = new StatsRegistry();
+    return *registry;
+}
+
+// Function to get the I/O counters for a file
+inline IoCounters& ioCounters(const std::string& file) {
+    return stats().io(file);
+}
+
+// Times the enclosing scope as one operation
+class StatTimer {
+public:
+    explicit StatTimer(StatOp timedOp) : op(timedOp), start(std::chrono::steady_clock::now()) {}
+
+    ~StatTimer() {
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        stats().record(op, static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()));
+    }
+
+    StatTimer(const StatTimer&) = delete;
+    StatTimer& operator=(const StatTimer&) = delete;
+
+private:
+    StatOp op;
+    std::chrono::steady_clock::time_point start;
+};
+
+namespace stats_detail {
+
+// Function to format nanoseconds as microseconds with three decimals
+inline std::string micros(uint64_t nanos) {
+    char text[32];
+    std::snprintf(text, sizeof(text), "%.3f", nanos / 1000.0);
+    return text;
+}
+
+inline std::string jsonString(const std::string& text) {
+    std::string quoted = "\"";
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            quoted += '\\';
+            quoted += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            char escape[8];
+            std::snprintf(escape, sizeof(escape), "\\u%04x", static_cast<unsigned>(c));
+            quoted += escape;
+        } else {
+            quoted += c;
+        }
+    }
+    return quoted + "\"";
+}
+
+inline std::string padLeft(const std::string& text, size_t width) {
+    return text.size() >= width ? text : std::string(width - text.size(), ' ') + text;
+}
+
+inline std::string padRight(const std::string& text, size_t width) {
+    return text.size() >= width ? text : text + std::string(width - text.size(), ' ');
+}
+
+} // namespace stats_detail
+
+// Percentiles in every dump, with their column names
+struct StatPercentile {
+    const char* name;
+    double fraction;
+};
+
+const StatPercentile STAT_PERCENTILES[] = {{"p50", 0.50}, {"p90", 0.90}, {"p99", 0.99}, {"p999", 0.999}};
+
+// Function to format a report as aligned text: one line per operation (every
+// operation, in a fixed order, times in microseconds), then one line per file
+// and a total. Column names and order do not change between versions.
+inline std::string formatStatsText(const StatsReport& report) {
+    using stats_detail::padLeft;
+    using stats_detail::padRight;
+    std::string text = padRight("operation", 14) + padLeft("count", 12) + padLeft("mean_us", 14);
+    for (const auto& percentile : STAT_PERCENTILES) {
+        text += padLeft(std::string(percentile.name) + "_us", 14);
+    }
+    text += padLeft("max_us", 14) + "\n";
+    for (size_t o = 0; o < STAT_OP_COUNT; ++o) {
+        const LatencyHistogram& histogram = report.operations[o];
+        text += padRight(statOpName(static_cast<StatOp>(o)), 14) + padLeft(std::to_string(histogram.count), 12) +
+                padLeft(stats_detail::micros(histogram.meanNanos()), 14);
+        for (const auto& percentile : STAT_PERCENTILES) {
+            text += padLeft(stats_detail::micros(histogram.percentile(percentile.fraction)), 14);
+        }
+        text += padLeft(stats_detail::micros(histogram.maxNanos), 14) + "\n";
+    }
+
+    text += "\n" + padRight("file", 30) + padLeft("bytes_read", 16) + padLeft("bytes_written", 16) +
+            padLeft("fsyncs", 10) + padLeft("records_parsed", 16) + "\n";
+    StatsReport::File total;
+    total.name = "total";
+    auto line = [&](const StatsReport::File& file) {
+        text += padRight(file.name, 30) + padLeft(std::to_string(file.bytesRead), 16) +
+                padLeft(std::to_string(file.bytesWritten), 16) + padLeft(std::to_string(file.fsyncs), 10) +
+                padLeft(std::to_string(file.recordsParsed), 16) + "\n";
+    };
+    for (const auto& file : report.files) {
+        line(file);
+        total.bytesRead += file.bytesRead;
+        total.bytesWritten += file.bytesWritten;
+        total.fsyncs += file.fsyncs;
+        total.recordsParsed += file.recordsParsed;
+    }
+    line(total);
+    return text;
+}
+
+// Function to format a report as one JSON object on one line:
+// {"operations":[{"name":..,"count":..,"mean_us":..,"p50_us":..,...,"max_us":..},...],
+//  "files":[{"file":..,"bytes_read":..,"bytes_written":..,"fsyncs":..,"records_parsed":..},...]}
+inline std::string formatStatsJson(const StatsReport& report) {
+    std::string json = "{\"operations\":[";
+    for (size_t o = 0; o < STAT_OP_COUNT; ++o) {
+        const LatencyHistogram& histogram = report.operations[o];
+        if (o > 0) json += ',';
+        json += "{\"name\":\"" + std::string(statOpName(static_cast<StatOp>(o))) + "\",\"count\":" +
+                std::to_string(histogram.count) + ",\"mean_us\":" + stats_detail::micros(histogram.meanNanos());
+        for (const auto& percentile : STAT_PERCENTILES) {
+            json += ",\"" + std::string(percentile.name) + "_us\":" +
+                    stats_detail::micros(histogram.percentile(percentile.fraction));
+        }
+        json += ",\"max_us\":" + stats_detail::micros(histogram.maxNanos) + "}";
+    }
+    json += "],\"files\":[";
+    for (size_t f = 0; f < report.files.size(); ++f) {
+        const StatsReport::File& file = report.files[f];
+        if (f > 0) json += ',';
+        json += "{\"file\":" + stats_detail::jsonString(file.name) + ",\"bytes_read\":" +
+                std::to_string(file.bytesRead) + ",\"bytes_written\":" + std::to_string(file.bytesWritten) +
+                ",\"fsyncs\":" + std::to_string(file.fsyncs) + ",\"records_parsed\":" +
+                std::to_string(file.recordsParsed) + "}";
+    }
+    return json + "]}\n";
+}
+
+#endif
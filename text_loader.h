@@ -0,0 +1,169 @@
+#ifndef TEXT_LOADER_H
+#define TEXT_LOADER_H
+
+#include <charconv>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "mapped_file.h"
+#include "thread_pool.h"
+
+// Loader for the pipe-delimited text tables (books.txt, students.txt,
+// transactions.txt): a first line holding the table's next id, then one
+// record per line.
+//
+// The file is mmapped and never copied. The body is cut into chunks at line
+// boundaries and the chunks are parsed in parallel on the shared pool, each
+// into its own row vector; the vectors are then moved into the result in
+// file order. Fields are std::string_views into the mapping and numbers are
+// parsed with std::from_chars, so nothing is allocated until a row keeps a
+// string. A line that does not parse is counted and skipped, and the first
+// few are kept (with their line number) for the caller to report.
+
+struct LoadReport {
+    size_t rows = 0;
+    size_t malformed = 0;
+    std::vector<std::string> samples; // "line N: reason", first few only
+};
+
+const size_t LOAD_REPORT_SAMPLES = 5;
+const size_t LOAD_CHUNK_BYTES = 1 << 20;
+
+// Function to split a line on sep into at most maxFields views. Returns the
+// number of fields in the line, which may be more than were stored.
+inline size_t splitFields(std::string_view line, char sep, std::string_view* fields, size_t maxFields) {
+    size_t count = 0;
+    size_t start = 0;
+    for (;;) {
+        size_t end = line.find(sep, start);
+        if (count < maxFields) {
+            fields[count] = line.substr(start, end == std::string_view::npos ? std::string_view::npos : end - start);
+        }
+        ++count;
+        if (end == std::string_view::npos) return count;
+        start = end + 1;
+    }
+}
+
+// Function to parse a whole field as a decimal int (no sign prefix '+',
+// no surrounding text)
+inline bool parseInt(std::string_view field, int& value) {
+    const char* first = field.data();
+    const char* last = field.data() + field.size();
+    std::from_chars_result result = std::from_chars(first, last, value);
+    return result.ec == std::errc() && result.ptr == last && first != last;
+}
+
+// Function to load one text table from an open mapping. parseRow(line, rows,
+// error) appends the row for a non-empty line (without its newline or
+// trailing '\r') and returns true, or sets error and returns false. Rows may
+// keep views into the mapping for as long as file stays open. nextId is left
+// alone when the header line is unusable.
+template <typename Row, typename ParseRow>
+void loadTextTable(const MappedFile& file, int& nextId, std::vector<Row>& rows,
+                   ParseRow parseRow, LoadReport& report) {
+    rows.clear();
+    report = LoadReport();
+
+    std::string_view text(file.data() != nullptr ? file.data() : "", file.size());
+    size_t headerEnd = text.find('\n');
+    std::string_view header = text.substr(0, headerEnd);
+    if (!header.empty() && header.back() == '\r') header.remove_suffix(1);
+    int headerId;
+    if (parseInt(header, headerId)) {
+        nextId = headerId;
+    } else if (!text.empty()) {
+        ++report.malformed;
+        report.samples.push_back("line 1: next id '" + std::string(header) + "' is not a number");
+    }
+    if (headerEnd == std::string_view::npos) {
+        return;
+    }
+    std::string_view body = text.substr(headerEnd + 1);
+
+    // Cut the body into chunks that each end just after a newline
+    ThreadPool& pool = sharedPool();
+    size_t wanted = pool.chunksFor(body.size(), LOAD_CHUNK_BYTES);
+    std::vector<std::string_view> chunks;
+    size_t start = 0;
+    for (size_t k = 1; k <= wanted && start < body.size(); ++k) {
+        size_t end = (k == wanted) ? body.size() : body.size() * k / wanted;
+        if (end < start) end = start;
+        size_t newline = body.find('\n', end);
+        end = (k == wanted || newline == std::string_view::npos) ? body.size() : newline + 1;
+        chunks.push_back(body.substr(start, end - start));
+        start = end;
+    }
+
+    struct ChunkResult {
+        std::vector<Row> rows;
+        size_t lines = 0;
+        size_t malformed = 0;
+        std::vector<std::pair<size_t, std::string>> samples; // chunk-local line
+    };
+    std::vector<ChunkResult> results(chunks.size());
+
+    pool.parallelFor(chunks.size(), 1, [&](size_t, size_t begin, size_t end) {
+        std::string error;
+        for (size_t c = begin; c < end; ++c) {
+            std::string_view chunk = chunks[c];
+            ChunkResult& result = results[c];
+            result.rows.reserve(chunk.size() / 32);
+
+            size_t pos = 0;
+            while (pos < chunk.size()) {
+                size_t newline = chunk.find('\n', pos);
+                size_t lineEnd = (newline == std::string_view::npos) ? chunk.size() : newline;
+                std::string_view line = chunk.substr(pos, lineEnd - pos);
+                pos = lineEnd + 1;
+                ++result.lines;
+
+                if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+                if (line.empty()) continue;
+
+                if (!parseRow(line, result.rows, error)) {
+                    ++result.malformed;
+                    if (result.samples.size() < LOAD_REPORT_SAMPLES) {
+                        result.samples.emplace_back(result.lines, error);
+                    }
+                }
+            }
+        }
+    });
+
+    size_t total = 0;
+    for (const auto& result : results) total += result.rows.size();
+    rows.reserve(total);
+
+    size_t lineBase = 1; // The header is line 1
+    for (auto& result : results) {
+        rows.insert(rows.end(), std::make_move_iterator(result.rows.begin()),
+                    std::make_move_iterator(result.rows.end()));
+        report.malformed += result.malformed;
+        for (const auto& sample : result.samples) {
+            if (report.samples.size() < LOAD_REPORT_SAMPLES) {
+                report.samples.push_back("line " + std::to_string(lineBase + sample.first) + ": " + sample.second);
+            }
+        }
+        lineBase += result.lines;
+        std::vector<Row>().swap(result.rows);
+    }
+    report.rows = rows.size();
+}
+
+// Function to load one text table by path, for rows that copy what they keep.
+// Returns false only if the file is missing.
+template <typename Row, typename ParseRow>
+bool loadTextTable(const std::string& path, int& nextId, std::vector<Row>& rows,
+                   ParseRow parseRow, LoadReport& report) {
+    MappedFile file;
+    if (!file.open(path)) {
+        return false;
+    }
+    loadTextTable(file, nextId, rows, parseRow, report);
+    return true;
+}
+
+#endif
@@ -0,0 +1,145 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed-size pool of worker threads fed from one FIFO task queue.
+//
+// parallelFor() splits a range into numbered chunks that the workers and the
+// calling thread claim from a shared counter. Because the caller works too, a
+// parallelFor issued from inside a pool task still finishes even when every
+// worker is busy. Tasks and loop bodies must not throw.
+class ThreadPool {
+public:
+    explicit ThreadPool(size_t threadCount) {
+        threadCount = std::max<size_t>(1, threadCount);
+        for (size_t i = 0; i < threadCount; ++i) {
+            workers.emplace_back([this]() { workerLoop(); });
+        }
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    size_t size() const {
+        return workers.size();
+    }
+
+    // Function to queue a task for any worker
+    void post(std::function<void()> task) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            tasks.push_back(std::move(task));
+        }
+        wake.notify_one();
+    }
+
+    // Function to get how many chunks parallelFor() will split count into, so
+    // callers can size per-chunk output up front and merge it in order
+    size_t chunksFor(size_t count, size_t minChunk) const {
+        if (count == 0) return 0;
+        minChunk = std::max<size_t>(1, minChunk);
+        size_t byGrain = (count + minChunk - 1) / minChunk;
+        return std::min(byGrain, (workers.size() + 1) * 4);
+    }
+
+    // Function to run body(chunk, begin, end) over [0, count) and wait for it.
+    // Ranges no larger than minChunk run inline on the calling thread.
+    void parallelFor(size_t count, size_t minChunk,
+                     const std::function<void(size_t, size_t, size_t)>& body) {
+        const size_t chunks = chunksFor(count, minChunk);
+        if (chunks == 0) return;
+        if (chunks == 1) {
+            body(0, 0, count);
+            return;
+        }
+
+        auto job = std::make_shared<ForJob>();
+        job->chunks = chunks;
+        job->count = count;
+        job->body = &body;
+
+        // Helpers that start after every chunk is claimed exit without
+        // touching body, so they may safely outlive this call
+        const size_t helpers = std::min(chunks - 1, workers.size());
+        for (size_t i = 0; i < helpers; ++i) {
+            post([job]() { runChunks(*job); });
+        }
+        runChunks(*job);
+
+        std::unique_lock<std::mutex> lock(job->mutex);
+        job->finished.wait(lock, [&job]() { return job->done == job->chunks; });
+    }
+
+private:
+    struct ForJob {
+        std::atomic<size_t> next{0};
+        size_t done = 0;
+        size_t chunks = 0;
+        size_t count = 0;
+        const std::function<void(size_t, size_t, size_t)>* body = nullptr;
+        std::mutex mutex;
+        std::condition_variable finished;
+    };
+
+    static void runChunks(ForJob& job) {
+        size_t chunk;
+        while ((chunk = job.next++) < job.chunks) {
+            size_t begin = job.count * chunk / job.chunks;
+            size_t end = job.count * (chunk + 1) / job.chunks;
+            (*job.body)(chunk, begin, end);
+
+            std::lock_guard<std::mutex> lock(job.mutex);
+            if (++job.done == job.chunks) {
+                job.finished.notify_all();
+            }
+        }
+    }
+
+    void workerLoop() {
+        for (;;) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [this]() { return stopping || !tasks.empty(); });
+                if (tasks.empty()) return; // stopping and drained
+                task = std::move(tasks.front());
+                tasks.pop_front();
+            }
+            task();
+        }
+    }
+
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping = false;
+};
+
+// Function to get the process-wide pool, sized to the hardware
+inline ThreadPool& sharedPool() {
+    static ThreadPool pool(std::thread::hardware_concurrency());
+    return pool;
+}
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef TRANSACTION_H
+#define TRANSACTION_H
+
+#include <cstdint>
+#include <string_view>
+
+#include "coarse_clock.h"
+
+// Kind of transaction
+enum class TransactionType : uint8_t {
+    Borrow,
+    Return
+};
+
+// Structure to represent a Transaction. The date is a day number (see
+// civil_date.h) and is only turned into text for display and export.
+struct Transaction {
+    int32_t id;
+    int32_t bookId;
+    int32_t studentId;
+    int32_t day;
+    TransactionType type;
+    
+    // Constructor (dated today)
+    Transaction(int32_t _id, int32_t _bookId, int32_t _studentId, TransactionType _type)
+        : id(_id), bookId(_bookId), studentId(_studentId), day(coarseClock().today()), type(_type) {}
+    
+    // Constructor with date (for loading from file)
+    Transaction(int32_t _id, int32_t _bookId, int32_t _studentId, TransactionType _type, int32_t _day)
+        : id(_id), bookId(_bookId), studentId(_studentId), day(_day), type(_type) {}
+};
+
+// Function to get a transaction type's name as stored in text files
+inline const char* transactionTypeName(TransactionType type) {
+    return type == TransactionType::Borrow ? "borrow" : "return";
+}
+
+// Function to parse a transaction type name
+inline bool parseTransactionType(std::string_view name, TransactionType& type) {
+    if (name == "borrow") {
+        type = TransactionType::Borrow;
+    } else if (name == "return") {
+        type = TransactionType::Return;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+#endif
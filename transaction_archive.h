@@ -0,0 +1,585 @@
+#ifndef TRANSACTION_ARCHIVE_H
+#define TRANSACTION_ARCHIVE_H
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <list>
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "atomic_file.h"
+#include "checksum.h"
+#include "civil_date.h"
+#include "mapped_file.h"
+#include "snapshot.h"
+#include "text_loader.h"
+#include "transaction.h"
+#include "transaction_codec.h"
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+// Transaction history split into time segments.
+//
+//   history/manifest.txt   segment list and the loans open at the last seal
+//   history/2025-03.bin    sealed segments, one per period, never rewritten,
+//                          in the columnar encoding of transaction_codec.h
+//   history/current.bin    the segment still being appended to
+//
+// A period is spanMonths calendar months (one by default). A transaction
+// joins the current segment unless it is dated in a later period, in which
+// case the current segment is sealed first, so segments hold consecutive id
+// ranges and the manifest can record each one's id and date bounds. Sealed
+// segments are only read when a query reaches them, through a cache of encoded
+// segments; date-range queries skip segments whose bounds miss the range, and
+// the blocks within a segment whose stats miss the query are not decoded. Startup reads
+// only the manifest and the current segment; a checkpoint writes only segments
+// sealed since the last one, the manifest and the current segment.
+//
+// Open loans are derived from history, so the manifest also keeps the borrows
+// still open when the last segment was sealed; those plus the current segment
+// give every open loan without touching sealed segments.
+//
+// A seal only moves the current rows aside; they are encoded when written.
+// A checkpoint copies what it has to write under the caller's lock
+// (prepareCheckpoint), encodes and writes it without the lock
+// (writeCheckpoint), and then files the encoded segments in the cache under
+// the lock again (checkpointWritten), so appends and queries carry on while
+// segment files are written and fsynced.
+//
+// Checkpoint order is new segment files, then the manifest (the commit point),
+// then current.bin. After a crash between the last two, current.bin still
+// holds rows that now belong to a sealed segment; open() drops them by id, and
+// rows appended after the seal are missing but still in the journal, which
+// replays them because the next id comes from the files actually read.
+//
+// Sealed segments are counted together as "<dir>/segments" in the I/O
+// statistics; records parsed there are rows decoded for queries.
+
+const int HISTORY_SEGMENT_MONTHS = 1;
+const size_t HISTORY_CACHED_SEGMENTS = 24; // Encoded, a few bytes a row
+
+// Id and date bounds of one segment
+struct HistorySegment {
+    std::string name; // First month of the period, "YYYY-MM"
+    int32_t period = 0;
+    int32_t firstId = 0;
+    int32_t lastId = 0;
+    int32_t minDay = 0;
+    int32_t maxDay = 0;
+    size_t count = 0;
+};
+
+// Function to write transactions as a snapshot file
+inline bool writeTransactionSnapshot(const std::string& path, const std::vector<Transaction>& rows,
+                                     int64_t nextId) {
+    SnapshotWriter writer(SNAPSHOT_TRANSACTIONS, sizeof(TransactionRecord), rows.size());
+    for (const auto& transaction : rows) {
+        TransactionRecord record;
+        record.id = transaction.id;
+        record.bookId = transaction.bookId;
+        record.studentId = transaction.studentId;
+        record.type = (transaction.type == TransactionType::Borrow) ? 0 : 1;
+        record.day = transaction.day;
+        record.reserved = 0;
+        writer.addRecord(&record);
+    }
+    return writer.write(path, nextId);
+}
+
+// Function to read a transactions snapshot of either format version. On
+// failure error says why, or is empty if the file does not exist.
+inline bool readTransactionSnapshot(const std::string& path, std::vector<Transaction>& rows, int64_t& nextId,
+                                    std::string& error) {
+    SnapshotReader reader;
+    if (!reader.open(path, SNAPSHOT_TRANSACTIONS, sizeof(TransactionRecord), error)) {
+        return false;
+    }
+
+    rows.clear();
+    rows.reserve(reader.count());
+    nextId = reader.nextId();
+    for (size_t i = 0; i < reader.count(); ++i) {
+        const TransactionRecord& record = reader.record<TransactionRecord>(i);
+        TransactionType type = record.type == 0 ? TransactionType::Borrow : TransactionType::Return;
+        int32_t day = record.day;
+        if (reader.version() == 1) {
+            // Version 1 kept the date as text in the heap
+            const TransactionRecordV1& legacy = reader.record<TransactionRecordV1>(i);
+            if (!reader.valid(legacy.date) || !parseDay(reader.view(legacy.date), day)) continue;
+        }
+        rows.push_back(Transaction(record.id, record.bookId, record.studentId, type, day));
+    }
+    return true;
+}
+
+class TransactionArchive {
+public:
+    explicit TransactionArchive(const std::string& archiveDirectory)
+        : directory(archiveDirectory), segmentIo(ioCounters(archiveDirectory + "/segments")) {}
+
+    TransactionArchive(const TransactionArchive&) = delete;
+    TransactionArchive& operator=(const TransactionArchive&) = delete;
+
+    // Function to choose the period length for an archive that does not
+    // exist yet (an existing archive keeps the span it was created with)
+    void setSpanMonths(int months) {
+        spanMonths = months;
+    }
+
+    int periodMonths() const {
+        return spanMonths;
+    }
+
+    // Function to load the manifest and the current segment. Returns false
+    // with error empty if there is no archive yet, or with error set if it
+    // cannot be used. nextId is raised to the archive's next id.
+    bool open(int& nextId, std::string& error) {
+        error.clear();
+        reset();
+
+        MappedFile file;
+        if (!file.open(manifestPath())) {
+            return false;
+        }
+        std::string_view text(file.data() != nullptr ? file.data() : "", file.size());
+        if (!parseManifest(text, error)) {
+            reset();
+            return false;
+        }
+
+        int64_t currentNext = 0;
+        std::string currentError;
+        if (!readTransactionSnapshot(currentPath(), currentRows, currentNext, currentError) &&
+            !currentError.empty()) {
+            error = "current.bin is unusable (" + currentError + ")";
+            reset();
+            return false;
+        }
+        int32_t sealedUpTo = sealed.empty() ? 0 : sealed.back().lastId;
+        std::vector<Transaction> rows;
+        rows.swap(currentRows);
+        for (const auto& transaction : rows) {
+            if (transaction.id > sealedUpTo) {
+                append(transaction); // A late-dated row may seal: handled like a live append
+            }
+        }
+
+        // Ids up to the last sealed one are taken even if current.bin is
+        // older than the manifest; anything later is replayed from the journal
+        int64_t next = std::max<int64_t>(sealedUpTo + 1, currentNext);
+        nextId = std::max(nextId, static_cast<int>(next));
+        opened = true;
+        return true;
+    }
+
+    // Function to start an empty archive in memory; nothing is written until
+    // the first checkpoint
+    void create() {
+        reset();
+        opened = true;
+    }
+
+    bool isOpen() const {
+        return opened;
+    }
+
+    // Function to add the next transaction (ids must increase)
+    void append(const Transaction& transaction) {
+        int32_t period = periodOf(transaction.day);
+        if (!currentRows.empty() && period > currentInfo.period) {
+            seal();
+        }
+        if (currentRows.empty()) {
+            currentInfo = HistorySegment();
+            currentInfo.period = period;
+            currentInfo.name = periodName(period);
+            currentInfo.firstId = transaction.id;
+            currentInfo.minDay = currentInfo.maxDay = transaction.day;
+        }
+        currentRows.push_back(transaction);
+        currentInfo.lastId = transaction.id;
+        currentInfo.minDay = std::min(currentInfo.minDay, transaction.day);
+        currentInfo.maxDay = std::max(currentInfo.maxDay, transaction.day);
+        currentInfo.count = currentRows.size();
+    }
+
+    // Function to get the borrows still open when the current segment began
+    const std::vector<Transaction>& openBorrows() const {
+        return *boundaryBorrows;
+    }
+
+    // Function to get the current segment's transactions
+    const std::vector<Transaction>& current() const {
+        return currentRows;
+    }
+
+    // Function to count every transaction, sealed or current
+    size_t size() const {
+        size_t total = currentRows.size();
+        for (const auto& info : sealed) total += info.count;
+        return total;
+    }
+
+    bool empty() const {
+        return size() == 0;
+    }
+
+    // Function to count segments; the last one is the current segment
+    size_t segmentCount() const {
+        return sealed.size() + 1;
+    }
+
+    const HistorySegment& segment(size_t index) const {
+        return index < sealed.size() ? sealed[index] : currentInfo;
+    }
+
+    // Function to check whether a segment may hold transactions dated in
+    // [fromDay, toDay]
+    bool overlaps(size_t index, int32_t fromDay, int32_t toDay) const {
+        const HistorySegment& info = segment(index);
+        return info.count > 0 && info.maxDay >= fromDay && info.minDay <= toDay;
+    }
+
+    // Function to get a segment's transactions, reading a sealed segment from
+    // disk if it is not cached. Returns false (with error set) if the segment
+    // file cannot be read.
+    bool rows(size_t index, std::vector<Transaction>& out, std::string& error) {
+        return select(index, TransactionBounds(), out, error);
+    }
+
+    // Function to get a segment's transactions that may fall within bounds.
+    // Sealed segments decode only the blocks whose stats admit a match; the
+    // current segment and seals not yet written are returned whole, so
+    // callers still test each row.
+    bool select(size_t index, const TransactionBounds& bounds, std::vector<Transaction>& out, std::string& error) {
+        out.clear();
+        error.clear();
+        if (!overlaps(index, bounds.fromDay, bounds.toDay)) {
+            return true;
+        }
+        if (index >= sealed.size()) {
+            out = currentRows;
+            return true;
+        }
+        auto waiting = pending.find(index);
+        if (waiting != pending.end()) {
+            out = *waiting->second; // Sealed but not written yet: still rows
+            return true;
+        }
+        std::shared_ptr<const std::string> encoded = encodedSegment(index, error);
+        if (!encoded) {
+            return false;
+        }
+        TransactionBlockReader reader;
+        if (!reader.open(*encoded, error)) {
+            error = segmentPath(sealed[index]) + ": " + error;
+            return false;
+        }
+        reader.decode(bounds, out);
+        segmentIo.parsed(out.size());
+        return true;
+    }
+
+    // Function to count sealed segments read from disk since startup
+    size_t segmentLoads() const {
+        return segmentsRead;
+    }
+
+    // Function to count segments sealed since the last checkpoint
+    size_t pendingSegments() const {
+        return pending.size();
+    }
+
+    // What a checkpoint writes, copied from the archive at one point
+    struct Checkpoint {
+        struct Segment {
+            size_t index;
+            std::string path;
+            std::shared_ptr<const std::vector<Transaction>> rows;
+            std::shared_ptr<const std::string> encoded; // Set by writeCheckpoint()
+        };
+        std::vector<Segment> segments;
+        std::vector<HistorySegment> sealed;
+        std::shared_ptr<const std::vector<Transaction>> openBorrows;
+        int spanMonths = HISTORY_SEGMENT_MONTHS;
+        std::vector<Transaction> current;
+        int nextId = 0;
+    };
+
+    // Function to copy what a checkpoint has to write (segments sealed since
+    // the last one, the manifest and the current rows); the caller holds the
+    // lock that guards appends
+    Checkpoint prepareCheckpoint(int nextId) const {
+        Checkpoint checkpoint;
+        for (const auto& waiting : pending) {
+            checkpoint.segments.push_back({waiting.first, segmentPath(sealed[waiting.first]), waiting.second, nullptr});
+        }
+        checkpoint.sealed = sealed;
+        checkpoint.openBorrows = boundaryBorrows; // Shared: a seal replaces it rather than changing it
+        checkpoint.spanMonths = spanMonths;
+        checkpoint.current = currentRows;
+        checkpoint.nextId = nextId;
+        return checkpoint;
+    }
+
+    // Function to encode and write a prepared checkpoint: the new segments,
+    // then the manifest, then the current segment. Touches no archive state,
+    // so it runs without the caller's lock.
+    bool writeCheckpoint(Checkpoint& checkpoint, std::string& error) const {
+        error.clear();
+        if (!makeDirectory()) {
+            error = "unable to create " + directory;
+            return false;
+        }
+        for (auto& segment : checkpoint.segments) {
+            segment.encoded = std::make_shared<const std::string>(encodeTransactions(*segment.rows));
+            AtomicFileWriter file(segment.path, segmentIo);
+            file.write(*segment.encoded);
+            if (!file.commit()) {
+                error = "unable to write " + segment.path;
+                return false;
+            }
+        }
+
+        AtomicFileWriter manifest(manifestPath());
+        manifest.write(manifestText(checkpoint));
+        if (!manifest.commit()) {
+            error = "unable to write " + manifestPath();
+            return false;
+        }
+
+        if (!writeTransactionSnapshot(currentPath(), checkpoint.current, checkpoint.nextId)) {
+            error = "unable to write " + currentPath();
+            return false;
+        }
+        return true;
+    }
+
+    // Function to note that a checkpoint's segments are on disk (with the
+    // caller's lock held again): they leave the pending seals and stay
+    // readable from the cache
+    void checkpointWritten(Checkpoint& checkpoint) {
+        for (auto& segment : checkpoint.segments) {
+            pending.erase(segment.index);
+            cache.emplace_front(segment.index, std::move(segment.encoded));
+        }
+        while (cache.size() > HISTORY_CACHED_SEGMENTS) {
+            cache.pop_back();
+        }
+    }
+
+private:
+    // Function to get a sealed, written segment's encoded bytes from the
+    // cache or its file. Segments written by older versions as row snapshots
+    // are encoded when read.
+    std::shared_ptr<const std::string> encodedSegment(size_t index, std::string& error) {
+        for (auto it = cache.begin(); it != cache.end(); ++it) {
+            if (it->first == index) {
+                cache.splice(cache.begin(), cache, it); // Most recently used first
+                return it->second;
+            }
+        }
+
+        std::string path = segmentPath(sealed[index]);
+        MappedFile file;
+        if (!file.open(path, segmentIo)) {
+            error = path + ": file is missing";
+            return nullptr;
+        }
+        std::string_view bytes(file.data() != nullptr ? file.data() : "", file.size());
+        std::shared_ptr<const std::string> encoded;
+        if (TransactionBlockReader::recognizes(bytes)) {
+            encoded = std::make_shared<const std::string>(bytes);
+        } else {
+            std::vector<Transaction> legacy;
+            int64_t ignored;
+            if (!readTransactionSnapshot(path, legacy, ignored, error)) {
+                error = path + ": " + error;
+                return nullptr;
+            }
+            encoded = std::make_shared<const std::string>(encodeTransactions(legacy));
+        }
+        ++segmentsRead;
+        cache.emplace_front(index, encoded);
+        if (cache.size() > HISTORY_CACHED_SEGMENTS) {
+            cache.pop_back();
+        }
+        return encoded;
+    }
+
+    std::string manifestPath() const {
+        return directory + "/manifest.txt";
+    }
+
+    std::string currentPath() const {
+        return directory + "/current.bin";
+    }
+
+    std::string segmentPath(const HistorySegment& info) const {
+        return directory + "/" + info.name + ".bin";
+    }
+
+    bool makeDirectory() const {
+#ifdef _WIN32
+        return ::_mkdir(directory.c_str()) == 0 || errno == EEXIST;
+#else
+        return ::mkdir(directory.c_str(), 0755) == 0 || errno == EEXIST;
+#endif
+    }
+
+    // Function to number the period a day falls in (months since year 0,
+    // divided by the span)
+    int32_t periodOf(int32_t day) const {
+        int year;
+        unsigned month, dayOfMonth;
+        civilFromDays(day, year, month, dayOfMonth);
+        int32_t months = year * 12 + static_cast<int32_t>(month) - 1;
+        return (months >= 0 ? months : months - spanMonths + 1) / spanMonths;
+    }
+
+    std::string periodName(int32_t period) const {
+        int32_t months = period * spanMonths;
+        int32_t year = (months >= 0 ? months : months - 11) / 12;
+        char name[32];
+        std::snprintf(name, sizeof(name), "%04d-%02d", static_cast<int>(year),
+                      static_cast<int>(months - year * 12 + 1));
+        return name;
+    }
+
+    // Function to move the current segment to the sealed list. Its rows stay
+    // in memory until the next checkpoint writes them.
+    void seal() {
+        std::map<int32_t, Transaction> open; // By book
+        for (const auto& borrow : *boundaryBorrows) {
+            open.emplace(borrow.bookId, borrow);
+        }
+        for (const auto& transaction : currentRows) {
+            if (transaction.type == TransactionType::Borrow) {
+                open.insert_or_assign(transaction.bookId, transaction);
+            } else {
+                open.erase(transaction.bookId);
+            }
+        }
+        auto borrows = std::make_shared<std::vector<Transaction>>();
+        borrows->reserve(open.size());
+        for (const auto& entry : open) {
+            borrows->push_back(entry.second);
+        }
+        boundaryBorrows = std::move(borrows);
+
+        sealed.push_back(currentInfo);
+        pending.emplace(sealed.size() - 1, std::make_shared<const std::vector<Transaction>>(std::move(currentRows)));
+        currentRows.clear();
+        currentInfo = HistorySegment();
+    }
+
+    // Function to format the manifest of a checkpoint (the loans open at
+    // the last seal can run to megabytes, so this is done without the lock)
+    static std::string manifestText(const Checkpoint& checkpoint) {
+        std::string text = "history|1\nspan|" + std::to_string(checkpoint.spanMonths) + "\n";
+        for (const auto& info : checkpoint.sealed) {
+            text += "segment|" + info.name + "|" + std::to_string(info.period) + "|" +
+                    std::to_string(info.firstId) + "|" + std::to_string(info.lastId) + "|" +
+                    std::to_string(info.count) + "|" + std::to_string(info.minDay) + "|" +
+                    std::to_string(info.maxDay) + "\n";
+        }
+        for (const auto& borrow : *checkpoint.openBorrows) {
+            text += "open|" + std::to_string(borrow.id) + "|" + std::to_string(borrow.bookId) + "|" +
+                    std::to_string(borrow.studentId) + "|" + std::to_string(borrow.day) + "\n";
+        }
+        char crc[16];
+        std::snprintf(crc, sizeof(crc), "%08x", crc32(text.data(), text.size()));
+        return text + "crc|" + crc + "\n";
+    }
+
+    bool parseManifest(std::string_view text, std::string& error) {
+        size_t crcLine = text.rfind("crc|");
+        if (crcLine == std::string_view::npos || (crcLine > 0 && text[crcLine - 1] != '\n')) {
+            error = "manifest has no checksum";
+            return false;
+        }
+        char expected[16];
+        std::snprintf(expected, sizeof(expected), "%08x", crc32(text.data(), crcLine));
+        std::string_view stored = text.substr(crcLine + 4, 8);
+        if (stored != std::string_view(expected, 8)) {
+            error = "manifest checksum mismatch";
+            return false;
+        }
+
+        auto borrows = std::make_shared<std::vector<Transaction>>();
+        std::string_view fields[8];
+        size_t pos = 0;
+        while (pos < crcLine) {
+            size_t newline = text.find('\n', pos);
+            std::string_view line = text.substr(pos, newline - pos);
+            pos = newline + 1;
+            size_t count = splitFields(line, '|', fields, 8);
+            int a, b, c, d, e, f;
+
+            if (fields[0] == "history" && count == 2) {
+                if (fields[1] != "1") {
+                    error = "unsupported manifest version " + std::string(fields[1]);
+                    return false;
+                }
+            } else if (fields[0] == "span" && count == 2 && parseInt(fields[1], a) && a > 0) {
+                spanMonths = a;
+            } else if (fields[0] == "segment" && count == 8 && parseInt(fields[2], a) && parseInt(fields[3], b) &&
+                       parseInt(fields[4], c) && parseInt(fields[5], d) && parseInt(fields[6], e) &&
+                       parseInt(fields[7], f)) {
+                HistorySegment info;
+                info.name = std::string(fields[1]);
+                info.period = a;
+                info.firstId = b;
+                info.lastId = c;
+                info.count = static_cast<size_t>(d);
+                info.minDay = e;
+                info.maxDay = f;
+                sealed.push_back(info);
+            } else if (fields[0] == "open" && count == 5 && parseInt(fields[1], a) && parseInt(fields[2], b) &&
+                       parseInt(fields[3], c) && parseInt(fields[4], d)) {
+                borrows->push_back(Transaction(a, b, c, TransactionType::Borrow, d));
+            } else {
+                error = "bad manifest line '" + std::string(line) + "'";
+                return false;
+            }
+        }
+        boundaryBorrows = std::move(borrows);
+        return true;
+    }
+
+    void reset() {
+        sealed.clear();
+        pending.clear();
+        cache.clear();
+        boundaryBorrows = std::make_shared<const std::vector<Transaction>>();
+        currentRows.clear();
+        currentInfo = HistorySegment();
+        opened = false;
+    }
+
+    std::string directory;
+    IoCounters& segmentIo;
+    int spanMonths = HISTORY_SEGMENT_MONTHS;
+    bool opened = false;
+
+    std::vector<HistorySegment> sealed;
+    // Sealed segments wait as rows until a checkpoint writes them; after
+    // that they are held encoded (transaction_codec.h)
+    std::map<size_t, std::shared_ptr<const std::vector<Transaction>>> pending; // Sealed, not yet written
+    std::list<std::pair<size_t, std::shared_ptr<const std::string>>> cache;
+    size_t segmentsRead = 0;
+
+    std::shared_ptr<const std::vector<Transaction>> boundaryBorrows = std::make_shared<const std::vector<Transaction>>();
+    std::vector<Transaction> currentRows;
+    HistorySegment currentInfo;
+};
+
+#endif
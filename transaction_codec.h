@@ -0,0 +1,320 @@
+#ifndef TRANSACTION_CODEC_H
+#define TRANSACTION_CODEC_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "checksum.h"
+#include "transaction.h"
+
+// Columnar encoding for sealed transaction history.
+//
+//   [TransactionBlockHeader][block 0 stats][block 1 stats]...[block 0 columns]...
+//
+// Rows are cut into blocks of TRANSACTION_BLOCK_ROWS. Each block stores its
+// columns one after another, every value as an unsigned offset from a base
+// kept in the block's stats, at the narrowest of 0, 1, 2 or 4 bytes that
+// holds the block's range:
+//
+//   id       id - (idBase + row); ids run consecutively, so normally 0 bytes
+//   day      day - minDay; one byte within a month
+//   book     bookId - minBook
+//   student  studentId - minStudent
+//   type     one bit per row, set for returns
+//
+// Fixed byte widths rather than varints keep every column decodable with a
+// branch-free widen-and-add loop (GCC vectorizes it at -O3). The stats hold
+// each block's id, day, book and student ranges, so a query decodes only the
+// blocks that can hold a match. Typical history packs into 3 to 5 bytes a
+// row, against 24 in a transaction snapshot and about 25 in transactions.txt.
+// Files are written in host byte order; the header's CRC-32C covers all of it.
+
+const uint32_t TRANSACTION_CODEC_VERSION = 1;
+const uint32_t TRANSACTION_CODEC_ENDIAN_TAG = 0x01020304;
+const char TRANSACTION_CODEC_MAGIC[8] = {'L', 'M', 'S', 'T', 'C', 'O', 'L', '\0'};
+const size_t TRANSACTION_BLOCK_ROWS = 1024;
+
+struct TransactionBlockHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t endianTag;
+    uint32_t blockCount;
+    uint32_t rowCount;
+    uint32_t payloadCrc; // CRC-32C of the block stats and columns
+    uint32_t headerCrc;  // CRC-32C of this header with headerCrc zeroed
+};
+static_assert(sizeof(TransactionBlockHeader) == 32, "transaction codec header layout changed");
+
+// Per-block stats: where the block's columns are, their widths and bases,
+// and the value ranges queries test before decoding it
+struct TransactionBlockStats {
+    uint32_t offset; // From the start of the file
+    uint32_t bytes;
+    uint32_t count;
+    uint8_t idWidth;
+    uint8_t dayWidth;
+    uint8_t bookWidth;
+    uint8_t studentWidth;
+    int32_t idBase;
+    int32_t minId;
+    int32_t maxId;
+    int32_t minDay;
+    int32_t maxDay;
+    int32_t minBook;
+    int32_t maxBook;
+    int32_t minStudent;
+    int32_t maxStudent;
+};
+static_assert(sizeof(TransactionBlockStats) == 52, "transaction block stats layout changed");
+
+// Bounds a query puts on rows; zero ids match anything
+struct TransactionBounds {
+    int32_t fromDay = std::numeric_limits<int32_t>::min(); // Inclusive
+    int32_t toDay = std::numeric_limits<int32_t>::max();   // Inclusive
+    int32_t bookId = 0;
+    int32_t studentId = 0;
+};
+
+// Function to check whether a block's ranges admit any row within bounds
+inline bool blockMayMatch(const TransactionBlockStats& stats, const TransactionBounds& bounds) {
+    if (stats.maxDay < bounds.fromDay || stats.minDay > bounds.toDay) return false;
+    if (bounds.bookId != 0 && (bounds.bookId < stats.minBook || bounds.bookId > stats.maxBook)) return false;
+    if (bounds.studentId != 0 && (bounds.studentId < stats.minStudent || bounds.studentId > stats.maxStudent)) {
+        return false;
+    }
+    return true;
+}
+
+// Function to pick the byte width of a column holding offsets up to range
+inline uint8_t columnWidth(uint64_t range) {
+    return range == 0 ? 0 : range <= 0xFF ? 1 : range <= 0xFFFF ? 2 : 4;
+}
+
+// Function to append count offsets (value - base) at the given width
+template <typename Value>
+void packColumn(std::string& out, const Value* values, size_t count, int64_t base, uint8_t width) {
+    for (size_t i = 0; i < count; ++i) {
+        uint32_t offset = static_cast<uint32_t>(static_cast<int64_t>(values[i]) - base);
+        out.append(reinterpret_cast<const char*>(&offset), width); // Little-endian low bytes
+    }
+}
+
+// Function to widen count offsets of type Packed and add base
+template <typename Packed>
+void unpackOffsets(const unsigned char* in, size_t count, int32_t base, int32_t* out) {
+    for (size_t i = 0; i < count; ++i) {
+        Packed offset;
+        std::memcpy(&offset, in + i * sizeof(Packed), sizeof(Packed));
+        out[i] = static_cast<int32_t>(static_cast<uint32_t>(base) + offset);
+    }
+}
+
+// Function to decode one column of the given width
+inline void unpackColumn(const unsigned char* in, size_t count, int32_t base, uint8_t width, int32_t* out) {
+    switch (width) {
+        case 0:
+            std::fill(out, out + count, base);
+            break;
+        case 1:
+            unpackOffsets<uint8_t>(in, count, base, out);
+            break;
+        case 2:
+            unpackOffsets<uint16_t>(in, count, base, out);
+            break;
+        default:
+            unpackOffsets<uint32_t>(in, count, base, out);
+            break;
+    }
+}
+
+// Function to encode rows (in id order) as a columnar history file
+inline std::string encodeTransactions(const std::vector<Transaction>& rows) {
+    size_t blockCount = (rows.size() + TRANSACTION_BLOCK_ROWS - 1) / TRANSACTION_BLOCK_ROWS;
+    std::vector<TransactionBlockStats> blocks(blockCount);
+    std::string columns;
+    size_t columnsStart = sizeof(TransactionBlockHeader) + blockCount * sizeof(TransactionBlockStats);
+
+    std::vector<int64_t> idOffsets;
+    std::vector<int32_t> days, bookIds, studentIds;
+    for (size_t b = 0; b < blockCount; ++b) {
+        size_t first = b * TRANSACTION_BLOCK_ROWS;
+        size_t count = std::min(TRANSACTION_BLOCK_ROWS, rows.size() - first);
+        TransactionBlockStats& stats = blocks[b];
+        std::memset(&stats, 0, sizeof(stats));
+        stats.offset = static_cast<uint32_t>(columnsStart + columns.size());
+        stats.count = static_cast<uint32_t>(count);
+
+        idOffsets.resize(count);
+        days.resize(count);
+        bookIds.resize(count);
+        studentIds.resize(count);
+        int64_t idBase = std::numeric_limits<int64_t>::max();
+        int64_t maxIdOffset = std::numeric_limits<int64_t>::min();
+        stats.minId = stats.minDay = stats.minBook = stats.minStudent = std::numeric_limits<int32_t>::max();
+        stats.maxId = stats.maxDay = stats.maxBook = stats.maxStudent = std::numeric_limits<int32_t>::min();
+        for (size_t i = 0; i < count; ++i) {
+            const Transaction& row = rows[first + i];
+            idOffsets[i] = static_cast<int64_t>(row.id) - static_cast<int64_t>(i);
+            days[i] = row.day;
+            bookIds[i] = row.bookId;
+            studentIds[i] = row.studentId;
+            idBase = std::min(idBase, idOffsets[i]);
+            maxIdOffset = std::max(maxIdOffset, idOffsets[i]);
+            stats.minId = std::min(stats.minId, row.id);
+            stats.maxId = std::max(stats.maxId, row.id);
+            stats.minDay = std::min(stats.minDay, row.day);
+            stats.maxDay = std::max(stats.maxDay, row.day);
+            stats.minBook = std::min(stats.minBook, row.bookId);
+            stats.maxBook = std::max(stats.maxBook, row.bookId);
+            stats.minStudent = std::min(stats.minStudent, row.studentId);
+            stats.maxStudent = std::max(stats.maxStudent, row.studentId);
+        }
+        stats.idBase = static_cast<int32_t>(idBase);
+        stats.idWidth = columnWidth(static_cast<uint64_t>(maxIdOffset - idBase));
+        stats.dayWidth = columnWidth(static_cast<uint64_t>(int64_t(stats.maxDay) - stats.minDay));
+        stats.bookWidth = columnWidth(static_cast<uint64_t>(int64_t(stats.maxBook) - stats.minBook));
+        stats.studentWidth = columnWidth(static_cast<uint64_t>(int64_t(stats.maxStudent) - stats.minStudent));
+
+        packColumn(columns, idOffsets.data(), count, idBase, stats.idWidth);
+        packColumn(columns, days.data(), count, stats.minDay, stats.dayWidth);
+        packColumn(columns, bookIds.data(), count, stats.minBook, stats.bookWidth);
+        packColumn(columns, studentIds.data(), count, stats.minStudent, stats.studentWidth);
+        std::string typeBits((count + 7) / 8, '\0');
+        for (size_t i = 0; i < count; ++i) {
+            if (rows[first + i].type == TransactionType::Return) {
+                typeBits[i / 8] = static_cast<char>(typeBits[i / 8] | (1 << (i % 8)));
+            }
+        }
+        columns += typeBits;
+        stats.bytes = static_cast<uint32_t>(columnsStart + columns.size() - stats.offset);
+    }
+
+    TransactionBlockHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, TRANSACTION_CODEC_MAGIC, sizeof(header.magic));
+    header.version = TRANSACTION_CODEC_VERSION;
+    header.endianTag = TRANSACTION_CODEC_ENDIAN_TAG;
+    header.blockCount = static_cast<uint32_t>(blockCount);
+    header.rowCount = static_cast<uint32_t>(rows.size());
+    header.payloadCrc = crc32c(columns.data(), columns.size(),
+                               crc32c(blocks.data(), blocks.size() * sizeof(TransactionBlockStats)));
+    header.headerCrc = crc32c(&header, sizeof(header));
+
+    std::string out;
+    out.reserve(columnsStart + columns.size());
+    out.append(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.append(reinterpret_cast<const char*>(blocks.data()), blocks.size() * sizeof(TransactionBlockStats));
+    out += columns;
+    return out;
+}
+
+// Reads an encoded history file in place; the bytes must outlive the reader.
+class TransactionBlockReader {
+public:
+    // Function to check whether bytes start like an encoded history file
+    static bool recognizes(std::string_view data) {
+        return data.size() >= sizeof(TRANSACTION_CODEC_MAGIC) &&
+               std::memcmp(data.data(), TRANSACTION_CODEC_MAGIC, sizeof(TRANSACTION_CODEC_MAGIC)) == 0;
+    }
+
+    // Function to validate the header, stats and checksum
+    bool open(std::string_view encoded, std::string& error) {
+        data = encoded;
+        error.clear();
+        if (data.size() < sizeof(TransactionBlockHeader)) {
+            error = "truncated header";
+            return false;
+        }
+        std::memcpy(&header, data.data(), sizeof(header));
+        TransactionBlockHeader check = header;
+        check.headerCrc = 0;
+        size_t statsEnd = sizeof(header) + static_cast<size_t>(header.blockCount) * sizeof(TransactionBlockStats);
+        if (!recognizes(data)) {
+            error = "not a history segment";
+        } else if (header.endianTag != TRANSACTION_CODEC_ENDIAN_TAG) {
+            error = "written on a machine with different byte order";
+        } else if (crc32c(&check, sizeof(check)) != header.headerCrc) {
+            error = "header checksum mismatch";
+        } else if (header.version != TRANSACTION_CODEC_VERSION) {
+            error = "unsupported version " + std::to_string(header.version);
+        } else if (statsEnd > data.size()) {
+            error = "section sizes do not match the file";
+        } else if (crc32c(data.data() + sizeof(header), data.size() - sizeof(header)) != header.payloadCrc) {
+            error = "data checksum mismatch";
+        } else {
+            for (size_t b = 0; b < blockCount(); ++b) {
+                const TransactionBlockStats& stats = block(b);
+                size_t needed = static_cast<size_t>(stats.count) *
+                                    (stats.idWidth + stats.dayWidth + stats.bookWidth + stats.studentWidth) +
+                                (stats.count + 7) / 8;
+                if (stats.count > TRANSACTION_BLOCK_ROWS || stats.offset < statsEnd ||
+                    static_cast<uint64_t>(stats.offset) + stats.bytes > data.size() || stats.bytes < needed) {
+                    error = "block " + std::to_string(b) + " is out of bounds";
+                    return false;
+                }
+            }
+            return true;
+        }
+        return false;
+    }
+
+    size_t blockCount() const {
+        return header.blockCount;
+    }
+
+    size_t rowCount() const {
+        return header.rowCount;
+    }
+
+    // Function to view block b's stats in place
+    const TransactionBlockStats& block(size_t b) const {
+        return reinterpret_cast<const TransactionBlockStats*>(data.data() + sizeof(header))[b];
+    }
+
+    // Function to decode block b, appending its rows to out
+    void decodeBlock(size_t b, std::vector<Transaction>& out) const {
+        const TransactionBlockStats& stats = block(b);
+        const size_t count = stats.count;
+        const unsigned char* in = reinterpret_cast<const unsigned char*>(data.data()) + stats.offset;
+        int32_t ids[TRANSACTION_BLOCK_ROWS], days[TRANSACTION_BLOCK_ROWS];
+        int32_t bookIds[TRANSACTION_BLOCK_ROWS], studentIds[TRANSACTION_BLOCK_ROWS];
+
+        unpackColumn(in, count, stats.idBase, stats.idWidth, ids);
+        in += count * stats.idWidth;
+        for (size_t i = 0; i < count; ++i) {
+            ids[i] += static_cast<int32_t>(i);
+        }
+        unpackColumn(in, count, stats.minDay, stats.dayWidth, days);
+        in += count * stats.dayWidth;
+        unpackColumn(in, count, stats.minBook, stats.bookWidth, bookIds);
+        in += count * stats.bookWidth;
+        unpackColumn(in, count, stats.minStudent, stats.studentWidth, studentIds);
+        in += count * stats.studentWidth;
+
+        out.reserve(out.size() + count);
+        for (size_t i = 0; i < count; ++i) {
+            TransactionType type = ((in[i / 8] >> (i % 8)) & 1) ? TransactionType::Return : TransactionType::Borrow;
+            out.push_back(Transaction(ids[i], bookIds[i], studentIds[i], type, days[i]));
+        }
+    }
+
+    // Function to decode every block that may hold rows within bounds
+    void decode(const TransactionBounds& bounds, std::vector<Transaction>& out) const {
+        for (size_t b = 0; b < blockCount(); ++b) {
+            if (blockMayMatch(block(b), bounds)) {
+                decodeBlock(b, out);
+            }
+        }
+    }
+
+private:
+    std::string_view data;
+    TransactionBlockHeader header;
+};
+
+#endif
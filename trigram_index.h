@@ -0,0 +1,118 @@
+#ifndef TRIGRAM_INDEX_H
+#define TRIGRAM_INDEX_H
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Inverted index from lowercase trigrams to the ids of the records whose text
+// contains them. A substring query of three or more characters can only match
+// records that appear in the posting list of every one of its trigrams, so
+// intersecting those lists gives a candidate set the caller then verifies with
+// a real substring check. Posting lists are kept sorted by id; ids are handed
+// out in increasing order, so adding a new record is a push_back.
+class TrigramIndex {
+public:
+    static const size_t GRAM = 3;
+
+    // Function to index the text of a record
+    void add(int id, std::string_view text) {
+        for (uint32_t gram : gramsOf(text)) {
+            std::vector<int>& list = postings[gram];
+            if (list.empty() || list.back() < id) {
+                list.push_back(id);
+            } else {
+                auto pos = std::lower_bound(list.begin(), list.end(), id);
+                if (pos == list.end() || *pos != id) {
+                    list.insert(pos, id);
+                }
+            }
+        }
+    }
+
+    // Function to unindex a record; text must be what was passed to add()
+    void remove(int id, std::string_view text) {
+        for (uint32_t gram : gramsOf(text)) {
+            auto it = postings.find(gram);
+            if (it == postings.end()) continue;
+
+            std::vector<int>& list = it->second;
+            auto pos = std::lower_bound(list.begin(), list.end(), id);
+            if (pos != list.end() && *pos == id) {
+                list.erase(pos);
+            }
+            if (list.empty()) {
+                postings.erase(it);
+            }
+        }
+    }
+
+    // Function to drop every posting list
+    void clear() {
+        postings.clear();
+    }
+
+    // Function to collect the ids that may contain term, in increasing order.
+    // Returns false when the term is shorter than a trigram, in which case
+    // the index cannot narrow anything down and the caller has to scan.
+    bool candidates(const std::string& term, std::vector<int>& out) const {
+        out.clear();
+        std::vector<uint32_t> grams = gramsOf(term);
+        if (grams.empty()) {
+            return false;
+        }
+
+        std::vector<const std::vector<int>*> lists;
+        lists.reserve(grams.size());
+        for (uint32_t gram : grams) {
+            auto it = postings.find(gram);
+            if (it == postings.end()) {
+                return true; // Some trigram occurs nowhere: no candidates
+            }
+            lists.push_back(&it->second);
+        }
+
+        // Intersect starting from the rarest trigram so the working set only
+        // ever shrinks; each survivor costs a binary search per longer list
+        std::sort(lists.begin(), lists.end(), [](const std::vector<int>* a, const std::vector<int>* b) {
+            return a->size() < b->size();
+        });
+        out = *lists[0];
+        for (size_t i = 1; i < lists.size() && !out.empty(); ++i) {
+            const std::vector<int>& list = *lists[i];
+            out.erase(std::remove_if(out.begin(), out.end(), [&list](int id) {
+                return !std::binary_search(list.begin(), list.end(), id);
+            }), out.end());
+        }
+        return true;
+    }
+
+private:
+    std::unordered_map<uint32_t, std::vector<int>> postings;
+
+    static uint32_t fold(char c) {
+        unsigned char u = static_cast<unsigned char>(c);
+        return (u >= 'A' && u <= 'Z') ? u + ('a' - 'A') : u;
+    }
+
+    // Distinct lowercase trigrams of text, each packed into 24 bits
+    static std::vector<uint32_t> gramsOf(std::string_view text) {
+        std::vector<uint32_t> grams;
+        if (text.size() < GRAM) {
+            return grams;
+        }
+
+        grams.reserve(text.size() - GRAM + 1);
+        for (size_t i = 0; i + GRAM <= text.size(); ++i) {
+            grams.push_back((fold(text[i]) << 16) | (fold(text[i + 1]) << 8) | fold(text[i + 2]));
+        }
+        std::sort(grams.begin(), grams.end());
+        grams.erase(std::unique(grams.begin(), grams.end()), grams.end());
+        return grams;
+    }
+};
+
+#endif